@@ -0,0 +1,378 @@
+#include "image_cache.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <mbedtls/sha256.h>
+#include "esp_image_format.h"
+#include "esp32/rom/crc.h"
+
+#define CACHE_SECTOR_SIZE 4096
+#define CACHE_MAGIC 0x4C584943 // "CIXL"
+
+ImageCache imageCache;
+
+// On-flash header, first bytes of an entry's header sector
+struct CacheHeader
+{
+  uint32_t magic;
+  uint8_t sha256[IMAGE_CACHE_HASH_SIZE];
+  uint32_t size;
+  uint32_t seq;
+  uint32_t crc; // CRC-32 of the fields above
+};
+
+// Shared copy buffer; store() and install() never run at the same time
+static uint8_t sBuffer[CACHE_SECTOR_SIZE];
+
+// Helpers
+static uint32_t roundUp(uint32_t size)
+{
+  return (size + CACHE_SECTOR_SIZE - 1) & ~(uint32_t)(CACHE_SECTOR_SIZE - 1);
+}
+
+static uint32_t entryBytes(uint32_t imageSize)
+{
+  return CACHE_SECTOR_SIZE + roundUp(imageSize);
+}
+
+static uint32_t headerCrc(const CacheHeader &h)
+{
+  return crc32_le(0, (const uint8_t *)&h, offsetof(CacheHeader, crc));
+}
+
+void imageCacheFormatHash(const uint8_t sha256[IMAGE_CACHE_HASH_SIZE], char *out)
+{
+  for (int i = 0; i < IMAGE_CACHE_HASH_SIZE; i++)
+  {
+    sprintf(out + i * 2, "%02x", sha256[i]);
+  }
+}
+
+// ========== Index ==========
+bool ImageCache::begin()
+{
+  _partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, NULL);
+  if (!_partition)
+  {
+    Serial.println("✘ Image cache: no spiffs partition");
+    return false;
+  }
+  scan();
+  Serial.printf("Image cache: %u image(s), %u/%u KB free\n", (unsigned)_count,
+                (unsigned)(freeBytes() / 1024), (unsigned)(capacity() / 1024));
+  return true;
+}
+
+void ImageCache::scan()
+{
+  _count = 0;
+  _nextSeq = 1;
+
+  uint32_t offset = 0;
+  while (offset + CACHE_SECTOR_SIZE <= _partition->size && _count < IMAGE_CACHE_MAX_ENTRIES)
+  {
+    CacheHeader h;
+    if (esp_partition_read(_partition, offset, &h, sizeof(h)) == ESP_OK &&
+        h.magic == CACHE_MAGIC && h.crc == headerCrc(h) &&
+        offset + entryBytes(h.size) <= _partition->size)
+    {
+      ImageCacheEntry &e = _entries[_count++];
+      memcpy(e.sha256, h.sha256, sizeof(e.sha256));
+      e.size = h.size;
+      e.seq = h.seq;
+      e.offset = offset;
+      if (h.seq >= _nextSeq)
+      {
+        _nextSeq = h.seq + 1;
+      }
+      offset += entryBytes(h.size);
+    }
+    else
+    {
+      offset += CACHE_SECTOR_SIZE;
+    }
+  }
+}
+
+int ImageCache::find(const uint8_t *sha256) const
+{
+  for (size_t i = 0; i < _count; i++)
+  {
+    if (memcmp(_entries[i].sha256, sha256, IMAGE_CACHE_HASH_SIZE) == 0)
+    {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+size_t ImageCache::freeBytes() const
+{
+  portENTER_CRITICAL(&_lock);
+  size_t freeSpace = freeBytesLocked();
+  portEXIT_CRITICAL(&_lock);
+  return freeSpace;
+}
+
+size_t ImageCache::snapshot(ImageCacheEntry out[IMAGE_CACHE_MAX_ENTRIES], size_t &freeSpace) const
+{
+  portENTER_CRITICAL(&_lock);
+  size_t count = _count;
+  memcpy(out, _entries, count * sizeof(ImageCacheEntry));
+  freeSpace = freeBytesLocked();
+  portEXIT_CRITICAL(&_lock);
+  return count;
+}
+
+size_t ImageCache::freeBytesLocked() const
+{
+  size_t used = 0;
+  for (size_t i = 0; i < _count; i++)
+  {
+    used += entryBytes(_entries[i].size);
+  }
+  return capacity() > used ? capacity() - used : 0;
+}
+
+// First gap that fits, evicting least recently used entries until one does
+bool ImageCache::allocate(size_t bytes, uint32_t &offset)
+{
+  if (bytes > _partition->size)
+  {
+    return false;
+  }
+
+  for (;;)
+  {
+    if (_count < IMAGE_CACHE_MAX_ENTRIES)
+    {
+      // Entries sorted by offset (tiny array, insertion sort)
+      portENTER_CRITICAL(&_lock);
+      for (size_t i = 1; i < _count; i++)
+      {
+        for (size_t j = i; j > 0 && _entries[j - 1].offset > _entries[j].offset; j--)
+        {
+          ImageCacheEntry t = _entries[j];
+          _entries[j] = _entries[j - 1];
+          _entries[j - 1] = t;
+        }
+      }
+      portEXIT_CRITICAL(&_lock);
+
+      uint32_t gapStart = 0;
+      for (size_t i = 0; i <= _count; i++)
+      {
+        uint32_t gapEnd = i < _count ? _entries[i].offset : _partition->size;
+        if (gapEnd - gapStart >= bytes)
+        {
+          offset = gapStart;
+          return true;
+        }
+        if (i < _count)
+        {
+          gapStart = _entries[i].offset + entryBytes(_entries[i].size);
+        }
+      }
+    }
+
+    if (_count == 0)
+    {
+      return false;
+    }
+    size_t oldest = 0;
+    for (size_t i = 1; i < _count; i++)
+    {
+      if (_entries[i].seq < _entries[oldest].seq)
+      {
+        oldest = i;
+      }
+    }
+    evict(oldest);
+  }
+}
+
+void ImageCache::evict(size_t index)
+{
+  char hex[IMAGE_CACHE_HASH_SIZE * 2 + 1];
+  imageCacheFormatHash(_entries[index].sha256, hex);
+  Serial.printf("Image cache: evicting %.12s (%u bytes)\n", hex, (unsigned)_entries[index].size);
+
+  // Dropping the header sector frees the whole entry
+  esp_partition_erase_range(_partition, _entries[index].offset, CACHE_SECTOR_SIZE);
+  portENTER_CRITICAL(&_lock);
+  _entries[index] = _entries[--_count];
+  portEXIT_CRITICAL(&_lock);
+}
+
+bool ImageCache::writeHeader(const ImageCacheEntry &entry)
+{
+  CacheHeader h;
+  h.magic = CACHE_MAGIC;
+  memcpy(h.sha256, entry.sha256, sizeof(h.sha256));
+  h.size = entry.size;
+  h.seq = entry.seq;
+  h.crc = headerCrc(h);
+  return esp_partition_erase_range(_partition, entry.offset, CACHE_SECTOR_SIZE) == ESP_OK &&
+         esp_partition_write(_partition, entry.offset, &h, sizeof(h)) == ESP_OK;
+}
+
+bool ImageCache::hashRange(const esp_partition_t *part, uint32_t offset, size_t size,
+                           uint8_t out[IMAGE_CACHE_HASH_SIZE], volatile bool *stop)
+{
+  mbedtls_sha256_context ctx;
+  mbedtls_sha256_init(&ctx);
+  mbedtls_sha256_starts(&ctx, 0);
+
+  bool ok = true;
+  for (size_t pos = 0; pos < size && ok; pos += CACHE_SECTOR_SIZE)
+  {
+    size_t len = size - pos < CACHE_SECTOR_SIZE ? size - pos : CACHE_SECTOR_SIZE;
+    ok = !(stop && *stop) && esp_partition_read(part, offset + pos, sBuffer, len) == ESP_OK;
+    if (ok)
+    {
+      mbedtls_sha256_update(&ctx, sBuffer, len);
+    }
+  }
+  mbedtls_sha256_finish(&ctx, out);
+  mbedtls_sha256_free(&ctx);
+  return ok;
+}
+
+// ========== Store ==========
+bool ImageCache::store(const esp_partition_t *src, volatile bool *stop)
+{
+  if (!_partition || !src)
+  {
+    return false;
+  }
+
+  // Only complete app images; image_len matches the firmware.bin file size
+  esp_partition_pos_t slot = {src->address, src->size};
+  esp_image_metadata_t meta;
+  if (esp_image_verify(ESP_IMAGE_VERIFY_SILENT, &slot, &meta) != ESP_OK)
+  {
+    return false;
+  }
+
+  ImageCacheEntry e;
+  e.size = meta.image_len;
+  if (!hashRange(src, 0, e.size, e.sha256, stop))
+  {
+    return false;
+  }
+
+  char hex[IMAGE_CACHE_HASH_SIZE * 2 + 1];
+  imageCacheFormatHash(e.sha256, hex);
+  if (find(e.sha256) >= 0)
+  {
+    Serial.printf("Image cache: %s image %.12s already cached\n", src->label, hex);
+    return true;
+  }
+  if (!allocate(entryBytes(e.size), e.offset))
+  {
+    Serial.printf("✘ Image cache: %u-byte image does not fit\n", (unsigned)e.size);
+    return false;
+  }
+
+  unsigned long start = millis();
+  uint32_t data = e.offset + CACHE_SECTOR_SIZE;
+  for (size_t pos = 0; pos < e.size; pos += CACHE_SECTOR_SIZE)
+  {
+    size_t len = e.size - pos < CACHE_SECTOR_SIZE ? e.size - pos : CACHE_SECTOR_SIZE;
+    bool stopped = stop && *stop;
+    if (stopped ||
+        esp_partition_erase_range(_partition, data + pos, CACHE_SECTOR_SIZE) != ESP_OK ||
+        esp_partition_read(src, pos, sBuffer, len) != ESP_OK ||
+        esp_partition_write(_partition, data + pos, sBuffer, len) != ESP_OK)
+    {
+      Serial.printf("✘ Image cache: copy of %.12s %s\n", hex, stopped ? "stopped" : "failed");
+      return false;
+    }
+    vTaskDelay(1); // Let the web server and WiFi run between sectors
+  }
+
+  // Read back before the header makes the entry visible
+  uint8_t check[IMAGE_CACHE_HASH_SIZE];
+  if (!hashRange(_partition, data, e.size, check, stop) ||
+      memcmp(check, e.sha256, sizeof(check)) != 0)
+  {
+    Serial.printf("✘ Image cache: read-back of %.12s does not match\n", hex);
+    return false;
+  }
+
+  e.seq = _nextSeq++;
+  if (!writeHeader(e))
+  {
+    return false;
+  }
+  portENTER_CRITICAL(&_lock);
+  _entries[_count++] = e;
+  portEXIT_CRITICAL(&_lock);
+  Serial.printf("✓ Image cache: stored %.12s (%u bytes) in %lu ms\n", hex, (unsigned)e.size, millis() - start);
+  return true;
+}
+
+// ========== Install ==========
+bool ImageCache::install(const uint8_t sha256[IMAGE_CACHE_HASH_SIZE], OtaSlotWriter &writer,
+                         size_t erasedBytes, const char *&error)
+{
+  int index = _partition ? find(sha256) : -1;
+  if (index < 0)
+  {
+    error = "not_cached";
+    return false;
+  }
+
+  ImageCacheEntry &e = _entries[index];
+  if (!writer.begin(e.size, erasedBytes))
+  {
+    error = "write_failed";
+    return false;
+  }
+
+  // Hash the cached bytes as they are copied, and only activate a match
+  mbedtls_sha256_context ctx;
+  mbedtls_sha256_init(&ctx);
+  mbedtls_sha256_starts(&ctx, 0);
+
+  uint32_t data = e.offset + CACHE_SECTOR_SIZE;
+  bool ok = true;
+  for (size_t pos = 0; pos < e.size && ok; pos += CACHE_SECTOR_SIZE)
+  {
+    size_t len = e.size - pos < CACHE_SECTOR_SIZE ? e.size - pos : CACHE_SECTOR_SIZE;
+    ok = esp_partition_read(_partition, data + pos, sBuffer, len) == ESP_OK;
+    if (ok)
+    {
+      mbedtls_sha256_update(&ctx, sBuffer, len);
+      ok = writer.write(sBuffer, len) == len;
+    }
+  }
+  uint8_t check[IMAGE_CACHE_HASH_SIZE];
+  mbedtls_sha256_finish(&ctx, check);
+  mbedtls_sha256_free(&ctx);
+
+  if (!ok)
+  {
+    writer.abort();
+    error = "write_failed";
+    return false;
+  }
+  if (memcmp(check, e.sha256, sizeof(check)) != 0)
+  {
+    writer.abort();
+    evict(index);
+    error = "corrupt";
+    return false;
+  }
+  if (!writer.end())
+  {
+    error = "write_failed";
+    return false;
+  }
+
+  // Mark as most recently used
+  portENTER_CRITICAL(&_lock);
+  e.seq = _nextSeq++;
+  portEXIT_CRITICAL(&_lock);
+  writeHeader(e);
+  return true;
+}
@@ -0,0 +1,111 @@
+#pragma once
+/**
+ * @file image_cache.h
+ * @brief Content-addressed cache of experiment images in the spiffs partition.
+ *
+ * When a board returns to the bootloader, the experiment image it was
+ * running is still in the inactive OTA slot. Before that slot is pre-erased,
+ * the image is copied into the otherwise unused spiffs data partition, keyed
+ * by the SHA-256 of the image (the same hash as the firmware.bin file the
+ * backend pushes). Switching back to a cached experiment is then a local
+ * flash-to-flash copy instead of a WiFi push.
+ *
+ * Partition layout: each entry is one 4 KB header sector followed by the
+ * image, sector-aligned. The header is written last, after the copy has been
+ * read back and hashed, so an interrupted copy leaves only free space.
+ * When there is no gap large enough, the least recently used entry is
+ * evicted. Installs hash the cached bytes again before the slot is
+ * activated; an entry that no longer matches its key is dropped.
+ *
+ * Usage Example:
+ * @code
+ * #include "image_cache.h"
+ * imageCache.begin();
+ * imageCache.store(inactiveSlot, &stopFlag);   // From the pre-erase task
+ * const char *error;
+ * if (imageCache.install(sha256, otaWriter, otaPreEraseStop(), error)) {
+ *   ESP.restart();
+ * }
+ * @endcode
+ */
+
+#include <Arduino.h>
+#include "esp_partition.h"
+#include "ota_writer.h"
+
+#define IMAGE_CACHE_MAX_ENTRIES 8
+#define IMAGE_CACHE_HASH_SIZE 32
+
+struct ImageCacheEntry {
+  uint8_t sha256[IMAGE_CACHE_HASH_SIZE];
+  uint32_t size;
+  uint32_t seq;    // Last use; the lowest is evicted first
+  uint32_t offset; // Header sector offset in the partition
+};
+
+/**
+ * @class ImageCache
+ * @brief LRU image store on the raw spiffs partition.
+ */
+class ImageCache {
+public:
+  /**
+   * @brief Find the spiffs partition and index the entries on it.
+   * @return false if the partition table has no spiffs partition
+   */
+  bool begin();
+
+  /**
+   * @brief Cache the valid app image in src unless it is cached already.
+   * @param stop polled between sectors; set it to abandon the copy
+   * @return true if the image is cached on return
+   */
+  bool store(const esp_partition_t *src, volatile bool *stop);
+
+  /**
+   * @brief Copy a cached image into the next OTA slot and make it the boot partition.
+   * @param erasedBytes bytes at the start of the slot known to be erased
+   * @param error set to "not_cached", "corrupt" or "write_failed" on failure
+   */
+  bool install(const uint8_t sha256[IMAGE_CACHE_HASH_SIZE], OtaSlotWriter &writer,
+               size_t erasedBytes, const char *&error);
+
+  bool isAvailable() const { return _partition != nullptr; }
+  size_t count() const { return _count; }
+  size_t capacity() const { return _partition ? _partition->size : 0; }
+  size_t freeBytes() const;
+
+  /**
+   * @brief Copy the entry table for a reader on another task.
+   *
+   * store() sorts, evicts and appends from the pre-erase task on core 0; the
+   * copy is taken under the same lock, so it never shows a half-moved entry.
+   * @param freeSpace set to freeBytes() of the same table
+   * @return number of entries copied into out
+   */
+  size_t snapshot(ImageCacheEntry out[IMAGE_CACHE_MAX_ENTRIES], size_t &freeSpace) const;
+
+private:
+  void scan();
+  int find(const uint8_t *sha256) const;
+  bool allocate(size_t bytes, uint32_t &offset);
+  void evict(size_t index);
+  bool writeHeader(const ImageCacheEntry &entry);
+  bool hashRange(const esp_partition_t *part, uint32_t offset, size_t size,
+                 uint8_t out[IMAGE_CACHE_HASH_SIZE], volatile bool *stop);
+
+  size_t freeBytesLocked() const;
+
+  const esp_partition_t *_partition = nullptr;
+  ImageCacheEntry _entries[IMAGE_CACHE_MAX_ENTRIES];
+  size_t _count = 0;
+  uint32_t _nextSeq = 1;
+  mutable portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED; // Guards _entries and _count
+};
+
+extern ImageCache imageCache;
+
+/**
+ * @brief Lowercase hex form of a cache key (out must hold 65 bytes)
+ */
+void imageCacheFormatHash(const uint8_t sha256[IMAGE_CACHE_HASH_SIZE], char *out);
@@ -2,17 +2,22 @@
 #include "wifi_credentials.h"
 WiFiCredentialManager wifiMgr;
 #include <WebServer.h>
-#include <Update.h>
 #include <Wire.h>
 #include <ArduinoJson.h>
 #include <EEPROM.h>
 #include "esp_partition.h"
 #include "esp_ota_ops.h"
-#include <WiFiUdp.h>
+#include "esp32/rom/crc.h"
 #include "nvs_mqtt_credentials.h"
+#include "nvs_wifi_credentials.h"
+#include "ota_writer.h"
+#include "ota_inflate.h"
+#include "ota_verify.h"
+#include "image_cache.h"
+#include "udp_discovery.h"
+#include "hex_bytes.h"
 #include <vector>
 // Forward declarations
-static bool hexToBytes(const String &hex, std::vector<uint8_t> &out);
 static String getDeviceIDFromMAC();
 // GPIO pin setup
 #define BLE_LED_PIN 12 
@@ -45,9 +50,26 @@ String deviceID = "LabExpertModule";
 // Backend discovery - Uses UDP broadcast discovery (see handleUDPDiscovery)
 
 // OTA state
+OtaSlotWriter otaWriter;
+OtaInflater otaInflater;       // Raw or gzip image -> otaWriter
+OtaImageVerifier otaVerifier;  // SHA-256 of the image as it is written
 bool otaInProgress = false;
-size_t otaExpectedSize = 0;
-size_t otaWritten = 0;
+size_t otaExpectedSize = 0;    // Bytes on the wire (compressed size for gzip)
+size_t otaWritten = 0;         // Wire bytes committed; offsets refer to these
+size_t otaImageSize = 0;       // image_size and sha256 given at /ota/begin; a resume must repeat them
+String otaSha256;
+
+// Largest chunk that can be CRC-checked before it is written
+#define OTA_MAX_CHUNK_SIZE 16384
+
+// Raw /ota/chunk request state (one request at a time on the sync WebServer)
+size_t chunkOffset = 0;
+size_t chunkReceived = 0;
+bool chunkVerify = false;      // X-OTA-CRC32 given: stage, check, then write
+uint32_t chunkCrc = 0;
+int chunkStatus = 200;
+const char *chunkError = nullptr;
+static uint8_t chunkStage[OTA_MAX_CHUNK_SIZE];
 
 // Sensor check state
 unsigned long lastSensorCheck = 0;
@@ -63,14 +85,10 @@ String sensorID = "N/A";
 #define EEPROM_RETRY_COUNT 3
 #define EEPROM_RETRY_DELAY 1000 // 1 second between retries
 
-// UDP Discovery configuration
-WiFiUDP udp;
-const unsigned int UDP_DISCOVERY_PORT = 8888;
-const unsigned int UDP_RESPONSE_PORT = 8889;
-const char *UDP_DISCOVERY_MAGIC = "LABEXPERT_DISCOVERY";
-const char *UDP_RESPONSE_MAGIC = "LABEXPERT_RESPONSE";
-unsigned long lastUDPCheck = 0;
-const unsigned long UDP_CHECK_INTERVAL = 1000; // Check for UDP packets every second
+// UDP Discovery: requests are answered from the AsyncUDP callback (udp_discovery.cpp);
+// loop() only refreshes the reply and applies broker announcements
+unsigned long lastUDPIdentity = 0;
+const unsigned long UDP_IDENTITY_REFRESH = 1000; // Rebuild the discovery reply every second
 
 // ========== Erase inactive OTA partition ==========
 void eraseInactivePartition()
@@ -228,6 +246,68 @@ void updateSensorLed()
   }
 }
 
+static bool writeOtaImage(const uint8_t *data, size_t len, void *)
+{
+  otaVerifier.update(data, len);
+  return otaWriter.write(data, len) == len;
+}
+
+// ========== OTA chunk commit ==========
+// Writes the part of [offset, offset + len) that lies beyond otaWritten, so a
+// resent chunk is acknowledged without being written twice.
+// Returns the HTTP status; error is set on failure.
+static int commitOtaChunk(size_t offset, uint8_t *data, size_t len, const char *&error)
+{
+  error = nullptr;
+  if (!otaInProgress)
+  {
+    error = "not_in_progress";
+    return 400;
+  }
+  if (offset > otaWritten)
+  {
+    error = "offset_gap";
+    return 409;
+  }
+
+  size_t skip = otaWritten - offset;
+  if (skip >= len)
+  {
+    return 200; // Already committed by an earlier attempt
+  }
+
+  size_t pending = len - skip;
+  if (!otaInflater.write(data + skip, pending))
+  {
+    Serial.printf("✘ OTA write failed: %s (%s)\n", otaInflater.error(), otaWriter.errorString());
+    if (otaWriter.hasError())
+    {
+      error = "write_failed";
+      return 500;
+    }
+    error = "bad_image"; // Corrupt gzip stream; restart with /ota/begin
+    return 400;
+  }
+  otaWritten += pending;
+  return 200;
+}
+
+static void sendOtaChunkResponse(int status, const char *error, size_t received)
+{
+  JsonDocument resp;
+  resp["success"] = (error == nullptr);
+  if (error)
+  {
+    resp["error"] = error;
+  }
+  resp["offset"] = otaWritten; // Next offset the device expects
+  resp["received"] = received;
+  resp["min_free_heap"] = ESP.getMinFreeHeap();
+  String json;
+  serializeJson(resp, json);
+  server.send(status, "application/json", json);
+}
+
 // ========== Web server routes ==========
 void setupRoutes()
 {
@@ -245,15 +325,19 @@ void setupRoutes()
 
   server.on("/update", HTTP_POST, []()
             {
-    server.send(200, "text/plain", Update.hasError() ? "FAIL" : "OK");
+    bool failed = otaWriter.hasError() || otaInflater.error() || otaVerifier.error();
+    server.send(200, "text/plain", failed ? "FAIL" : "OK");
     delay(200);
-    if (!Update.hasError()) {
+    if (!failed) {
       Serial.println("✓ Update successful. Rebooting...");
       
       // Fast blink OTA LED on success/restart
       otaLed.set(LedController::BLINK_FAST);
       unsigned long start = millis();
-      while(millis() - start < 2000) otaLed.update(); // Block briefly to show blink
+      while (millis() - start < 2000) { // Block briefly to show blink
+        otaLed.update();
+        delay(10);
+      }
       
       const esp_partition_t *running = esp_ota_get_running_partition();
       const esp_partition_t *next = esp_ota_get_next_update_partition(NULL);
@@ -267,18 +351,26 @@ void setupRoutes()
       Serial.printf("Update Start: %s\n", upload.filename.c_str());
       const esp_partition_t *next = esp_ota_get_next_update_partition(NULL);
       Serial.printf("Writing to partition: %s\n", next->label);
-      if (!Update.begin(UPDATE_SIZE_UNKNOWN)) {
-        Update.printError(Serial);
+      if (!otaWriter.begin(OTA_SIZE_UNKNOWN, otaPreEraseStop())) {
+        Serial.printf("✘ Update begin failed: %s\n", otaWriter.errorString());
+      }
+      otaInflater.begin(writeOtaImage, nullptr);
+      if (!otaVerifier.begin(server.header("X-Firmware-SHA256").c_str(), server.header("X-Firmware-Signature").c_str())) {
+        Serial.printf("✘ Update rejected: %s\n", otaVerifier.error());
       }
     } else if (upload.status == UPLOAD_FILE_WRITE) {
-      if (Update.write(upload.buf, upload.currentSize) != upload.currentSize) {
-        Update.printError(Serial);
+      if (!otaInflater.error() && !otaVerifier.error() && !otaInflater.write(upload.buf, upload.currentSize)) {
+        Serial.printf("✘ Update write failed: %s (%s)\n", otaInflater.error(), otaWriter.errorString());
       }
     } else if (upload.status == UPLOAD_FILE_END) {
-      if (Update.end(true)) {
-        Serial.printf("Update Success: %u bytes\n", upload.totalSize);
+      if (otaInflater.finish() && otaVerifier.finish() && otaWriter.end()) {
+        Serial.printf("Update Success: %u bytes received, %u written, hash %u ms\n", upload.totalSize,
+                      (unsigned)otaInflater.outputBytes(), (unsigned)(otaVerifier.hashMicros() / 1000));
       } else {
-        Update.printError(Serial);
+        const char *error = otaInflater.error() ? otaInflater.error() : otaVerifier.error();
+        Serial.printf("✘ Update failed: %s (%s)\n", error ? error : "-", otaWriter.errorString());
+        otaWriter.abort();
+        otaPreEraseStart(false);
       }
     } });
 
@@ -354,6 +446,10 @@ void setupRoutes()
     serializeJson(doc, json);
     server.send(200, "application/json", json); });
 
+  // Offset header for raw chunk uploads, digest headers for /update
+  static const char *otaHeaders[] = {"X-OTA-Offset", "X-OTA-CRC32", "X-Firmware-SHA256", "X-Firmware-Signature"};
+  server.collectHeaders(otaHeaders, sizeof(otaHeaders) / sizeof(otaHeaders[0]));
+
   // OTA push endpoints for backend
   server.on("/ota/begin", HTTP_POST, []()
             {
@@ -365,17 +461,55 @@ void setupRoutes()
       return;
     }
     size_t size = doc["size"] | 0;
-    const esp_partition_t *next = esp_ota_get_next_update_partition(NULL);
-    if (!Update.begin(size)) {
-      String e; Update.printError(Serial);
+    size_t imageSize = doc["image_size"] | 0; // Decompressed size of a gzip image, if known
+    const char *sha256 = doc["sha256"] | "";   // SHA-256 of the (decompressed) image, checked at /ota/end
+    const char *signature = doc["signature"] | "";
+
+    // Same image after a dropped connection: keep what is already written. Without
+    // a digest two images of the same size cannot be told apart, so start over.
+    if (otaInProgress && sha256[0] && otaSha256.equalsIgnoreCase(sha256) && size == otaExpectedSize &&
+        imageSize == otaImageSize && !otaInflater.error()) {
+      Serial.printf("OTA resume at offset %u\n", (unsigned)otaWritten);
+      server.send(200, "application/json", "{\"success\":true,\"resumed\":true,\"offset\":" + String(otaWritten) + "}");
+      return;
+    }
+    if (otaInProgress) {
+      otaWriter.abort();
+      otaInProgress = false;
+    }
+
+    if (!otaVerifier.begin(sha256, signature)) {
+      server.send(400, "application/json", String("{\"success\":false,\"error\":\"") + otaVerifier.error() + "\"}");
+      return;
+    }
+
+    // Writes must not race the background erase; keep whatever it finished
+    size_t erased = otaPreEraseStop();
+    // The wire size is checked at /ota/end, the flashed size against image_size when given
+    if (!otaWriter.begin(imageSize, erased)) {
+      Serial.printf("✘ OTA begin failed: %s\n", otaWriter.errorString());
+      otaPreEraseStart(false);
       server.send(500, "application/json", "{\"success\":false}");
       return;
     }
+    otaInflater.begin(writeOtaImage, nullptr);
     otaInProgress = true;
     otaExpectedSize = size;
     otaWritten = 0;
-    Serial.printf("OTA begin: size=%u, partition=%s\n", (unsigned)size, next? next->label : "?");
-    server.send(200, "application/json", "{\"success\":true}"); });
+    otaImageSize = imageSize;
+    otaSha256 = sha256;
+    size_t flashSize = imageSize ? imageSize : size;
+    bool preErased = flashSize > 0 && erased >= flashSize;
+    Serial.printf("OTA begin: size=%u, image=%u, partition=%s, pre-erased %u KB\n", (unsigned)size,
+                  (unsigned)imageSize, otaWriter.partition()->label, (unsigned)(erased / 1024));
+
+    JsonDocument resp;
+    resp["success"] = true;
+    resp["pre_erased"] = preErased;
+    resp["pre_erased_bytes"] = erased;
+    String json;
+    serializeJson(resp, json);
+    server.send(200, "application/json", json); });
 
   server.on("/ota/write", HTTP_POST, []()
             {
@@ -386,7 +520,7 @@ void setupRoutes()
       server.send(400, "application/json", "{\"success\":false,\"error\":\"bad_json\"}");
       return;
     }
-    size_t offset = doc["offset"] | 0;
+    size_t offset = doc["offset"] | otaWritten; // Like /ota/chunk without X-OTA-Offset
     size_t size = doc["size"] | 0;
     String hex = doc["data"] | "";
     std::vector<uint8_t> bytes;
@@ -398,18 +532,146 @@ void setupRoutes()
       server.send(400, "application/json", "{\"success\":false,\"error\":\"size_mismatch\"}");
       return;
     }
-    if (!otaInProgress) {
-      server.send(400, "application/json", "{\"success\":false,\"error\":\"not_in_progress\"}");
+    if (!doc["crc32"].isNull() && crc32_le(0, bytes.data(), bytes.size()) != doc["crc32"].as<uint32_t>()) {
+      sendOtaChunkResponse(400, "crc_mismatch", bytes.size());
       return;
     }
-    size_t written = Update.write(bytes.data(), bytes.size());
-    if (written != bytes.size()) {
-      Update.printError(Serial);
-      server.send(500, "application/json", "{\"success\":false}");
+    const char *error;
+    int status = commitOtaChunk(offset, bytes.data(), bytes.size(), error);
+    sendOtaChunkResponse(status, error, bytes.size()); });
+
+  // Raw binary chunk: body is application/octet-stream, X-OTA-Offset gives its
+  // position in the image. Without X-OTA-CRC32 the bytes go from the socket
+  // buffer straight to flash; with it (hex CRC-32 of the body) the
+  // chunk is staged, checked and only then written.
+  server.on("/ota/chunk", HTTP_POST, []()
+            { sendOtaChunkResponse(chunkStatus, chunkError, chunkReceived); }, []()
+            {
+    HTTPRaw &raw = server.raw();
+    if (raw.status == RAW_START) {
+      chunkReceived = 0;
+      chunkStatus = 200;
+      chunkError = nullptr;
+      chunkOffset = server.hasHeader("X-OTA-Offset")
+                      ? strtoul(server.header("X-OTA-Offset").c_str(), nullptr, 10)
+                      : otaWritten;
+      chunkVerify = server.hasHeader("X-OTA-CRC32");
+      chunkCrc = chunkVerify ? strtoul(server.header("X-OTA-CRC32").c_str(), nullptr, 16) : 0;
+
+      if (!otaInProgress) {
+        chunkStatus = 400;
+        chunkError = "not_in_progress";
+      } else if (chunkOffset > otaWritten) {
+        chunkStatus = 409;
+        chunkError = "offset_gap";
+      }
+    } else if (raw.status == RAW_WRITE) {
+      size_t at = chunkReceived;
+      chunkReceived += raw.currentSize;
+      if (chunkError) {
+        return; // Drain the body so the response can still be sent
+      }
+
+      if (!chunkVerify) {
+        chunkStatus = commitOtaChunk(chunkOffset + at, raw.buf, raw.currentSize, chunkError);
+      } else if (chunkReceived > OTA_MAX_CHUNK_SIZE) {
+        chunkStatus = 413;
+        chunkError = "chunk_too_large";
+      } else {
+        memcpy(chunkStage + at, raw.buf, raw.currentSize);
+      }
+    } else if (raw.status == RAW_END) {
+      if (chunkVerify && !chunkError) {
+        if (crc32_le(0, chunkStage, chunkReceived) != chunkCrc) {
+          chunkStatus = 400;
+          chunkError = "crc_mismatch";
+        } else {
+          chunkStatus = commitOtaChunk(chunkOffset, chunkStage, chunkReceived, chunkError);
+        }
+      }
+    } else if (raw.status == RAW_ABORTED) {
+      Serial.printf("OTA chunk aborted after %u bytes, resume at %u\n", (unsigned)chunkReceived, (unsigned)otaWritten);
+    } });
+
+  // Install a cached experiment image by SHA-256 instead of pushing it again
+  server.on("/ota/install", HTTP_POST, []()
+            {
+    String body = server.arg("plain");
+    JsonDocument doc;
+    DeserializationError err = deserializeJson(doc, body);
+    if (err) {
+      server.send(400, "application/json", "{\"success\":false,\"error\":\"bad_json\"}");
+      return;
+    }
+    String hash = doc["sha256"] | "";
+    std::vector<uint8_t> sha;
+    if (!hexToBytes(hash, sha) || sha.size() != IMAGE_CACHE_HASH_SIZE) {
+      server.send(400, "application/json", "{\"success\":false,\"error\":\"bad_hash\"}");
+      return;
+    }
+    if (otaInProgress) {
+      server.send(409, "application/json", "{\"success\":false,\"error\":\"ota_in_progress\"}");
+      return;
+    }
+
+    unsigned long start = millis();
+    const char *error = nullptr;
+    if (!imageCache.install(sha.data(), otaWriter, otaPreEraseStop(), error)) {
+      Serial.printf("✘ Cache install failed: %s\n", error);
+      otaWriter.abort();
+      otaPreEraseStart(false); // The slot may be part-written; erase it again for the next push
+      int status = strcmp(error, "not_cached") == 0 ? 404 : 500;
+      server.send(status, "application/json", String("{\"success\":false,\"error\":\"") + error + "\"}");
       return;
     }
-    otaWritten += written;
-    server.send(200, "application/json", "{\"success\":true}"); });
+    Serial.printf("✓ Installed cached image in %lu ms. Rebooting...\n", millis() - start);
+    server.send(200, "application/json", "{\"success\":true,\"install_ms\":" + String(millis() - start) + "}");
+    delay(200);
+    ESP.restart(); });
+
+  server.on("/ota/cache", HTTP_GET, []()
+            {
+    // The pre-erase task may be storing into the cache; serialise a copy of the table
+    ImageCacheEntry entries[IMAGE_CACHE_MAX_ENTRIES];
+    size_t freeSpace = 0;
+    size_t count = imageCache.snapshot(entries, freeSpace);
+
+    JsonDocument doc;
+    doc["capacity"] = imageCache.capacity();
+    doc["free"] = freeSpace;
+    JsonArray images = doc["images"].to<JsonArray>();
+    for (size_t i = 0; i < count; i++) {
+      const ImageCacheEntry &e = entries[i];
+      char hex[IMAGE_CACHE_HASH_SIZE * 2 + 1];
+      imageCacheFormatHash(e.sha256, hex);
+      JsonObject img = images.add<JsonObject>();
+      img["sha256"] = hex;
+      img["size"] = e.size;
+      img["last_used"] = e.seq;
+    }
+    String json;
+    serializeJson(doc, json);
+    server.send(200, "application/json", json); });
+
+  // Resume point for the backend after a dropped connection
+  server.on("/ota/status", HTTP_GET, []()
+            {
+    JsonDocument doc;
+    doc["in_progress"] = otaInProgress;
+    doc["offset"] = otaWritten;
+    doc["size"] = otaExpectedSize;
+    doc["compressed"] = otaInflater.compressed();
+    doc["image_written"] = otaInflater.outputBytes();
+    doc["hash_ms"] = otaVerifier.hashMicros() / 1000;
+    doc["max_chunk"] = OTA_MAX_CHUNK_SIZE;
+    doc["pre_erased_bytes"] = otaPreErasedBytes();
+    doc["pre_erasing"] = otaPreEraseRunning();
+    doc["discovery_requests"] = udpDiscoveryRequests();
+    doc["discovery_dropped"] = udpDiscoveryDropped();
+    doc["min_free_heap"] = ESP.getMinFreeHeap();
+    String json;
+    serializeJson(doc, json);
+    server.send(200, "application/json", json); });
 
   server.on("/ota/end", HTTP_POST, []()
             {
@@ -417,15 +679,25 @@ void setupRoutes()
       server.send(400, "application/json", "{\"success\":false,\"error\":\"not_in_progress\"}");
       return;
     }
-    bool ok = Update.end(true);
+    // Digest (and signature) are checked before the boot partition is switched
+    bool ok = otaWritten == otaExpectedSize && otaInflater.finish() && otaVerifier.finish() && otaWriter.end();
     if (ok) {
-      Serial.printf("OTA success: %u/%u bytes\n", (unsigned)otaWritten, (unsigned)otaExpectedSize);
+      Serial.printf("OTA success: %u/%u bytes received, %u written%s, hash %u ms%s\n", (unsigned)otaWritten,
+                    (unsigned)otaExpectedSize, (unsigned)otaInflater.outputBytes(), otaInflater.compressed() ? " (gzip)" : "",
+                    (unsigned)(otaVerifier.hashMicros() / 1000), otaVerifier.expectsDigest() ? ", digest verified" : "");
       server.send(200, "application/json", "{\"success\":true}");
       delay(200);
       ESP.restart();
     } else {
-      Update.printError(Serial);
-      server.send(500, "application/json", "{\"success\":false}");
+      const char *error = otaWritten != otaExpectedSize ? "incomplete"
+                          : otaInflater.error()           ? otaInflater.error()
+                          : otaVerifier.error()           ? otaVerifier.error()
+                                                          : "write_failed";
+      Serial.printf("✘ OTA end failed: %u/%u bytes, %s (%s)\n", (unsigned)otaWritten, (unsigned)otaExpectedSize,
+                    error, otaWriter.errorString());
+      otaWriter.abort();
+      otaPreEraseStart(false);
+      server.send(500, "application/json", String("{\"success\":false,\"error\":\"") + error + "\"}");
     }
     otaInProgress = false; });
 }
@@ -434,118 +706,82 @@ void setupRoutes()
 static bool sMqttConfigured = false;
 
 // ========== UDP Discovery Functions ==========
+static void updateDiscoveryResponse()
+{
+  JsonDocument doc;
+  doc["device_id"] = getDeviceIDFromMAC(); // Last 5 digits of the MAC
+  doc["ip_address"] = WiFi.localIP().toString();
+  doc["firmware_version"] = "OTA_BOOTLOADER";
+  doc["sensor_type"] = sensorType;
+  doc["availability"] = 1; // Always available in OTA mode
+  doc["magic"] = UDP_RESPONSE_MAGIC;
+
+  // Add stored backend MAC for bidirectional verification
+  const char* storedHostMac = wifiMgr.getHostMac();
+  if (storedHostMac && strlen(storedHostMac) > 0) {
+    doc["backend_mac"] = storedHostMac;
+  }
+
+  char response[UDP_DISCOVERY_MAX_RESPONSE];
+  if (measureJson(doc) >= sizeof(response)) {
+    Serial.println("✘ Discovery response too large");
+    return;
+  }
+  udpDiscoverySetResponse(response, serializeJson(doc, response, sizeof(response)));
+}
+
+static void applyDiscoveredBroker(const UdpDiscoveryConfig &cfg)
+{
+  // Broker IP is the UDP packet source (dynamic & robust); port is fixed
+  String remoteIPStr = cfg.broker.toString();
+  const char* mqttBroker = remoteIPStr.c_str();
+  const char* backendMAC = cfg.backendMac[0] ? cfg.backendMac : nullptr;
+  uint16_t mqttPort = 1883;
+
+  if (sMqttConfigured) {
+    // Already configured once this session, ignore subsequent packets
+    Serial.println("ℹ️ MQTT Config Ignored: Already configured in this session.");
+    return;
+  }
+
+  const char* storedHostMac = wifiMgr.getHostMac();
+  bool shouldSave = false;
+
+  // Verify Backend MAC against stored Host MAC
+  if (storedHostMac && strlen(storedHostMac) > 0) {
+    if (backendMAC && strcasecmp(storedHostMac, backendMAC) == 0) {
+      Serial.printf("✓ Backend MAC Verified: %s\n", backendMAC);
+      shouldSave = true;
+    } else {
+      Serial.printf("❌ MQTT Config Rejected: Backend MAC mismatch!\n");
+      Serial.printf("   Expected: %s\n", storedHostMac);
+      Serial.printf("   Received: %s\n", backendMAC ? backendMAC : "(null)");
+    }
+  } else {
+    // No stored Host MAC to verify against
+    Serial.println("⚠️ MQTT Config Ignored: No Host MAC stored in NVS to verify against.");
+  }
+
+  if (shouldSave && saveMQTTCredentialsToNVS(mqttBroker, mqttPort, backendMAC)) {
+    Serial.printf("📡 MQTT broker discovered and saved: %s:%d\n", mqttBroker, mqttPort);
+    sMqttConfigured = true; // Set flag to prevent future writes
+  }
+}
+
 void handleUDPDiscovery()
 {
+  // The reply depends on the sensor type, IP and stored host MAC; keep it current
   unsigned long currentMillis = millis();
-  if (currentMillis - lastUDPCheck >= UDP_CHECK_INTERVAL)
+  if (lastUDPIdentity == 0 || currentMillis - lastUDPIdentity >= UDP_IDENTITY_REFRESH)
   {
-    lastUDPCheck = currentMillis;
+    lastUDPIdentity = currentMillis;
+    updateDiscoveryResponse();
+  }
 
-    // Check for incoming UDP packets
-    int packetSize = udp.parsePacket();
-    if (packetSize)
-    {
-      char packetBuffer[512]; // Increased for JSON packets
-      int len = udp.read(packetBuffer, sizeof(packetBuffer) - 1);
-      if (len > 0)
-      {
-        packetBuffer[len] = '\0';
-
-        // Try to parse as JSON first (new format)
-        JsonDocument discoveryDoc;
-        DeserializationError error = deserializeJson(discoveryDoc, packetBuffer);
-        
-        bool isDiscovery = false;
-        
-        if (!error && discoveryDoc["magic"] == "LABEXPERT_DISCOVERY") {
-          // New JSON format
-          isDiscovery = true;
-          
-          // 1. Get Backend MAC from JSON (for security verification)
-          const char* backendMAC = discoveryDoc["backend_mac"];
-
-
-          
-          // 2. Get Broker IP from UDP Packet Source (Dynamic & Robust)
-          // We ignore any IP in the JSON and trust the network layer.
-          String remoteIPStr = udp.remoteIP().toString();
-          const char* mqttBroker = remoteIPStr.c_str();
-          
-          // Default port since we removed it from JSON
-          uint16_t mqttPort = 1883; 
-
-
-            
-            // Inside handleUDPDiscovery()
-            if (mqttBroker && strlen(mqttBroker) > 0) {
-            if (sMqttConfigured) {
-              // Already configured once this session, ignore subsequent packets
-              Serial.println("ℹ️ MQTT Config Ignored: Already configured in this session.");
-            } else {
-              const char* storedHostMac = wifiMgr.getHostMac();
-              bool shouldSave = false;
-              
-              // Verify Backend MAC against stored Host MAC
-              if (storedHostMac && strlen(storedHostMac) > 0) {
-                if (backendMAC && strcasecmp(storedHostMac, backendMAC) == 0) {
-                  Serial.printf("✓ Backend MAC Verified: %s\n", backendMAC);
-                  shouldSave = true;
-                } else {
-                  Serial.printf("❌ MQTT Config Rejected: Backend MAC mismatch!\n");
-                  Serial.printf("   Expected: %s\n", storedHostMac);
-                  Serial.printf("   Received: %s\n", backendMAC ? backendMAC : "(null)");
-                }
-              } else {
-                // No stored Host MAC to verify against - log warning but decide whether to allow
-                Serial.println("⚠️ MQTT Config Ignored: No Host MAC stored in NVS to verify against.");
-              }
-
-              if (shouldSave) {
-                // Save MQTT credentials to NVS
-                // Note: We are saving the UDP Source IP as the broker
-
-
-                if (saveMQTTCredentialsToNVS(mqttBroker, mqttPort, backendMAC)) {
-                  Serial.printf("📡 MQTT broker discovered and saved: %s:%d\n", mqttBroker, mqttPort);
-                  sMqttConfigured = true; // Set flag to prevent future writes
-                }
-              }
-            }
-          }
-        }else if (strcmp(packetBuffer, UDP_DISCOVERY_MAGIC) == 0) {
-          // Legacy simple string format (backward compatibility)
-          isDiscovery = true;
-        }
-        
-        if (isDiscovery) {
-          Serial.println("Received UDP discovery request");
-          // Get device ID from MAC address (last 5 digits)
-          String deviceID = getDeviceIDFromMAC();
-          // Create response JSON
-          JsonDocument doc;
-          doc["device_id"] = deviceID;
-          doc["ip_address"] = WiFi.localIP().toString();
-          doc["firmware_version"] = "OTA_BOOTLOADER";
-          doc["sensor_type"] = sensorType;
-          doc["availability"] = 1; // Always available in OTA mode
-          doc["magic"] = UDP_RESPONSE_MAGIC;
-          
-          // Add stored backend MAC for bidirectional verification
-          const char* storedHostMac = wifiMgr.getHostMac();
-          if (storedHostMac && strlen(storedHostMac) > 0) {
-            doc["backend_mac"] = storedHostMac;
-          }
-          
-          String response;
-          serializeJson(doc, response);
-          // Send response back to sender
-          udp.beginPacket(udp.remoteIP(), UDP_RESPONSE_PORT);
-          udp.write((const uint8_t *)response.c_str(), response.length());
-          udp.endPacket();
-          Serial.printf("Sent UDP discovery response: %s\n", response.c_str());
-        }
-      }
-    }
+  UdpDiscoveryConfig cfg;
+  if (udpDiscoveryTakeConfig(cfg))
+  {
+    applyDiscoveredBroker(cfg);
   }
 }
 
@@ -634,8 +870,10 @@ void setup()
     }
   }
 
-  // Erase inactive partition to allow clean OTA
-  eraseInactivePartition();
+  // Erase inactive partition in the background so OTA writes never wait on erases;
+  // the experiment image still in it is cached first
+  imageCache.begin();
+  otaPreEraseStart();
 
   // Check if already connected via wifiMgr
   bool wifiConnected = (WiFi.status() == WL_CONNECTED);
@@ -648,13 +886,15 @@ void setup()
   if (wifiConnected)
   {
     Serial.printf("\n✓ Connected to WiFi, IP: %s\n", WiFi.localIP().toString().c_str());
+    saveWiFiLinkToNVS(); // Lets the experiment firmware skip the scan after the jump
 
     // Only set up network services if WiFi is connected
     setupRoutes();
     server.begin();
 
     // Initialize UDP for discovery
-    if (udp.begin(UDP_DISCOVERY_PORT))
+    updateDiscoveryResponse();
+    if (udpDiscoveryBegin())
     {
       Serial.printf("✓ UDP discovery server started on port %d\n", UDP_DISCOVERY_PORT);
     }
@@ -698,7 +938,7 @@ void loop()
       Serial.println("✘ WiFi lost. Reconnecting...");
       
       // Stop UDP before disconnecting WiFi to prevent socket errors
-      udp.stop();
+      udpDiscoveryStop();
       
       WiFi.disconnect();
       
@@ -706,7 +946,8 @@ void loop()
       if (connectWithDynamicIP())
       {
         // Restart UDP after successful reconnection
-        if (udp.begin(UDP_DISCOVERY_PORT))
+        updateDiscoveryResponse();
+        if (udpDiscoveryBegin())
         {
           Serial.printf("✓ UDP discovery server restarted on port %d\n", UDP_DISCOVERY_PORT);
         }
@@ -743,33 +984,6 @@ void loop()
 }
 
 // ========== Utils ==========
-static bool hexToBytes(const String &hex, std::vector<uint8_t> &out)
-{
-  if (hex.length() % 2 != 0)
-    return false;
-  out.clear();
-  out.reserve(hex.length() / 2);
-  auto toNib = [](char c) -> int
-  {
-    if (c >= '0' && c <= '9')
-      return c - '0';
-    if (c >= 'a' && c <= 'f')
-      return 10 + (c - 'a');
-    if (c >= 'A' && c <= 'F')
-      return 10 + (c - 'A');
-    return -1;
-  };
-  for (size_t i = 0; i < hex.length(); i += 2)
-  {
-    int n1 = toNib(hex[i]);
-    int n2 = toNib(hex[i + 1]);
-    if (n1 < 0 || n2 < 0)
-      return false;
-    out.push_back((uint8_t)((n1 << 4) | n2));
-  }
-  return true;
-}
-
 static String getDeviceIDFromMAC()
 {
   String mac = WiFi.macAddress(); // "AA:BB:CC:DD:EE:FF"
@@ -0,0 +1,217 @@
+#include "ota_writer.h"
+#include "image_cache.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#define OTA_SECTOR_SIZE 4096
+#define OTA_PRE_ERASE_STACK 6144 // Image verify and SHA-256 for the cache copy
+#define OTA_PRE_ERASE_PRIORITY 1
+
+static volatile bool sPreEraseActive = false;
+static const esp_partition_t *sPreErasePartition = nullptr;
+static volatile size_t sPreErased = 0;
+static volatile bool sPreEraseStop = false;
+static bool sPreEraseCache = true;
+
+// Helpers
+static bool sectorIsBlank(const esp_partition_t *part, size_t offset)
+{
+  uint32_t buf[64];
+  for (size_t pos = 0; pos < OTA_SECTOR_SIZE; pos += sizeof(buf))
+  {
+    if (esp_partition_read(part, offset + pos, buf, sizeof(buf)) != ESP_OK)
+    {
+      return false;
+    }
+    for (size_t i = 0; i < sizeof(buf) / sizeof(buf[0]); i++)
+    {
+      if (buf[i] != 0xFFFFFFFF)
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static void preEraseTask(void *arg)
+{
+  const esp_partition_t *part = sPreErasePartition;
+
+  // The slot still holds the last experiment image; keep a copy before erasing it
+  if (sPreEraseCache)
+  {
+    imageCache.store(part, &sPreEraseStop);
+  }
+
+  unsigned long start = millis();
+  size_t skipped = 0;
+
+  while (!sPreEraseStop && sPreErased < part->size)
+  {
+    if (sectorIsBlank(part, sPreErased))
+    {
+      skipped++;
+    }
+    else if (esp_partition_erase_range(part, sPreErased, OTA_SECTOR_SIZE) != ESP_OK)
+    {
+      Serial.printf("✘ Pre-erase failed at 0x%x\n", (unsigned)sPreErased);
+      break;
+    }
+    sPreErased += OTA_SECTOR_SIZE;
+    vTaskDelay(1); // Let the web server and WiFi run between sectors
+  }
+
+  Serial.printf("✓ Pre-erase of %s %s: %u KB in %lu ms (%u sectors already blank)\n",
+                part->label, sPreErased >= part->size ? "done" : "stopped",
+                (unsigned)(sPreErased / 1024), millis() - start, (unsigned)skipped);
+
+  sPreEraseActive = false;
+  vTaskDelete(nullptr);
+}
+
+void otaPreEraseStart(bool cacheImage)
+{
+  if (sPreEraseActive)
+  {
+    return;
+  }
+
+  sPreErasePartition = esp_ota_get_next_update_partition(NULL);
+  if (!sPreErasePartition)
+  {
+    Serial.println("✘ Could not find inactive OTA partition.");
+    return;
+  }
+
+  sPreErased = 0;
+  sPreEraseStop = false;
+  sPreEraseCache = cacheImage;
+  sPreEraseActive = true;
+  if (xTaskCreatePinnedToCore(preEraseTask, "ota_erase", OTA_PRE_ERASE_STACK, nullptr,
+                              OTA_PRE_ERASE_PRIORITY, nullptr, 0) != pdPASS)
+  {
+    sPreEraseActive = false;
+  }
+}
+
+size_t otaPreEraseStop()
+{
+  sPreEraseStop = true;
+  while (sPreEraseActive)
+  {
+    vTaskDelay(pdMS_TO_TICKS(5));
+  }
+  // The caller is about to write into the slot; nothing is known erased after that
+  size_t erased = sPreErased;
+  sPreErased = 0;
+  return erased;
+}
+
+size_t otaPreErasedBytes()
+{
+  return sPreErased;
+}
+
+bool otaPreEraseRunning()
+{
+  return sPreEraseActive;
+}
+
+// ========== OtaSlotWriter ==========
+bool OtaSlotWriter::begin(size_t size, size_t erasedBytes)
+{
+  abort();
+
+  const esp_partition_t *part = esp_ota_get_next_update_partition(NULL);
+  if (!part)
+  {
+    _error = ESP_ERR_NOT_FOUND;
+    return false;
+  }
+  if (size > part->size)
+  {
+    _error = ESP_ERR_INVALID_SIZE;
+    return false;
+  }
+
+  _partition = part;
+  _size = size;
+  _written = 0;
+  _erasedEnd = erasedBytes - (erasedBytes % OTA_SECTOR_SIZE);
+  _error = ESP_OK;
+  return true;
+}
+
+bool OtaSlotWriter::ensureErased(size_t end)
+{
+  while (_erasedEnd < end)
+  {
+    esp_err_t err = esp_partition_erase_range(_partition, _erasedEnd, OTA_SECTOR_SIZE);
+    if (err != ESP_OK)
+    {
+      _error = err;
+      return false;
+    }
+    _erasedEnd += OTA_SECTOR_SIZE;
+  }
+  return true;
+}
+
+size_t OtaSlotWriter::write(const uint8_t *data, size_t len)
+{
+  if (!_partition || hasError())
+  {
+    return 0;
+  }
+  if (_written + len > _partition->size || (_size != OTA_SIZE_UNKNOWN && _written + len > _size))
+  {
+    _error = ESP_ERR_INVALID_SIZE;
+    return 0;
+  }
+  if (!ensureErased(_written + len))
+  {
+    return 0;
+  }
+
+  esp_err_t err = esp_partition_write(_partition, _written, data, len);
+  if (err != ESP_OK)
+  {
+    _error = err;
+    return 0;
+  }
+  _written += len;
+  return len;
+}
+
+bool OtaSlotWriter::end()
+{
+  if (!_partition || hasError())
+  {
+    return false;
+  }
+  if (_size != OTA_SIZE_UNKNOWN && _written != _size)
+  {
+    _error = ESP_ERR_INVALID_SIZE;
+    return false;
+  }
+
+  // Verifies the image header, segments and checksum before switching
+  esp_err_t err = esp_ota_set_boot_partition(_partition);
+  if (err != ESP_OK)
+  {
+    _error = err;
+    return false;
+  }
+  _partition = nullptr;
+  return true;
+}
+
+void OtaSlotWriter::abort()
+{
+  _partition = nullptr;
+  _size = 0;
+  _written = 0;
+  _erasedEnd = 0;
+  _error = ESP_OK;
+}
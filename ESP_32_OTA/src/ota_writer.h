@@ -0,0 +1,105 @@
+#pragma once
+/**
+ * @file ota_writer.h
+ * @brief Background pre-erase and direct flash writer for the inactive OTA slot.
+ *
+ * Update.write() erases each sector lazily as data arrives, so every 4 KB of
+ * a push stalls on a flash erase. Instead the bootloader erases the inactive
+ * slot in a low-priority task right after boot, and OtaSlotWriter programs
+ * the image with esp_partition_write(), erasing only sectors the background
+ * task has not reached yet.
+ *
+ * Usage Example:
+ * @code
+ * #include "ota_writer.h"
+ * OtaSlotWriter otaWriter;
+ * void setup() {
+ *   otaPreEraseStart();
+ * }
+ * // On /ota/begin:
+ * size_t erased = otaPreEraseStop();
+ * otaWriter.begin(size, erased);
+ * otaWriter.write(buf, len);
+ * otaWriter.end();   // Validates the image and sets it as boot partition
+ * @endcode
+ */
+
+#include <Arduino.h>
+#include "esp_partition.h"
+#include "esp_ota_ops.h"
+
+#define OTA_SIZE_UNKNOWN 0
+
+/**
+ * @brief Start erasing the inactive OTA slot in a low-priority background task.
+ * A valid image in the slot is first copied to the image cache; sectors that
+ * are already blank are skipped without erasing.
+ * @param cacheImage false after a failed push: the slot holds an image that
+ * did not pass the digest or signature check and must not be cached
+ */
+void otaPreEraseStart(bool cacheImage = true);
+
+/**
+ * @brief Stop the background erase after the current sector and hand the slot
+ * to a writer. Later calls return 0 until otaPreEraseStart() runs again, so an
+ * attempt that fails after writing must restart the erase (or write with 0).
+ * @return bytes from the start of the slot that are known to be erased
+ */
+size_t otaPreEraseStop();
+
+/**
+ * @brief Bytes from the start of the slot erased so far (for status reporting)
+ */
+size_t otaPreErasedBytes();
+
+/**
+ * @brief true while the background erase task is running
+ */
+bool otaPreEraseRunning();
+
+/**
+ * @class OtaSlotWriter
+ * @brief Sequential image writer for the next OTA partition.
+ */
+class OtaSlotWriter {
+public:
+  /**
+   * @brief Prepare to write an image into the next update partition.
+   * @param size expected image size, or OTA_SIZE_UNKNOWN
+   * @param erasedBytes bytes at the start of the slot known to be erased
+   * @return true if the partition exists and the image fits
+   */
+  bool begin(size_t size, size_t erasedBytes = 0);
+
+  /**
+   * @brief Append image bytes, erasing sectors ahead of the write as needed.
+   * @return number of bytes written (less than len on error)
+   */
+  size_t write(const uint8_t *data, size_t len);
+
+  /**
+   * @brief Check the size, validate the image and make it the boot partition.
+   */
+  bool end();
+
+  /**
+   * @brief Abandon the current image.
+   */
+  void abort();
+
+  bool isRunning() const { return _partition != nullptr; }
+  bool hasError() const { return _error != ESP_OK; }
+  size_t written() const { return _written; }
+  size_t size() const { return _size; }
+  const esp_partition_t *partition() const { return _partition; }
+  const char *errorString() const { return esp_err_to_name(_error); }
+
+private:
+  bool ensureErased(size_t end);
+
+  const esp_partition_t *_partition = nullptr;
+  size_t _size = 0;
+  size_t _written = 0;
+  size_t _erasedEnd = 0;
+  esp_err_t _error = ESP_OK;
+};
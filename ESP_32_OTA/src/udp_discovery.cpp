@@ -0,0 +1,173 @@
+#include "udp_discovery.h"
+#include <AsyncUDP.h>
+#include <ArduinoJson.h>
+
+static AsyncUDP sUdp;
+static bool sListening = false;
+static portMUX_TYPE sLock = portMUX_INITIALIZER_UNLOCKED;
+
+// Reply body, written by the main task and read in the callback
+static char sResponse[UDP_DISCOVERY_MAX_RESPONSE];
+static size_t sResponseLen = 0;
+
+// Latest broker announcement, consumed by the main task
+static UdpDiscoveryConfig sConfig;
+static bool sConfigPending = false;
+
+static volatile uint32_t sRequests = 0;
+static volatile uint32_t sDropped = 0;
+
+// Per-source rate limit; the least recently seen source is replaced
+struct SourceSlot
+{
+  uint32_t ip;
+  uint32_t lastMs;
+};
+static SourceSlot sSources[UDP_DISCOVERY_SOURCES];
+
+// Helpers
+static bool allowSource(uint32_t ip, uint32_t now)
+{
+  size_t oldest = 0;
+  for (size_t i = 0; i < UDP_DISCOVERY_SOURCES; i++)
+  {
+    if (sSources[i].ip == ip)
+    {
+      if (now - sSources[i].lastMs < UDP_DISCOVERY_MIN_INTERVAL_MS)
+      {
+        return false;
+      }
+      sSources[i].lastMs = now;
+      return true;
+    }
+    if (sSources[i].lastMs < sSources[oldest].lastMs)
+    {
+      oldest = i;
+    }
+  }
+  sSources[oldest].ip = ip;
+  sSources[oldest].lastMs = now;
+  return true;
+}
+
+static bool isLegacyRequest(const uint8_t *data, size_t len)
+{
+  size_t magicLen = strlen(UDP_DISCOVERY_MAGIC);
+  // Older backends send the bare magic, sometimes with a trailing NUL
+  return (len == magicLen || (len == magicLen + 1 && data[magicLen] == '\0')) &&
+         memcmp(data, UDP_DISCOVERY_MAGIC, magicLen) == 0;
+}
+
+// Runs in the AsyncUDP task
+static void onPacket(AsyncUDPPacket &packet)
+{
+  const uint8_t *data = packet.data();
+  size_t len = packet.length();
+  if (len == 0)
+  {
+    return;
+  }
+
+  bool isDiscovery = isLegacyRequest(data, len);
+  if (!isDiscovery && data[0] == '{')
+  {
+    JsonDocument filter;
+    filter["magic"] = true;
+    filter["backend_mac"] = true;
+    JsonDocument doc;
+    if (deserializeJson(doc, data, len, DeserializationOption::Filter(filter)) == DeserializationError::Ok &&
+        doc["magic"] == UDP_DISCOVERY_MAGIC)
+    {
+      isDiscovery = true;
+
+      // The broker is the sender; any IP in the payload is ignored
+      const char *backendMac = doc["backend_mac"] | "";
+      portENTER_CRITICAL(&sLock);
+      sConfig.broker = packet.remoteIP();
+      strlcpy(sConfig.backendMac, backendMac, sizeof(sConfig.backendMac));
+      sConfigPending = true;
+      portEXIT_CRITICAL(&sLock);
+    }
+  }
+  if (!isDiscovery)
+  {
+    return;
+  }
+
+  sRequests++;
+  if (!allowSource((uint32_t)packet.remoteIP(), millis()))
+  {
+    sDropped++;
+    return;
+  }
+
+  uint8_t reply[UDP_DISCOVERY_MAX_RESPONSE];
+  portENTER_CRITICAL(&sLock);
+  size_t replyLen = sResponseLen;
+  memcpy(reply, sResponse, replyLen);
+  portEXIT_CRITICAL(&sLock);
+
+  if (replyLen > 0)
+  {
+    sUdp.writeTo(reply, replyLen, packet.remoteIP(), UDP_RESPONSE_PORT);
+  }
+}
+
+// ========== API ==========
+bool udpDiscoveryBegin()
+{
+  udpDiscoveryStop();
+  memset(sSources, 0, sizeof(sSources));
+  if (!sUdp.listen(UDP_DISCOVERY_PORT))
+  {
+    return false;
+  }
+  sUdp.onPacket(onPacket);
+  sListening = true;
+  return true;
+}
+
+void udpDiscoveryStop()
+{
+  if (sListening)
+  {
+    sUdp.close();
+    sListening = false;
+  }
+}
+
+bool udpDiscoverySetResponse(const char *json, size_t len)
+{
+  if (len > sizeof(sResponse))
+  {
+    return false;
+  }
+  portENTER_CRITICAL(&sLock);
+  memcpy(sResponse, json, len);
+  sResponseLen = len;
+  portEXIT_CRITICAL(&sLock);
+  return true;
+}
+
+bool udpDiscoveryTakeConfig(UdpDiscoveryConfig &config)
+{
+  portENTER_CRITICAL(&sLock);
+  bool pending = sConfigPending;
+  if (pending)
+  {
+    config = sConfig;
+    sConfigPending = false;
+  }
+  portEXIT_CRITICAL(&sLock);
+  return pending;
+}
+
+uint32_t udpDiscoveryRequests()
+{
+  return sRequests;
+}
+
+uint32_t udpDiscoveryDropped()
+{
+  return sDropped;
+}
@@ -0,0 +1,65 @@
+#pragma once
+/**
+ * @file udp_discovery.h
+ * @brief Event-driven backend discovery on UDP port 8888.
+ *
+ * Datagrams are handled from the AsyncUDP callback as lwIP delivers them, so
+ * every request in a burst is answered within milliseconds; polling from
+ * loop() answered at most one request per second. Replies to the same source
+ * are rate-limited.
+ *
+ * The reply body is prepared by the main task (it depends on the sensor type
+ * and the stored backend MAC) and only copied in the callback. A JSON request
+ * carrying a backend MAC is handed back to the main task, which verifies it
+ * and saves the broker to NVS.
+ *
+ * Usage Example:
+ * @code
+ * #include "udp_discovery.h"
+ * udpDiscoveryBegin();                       // once WiFi is up
+ * udpDiscoverySetResponse(json, len);        // whenever the identity changes
+ * UdpDiscoveryConfig cfg;
+ * if (udpDiscoveryTakeConfig(cfg)) { ... }   // from loop()
+ * @endcode
+ */
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+#define UDP_DISCOVERY_PORT 8888
+#define UDP_RESPONSE_PORT 8889
+#define UDP_DISCOVERY_MAGIC "LABEXPERT_DISCOVERY"
+#define UDP_RESPONSE_MAGIC "LABEXPERT_RESPONSE"
+
+#define UDP_DISCOVERY_MAX_RESPONSE 384
+#define UDP_DISCOVERY_MIN_INTERVAL_MS 100 // Per source address
+#define UDP_DISCOVERY_SOURCES 8
+
+/**
+ * @brief Broker announcement from a JSON discovery request.
+ */
+struct UdpDiscoveryConfig {
+  IPAddress broker;    // Source address of the request
+  char backendMac[18]; // Empty if the request carried none
+};
+
+/**
+ * @brief Listen on UDP_DISCOVERY_PORT; safe to call again after a reconnect.
+ */
+bool udpDiscoveryBegin();
+
+void udpDiscoveryStop();
+
+/**
+ * @brief Replace the reply sent to discovery requests (JSON, not terminated).
+ * @return false if it does not fit UDP_DISCOVERY_MAX_RESPONSE
+ */
+bool udpDiscoverySetResponse(const char *json, size_t len);
+
+/**
+ * @brief Fetch the latest broker announcement, if one arrived since the last call.
+ */
+bool udpDiscoveryTakeConfig(UdpDiscoveryConfig &config);
+
+uint32_t udpDiscoveryRequests();
+uint32_t udpDiscoveryDropped();
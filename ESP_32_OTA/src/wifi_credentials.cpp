@@ -31,6 +31,7 @@ static const char kKeySsid[]   = "ssid";
 static const char kKeyPass[]   = "pass";
 static const char kKeyUser[]   = "user";
 static const char kKeyHostMac[] = "hostmac";
+static const char kKeyLink[] = "link"; // WIFI_LINK_NVS_KEY, the sensor firmwares' fast-reconnect cache
 static const char kDevPrefix[] = "LabExpertOTA";
 static const uint8_t kBleSecret[] = { 'D','E','V','_','S','E','C','R','E','T' };
 
@@ -279,6 +280,7 @@ void WiFiCredentialManager::clearCredentials() {
     nvs_erase_key(h, kKeyPass);
     nvs_erase_key(h, kKeyUser);
     nvs_erase_key(h, kKeyHostMac);
+    nvs_erase_key(h, kKeyLink); // New network: no directed connect to the old access point
     nvs_commit(h);
     nvs_close(h);
   }
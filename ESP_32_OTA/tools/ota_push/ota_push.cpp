@@ -0,0 +1,407 @@
+/**
+ * @file ota_push.cpp
+ * @brief Host client for the ESP_32_OTA raw chunk endpoint
+ *
+ * Pushes a firmware image with /ota/begin, /ota/chunk (application/octet-stream
+ * with X-OTA-Offset and X-OTA-CRC32) and /ota/end. When a request fails the
+ * client asks /ota/status for the last committed offset and resumes there.
+ * Prints throughput and the lowest free heap the device reported during the
+ * transfer.
+ *
+ * A gzip file (`gzip -9 -k firmware.bin`) is pushed as is; the device inflates
+ * it while writing. The decompressed size is read from the gzip trailer and
+ * sent as image_size, and the compression ratio is printed with the timing.
+ *
+ * The SHA-256 of a raw image is computed here and sent to /ota/begin, so the
+ * device rejects the image at /ota/end if what it flashed differs. For a gzip
+ * file pass the digest of the uncompressed firmware.bin with --sha256; a
+ * signing-enabled bootloader also needs --signature (Ed25519 over the digest).
+ * The device's hashing time is printed next to the transfer time.
+ *
+ * Build (Linux/macOS, no dependencies):
+ *   g++ -O2 -std=c++11 -o ota_push ota_push.cpp
+ *
+ * Usage:
+ *   ./ota_push <device-ip> <firmware.bin> [--chunk BYTES] [--port PORT] [--no-end]
+ *              [--sha256 HEX] [--signature HEX]
+ */
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+const int kMaxRetries = 5;
+const int kTimeoutSeconds = 10;
+const size_t kMaxChunk = 16384; // OTA_MAX_CHUNK_SIZE on the device
+
+struct HttpResponse {
+    int status = 0;
+    std::string body;
+};
+
+struct Options {
+    std::string host;
+    std::string file;
+    int port = 80;
+    size_t chunk = 16384;
+    bool end = true;
+    std::string sha256;
+    std::string signature;
+};
+
+bool sendAll(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, 0);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+int connectTo(const Options& opt) {
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* res = nullptr;
+    std::string port = std::to_string(opt.port);
+    if (getaddrinfo(opt.host.c_str(), port.c_str(), &hints, &res) != 0 || res == nullptr) {
+        return -1;
+    }
+
+    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd >= 0) {
+        timeval tv;
+        tv.tv_sec = kTimeoutSeconds;
+        tv.tv_usec = 0;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        if (connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+// Standard CRC-32 (same as zlib and the ESP32 ROM crc32_le with seed 0)
+uint32_t crc32(const uint8_t* data, size_t len) {
+    static uint32_t table[256];
+    if (table[1] == 0) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+    }
+    uint32_t crc = 0xFFFFFFFFu;
+    while (len--) {
+        crc = table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// FIPS 180-4 SHA-256, lowercase hex digest
+std::string sha256Hex(const uint8_t* data, size_t len) {
+    static const uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+    uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                     0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+    std::vector<uint8_t> msg(data, data + len);
+    msg.push_back(0x80);
+    while (msg.size() % 64 != 56) {
+        msg.push_back(0);
+    }
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i = 7; i >= 0; i--) {
+        msg.push_back((uint8_t)(bits >> (i * 8)));
+    }
+
+    auto rotr = [](uint32_t x, int n) { return (x >> n) | (x << (32 - n)); };
+    for (size_t off = 0; off < msg.size(); off += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            const uint8_t* p = &msg[off + i * 4];
+            w[i] = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = hh + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            hh = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+    }
+
+    char hex[65];
+    for (int i = 0; i < 8; i++) {
+        snprintf(hex + i * 8, 9, "%08x", h[i]);
+    }
+    return hex;
+}
+
+/**
+ * @brief One request per connection, matching the device's sync WebServer
+ */
+bool httpRequest(const Options& opt, const char* method, const char* path, const char* contentType,
+                 const std::string& extraHeaders, const uint8_t* body, size_t bodyLen,
+                 HttpResponse& out) {
+    int fd = connectTo(opt);
+    if (fd < 0) {
+        return false;
+    }
+
+    char head[512];
+    int headLen = snprintf(head, sizeof(head),
+                           "%s %s HTTP/1.1\r\n"
+                           "Host: %s\r\n"
+                           "Content-Type: %s\r\n"
+                           "Content-Length: %zu\r\n"
+                           "%s"
+                           "Connection: close\r\n\r\n",
+                           method, path, opt.host.c_str(), contentType, bodyLen, extraHeaders.c_str());
+
+    bool ok = headLen > 0 && (size_t)headLen < sizeof(head) &&
+              sendAll(fd, head, (size_t)headLen) &&
+              (bodyLen == 0 || sendAll(fd, (const char*)body, bodyLen));
+
+    std::string raw;
+    char buf[1024];
+    while (ok) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0) {
+            ok = false;
+        }
+        if (n <= 0) {
+            break;
+        }
+        raw.append(buf, (size_t)n);
+    }
+    close(fd);
+
+    if (!ok || raw.compare(0, 5, "HTTP/") != 0) {
+        return false;
+    }
+
+    out.status = atoi(raw.c_str() + raw.find(' ') + 1);
+    size_t split = raw.find("\r\n\r\n");
+    out.body = split == std::string::npos ? std::string() : raw.substr(split + 4);
+    return true;
+}
+
+bool httpPost(const Options& opt, const char* path, const char* contentType,
+              const std::string& extraHeaders, const uint8_t* body, size_t bodyLen,
+              HttpResponse& out) {
+    return httpRequest(opt, "POST", path, contentType, extraHeaders, body, bodyLen, out);
+}
+
+// Minimal numeric field lookup in the device's flat JSON responses
+bool jsonNumber(const std::string& body, const char* key, unsigned long& value) {
+    std::string needle = std::string("\"") + key + "\":";
+    size_t pos = body.find(needle);
+    if (pos == std::string::npos) {
+        return false;
+    }
+    value = strtoul(body.c_str() + pos + needle.size(), nullptr, 10);
+    return true;
+}
+
+bool parseArgs(int argc, char** argv, Options& opt) {
+    if (argc < 3) {
+        return false;
+    }
+    opt.host = argv[1];
+    opt.file = argv[2];
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--chunk") == 0 && i + 1 < argc) {
+            opt.chunk = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            opt.port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--no-end") == 0) {
+            opt.end = false;
+        } else if (strcmp(argv[i], "--sha256") == 0 && i + 1 < argc) {
+            opt.sha256 = argv[++i];
+        } else if (strcmp(argv[i], "--signature") == 0 && i + 1 < argc) {
+            opt.signature = argv[++i];
+        } else {
+            return false;
+        }
+    }
+    return opt.chunk > 0 && opt.chunk <= kMaxChunk;
+}
+
+bool readFile(const std::string& path, std::vector<uint8_t>& out) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        out.insert(out.end(), buf, buf + n);
+    }
+    fclose(f);
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) {
+        fprintf(stderr, "usage: %s <device-ip> <firmware.bin> [--chunk BYTES] [--port PORT] [--no-end]"
+                        " [--sha256 HEX] [--signature HEX]\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<uint8_t> image;
+    if (!readFile(opt.file, image) || image.empty()) {
+        fprintf(stderr, "cannot read %s\n", opt.file.c_str());
+        return 1;
+    }
+
+    HttpResponse resp;
+    // Gzip: ISIZE (last 4 bytes, little-endian) is the decompressed length
+    bool gzip = image.size() > 18 && image[0] == 0x1F && image[1] == 0x8B;
+    unsigned long imageSize = 0;
+    if (gzip) {
+        const uint8_t* t = image.data() + image.size() - 4;
+        imageSize = t[0] | (t[1] << 8) | (t[2] << 16) | ((unsigned long)t[3] << 24);
+        printf("gzip image: %zu -> %lu bytes (%.1f%% of raw)\n", image.size(), imageSize,
+               100.0 * image.size() / imageSize);
+    }
+
+    std::string begin = "{\"size\":" + std::to_string(image.size());
+    if (gzip) {
+        begin += ",\"image_size\":" + std::to_string(imageSize);
+    }
+    std::string digest = !opt.sha256.empty() ? opt.sha256 : gzip ? std::string() : sha256Hex(image.data(), image.size());
+    if (!digest.empty()) {
+        begin += ",\"sha256\":\"" + digest + "\"";
+        printf("image sha256 %s\n", digest.c_str());
+    }
+    if (!opt.signature.empty()) {
+        begin += ",\"signature\":\"" + opt.signature + "\"";
+    }
+    begin += "}";
+    if (!httpPost(opt, "/ota/begin", "application/json", "", (const uint8_t*)begin.data(), begin.size(), resp) ||
+        resp.status != 200) {
+        fprintf(stderr, "/ota/begin failed (HTTP %d): %s\n", resp.status, resp.body.c_str());
+        return 1;
+    }
+
+    // A repeated begin for the same image resumes where the device left off
+    unsigned long resumeAt = 0;
+    jsonNumber(resp.body, "offset", resumeAt);
+    if (resumeAt > 0) {
+        printf("Resuming at offset %lu\n", resumeAt);
+    }
+
+    unsigned long minFreeHeap = 0;
+    size_t offset = resumeAt;
+    int retries = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    while (offset < image.size()) {
+        size_t len = image.size() - offset < opt.chunk ? image.size() - offset : opt.chunk;
+        char header[96];
+        snprintf(header, sizeof(header), "X-OTA-Offset: %zu\r\nX-OTA-CRC32: %08x\r\n",
+                 offset, crc32(image.data() + offset, len));
+
+        bool sent = httpPost(opt, "/ota/chunk", "application/octet-stream", header,
+                             image.data() + offset, len, resp);
+        unsigned long deviceOffset = 0;
+        if (sent && jsonNumber(resp.body, "offset", deviceOffset)) {
+            unsigned long heap;
+            if (jsonNumber(resp.body, "min_free_heap", heap) && (minFreeHeap == 0 || heap < minFreeHeap)) {
+                minFreeHeap = heap;
+            }
+        }
+
+        if (sent && resp.status == 200) {
+            offset = deviceOffset;
+            retries = 0;
+        } else if (++retries <= kMaxRetries) {
+            fprintf(stderr, "\nchunk at %zu failed (HTTP %d), retry %d/%d\n", offset, resp.status, retries, kMaxRetries);
+            sleep(1);
+
+            // Resume from the device's committed offset; if it can't be reached
+            // yet, resending the same offset is safe (acknowledged idempotently)
+            HttpResponse status;
+            unsigned long committed;
+            if (httpRequest(opt, "GET", "/ota/status", "text/plain", "", nullptr, 0, status) &&
+                status.status == 200 && jsonNumber(status.body, "offset", committed)) {
+                offset = committed;
+            }
+            continue;
+        } else {
+            fprintf(stderr, "\ngiving up at offset %zu: %s\n", offset, resp.body.c_str());
+            return 1;
+        }
+
+        printf("\r%zu / %zu bytes", offset, image.size());
+        fflush(stdout);
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("\nPushed %zu bytes in %.2f s (%.3f MB/s), device min free heap %lu bytes\n",
+           image.size(), seconds, image.size() / seconds / (1024.0 * 1024.0), minFreeHeap);
+    if (gzip) {
+        printf("Effective image rate %.3f MB/s (%lu bytes flashed)\n",
+               imageSize / seconds / (1024.0 * 1024.0), imageSize);
+    }
+
+    // Time the device spent hashing, against the transfer time above
+    HttpResponse status;
+    unsigned long hashMs;
+    if (httpRequest(opt, "GET", "/ota/status", "text/plain", "", nullptr, 0, status) &&
+        jsonNumber(status.body, "hash_ms", hashMs)) {
+        printf("Device SHA-256 time %lu ms (%.1f%% of transfer)\n", hashMs, hashMs / 10.0 / seconds);
+    }
+
+    if (opt.end) {
+        if (!httpPost(opt, "/ota/end", "application/json", "", nullptr, 0, resp) || resp.status != 200) {
+            fprintf(stderr, "/ota/end failed (HTTP %d): %s\n", resp.status, resp.body.c_str());
+            return 1;
+        }
+        double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("OTA finalized in %.2f s end-to-end, device rebooting\n", total);
+    }
+    return 0;
+}
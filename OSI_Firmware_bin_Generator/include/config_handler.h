@@ -15,6 +15,8 @@
 #define EEPROM_SIZE 3
 #define EEPROM_RETRY_COUNT 3
 #define EEPROM_RETRY_DELAY 100
+#define SENSOR_TYPE_CODES "OSI"      // Accepted 3-byte EEPROM codes
+#define SENSOR_CHECK_INTERVAL 10000 // EEPROM presence probe period (ms)
 
 // Experiment configuration structure
 struct ExperimentConfig
@@ -13,6 +13,13 @@
 #define MQTT_DATA_TOPIC "sensors/%s/data"
 #define MQTT_STATUS_TOPIC "sensors/%s/status"
 
+// Fixed parse buffers for incoming command payloads, sized by key count:
+// a slot is 16 bytes on the ESP32 but 32 on a 64-bit native build.
+// MQTT_COMMAND_KEYS must match the keys setupMQTT() puts in the filter.
+#define MQTT_COMMAND_KEYS 7
+#define MQTT_COMMAND_FILTER_SIZE JSON_OBJECT_SIZE(MQTT_COMMAND_KEYS)
+#define MQTT_COMMAND_DOC_SIZE (2 * MQTT_COMMAND_FILTER_SIZE) // Room for a nested value
+
 // Global variables - DECLARE as extern
 extern WiFiClient wifiClient;
 extern PubSubClient mqttClient;
@@ -27,6 +34,8 @@ void publishOscillationData(int oscCount, unsigned long disconnectTime, unsigned
 void publishExperimentSummary();
 void publishStatus(const char *status, const char *message = nullptr);
 void publishSensorIdentification();
+void publishPresenceOffline();
+void publishHeartbeat();
 String formatTime(unsigned long milliseconds);
 
 // Firmware cleanup and OTA boot
@@ -4,10 +4,13 @@
 #include <Arduino.h>
 #include <Wire.h>
 #include "config_handler.h"
+#include "eeprom_presence.h"
+#include "sensor_runtime.h"
 
 // Global variables - DECLARE as extern (no initialization here)
 extern String sensorType;
 extern String sensorID;
+extern EepromPresence sensorPresence;
 
 // Function declarations
 bool detectSensorFromEEPROM();
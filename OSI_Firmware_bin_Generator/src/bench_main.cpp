@@ -0,0 +1,107 @@
+// Host microbenchmarks ([env:bench]) for the inbound MQTT paths: command
+// parsing through mqttCallback() on the command and config topics (OSI takes
+// {"command": ...} on both). Replaces main_sensor.cpp; the firmware modules
+// are linked unchanged and publish into the native_hal broker with no link
+// delay. The board-side suite is TOF's [env:esp32dev_bench].
+//
+//   .pio/build/bench/program [--filter=config] [--baseline=saved_run.txt]
+#include <Arduino.h>
+#include <WiFi.h>
+#include "native_hal.h"
+#include "microbench.h"
+
+#include "../include/sensor_communication.h"
+#include "../include/config_handler.h"
+#include "../include/experiment_manager.h"
+#include "../include/mqtt_handler.h"
+
+// Defined by main_sensor.cpp and config_handler.cpp on the board
+ExperimentConfig config;
+char mqttBroker[40] = "127.0.0.1";
+uint16_t mqttPort = 1883;
+
+void cleanFirmwareAndBootOTA() {
+    // disconnect_device is not benchmarked
+}
+
+// The payload is copied each iteration: ArduinoJson parses it in place, as
+// it does the PubSubClient buffer
+static void runCommand(MicroBench::State& state, const char* topicFormat, const char* payload) {
+    if (!mqttClient.connected()) {
+        state.skip("MQTT not connected");
+        return;
+    }
+    char topic[50];
+    snprintf(topic, sizeof(topic), topicFormat, sensorID.c_str());
+    size_t length = strlen(payload);
+    byte buffer[MQTT_COMMAND_DOC_SIZE];
+    while (state.keepRunning()) {
+        memcpy(buffer, payload, length);
+        mqttCallback(topic, buffer, length);
+    }
+    state.setBytesProcessed(length);
+}
+
+// Dispatch plus the retained presence record it republishes. status logs a
+// line per call; back to back at 115200 baud that would time the UART
+// (~3 ms a line), so Serial is unpaced and muted for this row
+static void BM_mqttCallback_command(MicroBench::State& state) {
+    Serial.begin(0);
+    simSerialEcho(false);
+    runCommand(state, MQTT_COMMAND_TOPIC, "{\"command\":\"status\",\"request_id\":\"a1b2c3d4\"}");
+    simSerialEcho(true);
+    Serial.begin(115200);
+}
+MICROBENCH(BM_mqttCallback_command);
+
+// The run parameters the backend sends; with a run already active the
+// parsed fields are applied and nothing is started or published
+static void BM_mqttCallback_config(MicroBench::State& state) {
+    experimentRunning = true;
+    runCommand(state, MQTT_CONFIG_TOPIC,
+               "{\"command\":\"start_experiment\",\"max_count\":20,\"pendulum_length_cm\":42.5,\"fleet_size\":40}");
+    experimentRunning = false;
+}
+MICROBENCH(BM_mqttCallback_config);
+
+static bool loadBaselineFile(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return false;
+    }
+    std::string text;
+    char chunk[512];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        text.append(chunk, n);
+    }
+    fclose(f);
+    return MicroBench::loadBaseline(text.c_str()) > 0;
+}
+
+void setup() {
+    Serial.begin(115200);
+    Serial.println("\n=== OSI Firmware - microbenchmarks ===");
+
+    sensorType = "OSI";
+    sensorID = "BENCH";
+    const char* baselinePath = simOption("baseline");
+    if (baselinePath && !loadBaselineFile(baselinePath)) {
+        printf("[bench] no %s rows in %s\n", MicroBench::kTickUnit, baselinePath);
+    }
+    WiFi.mode(WIFI_STA);
+    WiFi.begin("native", "");
+    setupMQTT();
+    reconnectMQTT();
+
+    int regressions = MicroBench::runAll(Serial, simOption("filter"));
+    if (regressions) {
+        Serial.printf("%d benchmark(s) more than %d%% slower than the baseline\n", regressions,
+                      MICROBENCH_REGRESSION_PCT);
+    }
+    simExit(regressions ? 1 : 0);
+}
+
+void loop() {
+    delay(1000);
+}
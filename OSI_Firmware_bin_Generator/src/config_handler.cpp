@@ -1,28 +1,57 @@
 #include "config_handler.h"
 #include <Update.h>
+#include "ota_inflate.h"
+#include "ota_verify.h"
 
 // Global variables
 ExperimentConfig config;
 AsyncWebServer server(80);
 
-// Handle OTA update upload
+// Decompressed (or raw) image bytes from the upload are hashed and go straight to flash
+static OtaInflater updateInflater;
+static OtaImageVerifier updateVerifier;
+
+static bool writeUpdate(const uint8_t *data, size_t len, void *) {
+    updateVerifier.update(data, len);
+    return Update.write((uint8_t *)data, len) == len;
+}
+
+static const char *updateHeader(AsyncWebServerRequest *request, const char *name) {
+    AsyncWebHeader *header = request->getHeader(name);
+    return header ? header->value().c_str() : nullptr;
+}
+
+// Handle OTA update upload (raw firmware.bin or gzip-compressed firmware.bin.gz)
 void handleUpdateUpload(AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final) {
     if (!index) {
         Serial.printf("Update Start: %s\n", filename.c_str());
         if (!Update.begin(UPDATE_SIZE_UNKNOWN)) {
             Update.printError(Serial);
         }
+        updateInflater.begin(writeUpdate, nullptr);
+        // Optional SHA-256 of firmware.bin (and Ed25519 signature when the build requires one)
+        if (!updateVerifier.begin(updateHeader(request, "X-Firmware-SHA256"),
+                                  updateHeader(request, "X-Firmware-Signature"))) {
+            Serial.printf("Update rejected: %s\n", updateVerifier.error());
+            Update.abort();
+        }
     }
     
-    if (Update.write(data, len) != len) {
+    if (!Update.hasError() && !updateInflater.write(data, len)) {
+        Serial.printf("Update decode failed: %s\n", updateInflater.error());
         Update.printError(Serial);
+        Update.abort();
     }
     
     if (final) {
-        if (Update.end(true)) {
-            Serial.printf("Update Success: %u bytes\n", index + len);
+        if (updateInflater.finish() && updateVerifier.finish() && Update.end(true)) {
+            Serial.printf("Update Success: %u bytes received, %u written, hash %u ms\n", index + len,
+                          updateInflater.outputBytes(), updateVerifier.hashMicros() / 1000);
         } else {
+            const char *error = updateInflater.error() ? updateInflater.error() : updateVerifier.error();
+            Serial.printf("Update failed: %s\n", error ? error : "flash");
             Update.printError(Serial);
+            Update.abort();
         }
     }
 }
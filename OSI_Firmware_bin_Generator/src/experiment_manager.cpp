@@ -167,15 +167,17 @@ void manageExperimentLoop()
     }
 }
 
-// Check sensor status
+// Check sensor status; the EEPROM is probed by sensorPresence's task, this only reacts to changes
 void checkSensorStatus()
 {
-    // Add periodic EEPROM check if needed
-    static unsigned long lastCheck = 0;
-    if (millis() - lastCheck > 10000)
-    { // Check every 10 seconds
-        lastCheck = millis();
-        bool currentStatus = detectSensorFromEEPROM();
+    static uint32_t lastPresenceChange = 0;
+    if (sensorPresence.changes() != lastPresenceChange)
+    {
+        lastPresenceChange = sensorPresence.changes();
+        char code[EEPROM_PRESENCE_CODE_SIZE + 1];
+        EepromPresence::State state = sensorPresence.snapshot(code);
+        bool currentStatus = state == EepromPresence::PRESENT;
+        sensorType = state == EepromPresence::ABSENT ? "UNKNOWN" : code;
 
         if (sensorWasPresent && !currentStatus)
         {
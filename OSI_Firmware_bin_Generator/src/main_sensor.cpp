@@ -42,10 +42,6 @@ char ssid[33];      // Will be loaded from NVS
 char password[65];  // Will be loaded from NVS
 // Network configuration - All settings obtained from DHCP
 
-// Function prototypes
-bool connectWithDynamicIP();
-bool connectWithDHCP();
-
 // MQTT configuration - Loaded from NVS (set by OTA bootloader via UDP discovery)
 char mqttBroker[40] = "";
 uint16_t mqttPort = 1883;
@@ -105,13 +101,13 @@ void setup()
         Serial.printf("   Backend MAC: %s\n", backendMAC);
     }
 
-    // Network setup with dynamic IP assignment
+    // Network setup
     WiFi.mode(WIFI_STA);
     
-    Serial.println("Starting dynamic IP connection...");
-    
-    // Try dynamic IP assignment (multiple static IPs, then fallback to DHCP)
-    bool wifiConnected = connectWithDynamicIP();
+    // Cached access point first, then a full DHCP connect
+    unsigned long wifiStart = millis();
+    bool wifiConnected = connectSensorWiFi(ssid, password);
+    Serial.printf("WiFi connect took %lu ms\n", millis() - wifiStart);
     
     if (wifiConnected) {
         Serial.printf("\n✅ WiFi connected successfully. IP: %s\n", WiFi.localIP().toString().c_str());
@@ -125,62 +121,12 @@ void setup()
         {
             Serial.println("❌ EEPROM not detected! Implementing failsafe mechanism...");
 
-            // Check current running partition
-            const esp_partition_t *running = esp_ota_get_running_partition();
-            Serial.printf("Current running partition: %s\n", running->label);
-
-            // If running on ota_1, switch back to ota_0 and erase ota_1
-            if (running && strcmp(running->label, "ota_1") == 0)
-            {
-                Serial.println("Running on ota_1 with EEPROM failure - switching to ota_0...");
-
-                // Set boot partition to ota_0 (ESP_32_OTA bootloader)
-                const esp_partition_t *ota_0 = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
-                if (ota_0 != NULL)
-                {
-                    esp_err_t err = esp_ota_set_boot_partition(ota_0);
-                    if (err == ESP_OK)
-                    {
-                        Serial.println("✅ Boot partition set to ota_0 (ESP_32_OTA)");
-
-                        // Erase current partition (ota_1) to clean up
-                        Serial.println("🗑️ Erasing ota_1 partition...");
-                        err = esp_partition_erase_range(running, 0, running->size);
-                        if (err == ESP_OK)
-                        {
-                            Serial.println("✅ ota_1 partition erased successfully");
-                        }
-                        else
-                        {
-                            Serial.printf("❌ Failed to erase ota_1 partition: %s\n", esp_err_to_name(err));
-                        }
-
-                        Serial.println("🔄 Restarting to ESP_32_OTA bootloader...");
-                        delay(2000);
-                        ESP.restart();
-                    }
-                    else
-                    {
-                        Serial.printf("❌ Failed to set boot partition: %s\n", esp_err_to_name(err));
-                    }
-                }
-                else
-                {
-                    Serial.println("❌ ota_0 partition not found!");
-                }
-            }
-            else
-            {
-                Serial.println("Running on ota_0 - EEPROM failure handled by OTA bootloader");
-            }
-
-            // If we reach here, something went wrong - restart anyway
-            Serial.println("⚠️ Failsafe mechanism completed - restarting...");
-            delay(3000);
-            ESP.restart();
+            failsafeToOtaLoader("EEPROM failure");
         }
 
         sensorWasPresent = sensorDetected;
+        sensorPresence.begin(Wire, EEPROM_SENSOR_ADDR, SENSOR_TYPE_CODES, SENSOR_CHECK_INTERVAL,
+                             EEPROM_RETRY_COUNT, EEPROM_RETRY_DELAY, sensorType.c_str());
         Serial.printf("Detected sensor type: %s\n", sensorType.c_str());
 
         // Get device ID from MAC address
@@ -278,6 +224,7 @@ void cleanFirmwareAndBootOTA()
     // Disconnect MQTT gracefully
     if (mqttClient.connected())
     {
+        publishPresenceOffline();
         mqttClient.disconnect();
         Serial.println("MQTT disconnected");
     }
@@ -289,73 +236,10 @@ void cleanFirmwareAndBootOTA()
 
     delay(1000);
 
-    // Get the running partition
-    const esp_partition_t *running = esp_ota_get_running_partition();
-    Serial.printf("Current running partition: %s\n", running->label);
-
-    // Find the OTA boot partition (partition 0)
-    const esp_partition_t *ota_partition = esp_partition_find_first(
-        ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
-
-    if (ota_partition != NULL)
-    {
-        Serial.printf("Found OTA partition: %s\n", ota_partition->label);
-
-        // Set boot partition to OTA 0
-        if (esp_ota_set_boot_partition(ota_partition) == ESP_OK)
-        {
-            Serial.println("Boot partition set to OTA_0 successfully");
-
-            // Restart the ESP32 to boot into OTA partition
-            Serial.println("Restarting ESP32 to boot into OTA partition...");
-            delay(1000);
-            ESP.restart();
-        }
-        else
-        {
-            Serial.println("Failed to set boot partition to OTA_0");
-        }
-    }
-    else
-    {
-        Serial.println("OTA partition not found");
-    }
+    restartIntoOtaLoader(false);
 
     // If we get here, something went wrong - restart anyway
     Serial.println("Restarting ESP32 as fallback...");
     delay(1000);
     ESP.restart();
 }
-
-// ================= DYNAMIC IP IMPLEMENTATION =================
-
-bool connectWithDynamicIP() {
-    Serial.println("🔧 Connecting to WiFi using DHCP...");
-    return connectWithDHCP();
-}
-
-
-
-bool connectWithDHCP() {
-    Serial.println("🌐 Trying DHCP connection...");
-    
-    // Use DHCP (no static IP configuration)
-    WiFi.begin(ssid, password);
-    
-    Serial.print("Connecting via DHCP");
-    int attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 30) {
-        delay(500);
-        Serial.print(".");
-        attempts++;
-        yield(); // Feed watchdog
-    }
-    
-    if (WiFi.status() == WL_CONNECTED) {
-        Serial.printf("\n✅ DHCP connection successful. IP: %s\n", WiFi.localIP().toString().c_str());
-        return true;
-    }
-    
-    Serial.println("\n❌ DHCP connection failed");
-    return false;
-}
@@ -2,6 +2,9 @@
 #include "sensor_communication.h"
 #include "experiment_manager.h"
 #include "../../shared/nvs_mqtt_credentials.h"
+#include "mqtt_command_dispatch.h"
+#include "mqtt_heartbeat.h"
+#include "mqtt_presence.h"
 #include <Arduino.h>
 
 // MQTT client
@@ -16,6 +19,12 @@ extern uint16_t mqttPort;
 extern void cleanFirmwareAndBootOTA();
 bool mqttConnected = false;
 
+// Keys kept when parsing command payloads
+static StaticJsonDocument<MQTT_COMMAND_FILTER_SIZE> commandFilter;
+
+// Retained heartbeat rate limiter
+static MqttHeartbeat heartbeat;
+
 String formatTime(unsigned long milliseconds)
 {
     unsigned long totalSeconds = milliseconds / 1000;
@@ -32,7 +41,19 @@ void setupMQTT()
 {
     mqttClient.setServer(mqttBroker, mqttPort);
     mqttClient.setCallback(mqttCallback);
-    mqttClient.setBufferSize(512);
+    mqttClient.setKeepAlive(MQTT_KEEPALIVE_SECONDS); // PINGREQ handled by mqttClient.loop()
+    heartbeat.begin(sensorID.c_str());
+
+    commandFilter["command"] = true;
+    commandFilter["max_count"] = true;
+    commandFilter["maxCount"] = true;
+    commandFilter["count"] = true;
+    commandFilter["pendulum_length_cm"] = true;
+    commandFilter["pendulumLengthCm"] = true;
+    commandFilter["fleet_size"] = true;
+    if (commandFilter.overflowed()) {
+        Serial.println("ERROR: MQTT command filter full, config keys will be ignored");
+    }
 
     Serial.println("MQTT client configured");
 }
@@ -42,108 +63,112 @@ void reconnectMQTT()
     Serial.print("Attempting MQTT connection...");
 
     String clientId = "ESP32_OscCounter_" + sensorID;
-
-    if (mqttClient.connect(clientId.c_str()))
-    {
-        Serial.println("connected");
-        mqttConnected = true;
-
-        // Subscribe to config and command topics
-        char configTopic[50];
-        snprintf(configTopic, sizeof(configTopic), MQTT_CONFIG_TOPIC, sensorID.c_str());
-        mqttClient.subscribe(configTopic);
-        
-        char commandTopic[50];
-        snprintf(commandTopic, sizeof(commandTopic), MQTT_COMMAND_TOPIC, sensorID.c_str());
-        mqttClient.subscribe(commandTopic);
-
-        Serial.printf("Subscribed to: %s and %s\n", configTopic, commandTopic);
-
-        // Publish sensor identification
-        publishSensorIdentification();
-    }
-    else
+    if (!connectMqttSession(mqttClient, clientId.c_str(), sensorType.c_str(), sensorID.c_str()))
     {
         Serial.print("failed, rc=");
         Serial.print(mqttClient.state());
         Serial.println(" try again in 5 seconds");
         // Don't delay here - the timing is handled by mqttLoop()
+        return;
     }
+
+    Serial.println("connected");
+    mqttConnected = true;
+    static bool firstConnect = true;
+    if (firstConnect)
+    {
+        firstConnect = false;
+        Serial.printf("Boot to MQTT connected: %lu ms\n", millis());
+    }
+
+    // Replace the retained last-will with our online presence
+    publishSensorIdentification();
 }
 
-void mqttCallback(char *topic, byte *payload, unsigned int length)
+static void cmdStartExperiment(JsonVariantConst msg)
 {
-    Serial.printf("Message arrived [%s]\n", topic);
-
-    // Create a buffer for the payload
-    char message[length + 1];
-    memcpy(message, payload, length);
-    message[length] = '\0';
+    int count = 20;
+    if (!msg["max_count"].isNull()) {
+        count = msg["max_count"].as<int>();
+    } else if (!msg["maxCount"].isNull()) {
+        count = msg["maxCount"].as<int>();
+    } else if (!msg["count"].isNull()) {
+        count = msg["count"].as<int>();
+    }
 
-    Serial.printf("Received MQTT message: %s\n", message);
+    float lengthCm = 0.0f;
+    if (!msg["pendulum_length_cm"].isNull()) {
+        lengthCm = msg["pendulum_length_cm"].as<float>();
+    } else if (!msg["pendulumLengthCm"].isNull()) {
+        lengthCm = msg["pendulumLengthCm"].as<float>();
+    }
 
-    // Parse JSON message
-    DynamicJsonDocument doc(256);
-    DeserializationError error = deserializeJson(doc, message);
+    pendulumLengthCm = lengthCm;
 
-    if (error)
+    if (!experimentRunning)
     {
-        Serial.printf("JSON parse error: %s\n", error.c_str());
-        return;
+        startExperiment(count);
+        publishStatus("experiment_started");
     }
+}
 
-    // Handle command messages
-    if (doc.containsKey("command"))
-    {
-        const char *command = doc["command"];
+static void cmdStopExperiment(JsonVariantConst)
+{
+    stopExperiment();
+    publishStatus("experiment_stopped");
+}
 
-        if (strcmp(command, "start_experiment") == 0)
-        {
-        int count = 20;
-        if (doc.containsKey("max_count")) {
-            count = doc["max_count"].as<int>();
-        } else if (doc.containsKey("maxCount")) {
-            count = doc["maxCount"].as<int>();
-        } else if (doc.containsKey("count")) {
-            count = doc["count"].as<int>();
-        }
+static void cmdDisconnectDevice(JsonVariantConst)
+{
+    Serial.println("Disconnect command received - cleaning firmware and booting to OTA");
+    publishStatus("disconnecting", "Device disconnecting and booting to OTA");
 
-        float lengthCm = 0.0f;
-        if (doc.containsKey("pendulum_length_cm")) {
-            lengthCm = doc["pendulum_length_cm"].as<float>();
-        } else if (doc.containsKey("pendulumLengthCm")) {
-            lengthCm = doc["pendulumLengthCm"].as<float>();
-        }
+    delay(1000);
+    cleanFirmwareAndBootOTA();
+}
 
-        pendulumLengthCm = lengthCm;
+static void cmdStatus(JsonVariantConst)
+{
+    publishSensorIdentification();
+}
 
-        if (!experimentRunning)
-        {
-            startExperiment(count);
-            publishStatus("experiment_started");
-        }
-    }
-    else if (strcmp(command, "stop_experiment") == 0)
+static const MqttCommand<JsonVariantConst> kCommands[] = {
+    MQTT_COMMAND("start_experiment", cmdStartExperiment),
+    MQTT_COMMAND("stop_experiment", cmdStopExperiment),
+    MQTT_COMMAND("disconnect_device", cmdDisconnectDevice),
+    MQTT_COMMAND("status", cmdStatus),
+};
+
+void mqttCallback(char *topic, byte *payload, unsigned int length)
+{
+    MQTT_LOGF("Message arrived [%s] (%u bytes)\n", topic, length);
+
+    // Both config and command topics carry {"command": ...} messages
+    if (mqttTopicKind(topic) == MQTT_TOPIC_UNKNOWN)
     {
-        stopExperiment();
-        publishStatus("experiment_stopped");
+        return;
     }
-    else if (strcmp(command, "disconnect_device") == 0)
+
+    // Parse in place from the PubSubClient buffer into a stack document
+    StaticJsonDocument<MQTT_COMMAND_DOC_SIZE> doc;
+    DeserializationError error = deserializeJson(doc, (char *)payload, length,
+                                                 DeserializationOption::Filter(commandFilter));
+
+    if (error)
     {
-        Serial.println("Disconnect command received - cleaning firmware and booting to OTA");
-        publishStatus("disconnecting", "Device disconnecting and booting to OTA");
-        
-        delay(1000);
-        cleanFirmwareAndBootOTA();
+        MQTT_LOGF("JSON parse error: %s\n", error.c_str());
+        return;
     }
-    else if (strcmp(command, "status") == 0)
+
+    if (!doc["fleet_size"].isNull())
     {
-        publishSensorIdentification();
-    }
+        heartbeat.setFleetSize(doc["fleet_size"].as<uint16_t>());
     }
-    else
+
+    const char *command = doc["command"];
+    if (!mqttDispatch(kCommands, command, doc.as<JsonVariantConst>()))
     {
-        Serial.println("Ignored non-command message");
+        MQTT_LOGF("Ignored message without a known command\n");
     }
 }
 
@@ -237,6 +262,23 @@ void publishStatus(const char *status, const char *message)
     mqttClient.publish(statusTopic, payload.c_str());
 }
 
+static void publishPresence(bool online)
+{
+    char payload[MQTT_PRESENCE_MAX_SIZE];
+    String ip = WiFi.localIP().toString();
+    int len = formatMqttPresence(payload, sizeof(payload), sensorType.c_str(), sensorID.c_str(),
+                                 config.userPaired ? config.pairedUserID.c_str() : nullptr, online, ip.c_str());
+    if (len == 0)
+    {
+        return;
+    }
+
+    char statusTopic[50];
+    snprintf(statusTopic, sizeof(statusTopic), MQTT_STATUS_TOPIC, sensorID.c_str());
+
+    mqttClient.publish(statusTopic, (const uint8_t *)payload, len, true); // Retained presence record
+}
+
 void publishSensorIdentification()
 {
     if (!mqttClient.connected())
@@ -244,31 +286,47 @@ void publishSensorIdentification()
         return;
     }
 
-    // Create JSON payload
-    DynamicJsonDocument doc(256);
-    doc["type"] = "sensor_identify";
-    doc["sensor_id"] = sensorID;
-    doc["sensor_type"] = sensorType;
-    doc["ip_address"] = WiFi.localIP().toString();
+    publishPresence(true);
+    Serial.println("Published sensor presence via MQTT");
+}
 
-    String payload;
-    serializeJson(doc, payload);
+void publishPresenceOffline()
+{
+    if (!mqttClient.connected())
+    {
+        return;
+    }
 
-    // Publish to status topic
-    char statusTopic[50];
-    snprintf(statusTopic, sizeof(statusTopic), MQTT_STATUS_TOPIC, sensorID.c_str());
+    // Graceful DISCONNECT suppresses the last-will, so clear the retained record ourselves
+    publishPresence(false);
+}
 
-    mqttClient.publish(statusTopic, payload.c_str());
-    Serial.println("Published sensor identification via MQTT");
+void publishHeartbeat()
+{
+    if (!mqttClient.connected())
+    {
+        return;
+    }
+
+    // Oscillations are published as they complete, so nothing is ever queued
+    char payload[64];
+    int len = formatMqttHeartbeat(payload, sizeof(payload), millis(), WiFi.RSSI(), 0);
+    if (len == 0)
+    {
+        return;
+    }
+
+    char heartbeatTopic[50];
+    snprintf(heartbeatTopic, sizeof(heartbeatTopic), MQTT_HEARTBEAT_TOPIC, sensorID.c_str());
+
+    mqttClient.publish(heartbeatTopic, (const uint8_t *)payload, len, true); // Retained
 }
 
 // MQTT loop function to be called in main loop
 void mqttLoop()
 {
     static unsigned long lastReconnectAttempt = 0;
-    static unsigned long lastKeepalivePing = 0;
     const unsigned long reconnectInterval = 5000; // 5 seconds between reconnection attempts
-    const unsigned long keepaliveInterval = 15000; // Send ping every 15 seconds to maintain connection
     
     if (!mqttClient.connected())
     {
@@ -284,18 +342,14 @@ void mqttLoop()
     }
     else
     {
+        // Also sends PINGREQ when the keepalive interval elapses without traffic
         mqttClient.loop();
-        
-        // Send periodic keepalive ping to maintain connection
-        unsigned long now = millis();
-        if (now - lastKeepalivePing > keepaliveInterval)
+
+#if MQTT_HEARTBEAT_ENABLED
+        if (heartbeat.due(millis()))
         {
-            lastKeepalivePing = now;
-            
-            // Publish empty message to keep connection alive
-            char statusTopic[50];
-            snprintf(statusTopic, sizeof(statusTopic), MQTT_STATUS_TOPIC, sensorID.c_str());
-            mqttClient.publish(statusTopic, ""); // Empty payload ping
+            publishHeartbeat();
         }
+#endif
     }
 }
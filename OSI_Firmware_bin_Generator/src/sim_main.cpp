@@ -0,0 +1,164 @@
+// Host-native entry point ([env:native]): runs the firmware modules unchanged
+// against shared/native_hal, with a simulated light gate under a pendulum,
+// ID EEPROM and an in-process MQTT broker. Replaces main_sensor.cpp (WiFi
+// provisioning, LEDs, HTTP server) and config_handler.cpp (HTTP handlers).
+//
+//   .pio/build/native/program --count=10 [--period-ms=2000] [--cut-ms=40]
+//                             [--link-us=400] [--link-bps=250000] [--quiet] [--broker=host:port]
+#include <Arduino.h>
+#include <Wire.h>
+#include <WiFi.h>
+#include "native_hal.h"
+#include "sim_devices.h"
+
+#include "../include/sensor_communication.h"
+#include "../include/config_handler.h"
+#include "../include/experiment_manager.h"
+#include "../include/mqtt_handler.h"
+
+#define EEPROM_SDA 18
+#define EEPROM_SCL 19
+#define SIM_RUN_GRACE_MS 10000
+
+// Defined by main_sensor.cpp and config_handler.cpp on the board
+ExperimentConfig config;
+char mqttBroker[40] = "127.0.0.1";
+uint16_t mqttPort = 1883;
+
+static unsigned long optionValue(const char* name, unsigned long fallback) {
+    const char* value = simOption(name);
+    return (value && *value) ? strtoul(value, nullptr, 10) : fallback;
+}
+
+static bool fleetMode = false;
+
+// --broker=host:port joins a real broker instead (tools/fleet_sim); runs are then driven over MQTT
+static void useBrokerOption() {
+    const char* broker = simOption("broker");
+    if (!broker || !*broker) {
+        return;
+    }
+    const char* colon = strrchr(broker, ':');
+    int hostLen = colon ? (int)(colon - broker) : (int)strlen(broker);
+    snprintf(mqttBroker, sizeof(mqttBroker), "%.*s", hostLen, broker);
+    if (colon) {
+        mqttPort = (uint16_t)atoi(colon + 1);
+    }
+    simMqttUseNetwork(true);
+    fleetMode = true;
+}
+
+static SimEeprom24C02 idEeprom("OSI");
+static SimLDR* lightGate = nullptr; // Built in setup(), once the options are known
+
+static std::atomic<uint32_t> oscillationsPublished{0};
+static std::atomic<unsigned long> lastOscillationMs{0};
+static unsigned long runDeadline = 0;
+
+static void countPublish(const char* topic, const uint8_t* payload, unsigned int length, bool retained) {
+    (void)retained;
+    size_t topicLen = strlen(topic);
+    if (topicLen > 5 && strcmp(topic + topicLen - 5, "/data") == 0) {
+        std::string json((const char*)payload, length);
+        const char* field = strstr(json.c_str(), "\"reconnect_time_ms\":");
+        if (field) {
+            lastOscillationMs = strtoul(field + 20, nullptr, 10);
+        }
+        oscillationsPublished++;
+    }
+}
+
+void cleanFirmwareAndBootOTA() {
+    Serial.println("Cleaning firmware and booting to OTA partition...");
+    experimentRunning = false;
+    dataReady = false;
+    if (mqttClient.connected()) {
+        publishPresenceOffline();
+        mqttClient.disconnect();
+    }
+    ESP.restart();
+}
+
+static void finishRun(int status) {
+    SimMqttStats stats = simMqttStats();
+    uint32_t count = oscillationsPublished;
+    printf("\n[native] %d oscillations, simulated period %lu ms\n", targetOscillationCount,
+           optionValue("period-ms", 2000));
+    printf("[native] oscillations sent %u, mean period %.1f ms\n", count,
+           count ? (double)lastOscillationMs / count : 0.0);
+    printf("[native] MQTT publishes   %u ok, %u rejected, %llu payload bytes\n", stats.published, stats.rejected,
+           (unsigned long long)stats.publishedBytes);
+    printf("[native] publish time     %.1f us avg, %llu us total\n",
+           stats.published ? (double)stats.publishUs / stats.published : 0.0, (unsigned long long)stats.publishUs);
+    simExit(status);
+}
+
+void setup() {
+    Serial.begin(115200);
+    simSerialEcho(simOption("quiet") == nullptr);
+    Serial.println("\n=== OSI Firmware - native simulation ===");
+
+    idEeprom.attach(Wire);
+    lightGate = new SimLDR(SENSOR_PIN, optionValue("period-ms", 2000), optionValue("cut-ms", 40));
+    lightGate->attach();
+    simMqttSetLink(optionValue("link-us", 0), optionValue("link-bps", 0));
+    simMqttOnPublish(countPublish);
+
+    Wire.begin(EEPROM_SDA, EEPROM_SCL);
+    pinMode(SENSOR_PIN, INPUT);
+
+    WiFi.mode(WIFI_STA);
+    WiFi.begin("native", "");
+
+    if (!detectSensorFromEEPROM()) {
+        finishRun(1);
+    }
+    sensorWasPresent = true;
+    sensorPresence.begin(Wire, EEPROM_SENSOR_ADDR, SENSOR_TYPE_CODES, SENSOR_CHECK_INTERVAL,
+                         EEPROM_RETRY_COUNT, EEPROM_RETRY_DELAY, sensorType.c_str());
+
+    sensorID = getDeviceIDFromMAC();
+    useBrokerOption();
+    setupMQTT();
+    reconnectMQTT();
+    if (fleetMode) {
+        lightGate->release();
+        return;
+    }
+
+    // What the backend sends to start a run; the pendulum is let go with it
+    char topic[50];
+    char payload[96];
+    snprintf(topic, sizeof(topic), MQTT_COMMAND_TOPIC, sensorID.c_str());
+    snprintf(payload, sizeof(payload), "{\"command\":\"start_experiment\",\"max_count\":%lu}",
+             optionValue("count", 10));
+    simMqttInject(topic, payload);
+    lightGate->release();
+}
+
+void loop() {
+    static bool runStarted = false;
+
+    checkSensorStatus();
+    handleBackendCleanup();
+    mqttLoop();
+    manageExperimentLoop();
+
+    if (fleetMode) {
+        delay(1);
+        return;
+    }
+    if (experimentRunning && !runStarted) {
+        runStarted = true;
+        runDeadline = millis() + (targetOscillationCount + 1) * optionValue("period-ms", 2000) + SIM_RUN_GRACE_MS;
+    }
+    if (runStarted && !experimentRunning) {
+        finishRun(0);
+    }
+    if (runStarted && (long)(millis() - runDeadline) > 0) {
+        printf("[native] run did not complete in time\n");
+        finishRun(1);
+    }
+
+    delay(1);
+}
@@ -13,6 +13,7 @@ struct ExperimentConfig {
     int duration = 0;             // seconds (0 = infinite/manual stop)
     String pairedUserID = "";     // User ID this sensor is paired with
     bool userPaired = false;      // Whether sensor is currently paired with a user
+    bool resumeRuns = false;      // Continue a run interrupted by a reset (run_persistence.h)
 };
 
 // HTTP request handlers
@@ -2,6 +2,8 @@
 #define EXPERIMENT_MANAGER_H
 
 #include <Arduino.h>
+#include <ArduinoJson.h>
+#include "mqtt_command_dispatch.h"
 
 // Experiment state variables
 extern bool experimentRunning;
@@ -23,4 +25,13 @@ void handleBackendCleanup();
 // Helper to get expected time for resolutions
 unsigned long getExpectedTime(int resolution);
 
+// Config and run progress kept in NVS
+void loadPersistedState();
+void saveConfig();
+void resumeInterruptedRun();
+
+// Config and command topics (experiment_runtime.h)
+void addExperimentFilterKeys(JsonDocument& filter);
+void handleExperimentMessage(MqttTopicKind kind, JsonVariantConst msg);
+
 #endif
@@ -17,6 +17,13 @@ extern uint16_t mqttPort;
 #define MQTT_CONFIG_TOPIC "sensors/%s/config"
 #define MQTT_COMMAND_TOPIC "sensors/%s/command"
 
+// Fixed parse buffers for incoming config/command payloads, sized by key count:
+// a slot is 16 bytes on the ESP32 but 32 on a 64-bit native build.
+// MQTT_COMMAND_KEYS must match the keys setupMQTT() puts in the filter.
+#define MQTT_COMMAND_KEYS 5
+#define MQTT_COMMAND_FILTER_SIZE JSON_OBJECT_SIZE(MQTT_COMMAND_KEYS)
+#define MQTT_COMMAND_DOC_SIZE (2 * MQTT_COMMAND_FILTER_SIZE) // Room for a nested value
+
 // Defines for data
 struct SensorDataPacket {
     float celsius;
@@ -33,7 +40,10 @@ void reconnectMQTT();
 void mqttCallback(char* topic, byte* payload, unsigned int length);
 void publishSensorData(const SensorDataPacket* data);
 void publishStatus(const char* status, const char* message = nullptr);
+void publishStatusJson(const char* json, size_t length); // Preformatted record, e.g. run_resumed
 void publishSensorIdentification();
+void publishPresenceOffline();
+void publishHeartbeat();
 void handleMQTTCommands(char* topic, byte* payload, unsigned int length);
 void mqttLoop();
 
@@ -4,6 +4,8 @@
 #include <Arduino.h>
 #include <OneWire.h>
 #include <DallasTemperature.h>
+#include "sensor_runtime.h"
+#include "sensor_traits.h"
 
 // Pin Configuration
 #define ONE_WIRE_BUS 23   // User specified pin 23
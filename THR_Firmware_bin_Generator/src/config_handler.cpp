@@ -1,4 +1,6 @@
 #include <Update.h>
+#include "ota_inflate.h"
+#include "ota_verify.h"
 #include "../include/config_handler.h"
 #include "../include/experiment_manager.h"
 #include "../include/mqtt_handler.h"
@@ -26,11 +28,16 @@ void handleConfigure(AsyncWebServerRequest *request) {
     if (request->hasParam("duration")) {
         config.duration = request->getParam("duration")->value().toInt();
     }
+    if (request->hasParam("resume")) {
+        config.resumeRuns = request->getParam("resume")->value() == "true";
+    }
+    saveConfig();
     
     // Create response
     DynamicJsonDocument doc(256);
     doc["resolution"] = config.resolution;
     doc["duration"] = config.duration;
+    doc["resume"] = config.resumeRuns;
     
     String response;
     serializeJson(doc, response);
@@ -62,21 +69,48 @@ void handleUpdate(AsyncWebServerRequest *request) {
     ESP.restart();
 }
 
+// Decompressed (or raw) image bytes from the upload are hashed and go straight to flash
+static OtaInflater updateInflater;
+static OtaImageVerifier updateVerifier;
+
+static bool writeUpdate(const uint8_t *data, size_t len, void *) {
+    updateVerifier.update(data, len);
+    return Update.write((uint8_t *)data, len) == len;
+}
+
+static const char *updateHeader(AsyncWebServerRequest *request, const char *name) {
+    AsyncWebHeader *header = request->getHeader(name);
+    return header ? header->value().c_str() : nullptr;
+}
+
 void handleUpdateUpload(AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final) {
     if (!index) {
         Serial.printf("Update Params: %s\n", filename.c_str());
         if (!Update.begin(UPDATE_SIZE_UNKNOWN, U_FLASH)) {
             Update.printError(Serial);
         }
+        updateInflater.begin(writeUpdate, nullptr);
+        // Optional SHA-256 of firmware.bin (and Ed25519 signature when the build requires one)
+        if (!updateVerifier.begin(updateHeader(request, "X-Firmware-SHA256"),
+                                  updateHeader(request, "X-Firmware-Signature"))) {
+            Serial.printf("Update rejected: %s\n", updateVerifier.error());
+            Update.abort();
+        }
     }
-    if (Update.write(data, len) != len) {
+    if (!Update.hasError() && !updateInflater.write(data, len)) {
+        Serial.printf("Update decode failed: %s\n", updateInflater.error());
         Update.printError(Serial);
+        Update.abort();
     }
     if (final) {
-        if (Update.end(true)) {
-            Serial.printf("Update Success: %uB\n", index + len);
+        if (updateInflater.finish() && updateVerifier.finish() && Update.end(true)) {
+            Serial.printf("Update Success: %uB received, %uB written, hash %ums\n", index + len,
+                          updateInflater.outputBytes(), updateVerifier.hashMicros() / 1000);
         } else {
+            const char *error = updateInflater.error() ? updateInflater.error() : updateVerifier.error();
+            Serial.printf("Update failed: %s\n", error ? error : "flash");
             Update.printError(Serial);
+            Update.abort();
         }
     }
 }
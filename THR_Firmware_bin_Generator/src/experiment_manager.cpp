@@ -2,6 +2,7 @@
 #include "../include/sensor_communication.h"
 #include "../include/mqtt_handler.h"
 #include "../include/config_handler.h"
+#include "experiment_runtime.h"
 #include <esp_partition.h>
 #include <esp_ota_ops.h>
 
@@ -36,12 +37,111 @@ unsigned long getExpectedTime(int resolution) {
     }
 }
 
+// Config as kept in NVS; 4-byte fields only, so no padding
+struct StoredConfig {
+    int32_t resolution;
+    int32_t duration;
+    uint32_t resumeRuns;
+};
+
+// Commands, config persistence and run resume from the shared runtime
+class ThrExperiment : public ExperimentRuntime<ThrExperiment, StoredConfig> {
+public:
+    ThrExperiment() : ExperimentRuntime(ThrTraits::typeId) {}
+
+    ExperimentConfig& settings() { return config; }
+
+    void addConfigKeys(JsonDocument& filter) { filter["resolution"] = true; }
+
+    void applyConfig(JsonVariantConst msg) {
+        if (!msg["resolution"].isNull()) {
+            int res = msg["resolution"];
+            if (res >= 9 && res <= 12) {
+                config.resolution = res;
+                setSensorResolution(res);
+            }
+        }
+    }
+
+    void storeConfig(StoredConfig& stored) {
+        stored.resolution = config.resolution;
+        stored.duration = config.duration;
+        stored.resumeRuns = config.resumeRuns;
+    }
+
+    // Called after the sensor is up
+    void restoreConfig(StoredConfig& stored) {
+        config.resolution = stored.resolution;
+        config.duration = stored.duration;
+        config.resumeRuns = stored.resumeRuns != 0;
+        setSensorResolution(config.resolution);
+    }
+
+    bool running() const { return experimentRunning; }
+    bool resumable() const { return config.resumeRuns; }
+    uint32_t lastSample() const { return readingCount; }
+    uint32_t elapsedMs() const { return millis() - experimentStartTime; }
+
+    // At most one reading per conversion + cooldown
+    uint32_t samplesPerCheckpoint() const {
+        return RUN_CHECKPOINT_INTERVAL_MS / (getExpectedTime(config.resolution) + 100) + 1;
+    }
+
+    uint32_t sampleLimit() const { return 0; } // Readings are published as taken, nothing is buffered
+
+    void beginRun(uint32_t firstReading, uint32_t elapsed) {
+        readingCount = firstReading - 1;
+        experimentStartTime = millis() - elapsed;
+        measureState = STATE_IDLE;
+        dataReady = false;
+        experimentRunning = true;
+    }
+
+    bool stopRun() {
+        experimentRunning = false;
+        dataReady = true;
+        return true;
+    }
+
+    void pauseRun() { experimentRunning = false; }
+    void continueRun() { experimentRunning = true; } // manageExperimentLoop() restarts from STATE_IDLE
+
+    void publishStatus(const char* status, const char* message) { ::publishStatus(status, message); }
+    void publishStatusJson(const char* json, size_t length) { ::publishStatusJson(json, length); }
+    const char* sensorId() const { return sensorID.c_str(); }
+    void disconnect() { cleanFirmwareAndBootOTA(); }
+};
+
+static ThrExperiment experiment;
+
+void loadPersistedState() {
+    experiment.loadPersistedState();
+}
+
+void saveConfig() {
+    experiment.saveConfig();
+}
+
+void resumeInterruptedRun() {
+    experiment.resumeInterruptedRun();
+}
+
+void addExperimentFilterKeys(JsonDocument& filter) {
+    experiment.addFilterKeys(filter);
+}
+
+void handleExperimentMessage(MqttTopicKind kind, JsonVariantConst msg) {
+    experiment.handleMessage(kind, msg);
+}
+
 void manageExperimentLoop() {
     // Handle Backend Cleanup
     handleBackendCleanup();
     
     // Check Sensor Status
     checkSensorStatus();
+
+    experiment.checkpointRun();
     
     if (!experimentRunning) {
         measureState = STATE_IDLE;
@@ -75,7 +175,8 @@ void manageExperimentLoop() {
                  unsigned long processStart = millis();
                  
                  float celsius = sensors.getTempC(sensorAddress);
-                 if (celsius == DEVICE_DISCONNECTED_C) {
+                 // Also rejects DEVICE_DISCONNECTED_C (-127), which is below the DS18B20 range
+                 if (!ThrTraits::inRange(celsius)) {
                      Serial.println("Error: Sensor read failed");
                      // Maybe retry or just skip?
                      measureState = STATE_IDLE; // Try again
@@ -43,8 +43,6 @@ uint16_t mqttPort = 1883;
 char backendMAC[18] = "";
 
 // Function Prototypes
-bool connectWithDHCP();
-
 void cleanFirmwareAndBootOTA();
 
 void setup() {
@@ -81,10 +79,17 @@ void setup() {
     if (!initializeTHRSensor()) {
         Serial.println("Warning: DS18B20 not found on boot.");
     }
+
+    // Config from before the last reset, if any
+    loadPersistedState();
     
     // 3. Connect WiFi
     WiFi.mode(WIFI_STA);
-    if (connectWithDHCP()) {
+    unsigned long wifiStart = millis();
+    // Cached access point first, then a full DHCP connect (10 s budget, as before)
+    bool wifiConnected = connectSensorWiFi(ssid, password, 10000);
+    if (wifiConnected) {
+        Serial.printf("WiFi connect took %lu ms\n", millis() - wifiStart);
         Serial.printf("WiFi Connected: %s\n", WiFi.localIP().toString().c_str());
         wifiLed.set(LedController::BLINK_SLOW); // Connected
         
@@ -154,14 +159,3 @@ void loop() {
     
     yield();
 }
-
-bool connectWithDHCP() {
-    WiFi.begin(ssid, password);
-    int attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 20) {
-        delay(500);
-        Serial.print(".");
-        attempts++;
-    }
-    return (WiFi.status() == WL_CONNECTED);
-}
@@ -2,6 +2,9 @@
 #include "../include/config_handler.h"
 #include "../include/experiment_manager.h"
 #include "../include/sensor_communication.h"
+#include "mqtt_command_dispatch.h"
+#include "mqtt_heartbeat.h"
+#include "mqtt_presence.h"
 #include <esp_ota_ops.h>
 
 WiFiClient wifiClient;
@@ -12,33 +15,43 @@ bool mqttConnected = false;
 extern char mqttBroker[40];
 extern uint16_t mqttPort;
 
+// Keys kept when parsing config/command payloads
+static StaticJsonDocument<MQTT_COMMAND_FILTER_SIZE> commandFilter;
+
+// Retained heartbeat rate limiter
+static MqttHeartbeat heartbeat;
+
 void setupMQTT() {
     mqttClient.setServer(mqttBroker, mqttPort);
     mqttClient.setCallback(mqttCallback);
+    mqttClient.setKeepAlive(MQTT_KEEPALIVE_SECONDS); // PINGREQ handled by mqttClient.loop()
+    heartbeat.begin(sensorID.c_str());
+
+    addExperimentFilterKeys(commandFilter);
+    commandFilter["fleet_size"] = true;
+    if (commandFilter.overflowed()) {
+        Serial.println("ERROR: MQTT command filter full, config keys will be ignored");
+    }
 }
 
 void reconnectMQTT() {
-    if (!mqttClient.connected()) {
-        String clientId = "ESP32_" + sensorID;
-        if (mqttClient.connect(clientId.c_str())) {
-            Serial.println("MQTT Connected");
-            mqttConnected = true;
-            
-            char configTopic[50];
-            snprintf(configTopic, sizeof(configTopic), MQTT_CONFIG_TOPIC, sensorID.c_str());
-            mqttClient.subscribe(configTopic, 1);
-            
-            char commandTopic[50];
-            snprintf(commandTopic, sizeof(commandTopic), MQTT_COMMAND_TOPIC, sensorID.c_str());
-            mqttClient.subscribe(commandTopic, 1);
-            
-            publishSensorIdentification();
-            
-        } else {
-            // Serial.print("failed, rc=");
-            // Serial.print(mqttClient.state());
-        }
+    if (mqttClient.connected()) return;
+
+    String clientId = "ESP32_" + sensorID;
+    if (!connectMqttSession(mqttClient, clientId.c_str(), "THR", sensorID.c_str())) return;
+
+    Serial.println("MQTT Connected");
+    mqttConnected = true;
+    static bool firstConnect = true;
+    if (firstConnect) {
+        firstConnect = false;
+        Serial.printf("Boot to MQTT connected: %lu ms\n", millis());
     }
+
+    publishSensorIdentification();
+
+    // Continue a run the last reset interrupted (resume mode)
+    resumeInterruptedRun();
 }
 
 void mqttCallback(char* topic, byte* payload, unsigned int length) {
@@ -46,42 +59,21 @@ void mqttCallback(char* topic, byte* payload, unsigned int length) {
 }
 
 void handleMQTTCommands(char* topic, byte* payload, unsigned int length) {
-    char message[length + 1];
-    memcpy(message, payload, length);
-    message[length] = '\0';
-    
-    DynamicJsonDocument doc(512);
-    deserializeJson(doc, message);
-    
-    String topicStr = String(topic);
-    
-    if (topicStr.endsWith("/config")) {
-        if (doc.containsKey("resolution")) {
-            int res = doc["resolution"];
-            if (res >= 9 && res <= 12) {
-                config.resolution = res;
-                setSensorResolution(res);
-            }
-        }
-        if (doc.containsKey("duration")) {
-            config.duration = doc["duration"];
-        }
-        publishStatus("config_updated");
-    } else if (topicStr.endsWith("/command")) {
-        const char* cmd = doc["command"];
-        if (strcmp(cmd, "start_experiment") == 0) {
-            experimentRunning = true;
-            experimentStartTime = millis();
-            readingCount = 0;
-            publishStatus("experiment_started");
-        } else if (strcmp(cmd, "stop_experiment") == 0) {
-            experimentRunning = false;
-            dataReady = true;
-            publishStatus("experiment_stopped");
-        } else if (strcmp(cmd, "disconnect_device") == 0) {
-            cleanFirmwareAndBootOTA();
-        }
+    MqttTopicKind kind = mqttTopicKind(topic);
+    if (kind == MQTT_TOPIC_UNKNOWN) return;
+
+    StaticJsonDocument<MQTT_COMMAND_DOC_SIZE> doc;
+    if (deserializeJson(doc, (char*)payload, length, DeserializationOption::Filter(commandFilter))) {
+        MQTT_LOGF("JSON parse error on %s\n", topic);
+        return;
+    }
+
+    // The heartbeat lives here; everything else is the experiment runtime's
+    if (kind == MQTT_TOPIC_CONFIG && !doc["fleet_size"].isNull()) {
+        heartbeat.setFleetSize(doc["fleet_size"].as<uint16_t>());
     }
+
+    handleExperimentMessage(kind, doc.as<JsonVariantConst>());
 }
 
 void publishSensorData(const SensorDataPacket* data) {
@@ -119,22 +111,47 @@ void publishStatus(const char* status, const char* message) {
     mqttClient.publish(statusTopic, payload.c_str());
 }
 
-void publishSensorIdentification() {
+void publishStatusJson(const char* json, size_t length) {
     if (!mqttClient.connected()) return;
-    
-    DynamicJsonDocument doc(256);
-    doc["type"] = "sensor_identify";
-    doc["sensor_id"] = sensorID;
-    doc["sensor_type"] = "THR"; // Force THR as type
-    doc["paired"] = config.userPaired;
-    doc["paired_user"] = config.pairedUserID;
-    
-    String payload;
-    serializeJson(doc, payload);
-    
+
     char statusTopic[50];
     snprintf(statusTopic, sizeof(statusTopic), MQTT_STATUS_TOPIC, sensorID.c_str());
-    mqttClient.publish(statusTopic, payload.c_str());
+    mqttClient.publish(statusTopic, (const uint8_t*)json, length);
+}
+
+static void publishPresence(bool online) {
+    char payload[MQTT_PRESENCE_MAX_SIZE];
+    int len = formatMqttPresence(payload, sizeof(payload), "THR", sensorID.c_str(), // Force THR as type
+                                 config.userPaired ? config.pairedUserID.c_str() : nullptr, online);
+    if (len == 0) return;
+
+    char statusTopic[50];
+    snprintf(statusTopic, sizeof(statusTopic), MQTT_STATUS_TOPIC, sensorID.c_str());
+    mqttClient.publish(statusTopic, (const uint8_t*)payload, len, true); // Retained presence record
+}
+
+void publishSensorIdentification() {
+    if (!mqttClient.connected()) return;
+    publishPresence(true);
+}
+
+void publishPresenceOffline() {
+    if (!mqttClient.connected()) return;
+    // Graceful DISCONNECT suppresses the last-will, so clear the retained record ourselves
+    publishPresence(false);
+}
+
+void publishHeartbeat() {
+    if (!mqttClient.connected()) return;
+
+    // Readings are published as they are taken, so nothing is ever queued
+    char payload[64];
+    int len = formatMqttHeartbeat(payload, sizeof(payload), millis(), WiFi.RSSI(), 0);
+    if (len == 0) return;
+
+    char heartbeatTopic[50];
+    snprintf(heartbeatTopic, sizeof(heartbeatTopic), MQTT_HEARTBEAT_TOPIC, sensorID.c_str());
+    mqttClient.publish(heartbeatTopic, (const uint8_t*)payload, len, true);
 }
 
 void mqttLoop() {
@@ -146,14 +163,17 @@ void mqttLoop() {
         }
     } else {
         mqttClient.loop();
+#if MQTT_HEARTBEAT_ENABLED
+        if (heartbeat.due(millis())) publishHeartbeat();
+#endif
     }
 }
 
 void cleanFirmwareAndBootOTA() {
-    // Similar logic to TOF to boot back to ota_0
-    const esp_partition_t *ota_0 = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
-    if (ota_0) {
-        esp_ota_set_boot_partition(ota_0);
-        ESP.restart();
+    if (mqttClient.connected()) {
+        publishPresenceOffline();
+        mqttClient.disconnect();
     }
+
+    restartIntoOtaLoader(false);
 }
@@ -0,0 +1,151 @@
+// Host-native entry point ([env:native]): runs the firmware modules unchanged
+// against shared/native_hal, with a simulated DS18B20, ID EEPROM and an
+// in-process MQTT broker. Replaces main.cpp (WiFi provisioning, LEDs, HTTP
+// server) and config_handler.cpp (HTTP handlers).
+//
+//   .pio/build/native/program --duration=10 [--resolution=10]
+//                             [--link-us=400] [--link-bps=250000] [--quiet] [--broker=host:port] [--resume]
+//
+// With SIM_NVS_FILE set, config and run progress survive the process; --resume turns on
+// resume mode, so a run killed mid-way continues in the next process instead of restarting.
+#include <Arduino.h>
+#include <Wire.h>
+#include <WiFi.h>
+#include "native_hal.h"
+#include "sim_devices.h"
+
+#include "../include/sensor_communication.h"
+#include "../include/config_handler.h"
+#include "../include/experiment_manager.h"
+#include "../include/mqtt_handler.h"
+
+#define SIM_RUN_GRACE_MS 10000
+
+// Defined by main.cpp and config_handler.cpp on the board
+ExperimentConfig config;
+char mqttBroker[40] = "127.0.0.1";
+uint16_t mqttPort = 1883;
+
+// Water bath drifting 22..28 C over a minute, +-0.1 C noise
+static SimEeprom24C02 idEeprom("THR");
+static SimDS18B20 thermometer(ONE_WIRE_BUS, SimSignal{25.0f, 3.0f, 60000, 0.2f});
+
+static std::atomic<uint32_t> readingsPublished{0};
+static unsigned long runDeadline = 0;
+static bool fleetMode = false;
+
+static unsigned long optionValue(const char* name, unsigned long fallback) {
+    const char* value = simOption(name);
+    return (value && *value) ? strtoul(value, nullptr, 10) : fallback;
+}
+
+// --broker=host:port joins a real broker instead (tools/fleet_sim); runs are then driven over MQTT
+static void useBrokerOption() {
+    const char* broker = simOption("broker");
+    if (!broker || !*broker) {
+        return;
+    }
+    const char* colon = strrchr(broker, ':');
+    int hostLen = colon ? (int)(colon - broker) : (int)strlen(broker);
+    snprintf(mqttBroker, sizeof(mqttBroker), "%.*s", hostLen, broker);
+    if (colon) {
+        mqttPort = (uint16_t)atoi(colon + 1);
+    }
+    simMqttUseNetwork(true);
+    fleetMode = true;
+}
+
+static void countPublish(const char* topic, const uint8_t* payload, unsigned int length, bool retained) {
+    (void)payload;
+    (void)length;
+    (void)retained;
+    size_t topicLen = strlen(topic);
+    if (topicLen > 5 && strcmp(topic + topicLen - 5, "/data") == 0) {
+        readingsPublished++;
+    }
+}
+
+static void finishRun(int status) {
+    SimMqttStats stats = simMqttStats();
+    unsigned long conversionMs = getExpectedTime(config.resolution);
+    printf("\n[native] %d-bit x %d s, %lu ms conversion + 100 ms cooldown\n", config.resolution, config.duration,
+           conversionMs);
+    printf("[native] readings         %d (ideal %lu)\n", readingCount,
+           config.duration * 1000UL / (conversionMs + 100));
+    printf("[native] readings sent    %u\n", readingsPublished.load());
+    printf("[native] MQTT publishes   %u ok, %u rejected, %llu payload bytes\n", stats.published, stats.rejected,
+           (unsigned long long)stats.publishedBytes);
+    printf("[native] publish time     %.1f us avg, %llu us total\n",
+           stats.published ? (double)stats.publishUs / stats.published : 0.0, (unsigned long long)stats.publishUs);
+    simExit(status);
+}
+
+void setup() {
+    Serial.begin(115200);
+    simSerialEcho(simOption("quiet") == nullptr);
+    Serial.println("\n=== THR Firmware (DS18B20) - native simulation ===");
+
+    idEeprom.attach(Wire);
+    thermometer.attach();
+    simMqttSetLink(optionValue("link-us", 0), optionValue("link-bps", 0));
+    simMqttOnPublish(countPublish);
+
+    Wire.begin(EEPROM_SDA, EEPROM_SCL);
+
+    if (!initializeTHRSensor()) {
+        Serial.println("Warning: DS18B20 not found on boot.");
+    }
+    loadPersistedState();
+
+    WiFi.mode(WIFI_STA);
+    WiFi.begin("native", "");
+
+    if (!detectSensorFromEEPROM()) {
+        finishRun(1);
+    }
+    sensorWasPresent = true;
+
+    sensorID = getDeviceIDFromMAC();
+    useBrokerOption();
+    setupMQTT();
+    reconnectMQTT();
+    if (fleetMode || experimentRunning) {
+        return; // Driven over MQTT, or resumed an interrupted run on connect
+    }
+
+    // What the backend sends to start a run
+    char topic[50];
+    char payload[80];
+    snprintf(topic, sizeof(topic), MQTT_CONFIG_TOPIC, sensorID.c_str());
+    snprintf(payload, sizeof(payload), "{\"resolution\":%lu,\"duration\":%lu,\"resume\":%s}",
+             optionValue("resolution", config.resolution), optionValue("duration", 10),
+             simOption("resume") ? "true" : "false");
+    simMqttInject(topic, payload);
+    snprintf(topic, sizeof(topic), MQTT_COMMAND_TOPIC, sensorID.c_str());
+    simMqttInject(topic, "{\"command\":\"start_experiment\"}");
+}
+
+void loop() {
+    static bool runStarted = false;
+
+    mqttLoop();
+    manageExperimentLoop();
+
+    if (fleetMode) {
+        delay(1);
+        return;
+    }
+    if (experimentRunning && !runStarted) {
+        runStarted = true;
+        runDeadline = millis() + config.duration * 1000UL + SIM_RUN_GRACE_MS;
+    }
+    if (runStarted && !experimentRunning) {
+        finishRun(0);
+    }
+    if (runStarted && (long)(millis() - runDeadline) > 0) {
+        printf("[native] run did not complete in time\n");
+        finishRun(1);
+    }
+
+    delay(1);
+}
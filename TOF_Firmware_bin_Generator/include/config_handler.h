@@ -15,13 +15,17 @@ struct ExperimentConfig {
     String mode = "medium";       // Default to medium for 30Hz
     bool configured = false;
     int averagingSamples = 1;
+    int latencyTargetMs = 200;    // Adaptive batching: max buffered-to-published delay
+    bool bulkUpload = false;      // Send the whole run at the end instead of streaming
     String pairedUserID = "";     // User ID this sensor is paired with
     bool userPaired = false;      // Whether sensor is currently paired with a user
     float motorAngle = 0;         // Motor Target Angle
+    bool resumeRuns = false;      // Continue a run interrupted by a reset (run_persistence.h)
 };
 
 // HTTP request handlers
 void handleStatus(AsyncWebServerRequest *request);
+void handleMetrics(AsyncWebServerRequest *request);
 void handleConfigure(AsyncWebServerRequest *request);
 void handleCalibrate(AsyncWebServerRequest *request);
 void handleStart(AsyncWebServerRequest *request);
@@ -31,7 +31,6 @@ public:
     // Safety & Calibration
     void executeSafeShutdown(); // Drives to MIN then signals readiness for reboot
     bool isShutdownComplete() const { return state == SHUTDOWN_COMPLETE; }
-    void checkLimits();
     
     // Status
     bool isIdle() const { return state == IDLE; }
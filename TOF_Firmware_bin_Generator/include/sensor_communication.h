@@ -3,6 +3,11 @@
 
 #include <Arduino.h>
 #include <Wire.h>
+#include "eeprom_presence.h"
+#include "sensor_runtime.h"
+#include "sensor_traits.h"
+#include "boot_trace.h"
+#include "runtime_metrics.h"
 #include <VL53L1X.h>
 
 // External declarations
@@ -22,6 +27,7 @@ extern VL53L1X tofSensor;
 #define EEPROM_SIZE 3
 #define EEPROM_RETRY_COUNT 3
 #define EEPROM_RETRY_DELAY 1000
+#define SENSOR_TYPE_CODES "TOF" // Accepted 3-byte EEPROM codes, back to back
 
 // Frequency configuration
 #define DEFAULT_FREQUENCY 30
@@ -43,6 +49,10 @@ struct DiagnosticStats {
     uint32_t readErrors = 0;
     uint32_t timeouts = 0;
     uint32_t outOfRange = 0;
+    uint32_t publishFailures = 0;
+    uint32_t wifiConnectMs = 0;   // WiFi.begin() to connected, this boot
+    uint32_t bootToMqttMs = 0;    // Boot to first MQTT connect
+    uint32_t bootToFirstSampleMs = 0; // Boot to first sample stored
 };
 
 // Function declarations
@@ -59,6 +69,9 @@ bool setSensorTiming(int frequency);
 extern VL53L1X tofSensor;
 extern SensorCalibration calibration;
 extern DiagnosticStats diagnostics;
+extern RuntimeMetrics metrics;
+extern EepromPresence sensorPresence;
+extern BootTrace bootTrace;
 extern String sensorType;
 extern String sensorID;
 
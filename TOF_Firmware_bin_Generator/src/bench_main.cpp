@@ -0,0 +1,220 @@
+// Microbenchmarks ([env:bench] on the host, [env:esp32dev_bench] on the board)
+// for the per-message paths: binary sample framing, status JSON, inbound
+// command parsing and OTA hex decoding. Replaces main_sensor.cpp; the
+// firmware modules are linked unchanged.
+//
+// The MQTT client is connected but costs nothing beyond the firmware's own
+// work: on the host it publishes into the native_hal broker with no link
+// delay, on the board into BenchSinkClient, which accepts the CONNECT and
+// discards every write, so PubSubClient framing is included.
+//
+//   .pio/build/bench/program [--filter=publishStatus] [--baseline=bench/baseline_native.txt]
+//   pio run -e esp32dev_bench -t upload && pio device monitor
+#include <Arduino.h>
+#include <WiFi.h>
+#ifndef ARDUINO_ARCH_ESP32
+#include "native_hal.h"
+#endif
+#include "microbench.h"
+#include "hex_bytes.h"
+
+#include "../include/sensor_communication.h"
+#include "../include/config_handler.h"
+#include "../include/experiment_manager.h"
+#include "../include/mqtt_handler.h"
+
+// Defined by main_sensor.cpp and config_handler.cpp on the board
+ExperimentConfig config;
+char mqttBroker[40] = "127.0.0.1";
+uint16_t mqttPort = 1883;
+
+void cleanFirmwareAndBootOTA() {
+    // disconnect_device is not benchmarked
+}
+
+#ifdef ARDUINO_ARCH_ESP32
+class BenchSinkClient : public Client {
+public:
+    int connect(IPAddress, uint16_t) override { return open(); }
+    int connect(const char*, uint16_t) override { return open(); }
+    size_t write(uint8_t) override { return 1; }
+    size_t write(const uint8_t*, size_t size) override { return size; }
+    int available() override { return _open ? (int)(sizeof(kConnack) - _rxPos) : 0; }
+    int read() override { return available() ? kConnack[_rxPos++] : -1; }
+    int read(uint8_t* buf, size_t size) override {
+        size_t n = 0;
+        while (n < size && available()) {
+            buf[n++] = kConnack[_rxPos++];
+        }
+        return (int)n;
+    }
+    int peek() override { return available() ? kConnack[_rxPos] : -1; }
+    void flush() override {}
+    void stop() override { _open = false; }
+    uint8_t connected() override { return _open; }
+    operator bool() override { return _open; }
+
+private:
+    static constexpr uint8_t kConnack[4] = {0x20, 0x02, 0x00, 0x00}; // Session accepted
+    int open() {
+        _open = true;
+        _rxPos = 0;
+        return 1;
+    }
+    bool _open = false;
+    size_t _rxPos = 0;
+};
+constexpr uint8_t BenchSinkClient::kConnack[4];
+
+static BenchSinkClient sinkClient;
+#endif
+
+static BinarySample samples[BINARY_MAX_SAMPLES_PER_PACKET];
+
+static bool requireConnection(MicroBench::State& state) {
+    if (!mqttClient.connected()) {
+        state.skip("MQTT not connected");
+        return false;
+    }
+    return true;
+}
+
+// One packet per latency-target flush; 1 is the worst per-sample case, the last a full packet
+static void BM_publishBinarySensorData(MicroBench::State& state) {
+    if (!requireConnection(state)) {
+        return;
+    }
+    uint16_t count = (uint16_t)state.arg();
+    for (uint16_t i = 0; i < count; i++) {
+        samples[i] = {i * 20u, (uint16_t)(400 + i % 400), i};
+    }
+    while (state.keepRunning()) {
+        publishBinarySensorData(samples, count, 0, count);
+    }
+    state.setBytesProcessed(BINARY_HEADER_SIZE + count * sizeof(BinarySample));
+}
+MICROBENCH_ARG(BM_publishBinarySensorData, 1);
+MICROBENCH_ARG(BM_publishBinarySensorData, 10);
+MICROBENCH_ARG(BM_publishBinarySensorData, BINARY_MAX_SAMPLES_PER_PACKET);
+
+static void BM_publishStatus(MicroBench::State& state) {
+    if (!requireConnection(state)) {
+        return;
+    }
+    while (state.keepRunning()) {
+        publishStatus("experiment_started");
+    }
+}
+MICROBENCH(BM_publishStatus);
+
+static void BM_publishStatusWithMessage(MicroBench::State& state) {
+    if (!requireConnection(state)) {
+        return;
+    }
+    while (state.keepRunning()) {
+        publishStatus("config_updated", "Configuration updated successfully");
+    }
+}
+MICROBENCH(BM_publishStatusWithMessage);
+
+// The payload is copied each iteration: ArduinoJson parses it in place, as
+// it does the PubSubClient buffer
+static void runCommand(MicroBench::State& state, const char* topicFormat, const char* payload) {
+    if (!requireConnection(state)) {
+        return;
+    }
+    char topic[50];
+    snprintf(topic, sizeof(topic), topicFormat, sensorID.c_str());
+    size_t length = strlen(payload);
+    byte buffer[MQTT_COMMAND_DOC_SIZE];
+    while (state.keepRunning()) {
+        memcpy(buffer, payload, length);
+        handleMQTTCommands(topic, buffer, length);
+    }
+    state.setBytesProcessed(length);
+}
+
+// Dispatch plus the experiment_paused status it publishes
+static void BM_handleMQTTCommands_command(MicroBench::State& state) {
+    runCommand(state, MQTT_COMMAND_TOPIC, "{\"command\":\"pause_experiment\",\"request_id\":\"a1b2c3d4\"}");
+}
+MICROBENCH(BM_handleMQTTCommands_command);
+
+// Config fields that touch no hardware, plus the config_updated status
+static void BM_handleMQTTCommands_config(MicroBench::State& state) {
+    runCommand(state, MQTT_CONFIG_TOPIC,
+               "{\"maxRange\":4000,\"duration\":30,\"averagingSamples\":4,\"latencyTargetMs\":200,\"bulkUpload\":false}");
+}
+MICROBENCH(BM_handleMQTTCommands_config);
+
+// One /ota/write chunk (ESP_32_OTA) of arg bytes, hex encoded
+static void BM_hexToBytes(MicroBench::State& state) {
+    String hex;
+    hex.reserve(state.arg() * 2);
+    for (long i = 0; i < state.arg(); i++) {
+        char pair[3];
+        snprintf(pair, sizeof(pair), "%02x", (unsigned)(i * 37 & 0xFF));
+        hex += pair;
+    }
+    std::vector<uint8_t> bytes;
+    while (state.keepRunning()) {
+        hexToBytes(hex, bytes);
+    }
+    state.setBytesProcessed(hex.length());
+}
+MICROBENCH_ARG(BM_hexToBytes, 64);
+MICROBENCH_ARG(BM_hexToBytes, 1024);
+
+#ifndef ARDUINO_ARCH_ESP32
+static bool loadBaselineFile(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return false;
+    }
+    std::string text;
+    char chunk[512];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        text.append(chunk, n);
+    }
+    fclose(f);
+    return MicroBench::loadBaseline(text.c_str()) > 0;
+}
+#endif
+
+void setup() {
+    Serial.begin(115200);
+    Serial.println("\n=== TOF400F Firmware - microbenchmarks ===");
+
+    sensorType = "TOF";
+    sensorID = "BENCH";
+    const char* filter = nullptr;
+#ifdef ARDUINO_ARCH_ESP32
+    Serial.printf("CPU %lu MHz, cycle counter esp_cpu_get_ccount()\n", (unsigned long)getCpuFrequencyMhz());
+    setupMQTT();
+    mqttClient.setClient(sinkClient);
+#else
+    filter = simOption("filter");
+    const char* baselinePath = simOption("baseline");
+    if (baselinePath && !loadBaselineFile(baselinePath)) {
+        printf("[bench] no %s rows in %s\n", MicroBench::kTickUnit, baselinePath);
+    }
+    WiFi.mode(WIFI_STA);
+    WiFi.begin("native", "");
+    setupMQTT();
+#endif
+    reconnectMQTT();
+
+    int regressions = MicroBench::runAll(Serial, filter);
+    if (regressions) {
+        Serial.printf("%d benchmark(s) more than %d%% slower than the baseline\n", regressions,
+                      MICROBENCH_REGRESSION_PCT);
+    }
+#ifndef ARDUINO_ARCH_ESP32
+    simExit(regressions ? 1 : 0);
+#endif
+}
+
+void loop() {
+    delay(1000);
+}
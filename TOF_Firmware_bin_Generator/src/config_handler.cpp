@@ -3,7 +3,10 @@
 #include "experiment_manager.h"
 #include "motor_controller.h"
 #include <ArduinoJson.h>
+#include <WiFi.h>
 #include <Update.h>
+#include "ota_inflate.h"
+#include "ota_verify.h"
 
 // Global variables
 ExperimentConfig config;
@@ -11,7 +14,7 @@ AsyncWebServer server(80);
 
 // Handle status request
 void handleStatus(AsyncWebServerRequest *request) {
-    DynamicJsonDocument doc(1024);
+    DynamicJsonDocument doc(2048);
     doc["connected"] = true;
     doc["sensor_type"] = sensorType + "_I2C_HS";
     doc["sensor_id"] = sensorType;
@@ -20,6 +23,7 @@ void handleStatus(AsyncWebServerRequest *request) {
     doc["samples"] = sampleCount;
     doc["max_samples"] = MAX_SAMPLES;
     doc["configured"] = config.configured;
+    doc["config_generation"] = configGeneration();
     
     JsonObject diag = doc["diagnostics"].to<JsonObject>();
     diag["total_readings"] = diagnostics.totalReadings;
@@ -31,12 +35,46 @@ void handleStatus(AsyncWebServerRequest *request) {
     if (diagnostics.totalReadings > 0) {
         diag["success_rate"] = (float)diagnostics.successfulReadings / diagnostics.totalReadings * 100.0;
     }
+    diag["batch_size"] = currentBatchSize();
+    diag["publish_failures"] = diagnostics.publishFailures;
+    diag["wifi_connect_ms"] = diagnostics.wifiConnectMs;
+    diag["boot_to_mqtt_ms"] = diagnostics.bootToMqttMs;
+    diag["boot_to_first_sample_ms"] = diagnostics.bootToFirstSampleMs;
+
+    // Histogram bucket i counts values below 8 << i us; the last takes the rest
+    SampleTimingPacket timing = sampleTiming.snapshot();
+    JsonObject timingJson = diag["timing"].to<JsonObject>();
+    timingJson["nominal_interval_us"] = timing.nominal_interval_us;
+    timingJson["ticks"] = timing.ticks;
+    timingJson["missed"] = timing.missed;
+    timingJson["interval_min_us"] = timing.interval_min_us;
+    timingJson["interval_max_us"] = timing.interval_max_us;
+    timingJson["latency_max_us"] = timing.latency_max_us;
+    JsonArray jitter = timingJson["interval_jitter"].to<JsonArray>();
+    JsonArray latency = timingJson["latency"].to<JsonArray>();
+    for (int i = 0; i < SAMPLE_TIMING_BUCKETS; i++) {
+        jitter.add((uint32_t)timing.interval_jitter[i]);
+        latency.add((uint32_t)timing.latency[i]);
+    }
     
     String response;
     serializeJson(doc, response);
     request->send(200, "application/json", response);
 }
 
+// Prometheus text format for scrapers; ?format=json returns the MQTT metrics payload
+void handleMetrics(AsyncWebServerRequest *request) {
+    bool json = request->hasParam("format") && request->getParam("format")->value() == "json";
+    AsyncResponseStream *response =
+        request->beginResponseStream(json ? "application/json" : "text/plain; version=0.0.4");
+    if (json) {
+        metrics.writeJson(*response, WiFi.RSSI());
+    } else {
+        metrics.writePrometheus(*response, sensorType.c_str(), sensorID.c_str(), WiFi.RSSI());
+    }
+    request->send(response);
+}
+
 // Handle configuration request
 void handleConfigure(AsyncWebServerRequest *request) {
     Serial.println("=== DEBUG: Configuration Request Received ===");
@@ -91,7 +129,11 @@ void handleConfigure(AsyncWebServerRequest *request) {
             calibration.scaleFactor = doc["calibration"]["scale"] | 1.0;
         }
         
+        if (doc.containsKey("resume")) {
+            config.resumeRuns = doc["resume"];
+        }
         config.configured = true;
+        saveConfig();
         sampleInterval = 1000 / config.frequency;
         diagnostics = DiagnosticStats();
         
@@ -143,6 +185,7 @@ void handleCalibrate(AsyncWebServerRequest *request) {
             
             Serial.printf("Calibration updated: offset=%.2fmm, scale=%.4f\n", 
                 calibration.offsetMM, calibration.scaleFactor);
+            saveConfig();
                 
             request->send(200, "application/json", "{\"success\":true}");
             return;
@@ -172,6 +215,7 @@ void handleStart(AsyncWebServerRequest *request) {
         return;
     }
     
+    resetSamplingRun();
     experimentRunning = true;
     dataReady = false;
     sampleCount = 0;
@@ -221,24 +265,51 @@ void handleId(AsyncWebServerRequest *request) {
     request->send(200, "application/json", response);
 }
 
-// Handle OTA update upload
+// Decompressed (or raw) image bytes from the upload are hashed and go straight to flash
+static OtaInflater updateInflater;
+static OtaImageVerifier updateVerifier;
+
+static bool writeUpdate(const uint8_t *data, size_t len, void *) {
+    updateVerifier.update(data, len);
+    return Update.write((uint8_t *)data, len) == len;
+}
+
+static const char *updateHeader(AsyncWebServerRequest *request, const char *name) {
+    AsyncWebHeader *header = request->getHeader(name);
+    return header ? header->value().c_str() : nullptr;
+}
+
+// Handle OTA update upload (raw firmware.bin or gzip-compressed firmware.bin.gz)
 void handleUpdateUpload(AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final) {
     if (!index) {
         Serial.printf("Update Start: %s\n", filename.c_str());
         if (!Update.begin(UPDATE_SIZE_UNKNOWN)) {
             Update.printError(Serial);
         }
+        updateInflater.begin(writeUpdate, nullptr);
+        // Optional SHA-256 of firmware.bin (and Ed25519 signature when the build requires one)
+        if (!updateVerifier.begin(updateHeader(request, "X-Firmware-SHA256"),
+                                  updateHeader(request, "X-Firmware-Signature"))) {
+            Serial.printf("Update rejected: %s\n", updateVerifier.error());
+            Update.abort();
+        }
     }
     
-    if (Update.write(data, len) != len) {
+    if (!Update.hasError() && !updateInflater.write(data, len)) {
+        Serial.printf("Update decode failed: %s\n", updateInflater.error());
         Update.printError(Serial);
+        Update.abort();
     }
     
     if (final) {
-        if (Update.end(true)) {
-            Serial.printf("Update Success: %u bytes\n", index + len);
+        if (updateInflater.finish() && updateVerifier.finish() && Update.end(true)) {
+            Serial.printf("Update Success: %u bytes received, %u written, hash %u ms\n", index + len,
+                          updateInflater.outputBytes(), updateVerifier.hashMicros() / 1000);
         } else {
+            const char *error = updateInflater.error() ? updateInflater.error() : updateVerifier.error();
+            Serial.printf("Update failed: %s\n", error ? error : "flash");
             Update.printError(Serial);
+            Update.abort();
         }
     }
 }
@@ -3,12 +3,10 @@
 #include "sensor_communication.h"
 #include "mqtt_handler.h"
 #include "config_handler.h"
+#include "sampling_runtime.h"
+#include "experiment_runtime.h"
 #include <esp_partition.h>
 #include <esp_ota_ops.h>
-#include <driver/timer.h>
-#include <freertos/FreeRTOS.h>
-#include <freertos/queue.h>
-#include <freertos/task.h>
 
 #define STATUS_LED 13
 #define WIFI_LED 14
@@ -27,221 +25,310 @@ unsigned long lastSampleTime = 0;
 int sampleInterval = 1000 / 50;
 
 // Sensor detection variables
-unsigned long lastSensorCheck = 0;
 const unsigned long SENSOR_CHECK_INTERVAL = 5000;
 bool sensorWasPresent = false;
 unsigned long lastExperimentEnd = 0;
 bool backendCleanupRequested = false;
 
-// Hardware timer and queue
-QueueHandle_t sensorDataQueue = NULL;
-volatile bool timerInitialized = false;
-volatile bool sampleRequested = false;
+// VL53L0X driver for the shared timer/task/streaming runtime
+class TofSampler : public SamplingRuntime<TofSampler, BinarySample, BINARY_MAX_SAMPLES_PER_PACKET>
+{
+public:
+    static bool running() { return experimentRunning; }
 
-// Binary data batching
-BinarySample sampleBuffer[BINARY_MAX_SAMPLES_PER_PACKET];
-uint16_t bufferedSampleCount = 0;
+    uint16_t read() { return readTOFDistanceMM(); }
 
-// CRITICAL FIX: Pre-captured timestamps
-volatile unsigned long preCapturedTimestamp = 0;
-TaskHandle_t sensorTaskHandle = NULL;
+    bool store(unsigned long tickMs, uint16_t distance_mm, BinarySample &out)
+    {
+        if (sampleCount >= MAX_SAMPLES)
+            return false;
+
+        timestamps[sampleCount] = tickMs - experimentStartTime;
+        distances[sampleCount] = distance_mm;
+        SensorTraits::encode(out, timestamps[sampleCount], distance_mm, sampleCount + 1);
+        sampleCount++;
+        digitalWrite(STATUS_LED, !digitalRead(STATUS_LED));
+        return true;
+    }
 
-// Forward declarations
-void flushSampleBuffer();
-void sensorReadingTask(void *parameter);
+    bool streaming() const { return !config.bulkUpload; }
 
-// Timer ISR - captures timestamp FIRST
-void IRAM_ATTR timerISR(void *arg)
-{
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    bool publish(const BinarySample *samples, uint16_t count)
+    {
+        return publishBinarySensorData(samples, count, experimentStartTime, sampleCount);
+    }
 
-    if (experimentRunning)
+    void onTicksMissed(uint32_t ticks)
     {
-        // CRITICAL: Capture timestamp IMMEDIATELY
-        preCapturedTimestamp = millis();
-        sampleRequested = true;
+        metrics.counter(METRIC_SAMPLES_MISSED).add(ticks);
+    }
 
-        // Wake sensor task
-        if (sensorTaskHandle != NULL)
+    void onSampleStored(int)
+    {
+        metrics.counter(METRIC_SAMPLES).add();
+        if (diagnostics.bootToFirstSampleMs == 0)
         {
-            vTaskNotifyGiveFromISR(sensorTaskHandle, &xHigherPriorityTaskWoken);
+            bootTrace.mark("first_sample");
+            diagnostics.bootToFirstSampleMs = millis();
         }
     }
+};
 
-    timer_group_clr_intr_status_in_isr(TIMER_GROUP_0, TIMER_0);
-    timer_group_enable_alarm_in_isr(TIMER_GROUP_0, TIMER_0);
+static TofSampler sampler;
 
-    if (xHigherPriorityTaskWoken)
-    {
-        portYIELD_FROM_ISR();
-    }
-}
+// Tick interval and ISR-to-read histograms for the current run
+SampleTiming &sampleTiming = sampler.timing;
 
-// Dedicated sensor task on Core 0
-void sensorReadingTask(void *parameter)
+uint16_t bufferedSampleCount()
 {
-    Serial.println("Sensor task started on Core 0");
+    return sampler.buffered();
+}
 
-    // Performance monitoring variables
-    static unsigned long lastSampleTime = 0;
-    static int missedSamples = 0;
-    static int consecutiveMisses = 0;
+void resetSamplingRun()
+{
+    sampler.startRun(config.frequency);
+}
 
-    while (true)
-    {
-        // Wait for timer trigger with minimal timeout
-        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1)); // Reduced from 10ms to 1ms
+// Run ended: wait for the last sample, then send whatever is still buffered
+void flushSampleBuffer()
+{
+    sampler.finishRun();
+}
 
-        if (sampleRequested && experimentRunning)
-        {
-            // Use pre-captured timestamp
-            unsigned long timestamp = preCapturedTimestamp;
-            sampleRequested = false;
+// Process data in main loop
+void processSensorDataQueue()
+{
+    sampler.pollFlush(config.frequency, config.latencyTargetMs);
+}
 
-            // Check for sample timing issues
-            unsigned long currentTime = millis();
-            if (lastSampleTime > 0)
-            {
-                unsigned long timeSinceLastSample = currentTime - lastSampleTime;
-                int expectedInterval = 1000 / config.frequency;
-
-                // Detect missed samples (more than 1.5x expected interval)
-                if (timeSinceLastSample > (expectedInterval * 1.5))
-                {
-                    missedSamples++;
-                    consecutiveMisses++;
-
-                    if (consecutiveMisses > 3)
-                    {
-                        Serial.printf("WARNING: %d consecutive samples missed at %dHz\n",
-                                      consecutiveMisses, config.frequency);
-                    }
-                }
-                else
-                {
-                    consecutiveMisses = 0;
-                }
-            }
-            lastSampleTime = currentTime;
+uint16_t currentBatchSize()
+{
+    return sampler.batchSize();
+}
 
-            // Read sensor (safe now, timestamp already captured)
-            uint16_t distance_mm = readTOFDistanceMM();
+// Stop command in bulk mode; the upload runs from manageExperimentLoop()
+static bool stoppedRunUploadPending = false;
 
-            if (distance_mm != 65535 && sampleCount < MAX_SAMPLES)
-            {
-                // Store directly (avoid queue overhead for simplicity)
-                timestamps[sampleCount] = timestamp - experimentStartTime;
-                distances[sampleCount] = distance_mm;
-
-                // Add to buffer for MQTT with overflow protection
-                if (bufferedSampleCount < BINARY_MAX_SAMPLES_PER_PACKET)
-                {
-                    sampleBuffer[bufferedSampleCount].timestamp = timestamps[sampleCount];
-                    sampleBuffer[bufferedSampleCount].distance = distance_mm;
-                    sampleBuffer[bufferedSampleCount].sample_number = sampleCount + 1; // Use next sample number
-                    bufferedSampleCount++;
-                }
-                else
-                {
-                    // Buffer full, force flush to prevent data loss
-                    flushSampleBuffer();
-
-                    // Add current sample to fresh buffer
-                    sampleBuffer[0].timestamp = timestamps[sampleCount];
-                    sampleBuffer[0].distance = distance_mm;
-                    sampleBuffer[0].sample_number = sampleCount + 1; // Use next sample number
-                    bufferedSampleCount = 1;
-                }
-
-                sampleCount++;
-                digitalWrite(STATUS_LED, !digitalRead(STATUS_LED));
-
-                // Debug first few samples and periodic status
-                if (sampleCount <= 5)
-                {
-                    Serial.printf("Sample %d: %umm @ %ums\n",
-                                  sampleCount, distance_mm, timestamps[sampleCount - 1]);
-                }
-
-                // Periodic status report
-                if (sampleCount % 50 == 0)
-                {
-                    Serial.printf("Collected %d samples, %d missed\n", sampleCount, missedSamples);
-                }
-            }
-            else if (distance_mm == 65535)
-            {
-                // Sensor read error
-                Serial.println("Sensor read error (65535), skipping sample");
-                missedSamples++;
-            }
-        }
-
-        // Minimal delay to allow other tasks
-        vTaskDelay(0); // Changed from 1ms to 0ms for better responsiveness
+// Publish the whole run in maximum-size packets (bulk upload mode)
+static void uploadRunInBulk()
+{
+    int sent = sampler.publishAll(sampleCount, [](int i, BinarySample &sample) {
+        SensorTraits::encode(sample, timestamps[i], (uint16_t)distances[i], i + 1);
+    });
+    if (sent < sampleCount)
+    {
+        Serial.printf("Bulk upload stopped at sample %d/%d\n", sent, sampleCount);
+        return;
     }
+    Serial.printf("Bulk upload sent %d samples\n", sent);
 }
 
-// Process data in main loop
-void processSensorDataQueue()
+void requestStoppedRunUpload()
 {
-    static unsigned long lastFlushTime = 0;
-    unsigned long currentFlushInterval = 50; // Default 50ms
+    stoppedRunUploadPending = true;
+}
+
+// Config and calibration as kept in NVS; 4-byte fields and the string last, so no padding
+struct StoredConfig
+{
+    int32_t frequency;
+    int32_t duration;
+    int32_t maxRange;
+    int32_t averagingSamples;
+    int32_t latencyTargetMs;
+    uint32_t configured;
+    uint32_t bulkUpload;
+    uint32_t resumeRuns;
+    float motorAngle;
+    float calibrationOffsetMM;
+    float calibrationScale;
+    char mode[8];
+};
+
+// Commands, config persistence and run resume from the shared runtime
+class TofExperiment : public ExperimentRuntime<TofExperiment, StoredConfig>
+{
+public:
+    TofExperiment() : ExperimentRuntime(SensorTraits::typeId) {}
 
-    // Adaptive flush interval based on frequency
-    if (config.frequency <= 5)
+    ExperimentConfig &settings() { return config; }
+
+    void addConfigKeys(JsonDocument &filter)
     {
-        currentFlushInterval = 200; // 200ms for low frequencies (1-5Hz)
+        filter["freq"] = true;
+        filter["maxRange"] = true;
+        filter["averagingSamples"] = true;
+        filter["latencyTargetMs"] = true;
+        filter["bulkUpload"] = true;
     }
-    else if (config.frequency <= 20)
+
+    void applyConfig(JsonVariantConst msg)
     {
-        currentFlushInterval = 100; // 100ms for medium frequencies (10-20Hz)
+        if (!msg["freq"].isNull())
+        {
+            config.frequency = msg["freq"];
+            MQTT_LOGF("Frequency updated to: %d\n", config.frequency);
+            updateTimerFrequency(config.frequency);
+        }
+
+        if (!msg["maxRange"].isNull())
+        {
+            config.maxRange = msg["maxRange"];
+            MQTT_LOGF("Max range updated to: %d\n", config.maxRange);
+        }
+
+        if (!msg["averagingSamples"].isNull())
+        {
+            config.averagingSamples = msg["averagingSamples"];
+            MQTT_LOGF("Averaging samples updated to: %d\n", config.averagingSamples);
+        }
+
+        if (!msg["latencyTargetMs"].isNull())
+        {
+            config.latencyTargetMs = msg["latencyTargetMs"];
+            MQTT_LOGF("Latency target updated to: %d ms\n", config.latencyTargetMs);
+        }
+
+        if (!msg["bulkUpload"].isNull())
+        {
+            config.bulkUpload = msg["bulkUpload"];
+            MQTT_LOGF("Bulk upload %s\n", config.bulkUpload ? "enabled" : "disabled");
+        }
     }
-    else if (config.frequency <= 50)
+
+    void storeConfig(StoredConfig &stored)
     {
-        currentFlushInterval = 33; // ~30Hz equivalent (30-50Hz)
+        stored.frequency = config.frequency;
+        stored.duration = config.duration;
+        stored.maxRange = config.maxRange;
+        stored.averagingSamples = config.averagingSamples;
+        stored.latencyTargetMs = config.latencyTargetMs;
+        stored.configured = config.configured;
+        stored.bulkUpload = config.bulkUpload;
+        stored.resumeRuns = config.resumeRuns;
+        stored.motorAngle = config.motorAngle;
+        stored.calibrationOffsetMM = calibration.offsetMM;
+        stored.calibrationScale = calibration.scaleFactor;
+        strncpy(stored.mode, config.mode.c_str(), sizeof(stored.mode) - 1);
     }
-    else
+
+    void restoreConfig(StoredConfig &stored)
     {
-        currentFlushInterval = 20; // 20ms for high frequencies (>50Hz)
+        config.frequency = stored.frequency;
+        config.duration = stored.duration;
+        config.maxRange = stored.maxRange;
+        config.averagingSamples = stored.averagingSamples;
+        config.latencyTargetMs = stored.latencyTargetMs;
+        config.configured = stored.configured != 0;
+        config.bulkUpload = stored.bulkUpload != 0;
+        config.resumeRuns = stored.resumeRuns != 0;
+        config.motorAngle = stored.motorAngle;
+        calibration.offsetMM = stored.calibrationOffsetMM;
+        calibration.scaleFactor = stored.calibrationScale;
+        stored.mode[sizeof(stored.mode) - 1] = '\0';
+        config.mode = stored.mode;
+        sampleInterval = 1000 / config.frequency;
     }
 
-    // Adaptive batch size triggering
-    bool shouldFlush = false;
+    bool running() const { return experimentRunning; }
 
-    if (config.frequency <= 5 && bufferedSampleCount >= BATCH_1_5HZ)
-    {
-        shouldFlush = true;
-    }
-    else if (config.frequency <= 20 && bufferedSampleCount >= BATCH_10_20HZ)
-    {
-        shouldFlush = true;
-    }
-    else if (config.frequency <= 50 && bufferedSampleCount >= BATCH_30_50HZ)
+    // Bulk runs keep their samples in RAM and cannot resume
+    bool resumable() const { return config.resumeRuns && !config.bulkUpload; }
+
+    uint32_t lastSample() const { return sampleCount; }
+    uint32_t elapsedMs() const { return millis() - experimentStartTime; }
+    uint32_t samplesPerCheckpoint() const { return config.frequency * RUN_CHECKPOINT_INTERVAL_MS / 1000 + 1; }
+    uint32_t sampleLimit() const { return MAX_SAMPLES; }
+
+    void beginRun(uint32_t firstSample, uint32_t elapsed)
     {
-        shouldFlush = true;
+        resetSamplingRun();
+        sampleCount = firstSample - 1;
+        experimentStartTime = millis() - elapsed;
+        lastSampleTime = millis();
+        dataReady = false;
+        experimentRunning = true;
     }
-    else if (bufferedSampleCount >= BATCH_HIGH_FREQ)
+
+    bool stopRun()
     {
-        shouldFlush = true;
+        experimentRunning = false;
+        dataReady = true;
+        if (config.bulkUpload)
+        {
+            // Not from inside PubSubClient's callback: the status follows the upload
+            requestStoppedRunUpload();
+            return false;
+        }
+        return true;
     }
 
-    // Time-based flushing (prevent stale data)
-    if (bufferedSampleCount > 0 &&
-        (shouldFlush || (millis() - lastFlushTime > currentFlushInterval)))
+    void pauseRun() { experimentRunning = false; }
+
+    void continueRun()
     {
-        flushSampleBuffer();
-        lastFlushTime = millis();
+        sampleTiming.restartInterval();
+        experimentRunning = true;
     }
+
+    void publishStatus(const char *status, const char *message) { ::publishStatus(status, message); }
+    void publishStatusJson(const char *json, size_t length) { ::publishStatusJson(json, length); }
+    const char *sensorId() const { return sensorID.c_str(); }
+    void disconnect() { cleanFirmwareAndBootOTA(); }
+};
+
+static TofExperiment experiment;
+
+void loadPersistedState()
+{
+    experiment.loadPersistedState();
+}
+
+void saveConfig()
+{
+    experiment.saveConfig();
+}
+
+uint32_t configGeneration()
+{
+    return experiment.configGeneration();
+}
+
+void resumeInterruptedRun()
+{
+    experiment.resumeInterruptedRun();
+}
+
+void addExperimentFilterKeys(JsonDocument &filter)
+{
+    experiment.addFilterKeys(filter);
+}
+
+void handleExperimentMessage(MqttTopicKind kind, JsonVariantConst msg)
+{
+    experiment.handleMessage(kind, msg);
 }
 
 // Main experiment loop
 void manageExperimentLoop()
 {
+    // Set while a run is going; the timing histograms go out once it ends
+    // (completed or stopped over MQTT/HTTP, not paused)
+    static bool timingPending = false;
+
     processSensorDataQueue();
 
+    if (stoppedRunUploadPending)
+    {
+        stoppedRunUploadPending = false;
+        flushSampleBuffer();
+        uploadRunInBulk();
+        publishStatus("experiment_stopped");
+    }
+
     if (experimentRunning)
     {
+        timingPending = true;
         unsigned long currentTime = millis();
         unsigned long elapsedTime = currentTime - experimentStartTime;
 
@@ -260,6 +347,11 @@ void manageExperimentLoop()
             // Final flush to ensure all data is sent
             flushSampleBuffer();
 
+            if (config.bulkUpload)
+            {
+                uploadRunInBulk();
+            }
+
             // Small delay to ensure MQTT messages are sent
             delay(10);
 
@@ -283,86 +375,45 @@ void manageExperimentLoop()
     else
     {
         digitalWrite(STATUS_LED, LOW);
+
+        if (timingPending && dataReady)
+        {
+            timingPending = false;
+            publishSampleTiming();
+        }
     }
+
+    experiment.checkpointRun();
 }
 
 // Initialize hardware timer
 bool initHardwareTimer()
 {
-    if (timerInitialized)
-        return true;
-
-    // Create sensor task on Core 0
-    xTaskCreatePinnedToCore(
-        sensorReadingTask,
-        "SensorTask",
-        4096,
-        NULL,
-        configMAX_PRIORITIES - 1,
-        &sensorTaskHandle,
-        0 // Core 0
-    );
-
-    if (sensorTaskHandle == NULL)
-    {
-        Serial.println("ERROR: Failed to create sensor task");
+    if (!sampler.begin(config.frequency))
         return false;
-    }
-
-    // Configure timer
-    timer_config_t timerConfig = {
-        .alarm_en = TIMER_ALARM_EN,
-        .counter_en = TIMER_PAUSE,
-        .intr_type = TIMER_INTR_LEVEL,
-        .counter_dir = TIMER_COUNT_UP,
-        .auto_reload = TIMER_AUTORELOAD_EN,
-        .divider = 80};
-
-    timer_init(TIMER_GROUP_0, TIMER_0, &timerConfig);
-
-    int intervalMicroseconds = 1000000 / config.frequency;
-    timer_set_alarm_value(TIMER_GROUP_0, TIMER_0, intervalMicroseconds);
-    timer_enable_intr(TIMER_GROUP_0, TIMER_0);
-    timer_isr_register(TIMER_GROUP_0, TIMER_0, timerISR, NULL, ESP_INTR_FLAG_IRAM, NULL);
-    timer_start(TIMER_GROUP_0, TIMER_0);
-
-    timerInitialized = true;
-    Serial.printf("Timer initialized for %dHz\n", config.frequency);
+    metrics.watchTask(sampler.task());
     return true;
 }
 
 // Update timer frequency
 void updateTimerFrequency(int frequency)
 {
-    if (!timerInitialized)
-        return;
-
-    timer_pause(TIMER_GROUP_0, TIMER_0);
-    int intervalMicroseconds = 1000000 / frequency;
-    timer_set_alarm_value(TIMER_GROUP_0, TIMER_0, intervalMicroseconds);
+    sampler.setFrequency(frequency);
     sampleInterval = 1000 / frequency;
-    timer_start(TIMER_GROUP_0, TIMER_0);
-
-    Serial.printf("Timer frequency updated to %dHz\n", frequency);
 }
 
-// Flush sample buffer
-void flushSampleBuffer()
-{
-    if (bufferedSampleCount > 0)
-    {
-        publishBinarySensorData(sampleBuffer, bufferedSampleCount, experimentStartTime, sampleCount);
-        bufferedSampleCount = 0;
-    }
-}
-
-// Check sensor status
+// Check sensor status; the EEPROM is probed by sensorPresence's task, this only reacts to changes
 void checkSensorStatus()
 {
-    if (millis() - lastSensorCheck > SENSOR_CHECK_INTERVAL)
+    static uint32_t lastPresenceChange = 0;
+    if (sensorPresence.changes() != lastPresenceChange)
     {
-        lastSensorCheck = millis();
-        bool sensorCurrentlyPresent = detectSensorFromEEPROM();
+        lastPresenceChange = sensorPresence.changes();
+        char code[EEPROM_PRESENCE_CODE_SIZE + 1];
+        EepromPresence::State state = sensorPresence.snapshot(code);
+        bool sensorCurrentlyPresent = state == EepromPresence::PRESENT;
+        sensorType = state == EepromPresence::ABSENT ? "UNKNOWN" : code;
+        Serial.printf("Sensor presence changed: %s (%s)\n", sensorCurrentlyPresent ? "present" : "missing", sensorType.c_str());
 
         if (sensorWasPresent && !sensorCurrentlyPresent)
         {
@@ -372,58 +423,7 @@ void checkSensorStatus()
                 publishStatus("sensor_unplugged", "Switching to bootloader");
             }
 
-            // Check current running partition
-            const esp_partition_t *running = esp_ota_get_running_partition();
-            Serial.printf("Current running partition: %s\n", running->label);
-
-            // If running on ota_1, switch back to ota_0 and erase ota_1
-            if (running && strcmp(running->label, "ota_1") == 0)
-            {
-                Serial.println("Running on ota_1 with sensor unplugged - switching to ota_0...");
-
-                // Set boot partition to ota_0 (ESP_32_OTA bootloader)
-                const esp_partition_t *ota_0 = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
-                if (ota_0 != NULL)
-                {
-                    esp_err_t err = esp_ota_set_boot_partition(ota_0);
-                    if (err == ESP_OK)
-                    {
-                        Serial.println("✅ Boot partition set to ota_0 (ESP_32_OTA)");
-
-                        // Erase current partition (ota_1) to clean up
-                        Serial.println("🗑️ Erasing ota_1 partition...");
-                        err = esp_partition_erase_range(running, 0, running->size);
-                        if (err == ESP_OK)
-                        {
-                            Serial.println("✅ ota_1 partition erased successfully");
-                        }
-                        else
-                        {
-                            Serial.printf("❌ Failed to erase ota_1 partition: %s\n", esp_err_to_name(err));
-                        }
-
-                        Serial.println("🔄 Restarting to ESP_32_OTA bootloader...");
-                        delay(2000);
-                        ESP.restart();
-                    }
-                    else
-                    {
-                        Serial.printf("❌ Failed to set boot partition: %s\n", esp_err_to_name(err));
-                    }
-                }
-                else
-                {
-                    Serial.println("❌ ota_0 partition not found!");
-                }
-            }
-            else
-            {
-                Serial.println("Running on ota_0 - sensor unplugged handled by OTA bootloader");
-            }
-
-            // Fallback restart if partition switching fails
-            delay(1000);
-            ESP.restart();
+            failsafeToOtaLoader("sensor unplugged");
         }
 
         sensorWasPresent = sensorCurrentlyPresent;
@@ -32,6 +32,10 @@
 #define TOF_SCL 22
 #define SENSOR_ACTIVE_LED_PIN 27
 
+// VL53L1X bring-up runs in its own task on core 0 while setup() joins WiFi
+#define TOF_POWER_UP_DELAY_MS 300
+#define TOF_INIT_WARN_MS 5000 // setup() still waits: the task owns Wire1 until it is done
+
 #include "../../shared/LedController.h"
 
 LedController wifiLed(WIFI_LED_PIN, true);   // Active LOW
@@ -46,8 +50,6 @@ char password[65];  // Will be loaded from NVS
 // Network configuration - All settings obtained from DHCP
 
 // Function prototypes
-bool connectWithDynamicIP();
-bool connectWithDHCP();
 void safeRestartSequence(); // FWD DECLARE
 
 // MQTT configuration - Loaded from NVS (set by OTA bootloader via UDP discovery)
@@ -55,9 +57,31 @@ char mqttBroker[40] = "";
 uint16_t mqttPort = 1883;
 char backendMAC[18] = "";
 
+static volatile bool tofInitOk = false;
+
+// FreeRTOS tick hook (both cores) for the CPU load in /metrics
+static void IRAM_ATTR metricsTick()
+{
+    metrics.onTick(xPortGetCoreID());
+}
+
+static void tofInitTask(void *parameter)
+{
+    TaskHandle_t setupTask = (TaskHandle_t)parameter;
+
+    vTaskDelay(pdMS_TO_TICKS(TOF_POWER_UP_DELAY_MS)); // Sensor power-up settle
+    tofInitOk = initializeTOFSensor();
+    bootTrace.mark("tof_init");
+
+    xTaskNotifyGive(setupTask);
+    vTaskDelete(NULL);
+}
+
 void setup()
 {
+    bootTrace.begin();
     Serial.begin(115200);
+    asyncLog().begin(); // Sampling task logs through the ring, see async_log.h
     Serial.println("\n=== TOF400F Firmware - I2C Version with Core-Based Processing ===");
 
     // Initialize I2C buses
@@ -67,6 +91,7 @@ void setup()
     Serial.printf("I2C Buses Initialized:\n");
     Serial.printf("  - EEPROM: SDA=%d, SCL=%d\n", EEPROM_SDA, EEPROM_SCL);
     Serial.printf("  - TOF Sensor: SDA=%d, SCL=%d\n", TOF_SDA, TOF_SCL);
+    bootTrace.mark("i2c");
 
     // Load WiFi credentials from NVS
     if (!loadWiFiCredentialsFromNVS(ssid, sizeof(ssid), password, sizeof(password))) {
@@ -92,6 +117,14 @@ void setup()
     if (strlen(backendMAC) > 0) {
         Serial.printf("   Backend MAC: %s\n", backendMAC);
     }
+    bootTrace.mark("nvs");
+
+    // Config from before the last reset, if any; the timer and sensor below start from it
+    loadPersistedState();
+
+    // Sensor init (Wire1) does not depend on the network; overlap it with WiFi
+    bool tofInitAsync = xTaskCreatePinnedToCore(tofInitTask, "tof_init", 4096, xTaskGetCurrentTaskHandle(),
+                                                1, NULL, 0) == pdPASS;
 
     // Init LEDs
     wifiLed.begin();
@@ -104,21 +137,47 @@ void setup()
     
     pinMode(RESTART_TRIGGER_PIN, INPUT_PULLUP);
 
-    delay(300);
+    // Initialize Motor Controller (calibration continues in motor.update())
+    motor.begin();
+    bootTrace.mark("motor");
+    
+    // Network setup
+    WiFi.mode(WIFI_STA);
+    
+    // Cached access point first, then a full DHCP connect
+    unsigned long wifiStart = millis();
+    bool wifiConnected = connectSensorWiFi(ssid, password);
+    diagnostics.wifiConnectMs = millis() - wifiStart;
+    bootTrace.mark("wifi");
+
+    // Join the sensor init before anything can start sampling
+    if (!tofInitAsync)
+    {
+        vTaskDelay(pdMS_TO_TICKS(TOF_POWER_UP_DELAY_MS));
+        tofInitOk = initializeTOFSensor();
+        bootTrace.mark("tof_init");
+    }
+    else if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(TOF_INIT_WARN_MS)) == 0)
+    {
+        // An I2C transaction cannot be abandoned safely, and the task's notify and
+        // tofInitOk must not land after sampling has started on Wire1
+        Serial.println("WARNING: TOF Sensor init is slow, still waiting");
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
 
-    // Initialize TOF sensor
-    if (initializeTOFSensor())
+    if (tofInitOk)
     {
         Serial.println("TOF Sensor initialization successful");
+        if (config.configured && !configureSensorForFrequency(config.frequency))
+        {
+            Serial.println("WARNING: Sensor configuration failed");
+        }
     }
     else
     {
         Serial.println("WARNING: TOF Sensor init issues - check wiring");
     }
 
-    // Initialize Motor Controller
-    motor.begin();
-
     // Initialize hardware timer for interrupt-driven sampling
     if (initHardwareTimer())
     {
@@ -128,14 +187,10 @@ void setup()
     {
         Serial.println("ERROR: Hardware timer initialization failed");
     }
-    
-    // Network setup with dynamic IP assignment
-    WiFi.mode(WIFI_STA);
-    
-    Serial.println("Starting dynamic IP connection...");
-    
-    // Try dynamic IP assignment (multiple static IPs, then fallback to DHCP)
-    bool wifiConnected = connectWithDynamicIP();
+    bootTrace.mark("timer");
+
+    metrics.begin(metricsTick);
+    metrics.watchTask(xTaskGetCurrentTaskHandle()); // loopTask: setup(), loop() and MQTT
     
     if (wifiConnected) {
         Serial.printf("\n✅ WiFi connected successfully. IP: %s\n", WiFi.localIP().toString().c_str());
@@ -149,62 +204,13 @@ void setup()
         {
             Serial.println("❌ EEPROM not detected! Implementing failsafe mechanism...");
 
-            // Check current running partition
-            const esp_partition_t *running = esp_ota_get_running_partition();
-            Serial.printf("Current running partition: %s\n", running->label);
-
-            // If running on ota_1, switch back to ota_0 and erase ota_1
-            if (running && strcmp(running->label, "ota_1") == 0)
-            {
-                Serial.println("Running on ota_1 with EEPROM failure - switching to ota_0...");
-
-                // Set boot partition to ota_0 (ESP_32_OTA bootloader)
-                const esp_partition_t *ota_0 = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
-                if (ota_0 != NULL)
-                {
-                    esp_err_t err = esp_ota_set_boot_partition(ota_0);
-                    if (err == ESP_OK)
-                    {
-                        Serial.println("✅ Boot partition set to ota_0 (ESP_32_OTA)");
-
-                        // Erase current partition (ota_1) to clean up
-                        Serial.println("🗑️ Erasing ota_1 partition...");
-                        err = esp_partition_erase_range(running, 0, running->size);
-                        if (err == ESP_OK)
-                        {
-                            Serial.println("✅ ota_1 partition erased successfully");
-                        }
-                        else
-                        {
-                            Serial.printf("❌ Failed to erase ota_1 partition: %s\n", esp_err_to_name(err));
-                        }
-
-                        Serial.println("🔄 Restarting to ESP_32_OTA bootloader...");
-                        delay(2000);
-                        ESP.restart();
-                    }
-                    else
-                    {
-                        Serial.printf("❌ Failed to set boot partition: %s\n", esp_err_to_name(err));
-                    }
-                }
-                else
-                {
-                    Serial.println("❌ ota_0 partition not found!");
-                }
-            }
-            else
-            {
-                Serial.println("Running on ota_0 - EEPROM failure handled by OTA bootloader");
-            }
-
-            // If we reach here, something went wrong - restart anyway
-            Serial.println("⚠️ Failsafe mechanism completed - restarting...");
-            delay(3000);
-            ESP.restart();
+            failsafeToOtaLoader("EEPROM failure");
         }
 
         sensorWasPresent = sensorDetected;
+        sensorPresence.begin(Wire, EEPROM_SENSOR_ADDR, SENSOR_TYPE_CODES, SENSOR_CHECK_INTERVAL,
+                             EEPROM_RETRY_COUNT, EEPROM_RETRY_DELAY, sensorType.c_str());
+        bootTrace.mark("eeprom");
         Serial.printf("Detected sensor type: %s\n", sensorType.c_str());
 
         // Get device ID from MAC address
@@ -222,6 +228,7 @@ void setup()
 
     // Setup HTTP routes
     server.on("/update", HTTP_POST, handleUpdate, handleUpdateUpload);
+    server.on("/metrics", HTTP_GET, handleMetrics);
 
     // CORS handling
     server.onNotFound([](AsyncWebServerRequest *request)
@@ -234,6 +241,7 @@ void setup()
 
     server.begin();
     Serial.println("HTTP server started");
+    bootTrace.mark("http");
     
      // Initial sensor LED state
     if (sensorID != "UNKNOWN") {
@@ -325,6 +333,7 @@ void cleanFirmwareAndBootOTA()
     // Disconnect MQTT gracefully
     if (mqttClient.connected())
     {
+        publishPresenceOffline();
         mqttClient.disconnect();
         Serial.println("MQTT disconnected");
     }
@@ -336,73 +345,10 @@ void cleanFirmwareAndBootOTA()
 
     delay(1000);
 
-    // Get the running partition
-    const esp_partition_t *running = esp_ota_get_running_partition();
-    Serial.printf("Current running partition: %s\n", running->label);
-
-    // Find the OTA boot partition (partition 0)
-    const esp_partition_t *ota_partition = esp_partition_find_first(
-        ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
-
-    if (ota_partition != NULL)
-    {
-        Serial.printf("Found OTA partition: %s\n", ota_partition->label);
-
-        // Set boot partition to OTA 0
-        if (esp_ota_set_boot_partition(ota_partition) == ESP_OK)
-        {
-            Serial.println("Boot partition set to OTA_0 successfully");
-
-            // Restart the ESP32 to boot into OTA partition
-            Serial.println("Restarting ESP32 to boot into OTA partition...");
-            delay(1000);
-            ESP.restart();
-        }
-        else
-        {
-            Serial.println("Failed to set boot partition to OTA_0");
-        }
-    }
-    else
-    {
-        Serial.println("OTA partition not found");
-    }
+    restartIntoOtaLoader(false);
 
     // If we get here, something went wrong - restart anyway
     Serial.println("Restarting ESP32 as fallback...");
     delay(1000);
     ESP.restart();
 }
-
-// ================= DYNAMIC IP IMPLEMENTATION =================
-
-bool connectWithDynamicIP() {
-    Serial.println("🔧 Connecting to WiFi using DHCP...");
-    return connectWithDHCP();
-}
-
-
-
-bool connectWithDHCP() {
-    Serial.println("🌐 Trying DHCP connection...");
-    
-    // Use DHCP (no static IP configuration)
-    WiFi.begin(ssid, password);
-    
-    Serial.print("Connecting via DHCP");
-    int attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 30) {
-        delay(500);
-        Serial.print(".");
-        attempts++;
-        yield(); // Feed watchdog
-    }
-    
-    if (WiFi.status() == WL_CONNECTED) {
-        Serial.printf("\n✅ DHCP connection successful. IP: %s\n", WiFi.localIP().toString().c_str());
-        return true;
-    }
-    
-    Serial.println("\n❌ DHCP connection failed");
-    return false;
-}
@@ -2,6 +2,9 @@
 #include "sensor_communication.h"
 #include "config_handler.h"
 #include "experiment_manager.h"
+#include "mqtt_command_dispatch.h"
+#include "mqtt_heartbeat.h"
+#include "mqtt_presence.h"
 #include <WiFi.h>
 #include <algorithm>
 
@@ -16,206 +19,148 @@ extern uint16_t mqttPort;
 // MQTT status
 bool mqttConnected = false;
 
+// Keys kept when parsing config/command payloads
+static StaticJsonDocument<MQTT_COMMAND_FILTER_SIZE> commandFilter;
+
+// Retained heartbeat rate limiter
+static MqttHeartbeat heartbeat;
+
+// Every publish goes through here so the runtime metrics see it
+static bool publishCounted(const char* topic, const uint8_t* payload, size_t length, bool retained = false) {
+    bool ok = mqttClient.publish(topic, payload, length, retained);
+    if (ok) {
+        metrics.counter(METRIC_MQTT_PUBLISHES).add();
+        metrics.counter(METRIC_MQTT_PUBLISH_BYTES).add(length);
+    } else {
+        metrics.counter(METRIC_MQTT_PUBLISH_FAILURES).add();
+    }
+    return ok;
+}
+
 void setupMQTT() {
     mqttClient.setServer(mqttBroker, mqttPort);
     mqttClient.setCallback(mqttCallback);
+    mqttClient.setKeepAlive(MQTT_KEEPALIVE_SECONDS); // PINGREQ handled by mqttClient.loop()
+    heartbeat.begin(sensorID.c_str());
+
+    addExperimentFilterKeys(commandFilter);
+    commandFilter["fleet_size"] = true;
+    if (commandFilter.overflowed()) {
+        Serial.println("ERROR: MQTT command filter full, config keys will be ignored");
+    }
     
     Serial.println("MQTT client configured");
 }
 
 void reconnectMQTT() {
-    // Loop until we're reconnected
-    while (!mqttClient.connected()) {
-        Serial.print("Attempting MQTT connection...");
-        
-        // Create a client ID with sensor ID
-        String clientId = "ESP32_" + sensorID;
-        
-        // Attempt to connect
-        if (mqttClient.connect(clientId.c_str())) {
-            Serial.println("connected");
-            mqttConnected = true;
-            
-            // Subscribe to config and command topics with QoS 1 to match backend
-            char configTopic[50];
-            snprintf(configTopic, sizeof(configTopic), MQTT_CONFIG_TOPIC, sensorID.c_str());
-            mqttClient.subscribe(configTopic, 1); // QoS 1
-            
-            char commandTopic[50];
-            snprintf(commandTopic, sizeof(commandTopic), MQTT_COMMAND_TOPIC, sensorID.c_str());
-            mqttClient.subscribe(commandTopic, 1); // QoS 1
-            
-            Serial.printf("Subscribed to: %s and %s\n", configTopic, commandTopic);
-            
-            // Publish sensor identification
-            publishSensorIdentification();
-            
-        } else {
-            Serial.print("failed, rc=");
-            Serial.print(mqttClient.state());
-            Serial.println(" try again in 5 seconds");
-            
-            // Wait 5 seconds before retrying
-            delay(5000);
-        }
+    // One attempt per call; mqttLoop() retries every 5 seconds
+    Serial.print("Attempting MQTT connection...");
+    String clientId = "ESP32_" + sensorID;
+    if (!connectMqttSession(mqttClient, clientId.c_str(), sensorType.c_str(), sensorID.c_str())) {
+        Serial.print("failed, rc=");
+        Serial.print(mqttClient.state());
+        Serial.println(" try again in 5 seconds");
+        return;
+    }
+
+    Serial.println("connected");
+    mqttConnected = true;
+    metrics.counter(METRIC_MQTT_CONNECTS).add();
+    if (diagnostics.bootToMqttMs == 0) {
+        diagnostics.bootToMqttMs = millis();
+        Serial.printf("Boot to MQTT connected: %lu ms (WiFi %lu ms)\n",
+                      (unsigned long)diagnostics.bootToMqttMs, (unsigned long)diagnostics.wifiConnectMs);
+        bootTrace.mark("mqtt");
+        bootTrace.complete();
+        bootTrace.print(Serial);
+        publishBootTrace();
     }
+
+    // Replace the retained last-will with our online presence
+    publishSensorIdentification();
+
+    // Continue a run the last reset interrupted (resume mode)
+    resumeInterruptedRun();
 }
 
 void mqttCallback(char* topic, byte* payload, unsigned int length) {
-    Serial.printf("Message arrived [%s]\n", topic);
-    Serial.printf("Payload length: %d\n", length);
-    
-    // Log raw payload for debugging
-    Serial.print("Raw payload: ");
-    for (unsigned int i = 0; i < min(length, 50u); i++) {
-        if (payload[i] >= 32 && payload[i] <= 126) {
-            Serial.print((char)payload[i]);
-        } else {
-            Serial.printf("\\x%02X", payload[i]);
-        }
-    }
-    Serial.println();
-    
-    // Handle different topic types
-    String topicStr = String(topic);
-    
-    if (topicStr.endsWith("/config")) {
-        Serial.println("Config topic detected - processing...");
-        handleMQTTCommands(topic, payload, length);
-    } else if (topicStr.endsWith("/command")) {
-        Serial.println("Command topic detected - processing...");
-        handleMQTTCommands(topic, payload, length);
-    } else {
-        Serial.println("Unknown topic type");
-    }
+    MQTT_LOGF("Message arrived [%s] (%u bytes)\n", topic, length);
+    handleMQTTCommands(topic, payload, length);
 }
 
 void handleMQTTCommands(char* topic, byte* payload, unsigned int length) {
-    // Create a buffer for the payload
-    char message[length + 1];
-    memcpy(message, payload, length);
-    message[length] = '\0';
-    
-    Serial.printf("Received MQTT message: %s\n", message);
-    Serial.printf("Raw payload (first 20 bytes): ");
-    for (unsigned int i = 0; i < min(length, 20u); i++) {
-        Serial.printf("%02X ", payload[i]);
+    MqttTopicKind kind = mqttTopicKind(topic);
+    if (kind == MQTT_TOPIC_UNKNOWN) {
+        MQTT_LOGF("Unknown topic type: %s\n", topic);
+        return;
     }
-    Serial.println();
-    
-    // Parse JSON message
-    DynamicJsonDocument doc(512);
-    DeserializationError error = deserializeJson(doc, message);
-    
+
+    // Parse in place from the PubSubClient buffer into a stack document;
+    // the filter drops any keys we do not act on
+    StaticJsonDocument<MQTT_COMMAND_DOC_SIZE> doc;
+    DeserializationError error = deserializeJson(doc, (char*)payload, length,
+                                                 DeserializationOption::Filter(commandFilter));
+
     if (error) {
-        Serial.printf("JSON parse error: %s\n", error.c_str());
+        MQTT_LOGF("JSON parse error: %s\n", error.c_str());
         return;
     }
-    
-    // Handle different command types
-    String topicStr = String(topic);
-    
-    if (topicStr.endsWith("/config")) {
-        // Handle configuration updates
-        if (doc.containsKey("freq")) {
-            config.frequency = doc["freq"];
-            Serial.printf("Frequency updated to: %d\n", config.frequency);
-            updateTimerFrequency(config.frequency);
-        }
-        
-        if (doc.containsKey("maxRange")) {
-            config.maxRange = doc["maxRange"];
-            Serial.printf("Max range updated to: %d\n", config.maxRange);
-        }
-        
-        if (doc.containsKey("duration")) {
-            config.duration = doc["duration"];
-            Serial.printf("Duration updated to: %d\n", config.duration);
-        }
-        
-        if (doc.containsKey("averagingSamples")) {
-            config.averagingSamples = doc["averagingSamples"];
-            Serial.printf("Averaging samples updated to: %d\n", config.averagingSamples);
-        }
-        
-        publishStatus("config_updated", "Configuration updated successfully");
-        
-    } else if (topicStr.endsWith("/command")) {
-        // Handle command messages
-        const char* command = doc["command"];
-        
-        if (strcmp(command, "start_experiment") == 0) {
-            experimentRunning = true;
-            experimentStartTime = millis();
-            sampleCount = 0;
-            Serial.println("Experiment started via MQTT");
-            publishStatus("experiment_started");
-            
-        } else if (strcmp(command, "stop_experiment") == 0) {
-            experimentRunning = false;
-            dataReady = true;
-            Serial.println("Experiment stopped via MQTT");
-            publishStatus("experiment_stopped");
-            
-        } else if (strcmp(command, "pause_experiment") == 0) {
-            experimentRunning = false;
-            Serial.println("Experiment paused via MQTT");
-            publishStatus("experiment_paused");
-            
-        } else if (strcmp(command, "resume_experiment") == 0) {
-            experimentRunning = true;
-            Serial.println("Experiment resumed via MQTT");
-            publishStatus("experiment_resumed");
-            
-        } else if (strcmp(command, "disconnect_device") == 0) {
-            Serial.println("Disconnect command received - cleaning firmware and booting to OTA");
-            publishStatus("disconnecting", "Device disconnecting and booting to OTA");
-            
-            // Clean up and prepare for OTA boot
-            delay(1000); // Give time for status message to be sent
-            
-            // Clean firmware partition and boot to OTA
-            cleanFirmwareAndBootOTA();
-        }
+
+    // The heartbeat lives here; everything else is the experiment runtime's
+    if (kind == MQTT_TOPIC_CONFIG && !doc["fleet_size"].isNull()) {
+        heartbeat.setFleetSize(doc["fleet_size"].as<uint16_t>());
+        MQTT_LOGF("Heartbeat interval now %lu ms\n", heartbeat.interval());
     }
+
+    handleExperimentMessage(kind, doc.as<JsonVariantConst>());
 }
 
-void publishBinarySensorData(const BinarySample* samples, uint16_t count, uint32_t start_time, uint16_t total_samples) {
+bool publishBinarySensorData(const BinarySample* samples, uint16_t count, uint32_t start_time, uint16_t total_samples) {
     if (!mqttClient.connected() || count == 0) {
-        return;
+        return false;
     }
     
-    // Calculate packet size
-    size_t packet_size = BINARY_HEADER_SIZE + (count * sizeof(BinarySample));
+    size_t packet_size = BinaryPacket<SensorTraits>::size(count);
     
     // Allocate buffer for binary packet
     uint8_t* packet_buffer = (uint8_t*)malloc(packet_size);
     if (!packet_buffer) {
         Serial.println("ERROR: Failed to allocate memory for binary packet");
-        return;
+        diagnostics.publishFailures++;
+        metrics.counter(METRIC_MQTT_PUBLISH_FAILURES).add();
+        return false;
     }
     
-    // Fill packet header
-    BinaryPacketHeader* header = (BinaryPacketHeader*)packet_buffer;
-    header->version = BINARY_PROTOCOL_VERSION;
-    header->sensor_type = (sensorType == "TOF") ? 1 : 0; // 1=TOF, 0=other
-    header->packet_id = (uint16_t)(millis() & 0xFFFF); // Simple packet ID
-    header->sample_count = count;
-    header->total_samples = total_samples;
-    header->start_timestamp = start_time;
-    
-    // Copy sample data
-    BinarySample* packet_samples = (BinarySample*)(packet_buffer + BINARY_HEADER_SIZE);
-    memcpy(packet_samples, samples, count * sizeof(BinarySample));
+    // Header (sensor_type fixed by SensorTraits) and samples
+    BinaryPacket<SensorTraits>::write(packet_buffer, samples, count, (uint16_t)(millis() & 0xFFFF), total_samples,
+                                      start_time);
     
     // Publish to binary data topic
     char binaryTopic[50];
     snprintf(binaryTopic, sizeof(binaryTopic), MQTT_BINARY_DATA_TOPIC, sensorID.c_str());
     
-    mqttClient.publish(binaryTopic, packet_buffer, packet_size);
+    bool ok = publishCounted(binaryTopic, packet_buffer, packet_size);
+    if (!ok) {
+        diagnostics.publishFailures++;
+    }
     
     // Free buffer
     free(packet_buffer);
+    return ok;
+}
+
+void publishSampleTiming() {
+    if (!mqttClient.connected()) {
+        return;
+    }
+
+    SampleTimingPacket packet = sampleTiming.snapshot();
+    char timingTopic[50];
+    snprintf(timingTopic, sizeof(timingTopic), MQTT_TIMING_TOPIC, sensorID.c_str());
+
+    if (!publishCounted(timingTopic, (const uint8_t*)&packet, sizeof(packet))) {
+        diagnostics.publishFailures++;
+    }
 }
 
 void publishStatus(const char* status, const char* message) {
@@ -240,39 +185,121 @@ void publishStatus(const char* status, const char* message) {
     char statusTopic[50];
     snprintf(statusTopic, sizeof(statusTopic), MQTT_STATUS_TOPIC, sensorID.c_str());
     
-    mqttClient.publish(statusTopic, payload.c_str());
+    publishCounted(statusTopic, (const uint8_t*)payload.c_str(), payload.length());
 }
 
-void publishSensorIdentification() {
+void publishStatusJson(const char* json, size_t length) {
     if (!mqttClient.connected()) {
         return;
     }
-    
-    // Create JSON payload
-    DynamicJsonDocument doc(256);
-    doc["type"] = "sensor_identify";
-    doc["sensor_id"] = sensorID;
-    doc["sensor_type"] = sensorType;
-    doc["paired"] = config.userPaired;
-    doc["paired_user"] = config.pairedUserID;
-    
-    String payload;
-    serializeJson(doc, payload);
-    
-    // Publish to status topic
+
     char statusTopic[50];
     snprintf(statusTopic, sizeof(statusTopic), MQTT_STATUS_TOPIC, sensorID.c_str());
-    
-    mqttClient.publish(statusTopic, payload.c_str());
-    Serial.println("Published sensor identification via MQTT");
+    publishCounted(statusTopic, (const uint8_t*)json, length);
+}
+
+static void publishPresence(bool online) {
+    char payload[MQTT_PRESENCE_MAX_SIZE];
+    int len = formatMqttPresence(payload, sizeof(payload), sensorType.c_str(), sensorID.c_str(),
+                                 config.userPaired ? config.pairedUserID.c_str() : nullptr, online);
+    if (len == 0) {
+        return;
+    }
+
+    char statusTopic[50];
+    snprintf(statusTopic, sizeof(statusTopic), MQTT_STATUS_TOPIC, sensorID.c_str());
+
+    publishCounted(statusTopic, (const uint8_t*)payload, len, true); // Retained presence record
+}
+
+// Retained, so the backend always holds the latest boot timeline of each sensor
+void publishBootTrace() {
+    char payload[BOOT_TRACE_JSON_SIZE];
+    size_t len = bootTrace.formatJson(payload, sizeof(payload));
+    if (len == 0 || !mqttClient.connected()) {
+        return;
+    }
+
+    char bootTopic[50];
+    snprintf(bootTopic, sizeof(bootTopic), MQTT_BOOT_TOPIC, sensorID.c_str());
+
+    publishCounted(bootTopic, (const uint8_t*)payload, len, true);
+}
+
+void publishSensorIdentification() {
+    if (!mqttClient.connected()) {
+        return;
+    }
+
+    publishPresence(true);
+    Serial.println("Published sensor presence via MQTT");
+}
+
+void publishPresenceOffline() {
+    if (!mqttClient.connected()) {
+        return;
+    }
+
+    // Graceful DISCONNECT suppresses the last-will, so clear the retained record ourselves
+    publishPresence(false);
+}
+
+void publishHeartbeat() {
+    if (!mqttClient.connected()) {
+        return;
+    }
+
+    char payload[64];
+    int len = formatMqttHeartbeat(payload, sizeof(payload), millis(), WiFi.RSSI(), bufferedSampleCount());
+    if (len == 0) {
+        return;
+    }
+
+    char heartbeatTopic[50];
+    snprintf(heartbeatTopic, sizeof(heartbeatTopic), MQTT_HEARTBEAT_TOPIC, sensorID.c_str());
+
+    publishCounted(heartbeatTopic, (const uint8_t*)payload, len, true); // Retained
+}
+
+void publishRuntimeMetrics() {
+    if (!mqttClient.connected()) {
+        return;
+    }
+
+    char payload[RUNTIME_METRICS_JSON_SIZE];
+    MetricsBuffer out(payload, sizeof(payload));
+    metrics.writeJson(out, WiFi.RSSI());
+    if (out.overflowed()) {
+        Serial.println("WARNING: runtime metrics truncated, not published");
+        return;
+    }
+
+    char metricsTopic[50];
+    snprintf(metricsTopic, sizeof(metricsTopic), RUNTIME_METRICS_TOPIC, sensorID.c_str());
+
+    publishCounted(metricsTopic, (const uint8_t*)payload, out.length());
+}
+
+#if ASYNC_LOG_MQTT_LEVEL
+// async_log sink: "<level letter> <line>" on sensors/<id>/log, without the newline
+static void publishLogLine(uint8_t level, const char* line, size_t length) {
+    if (length > 0 && line[length - 1] == '\n') {
+        length--;
+    }
+    char payload[ASYNC_LOG_LINE_SIZE + 2];
+    int len = snprintf(payload, sizeof(payload), "%c %.*s", AsyncLog::levelLetter(level), (int)length, line);
+
+    char topic[50];
+    snprintf(topic, sizeof(topic), ASYNC_LOG_TOPIC, sensorID.c_str());
+
+    publishCounted(topic, (const uint8_t*)payload, len);
 }
+#endif
 
 // MQTT loop function to be called in main loop
 void mqttLoop() {
     static unsigned long lastReconnectAttempt = 0;
-    static unsigned long lastKeepalivePing = 0;
     const unsigned long reconnectInterval = 5000; // 5 seconds between reconnection attempts
-    const unsigned long keepaliveInterval = 15000; // Send ping every 15 seconds to maintain connection
     
     if (!mqttClient.connected()) {
         mqttConnected = false;
@@ -284,17 +311,33 @@ void mqttLoop() {
             reconnectMQTT();
         }
     } else {
+        // Also sends PINGREQ when the keepalive interval elapses without traffic
         mqttClient.loop();
-        
-        // Send periodic keepalive ping to maintain connection
-        unsigned long now = millis();
-        if (now - lastKeepalivePing > keepaliveInterval) {
-            lastKeepalivePing = now;
-            
-            // Publish empty message to keep connection alive
-            char statusTopic[50];
-            snprintf(statusTopic, sizeof(statusTopic), MQTT_STATUS_TOPIC, sensorID.c_str());
-            mqttClient.publish(statusTopic, ""); // Empty payload ping
+
+#if MQTT_HEARTBEAT_ENABLED
+        if (heartbeat.due(millis())) {
+            publishHeartbeat();
+        }
+#endif
+
+        // The first sample comes after the connect that published the trace; send it again with that phase
+        static bool firstSampleTraced = false;
+        if (!firstSampleTraced && diagnostics.bootToFirstSampleMs != 0) {
+            firstSampleTraced = true;
+            publishBootTrace();
+        }
+
+#if ASYNC_LOG_MQTT_LEVEL
+        asyncLog().drainForwarded(publishLogLine);
+#endif
+
+#if RUNTIME_METRICS_INTERVAL_MS
+        // Phase-shifted per device, like the heartbeat, so a fleet does not report in step
+        static unsigned long lastMetrics = millis() - mqttHashRuntime(sensorID.c_str()) % RUNTIME_METRICS_INTERVAL_MS;
+        if (millis() - lastMetrics >= RUNTIME_METRICS_INTERVAL_MS) {
+            lastMetrics = millis();
+            publishRuntimeMetrics();
         }
+#endif
     }
 }
\ No newline at end of file
@@ -9,6 +9,10 @@ VL53L1X tofSensor;
 // Global variables
 SensorCalibration calibration;
 DiagnosticStats diagnostics;
+RuntimeMetrics metrics;
+EepromPresence sensorPresence;
+RTC_NOINIT_ATTR BootTraceRecord bootTraceRecord; // Survives the restart, see boot_trace.h
+BootTrace bootTrace(bootTraceRecord);
 String sensorType = "TOF400F_I2C";
 String sensorID = "UNKNOWN";
 bool wifiLedState = false;
@@ -44,79 +48,20 @@ bool initializeTOFSensor()
 // Detect sensor from EEPROM
 bool detectSensorFromEEPROM()
 {
-    for (int retry = 0; retry < EEPROM_RETRY_COUNT; retry++)
+    if (!readSensorTypeFromEeprom(Wire, EEPROM_SENSOR_ADDR, SENSOR_TYPE_CODES, EEPROM_RETRY_COUNT,
+                                  EEPROM_RETRY_DELAY, sensorType))
     {
-        Wire.beginTransmission(EEPROM_SENSOR_ADDR);
-        int error = Wire.endTransmission();
-        if (error == 0)
-        {
-            Wire.beginTransmission(EEPROM_SENSOR_ADDR);
-            Wire.write(0x00);
-            if (Wire.endTransmission(false) == 0)
-            {
-                Wire.requestFrom(EEPROM_SENSOR_ADDR, EEPROM_SIZE);
-                if (Wire.available() >= EEPROM_SIZE)
-                {
-                    char buffer[EEPROM_SIZE + 1];
-                    for (int i = 0; i < EEPROM_SIZE; i++)
-                    {
-                        buffer[i] = Wire.read();
-                    }
-                    buffer[EEPROM_SIZE] = '\0';
-                    String eepromData = String(buffer);
-                    Serial.printf("EEPROM data: %s\n", eepromData.c_str());
-
-                    if (eepromData == "TOF")
-                    {
-                        sensorType = eepromData;
-                        sensorLedState = true;
-                        digitalWrite(STATUS_LED, sensorLedState ? LOW : HIGH);
-                    }
-                    else
-                    {
-                        sensorType = eepromData;
-                        Serial.printf("⚠️ WARNNING!(Sensor Type: %s, ID: %s not copatible with this firmware)\n ♻ REBOOTING OTA\n", sensorType.c_str(), sensorID.c_str());
-                        return false;
-                    }
-                    Serial.printf("Sensor Type: %s, ID: %s\n", sensorType.c_str(), sensorID.c_str());
-                    return (sensorType != "UNKNOWN");
-                }
-                else
-                {
-                    Serial.println("✘ Not enough data from EEPROM");
-                }
-            }
-            else
-            {
-                Serial.println("✘ Failed to set EEPROM address");
-            }
-        }
-        else
-        {
-            Serial.printf("✘ EEPROM sensor not found, I2C error: %d\n", error);
-        }
-        if (retry < EEPROM_RETRY_COUNT - 1)
-        {
-            Serial.printf("Retrying EEPROM detection (%d/%d)...\n", retry + 1, EEPROM_RETRY_COUNT);
-            delay(EEPROM_RETRY_DELAY);
-        }
+        return false;
     }
-
-    // CRITICAL: If EEPROM detection fails completely, return false
-    // This triggers the failsafe mechanism to boot back to ESP_32_OTA
-    Serial.println("❌ EEPROM detection failed after all retries");
-    sensorType = "UNKNOWN";
-    return false;
+    sensorLedState = true;
+    digitalWrite(STATUS_LED, LOW);
+    return true;
 }
 
 // Get device ID from MAC address
 String getDeviceIDFromMAC()
 {
-    String mac = WiFi.macAddress();
-    mac.replace(":", "");
-    if (mac.length() >= 5)
-        return mac.substring(mac.length() - 5);
-    return mac;
+    return sensorIdFromMac();
 }
 
 // Configure sensor timing based on frequency
@@ -184,6 +129,19 @@ uint16_t readTOFDistanceMM()
 
     // Read distance (this clears the dataReady flag)
     uint16_t distance_mm = tofSensor.read();
+    diagnostics.totalReadings++;
+    metrics.counter(METRIC_SENSOR_READS).add();
+    if (tofSensor.last_status != 0)
+    {
+        // Wire error code of the last transfer: the result registers were not read
+        diagnostics.readErrors++;
+        metrics.counter(METRIC_SENSOR_I2C_ERRORS).add();
+    }
+    if (tofSensor.timeoutOccurred())
+    {
+        diagnostics.timeouts++;
+        metrics.counter(METRIC_SENSOR_TIMEOUTS).add();
+    }
 
     // Validate reading
     if (distance_mm >= calibration.minValidReading &&
@@ -195,18 +153,13 @@ uint16_t readTOFDistanceMM()
         consecutiveFailures = 0;
         diagnostics.successfulReadings++;
 
-        // Apply calibration offset
-        int32_t calibrated = (int32_t)distance_mm + (int32_t)calibration.offsetMM;
-        if (calibrated < 10)
-            calibrated = 10;
-        if (calibrated > 8500)
-            calibrated = 8500;
-
-        return (uint16_t)calibrated;
+        // Apply calibration offset, clamped to the wire range
+        return TofTraits::clamp((int32_t)distance_mm + (int32_t)calibration.offsetMM);
     }
     else
     {
         diagnostics.outOfRange++;
+        metrics.counter(METRIC_SENSOR_OUT_OF_RANGE).add();
         consecutiveFailures++;
 
         if (consecutiveFailures > 5)
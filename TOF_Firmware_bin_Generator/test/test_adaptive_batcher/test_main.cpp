@@ -0,0 +1,150 @@
+// AdaptiveBatcher against the native MQTT link model: a 200 Hz stream is
+// published through simMqttSetLink() at several publish costs. The batch must
+// grow on a fast link, back off when the link slows, and no sample may wait
+// longer than the latency target.
+//   pio test -e native -f test_adaptive_batcher
+#include <Arduino.h>
+#include <WiFi.h>
+#include <PubSubClient.h>
+#include <unity.h>
+#include "native_hal.h"
+#include "adaptive_batcher.h"
+
+#define SAMPLE_RATE_HZ 200
+#define LATENCY_TARGET_MS 100
+#define MAX_BATCH 64
+#define LATENCY_SLACK_MS 10 // 1 ms loop plus host scheduling
+
+static WiFiClient wifiClient;
+static PubSubClient mqttClient(wifiClient);
+
+struct StreamResult
+{
+    uint32_t publishes = 0;
+    uint32_t failures = 0;
+    uint16_t minBatch = 0xFFFF;
+    uint16_t maxBatch = 0;
+    uint32_t worstLatencyMs = 0; // Oldest sample taken -> its publish returned
+};
+
+static AdaptiveBatcher makeBatcher()
+{
+    AdaptiveBatcher batcher(MAX_BATCH);
+    batcher.setLatencyTarget(LATENCY_TARGET_MS);
+    batcher.setSampleRate(SAMPLE_RATE_HZ);
+    return batcher;
+}
+
+// Samples arrive on schedule; loop() flushes whenever the batcher says so
+static StreamResult stream(AdaptiveBatcher& batcher, uint32_t durationMs)
+{
+    static uint8_t packet[12 + 8 * MAX_BATCH]; // Header + 8-byte samples, as binary_data
+    const int64_t intervalUs = 1000000 / SAMPLE_RATE_HZ;
+    StreamResult result;
+    uint16_t buffered = 0;
+    int64_t oldestUs = 0;
+    int64_t start = esp_timer_get_time();
+    int64_t nextSampleUs = start;
+
+    while (esp_timer_get_time() - start < (int64_t)durationMs * 1000) {
+        int64_t now = esp_timer_get_time();
+        while (nextSampleUs <= now && buffered < MAX_BATCH) {
+            if (buffered == 0) {
+                oldestUs = nextSampleUs;
+            }
+            buffered++;
+            nextSampleUs += intervalUs;
+        }
+
+        if (buffered > 0 && batcher.shouldFlush(buffered, (unsigned long)((now - oldestUs) / 1000))) {
+            int64_t sent = esp_timer_get_time();
+            bool ok = mqttClient.publish("sensors/TEST0/binary_data", packet, 12 + 8 * buffered);
+            int64_t done = esp_timer_get_time();
+            batcher.onPublish(buffered, (uint32_t)(done - sent), ok);
+
+            result.publishes++;
+            if (!ok) {
+                result.failures++;
+            }
+            uint32_t latencyMs = (uint32_t)((done - oldestUs) / 1000);
+            if (latencyMs > result.worstLatencyMs) {
+                result.worstLatencyMs = latencyMs;
+            }
+            if (batcher.batchSize() < result.minBatch) {
+                result.minBatch = batcher.batchSize();
+            }
+            if (batcher.batchSize() > result.maxBatch) {
+                result.maxBatch = batcher.batchSize();
+            }
+            buffered = 0;
+        }
+        delay(1);
+    }
+    return result;
+}
+
+void setUp()
+{
+    simMqttSetLink(0, 0);
+}
+
+void tearDown() {}
+
+void test_batch_grows_on_a_fast_link()
+{
+    AdaptiveBatcher batcher = makeBatcher();
+    TEST_ASSERT_EQUAL(1, batcher.batchSize());
+
+    simMqttSetLink(100, 0);
+    StreamResult result = stream(batcher, 1500);
+
+    // Ceiling at 5 ms per sample and ~0 ms publish cost: (100 - 0) / 5 + 1 = 21
+    TEST_ASSERT_EQUAL_UINT32(0, result.failures);
+    TEST_ASSERT_GREATER_OR_EQUAL(15, batcher.batchSize());
+    TEST_ASSERT_LESS_OR_EQUAL(21, result.maxBatch);
+    TEST_ASSERT_LESS_OR_EQUAL(LATENCY_TARGET_MS + LATENCY_SLACK_MS, result.worstLatencyMs);
+}
+
+void test_batch_shrinks_when_the_link_slows()
+{
+    AdaptiveBatcher batcher = makeBatcher();
+    simMqttSetLink(100, 0);
+    stream(batcher, 1500);
+    uint16_t grown = batcher.batchSize();
+    TEST_ASSERT_GREATER_OR_EQUAL(15, grown);
+
+    // 40 ms per publish: congestion halves the batch, the ceiling drops to (100 - 40) / 5 + 1 = 13
+    simMqttSetLink(40000, 0);
+    StreamResult result = stream(batcher, 1500);
+
+    TEST_ASSERT_LESS_OR_EQUAL(grown / 2, result.minBatch);
+    TEST_ASSERT_LESS_OR_EQUAL(13, batcher.batchSize());
+    TEST_ASSERT_GREATER_OR_EQUAL(35, batcher.publishCostUs() / 1000);
+}
+
+void test_latency_target_holds_at_every_link_cost()
+{
+    static const uint32_t linkCostsUs[] = {0, 5000, 20000, 40000};
+
+    for (uint32_t costUs : linkCostsUs) {
+        AdaptiveBatcher batcher = makeBatcher();
+        simMqttSetLink(costUs, 0);
+        StreamResult result = stream(batcher, 1500);
+
+        TEST_ASSERT_EQUAL_UINT32(0, result.failures);
+        TEST_ASSERT_GREATER_THAN(0, result.publishes);
+        TEST_ASSERT_LESS_OR_EQUAL(LATENCY_TARGET_MS + LATENCY_SLACK_MS, result.worstLatencyMs);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    mqttClient.setServer("native", 1883);
+    mqttClient.connect("test_adaptive_batcher");
+
+    UNITY_BEGIN();
+    RUN_TEST(test_batch_grows_on_a_fast_link);
+    RUN_TEST(test_batch_shrinks_when_the_link_slows);
+    RUN_TEST(test_latency_target_holds_at_every_link_cost);
+    return UNITY_END();
+}
@@ -0,0 +1,62 @@
+// BootTrace against the native HAL: phase names as long as the firmware's
+// are stored whole, found again by phaseMs() and written to the JSON record.
+//   pio test -e native -f test_boot_trace
+#include <Arduino.h>
+#include <string.h>
+#include <unity.h>
+#include "native_hal.h"
+#include "boot_trace.h"
+
+static BootTraceRecord record;
+
+void setUp()
+{
+    memset(&record, 0, sizeof(record));
+}
+
+void tearDown() {}
+
+void test_longest_phase_name_is_kept_whole()
+{
+    BootTrace trace(record);
+    trace.begin();
+    trace.mark("mqtt");
+    delay(2);
+    trace.mark("first_sample");
+
+    TEST_ASSERT_EQUAL(0, strcmp(record.phases[1].name, "first_sample"));
+    TEST_ASSERT_GREATER_OR_EQUAL(trace.phaseMs("mqtt"), trace.phaseMs("first_sample"));
+    TEST_ASSERT_GREATER_THAN(0, trace.phaseMs("first_sample"));
+}
+
+void test_unknown_phase_reads_zero()
+{
+    BootTrace trace(record);
+    trace.begin();
+    trace.mark("first_sample");
+
+    TEST_ASSERT_EQUAL_UINT32(0, trace.phaseMs("first_sampl"));
+    TEST_ASSERT_EQUAL_UINT32(0, trace.phaseMs("wifi"));
+}
+
+void test_json_names_every_phase()
+{
+    BootTrace trace(record);
+    trace.begin();
+    trace.mark("wifi");
+    trace.mark("first_sample");
+
+    char json[BOOT_TRACE_JSON_SIZE];
+    TEST_ASSERT_GREATER_THAN(0, trace.formatJson(json, sizeof(json)));
+    TEST_ASSERT_TRUE(strstr(json, "[\"wifi\",") != nullptr);
+    TEST_ASSERT_TRUE(strstr(json, "[\"first_sample\",") != nullptr);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_longest_phase_name_is_kept_whole);
+    RUN_TEST(test_unknown_phase_reads_zero);
+    RUN_TEST(test_json_names_every_phase);
+    return UNITY_END();
+}
@@ -0,0 +1,110 @@
+// LedController against the native HAL: pattern timings, idempotent set(),
+// and blinking from the one-shot esp_timer with no update() calls.
+//   pio test -e native -f test_led_controller
+#include <Arduino.h>
+#include <unity.h>
+#include "native_hal.h"
+#include "LedController.h"
+#include "LedController.cpp" // shared/ is an include path, not a library
+
+static const uint8_t LED_PIN = 5;
+
+// Active LOW, as every LED on the sensor boards
+static bool ledOn()
+{
+    return simGpioOutput(LED_PIN) == LOW;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_blink_timing_of_every_state()
+{
+    unsigned long on = 0;
+    unsigned long off = 0;
+
+    TEST_ASSERT_FALSE(LedController::blinkTiming(LedController::OFF, on, off));
+    TEST_ASSERT_FALSE(LedController::blinkTiming(LedController::ON, on, off));
+    TEST_ASSERT_FALSE(LedController::blinkTiming(LedController::BLINK_CUSTOM, on, off));
+
+    TEST_ASSERT_TRUE(LedController::blinkTiming(LedController::BLINK_SLOW, on, off));
+    TEST_ASSERT_EQUAL_UINT32(1000, on);
+    TEST_ASSERT_EQUAL_UINT32(1000, off);
+
+    TEST_ASSERT_TRUE(LedController::blinkTiming(LedController::BLINK_FAST, on, off));
+    TEST_ASSERT_EQUAL_UINT32(200, on);
+    TEST_ASSERT_EQUAL_UINT32(200, off);
+
+    TEST_ASSERT_TRUE(LedController::blinkTiming(LedController::BLINK_PULSE, on, off));
+    TEST_ASSERT_EQUAL_UINT32(150, on);
+    TEST_ASSERT_EQUAL_UINT32(2850, off);
+}
+
+void test_set_is_idempotent()
+{
+    LedController led(LED_PIN);
+    led.begin();
+
+    led.set(LedController::ON);
+    uint32_t writes = simGpioWrites(LED_PIN);
+    led.set(LedController::ON);
+    TEST_ASSERT_EQUAL_UINT32(writes, simGpioWrites(LED_PIN));
+    TEST_ASSERT_TRUE(ledOn());
+
+    // 300 ms into BLINK_FAST the LED is in its off phase; asking again must not restart it
+    led.set(LedController::BLINK_FAST);
+    delay(300);
+    TEST_ASSERT_FALSE(ledOn());
+    writes = simGpioWrites(LED_PIN);
+    led.set(LedController::BLINK_FAST);
+    TEST_ASSERT_FALSE(ledOn());
+    TEST_ASSERT_EQUAL_UINT32(writes, simGpioWrites(LED_PIN));
+}
+
+void test_set_blink_runs_a_custom_pattern_from_the_timer()
+{
+    LedController led(LED_PIN);
+    led.begin();
+
+    led.setBlink(100, 150);
+    TEST_ASSERT_EQUAL(LedController::BLINK_CUSTOM, led.getState());
+    TEST_ASSERT_TRUE(ledOn());
+
+    delay(50); // 0..100 ms on
+    TEST_ASSERT_TRUE(ledOn());
+    delay(125); // 100..250 ms off
+    TEST_ASSERT_FALSE(ledOn());
+    delay(125); // 250..350 ms on
+    TEST_ASSERT_TRUE(ledOn());
+
+    // A preset pattern leaves BLINK_CUSTOM
+    led.set(LedController::BLINK_SLOW);
+    TEST_ASSERT_EQUAL(LedController::BLINK_SLOW, led.getState());
+}
+
+void test_off_stops_the_pattern()
+{
+    LedController led(LED_PIN);
+    led.begin();
+
+    led.set(LedController::BLINK_FAST);
+    delay(50);
+    led.set(LedController::OFF);
+    TEST_ASSERT_EQUAL(LedController::OFF, led.getState());
+    TEST_ASSERT_FALSE(ledOn());
+
+    uint32_t writes = simGpioWrites(LED_PIN);
+    delay(450);
+    TEST_ASSERT_EQUAL_UINT32(writes, simGpioWrites(LED_PIN));
+    TEST_ASSERT_FALSE(ledOn());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_blink_timing_of_every_state);
+    RUN_TEST(test_set_is_idempotent);
+    RUN_TEST(test_set_blink_runs_a_custom_pattern_from_the_timer);
+    RUN_TEST(test_off_stops_the_pattern);
+    return UNITY_END();
+}
@@ -0,0 +1,84 @@
+// LedController built with LED_CONTROLLER_POLLED: no esp_timer, patterns
+// advance only from update() in loop().
+//   pio test -e native -f test_led_controller_polled
+#define LED_CONTROLLER_POLLED 1
+
+#include <Arduino.h>
+#include <unity.h>
+#include "native_hal.h"
+#include "LedController.h"
+#include "LedController.cpp" // shared/ is an include path, not a library
+
+static const uint8_t LED_PIN = 5;
+
+// Active LOW, as every LED on the sensor boards
+static bool ledOn()
+{
+    return simGpioOutput(LED_PIN) == LOW;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_update_drives_the_pattern()
+{
+    LedController led(LED_PIN);
+    led.begin();
+
+    led.setBlink(100, 150);
+    TEST_ASSERT_TRUE(ledOn());
+
+    // Nothing toggles between update() calls
+    delay(175);
+    TEST_ASSERT_TRUE(ledOn());
+
+    // On time elapsed; the off phase runs from this update()
+    led.update();
+    TEST_ASSERT_FALSE(ledOn());
+    delay(100);
+    led.update();
+    TEST_ASSERT_FALSE(ledOn());
+    delay(100);
+    led.update();
+    TEST_ASSERT_TRUE(ledOn());
+}
+
+void test_set_is_idempotent()
+{
+    LedController led(LED_PIN);
+    led.begin();
+
+    led.set(LedController::BLINK_FAST);
+    delay(250);
+    led.update(); // Off phase
+    TEST_ASSERT_FALSE(ledOn());
+
+    uint32_t writes = simGpioWrites(LED_PIN);
+    led.set(LedController::BLINK_FAST);
+    led.update();
+    TEST_ASSERT_FALSE(ledOn());
+    TEST_ASSERT_EQUAL_UINT32(writes, simGpioWrites(LED_PIN));
+}
+
+void test_off_ignores_update()
+{
+    LedController led(LED_PIN);
+    led.begin();
+
+    led.set(LedController::BLINK_FAST);
+    led.set(LedController::OFF);
+    uint32_t writes = simGpioWrites(LED_PIN);
+    delay(250);
+    led.update();
+    TEST_ASSERT_EQUAL_UINT32(writes, simGpioWrites(LED_PIN));
+    TEST_ASSERT_FALSE(ledOn());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_update_drives_the_pattern);
+    RUN_TEST(test_set_is_idempotent);
+    RUN_TEST(test_off_ignores_update);
+    return UNITY_END();
+}
@@ -2,6 +2,10 @@
 #define EXPERIMENT_MANAGER_H
 
 #include <Arduino.h>
+#include <ArduinoJson.h>
+#include "mqtt_command_dispatch.h"
+#include "sample_timing.h"
+#include "async_log.h"
 
 // LED pin definitions
 #define STATUS_LED 13
@@ -24,24 +28,37 @@ extern unsigned long lastSampleTime;
 extern int sampleInterval;
 
 // Sensor detection variables
-extern unsigned long lastSensorCheck;
 extern const unsigned long SENSOR_CHECK_INTERVAL;
 extern bool sensorWasPresent;
 extern unsigned long lastExperimentEnd;
 
+// Samples waiting to be published
+uint16_t bufferedSampleCount();
+
+// Sampling jitter and ISR-to-read latency of the current run
+extern SampleTiming &sampleTiming;
+
 // Backend cleanup flag
 extern bool backendCleanupRequested;
 
-// Adaptive batching constants
-#define BATCH_1_5HZ 2
-#define BATCH_10_20HZ 5
-#define BATCH_30_50HZ 10
-#define BATCH_HIGH_FREQ 15
-
 // Experiment management functions
 void manageExperimentLoop();
 void checkSensorStatus();
 void handleBackendCleanup();
+uint16_t currentBatchSize();
+void resetSamplingRun();
+// Bulk mode: upload the stopped run from manageExperimentLoop(), then report experiment_stopped
+void requestStoppedRunUpload();
+
+// Config and run progress kept in NVS
+void loadPersistedState();
+void saveConfig();
+uint32_t configGeneration();
+void resumeInterruptedRun();
+
+// Config and command topics (experiment_runtime.h)
+void addExperimentFilterKeys(JsonDocument& filter);
+void handleExperimentMessage(MqttTopicKind kind, JsonVariantConst msg);
 
 // Hardware timer functions
 bool initHardwareTimer();
@@ -5,6 +5,7 @@
 #include <WiFi.h>
 #include <PubSubClient.h>
 #include <ArduinoJson.h>
+#include "sensor_traits.h"
 
 // MQTT configuration
 extern PubSubClient mqttClient;
@@ -17,39 +18,38 @@ extern uint16_t mqttPort;
 #define MQTT_CONFIG_TOPIC "sensors/%s/config"
 #define MQTT_COMMAND_TOPIC "sensors/%s/command"
 #define MQTT_BINARY_DATA_TOPIC "sensors/%s/binary_data"
-
-// Binary protocol definitions
-#define BINARY_PROTOCOL_VERSION 1
-#define BINARY_HEADER_SIZE 12  // Fixed: version(1) + sensor_type(1) + packet_id(2) + sample_count(2) + total_samples(2) + start_timestamp(4)
-#define BINARY_SAMPLE_SIZE 8
-#define BINARY_MAX_SAMPLES_PER_PACKET 10
-
-// Binary protocol packet structure
-#pragma pack(push, 1)
-typedef struct {
-    uint8_t version;          // Protocol version
-    uint8_t sensor_type;      // Sensor type identifier
-    uint16_t packet_id;       // Sequential packet ID
-    uint16_t sample_count;    // Number of samples in this packet
-    uint16_t total_samples;   // Total samples in experiment
-    uint32_t start_timestamp; // Experiment start timestamp
-    // Followed by sample_count * BINARY_SAMPLE_SIZE bytes of sample data
-} BinaryPacketHeader;
-
-typedef struct {
-    uint32_t timestamp;       // Sample timestamp (ms since start)
-    uint16_t distance;        // Distance measurement
-    uint16_t sample_number;   // Sequential sample number
-} BinarySample;
-#pragma pack(pop)
+#define MQTT_TIMING_TOPIC "sensors/%s/timing"
+
+// Fixed parse buffers for incoming config/command payloads, sized by key count:
+// a slot is 16 bytes on the ESP32 but 32 on a 64-bit native build.
+// MQTT_COMMAND_KEYS must match the keys setupMQTT() puts in the filter.
+#define MQTT_COMMAND_KEYS 9
+#define MQTT_COMMAND_FILTER_SIZE JSON_OBJECT_SIZE(MQTT_COMMAND_KEYS)
+#define MQTT_COMMAND_DOC_SIZE (2 * MQTT_COMMAND_FILTER_SIZE) // Room for a nested value
+
+// Binary protocol: header, sample record and sensor_type come from this firmware's traits
+typedef UltrasonicTraits SensorTraits;
+typedef SensorTraits::Sample BinarySample;
+
+// PubSubClient allocates its buffer once from MQTT_MAX_PACKET_SIZE (set in platformio.ini);
+// a packet must fit it together with the MQTT fixed header, topic length and topic
+#define BINARY_PACKET_OVERHEAD (MQTT_MAX_HEADER_SIZE + 2 + 50)
+#define BINARY_PACKET_SAMPLE_ROOM ((MQTT_MAX_PACKET_SIZE - BINARY_PACKET_OVERHEAD - BINARY_HEADER_SIZE) / BINARY_SAMPLE_SIZE)
+#define BINARY_MAX_SAMPLES_PER_PACKET (BINARY_PACKET_SAMPLE_ROOM < 256 ? BINARY_PACKET_SAMPLE_ROOM : 256)
+static_assert(MQTT_MAX_PACKET_SIZE > BINARY_PACKET_OVERHEAD + BINARY_HEADER_SIZE + BINARY_SAMPLE_SIZE,
+              "MQTT_MAX_PACKET_SIZE too small for a binary sample packet");
 
 // MQTT functions
 void setupMQTT();
 void reconnectMQTT();
 void mqttCallback(char* topic, byte* payload, unsigned int length);
-void publishBinarySensorData(const BinarySample* samples, uint16_t count, uint32_t start_time, uint16_t total_samples);
+bool publishBinarySensorData(const BinarySample* samples, uint16_t count, uint32_t start_time, uint16_t total_samples);
 void publishStatus(const char* status, const char* message = nullptr);
+void publishStatusJson(const char* json, size_t length); // Preformatted record, e.g. run_resumed
+void publishSampleTiming();
 void publishSensorIdentification();
+void publishPresenceOffline();
+void publishHeartbeat();
 void handleMQTTCommands(char* topic, byte* payload, unsigned int length);
 void mqttLoop();
 
@@ -3,6 +3,9 @@
 
 #include <Arduino.h>
 #include <Wire.h>
+#include "eeprom_presence.h"
+#include "sensor_runtime.h"
+#include "sensor_traits.h"
 
 // External declarations
 // No external sensor object needed for HC-SR04
@@ -23,6 +26,7 @@
 #define EEPROM_SIZE 3
 #define EEPROM_RETRY_COUNT 3
 #define EEPROM_RETRY_DELAY 1000
+#define SENSOR_TYPE_CODES "ULTTOF" // Accepted 3-byte EEPROM codes, back to back
 
 // Frequency configuration
 #define DEFAULT_FREQUENCY 30
@@ -30,7 +34,7 @@
 #define MIN_FREQUENCY 10
 
 // HC-SR04 specific configuration
-#define MAX_DISTANCE_MM 4000 // Maximum reliable distance for HC-SR04 (400cm = 4000mm)
+#define MAX_DISTANCE_MM UltrasonicTraits::maxValue // Maximum reliable distance for HC-SR04 (400cm = 4000mm)
 #define SOUND_SPEED 0.0343   // Speed of sound in cm/μs
 #define TIMEOUT_MICROS 30000 // Timeout for pulseIn (30ms)
 
@@ -51,6 +55,9 @@ struct DiagnosticStats
     uint32_t readErrors = 0;
     uint32_t timeouts = 0;
     uint32_t outOfRange = 0;
+    uint32_t publishFailures = 0;
+    uint32_t wifiConnectMs = 0;   // WiFi.begin() to connected, this boot
+    uint32_t bootToMqttMs = 0;    // Boot to first MQTT connect
 };
 
 // Function declarations
@@ -66,6 +73,7 @@ bool setSensorTiming(int frequency);
 // External variables
 extern SensorCalibration calibration;
 extern DiagnosticStats diagnostics;
+extern EepromPresence sensorPresence;
 extern String sensorType;
 extern String sensorID;
 
@@ -0,0 +1,98 @@
+// Host microbenchmarks ([env:bench]) for the inbound MQTT paths: command and
+// config parsing through handleMQTTCommands(), with the status record each
+// one publishes. Replaces main_sensor.cpp; the firmware modules are linked
+// unchanged and publish into the native_hal broker with no link delay.
+// The board-side suite is TOF's [env:esp32dev_bench].
+//
+//   .pio/build/bench/program [--filter=config] [--baseline=saved_run.txt]
+#include <Arduino.h>
+#include <WiFi.h>
+#include "native_hal.h"
+#include "microbench.h"
+
+#include "../include/sensor_communication.h"
+#include "../include/config_handler.h"
+#include "../include/experiment_manager.h"
+#include "../include/mqtt_handler.h"
+
+// Defined by main_sensor.cpp and config_handler.cpp on the board
+ExperimentConfig config;
+char mqttBroker[40] = "127.0.0.1";
+uint16_t mqttPort = 1883;
+
+void cleanFirmwareAndBootOTA() {
+    // disconnect_device is not benchmarked
+}
+
+// The payload is copied each iteration: ArduinoJson parses it in place, as
+// it does the PubSubClient buffer
+static void runCommand(MicroBench::State& state, const char* topicFormat, const char* payload) {
+    if (!mqttClient.connected()) {
+        state.skip("MQTT not connected");
+        return;
+    }
+    char topic[50];
+    snprintf(topic, sizeof(topic), topicFormat, sensorID.c_str());
+    size_t length = strlen(payload);
+    byte buffer[MQTT_COMMAND_DOC_SIZE];
+    while (state.keepRunning()) {
+        memcpy(buffer, payload, length);
+        handleMQTTCommands(topic, buffer, length);
+    }
+    state.setBytesProcessed(length);
+}
+
+// Dispatch plus the experiment_paused status it publishes
+static void BM_handleMQTTCommands_command(MicroBench::State& state) {
+    runCommand(state, MQTT_COMMAND_TOPIC, "{\"command\":\"pause_experiment\",\"request_id\":\"a1b2c3d4\"}");
+}
+MICROBENCH(BM_handleMQTTCommands_command);
+
+// Config fields that touch no hardware (freq would re-arm the timer), plus the config_updated status
+static void BM_handleMQTTCommands_config(MicroBench::State& state) {
+    runCommand(state, MQTT_CONFIG_TOPIC,
+               "{\"maxRange\":4000,\"duration\":30,\"averagingSamples\":4,\"latencyTargetMs\":200,\"bulkUpload\":false}");
+}
+MICROBENCH(BM_handleMQTTCommands_config);
+
+static bool loadBaselineFile(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return false;
+    }
+    std::string text;
+    char chunk[512];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        text.append(chunk, n);
+    }
+    fclose(f);
+    return MicroBench::loadBaseline(text.c_str()) > 0;
+}
+
+void setup() {
+    Serial.begin(115200);
+    Serial.println("\n=== Ultrasonic Firmware - microbenchmarks ===");
+
+    sensorType = "ULT";
+    sensorID = "BENCH";
+    const char* baselinePath = simOption("baseline");
+    if (baselinePath && !loadBaselineFile(baselinePath)) {
+        printf("[bench] no %s rows in %s\n", MicroBench::kTickUnit, baselinePath);
+    }
+    WiFi.mode(WIFI_STA);
+    WiFi.begin("native", "");
+    setupMQTT();
+    reconnectMQTT();
+
+    int regressions = MicroBench::runAll(Serial, simOption("filter"));
+    if (regressions) {
+        Serial.printf("%d benchmark(s) more than %d%% slower than the baseline\n", regressions,
+                      MICROBENCH_REGRESSION_PCT);
+    }
+    simExit(regressions ? 1 : 0);
+}
+
+void loop() {
+    delay(1000);
+}
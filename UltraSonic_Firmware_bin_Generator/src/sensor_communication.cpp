@@ -8,6 +8,7 @@
 // Global variables
 SensorCalibration calibration;
 DiagnosticStats diagnostics;
+EepromPresence sensorPresence;
 String sensorType = "ULTRASONIC";
 String sensorID = "UNKNOWN";
 bool wifiLedState = false;
@@ -37,79 +38,20 @@ bool initializeUltrasonicSensor()
 // Detect sensor from EEPROM
 bool detectSensorFromEEPROM()
 {
-    for (int retry = 0; retry < EEPROM_RETRY_COUNT; retry++)
+    if (!readSensorTypeFromEeprom(Wire, EEPROM_SENSOR_ADDR, SENSOR_TYPE_CODES, EEPROM_RETRY_COUNT,
+                                  EEPROM_RETRY_DELAY, sensorType))
     {
-        Wire.beginTransmission(EEPROM_SENSOR_ADDR);
-        int error = Wire.endTransmission();
-        if (error == 0)
-        {
-            Wire.beginTransmission(EEPROM_SENSOR_ADDR);
-            Wire.write(0x00);
-            if (Wire.endTransmission(false) == 0)
-            {
-                Wire.requestFrom(EEPROM_SENSOR_ADDR, EEPROM_SIZE);
-                if (Wire.available() >= EEPROM_SIZE)
-                {
-                    char buffer[EEPROM_SIZE + 1];
-                    for (int i = 0; i < EEPROM_SIZE; i++)
-                    {
-                        buffer[i] = Wire.read();
-                    }
-                    buffer[EEPROM_SIZE] = '\0';
-                    String eepromData = String(buffer);
-                    Serial.printf("EEPROM data: %s\n", eepromData.c_str());
-
-                    if (eepromData == "ULT" || eepromData == "TOF")
-                    {
-                        sensorType = eepromData;
-                        sensorLedState = true;
-                        digitalWrite(SENSOR_LED, sensorLedState ? LOW : HIGH);
-                    }
-                    else
-                    {
-                        sensorType = eepromData;
-                        Serial.printf("⚠️ WARNNING!(Sensor Type: %s, ID: %s not copatible with this firmware)\n ♻ REBOOTING OTA", sensorType.c_str(), sensorID.c_str());
-                        return false;
-                    }
-                    Serial.printf("Sensor Type: %s, ID: %s\n", sensorType.c_str(), sensorID.c_str());
-                    return (sensorType != "UNKNOWN");
-                }
-                else
-                {
-                    Serial.println("✘ Not enough data from EEPROM");
-                }
-            }
-            else
-            {
-                Serial.println("✘ Failed to set EEPROM address");
-            }
-        }
-        else
-        {
-            Serial.printf("✘ EEPROM sensor not found, I2C error: %d\n", error);
-        }
-        if (retry < EEPROM_RETRY_COUNT - 1)
-        {
-            Serial.printf("Retrying EEPROM detection (%d/%d)...\n", retry + 1, EEPROM_RETRY_COUNT);
-            delay(EEPROM_RETRY_DELAY);
-        }
+        return false;
     }
-
-    // CRITICAL: If EEPROM detection fails completely, return false
-    // This triggers the failsafe mechanism to boot back to ESP_32_OTA
-    Serial.println("❌ EEPROM detection failed after all retries");
-    sensorType = "UNKNOWN";
-    return false;
+    sensorLedState = true;
+    digitalWrite(SENSOR_LED, LOW);
+    return true;
 }
 
 // Get device ID from MAC address
 String getDeviceIDFromMAC()
 {
-    String mac = WiFi.macAddress();
-    mac.replace(":", "");
-    if (mac.length() >= 5)
-        return mac.substring(mac.length() - 5);
-    return mac;
+    return sensorIdFromMac();
 }
 
 // Configure sensor timing based on frequency
@@ -192,13 +134,8 @@ uint16_t readUltrasonicDistanceCM()
         float calibrated = distance_mm + (calibration.offsetCM * 10);
         calibrated = calibrated * calibration.scaleFactor;
 
-        // Clamp to valid range (convert cm ranges to mm)
-        if (calibrated < 20)
-            calibrated = 20; // 2cm min
-        if (calibrated > MAX_DISTANCE_MM)
-            calibrated = MAX_DISTANCE_MM;
-
-        return (uint16_t)calibrated;
+        // Clamp to the wire range (2cm..MAX_DISTANCE_MM)
+        return UltrasonicTraits::clamp((int32_t)calibrated);
     }
     else
     {
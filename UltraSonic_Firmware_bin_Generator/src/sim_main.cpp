@@ -0,0 +1,183 @@
+// Host-native entry point ([env:native]): runs the firmware modules unchanged
+// against shared/native_hal, with a simulated HC-SR04, ID EEPROM and an
+// in-process MQTT broker. Replaces main_sensor.cpp (WiFi provisioning, LEDs,
+// HTTP server) and config_handler.cpp (HTTP handlers).
+//
+//   .pio/build/native/program --freq=50 --duration=10 [--latency=200] [--bulk]
+//                             [--link-us=400] [--link-bps=250000] [--quiet] [--broker=host:port] [--resume]
+//
+// With SIM_NVS_FILE set, config and run progress survive the process; --resume turns on
+// resume mode, so a run killed mid-way continues in the next process instead of restarting.
+#include <Arduino.h>
+#include <Wire.h>
+#include <WiFi.h>
+#include "native_hal.h"
+#include "sim_devices.h"
+
+#include "../include/sensor_communication.h"
+#include "../include/config_handler.h"
+#include "../include/experiment_manager.h"
+#include "../include/mqtt_handler.h"
+
+#define SIM_RUN_GRACE_MS 10000
+
+// Defined by main_sensor.cpp and config_handler.cpp on the board
+ExperimentConfig config;
+char mqttBroker[40] = "127.0.0.1";
+uint16_t mqttPort = 1883;
+
+// Target swinging 300..1500 mm every 3 s, +-5 mm noise
+static SimEeprom24C02 idEeprom("ULT");
+static SimHCSR04 echoDevice(TRIG_PIN, ECHO_PIN, SimSignal{900, 600, 3000, 10});
+
+static std::atomic<uint32_t> packetsPublished{0};
+static std::atomic<uint32_t> samplesPublished{0};
+static unsigned long runDeadline = 0;
+static bool fleetMode = false;
+
+static unsigned long optionValue(const char* name, unsigned long fallback) {
+    const char* value = simOption(name);
+    return (value && *value) ? strtoul(value, nullptr, 10) : fallback;
+}
+
+// --broker=host:port joins a real broker instead (tools/fleet_sim); runs are then driven over MQTT
+static void useBrokerOption() {
+    const char* broker = simOption("broker");
+    if (!broker || !*broker) {
+        return;
+    }
+    const char* colon = strrchr(broker, ':');
+    int hostLen = colon ? (int)(colon - broker) : (int)strlen(broker);
+    snprintf(mqttBroker, sizeof(mqttBroker), "%.*s", hostLen, broker);
+    if (colon) {
+        mqttPort = (uint16_t)atoi(colon + 1);
+    }
+    simMqttUseNetwork(true);
+    fleetMode = true;
+}
+
+static void countPublish(const char* topic, const uint8_t* payload, unsigned int length, bool retained) {
+    (void)retained;
+    size_t topicLen = strlen(topic);
+    if (topicLen > 12 && strcmp(topic + topicLen - 12, "/binary_data") == 0 && length >= BINARY_HEADER_SIZE) {
+        packetsPublished++;
+        samplesPublished += ((const BinaryPacketHeader*)payload)->sample_count;
+    }
+}
+
+void cleanFirmwareAndBootOTA() {
+    Serial.println("Cleaning firmware and booting to OTA partition...");
+    experimentRunning = false;
+    dataReady = false;
+    if (mqttClient.connected()) {
+        publishPresenceOffline();
+        mqttClient.disconnect();
+    }
+    ESP.restart();
+}
+
+static void finishRun(int status) {
+    SimMqttStats stats = simMqttStats();
+    int expected = config.frequency * config.duration;
+    printf("\n[native] %d Hz x %d s, %s upload, latency target %d ms\n", config.frequency, config.duration,
+           config.bulkUpload ? "bulk" : "streamed", config.latencyTargetMs);
+    printf("[native] samples stored   %d/%d\n", sampleCount, expected);
+    printf("[native] samples sent     %u in %u packets (%.1f per packet)\n", samplesPublished.load(),
+           packetsPublished.load(), packetsPublished ? (double)samplesPublished / packetsPublished : 0.0);
+    printf("[native] MQTT publishes   %u ok, %u rejected, %llu payload bytes\n", stats.published, stats.rejected,
+           (unsigned long long)stats.publishedBytes);
+    printf("[native] publish time     %.1f us avg, %llu us total\n",
+           stats.published ? (double)stats.publishUs / stats.published : 0.0, (unsigned long long)stats.publishUs);
+    printf("[native] sensor pings     %u, publish failures %u\n", echoDevice.pings(), diagnostics.publishFailures);
+    SampleTimingPacket timing = sampleTiming.snapshot();
+    printf("[native] timer ticks      %u serviced, %u missed, interval %u..%u us, read latency max %u us\n",
+           timing.ticks, timing.missed, timing.interval_min_us, timing.interval_max_us, timing.latency_max_us);
+    printf("[native] histograms      ");
+    for (int i = 0; i < SAMPLE_TIMING_BUCKETS - 1; i++) {
+        printf(" <%lu:%u/%u", SAMPLE_TIMING_BUCKET_US(i), timing.interval_jitter[i], timing.latency[i]);
+    }
+    printf(" more:%u/%u (us, jitter/latency)\n", timing.interval_jitter[SAMPLE_TIMING_BUCKETS - 1],
+           timing.latency[SAMPLE_TIMING_BUCKETS - 1]);
+    simExit(status);
+}
+
+void setup() {
+    Serial.begin(115200);
+    asyncLog().begin(); // Sampling task logs through the ring, see async_log.h
+    simSerialEcho(simOption("quiet") == nullptr);
+    Serial.println("\n=== Ultrasonic Firmware - native simulation ===");
+
+    idEeprom.attach(Wire);
+    echoDevice.attach();
+    simMqttSetLink(optionValue("link-us", 0), optionValue("link-bps", 0));
+    simMqttOnPublish(countPublish);
+
+    Wire.begin(EEPROM_SDA, EEPROM_SCL);
+
+    if (!initializeUltrasonicSensor()) {
+        Serial.println("WARNING: Ultrasonic Sensor init issues - check wiring");
+    }
+    loadPersistedState();
+
+    if (!initHardwareTimer()) {
+        Serial.println("ERROR: Hardware timer initialization failed");
+    }
+
+    WiFi.mode(WIFI_STA);
+    WiFi.begin("native", "");
+
+    if (!detectSensorFromEEPROM()) {
+        finishRun(1);
+    }
+    sensorWasPresent = true;
+    sensorPresence.begin(Wire, EEPROM_SENSOR_ADDR, SENSOR_TYPE_CODES, SENSOR_CHECK_INTERVAL,
+                         EEPROM_RETRY_COUNT, EEPROM_RETRY_DELAY, sensorType.c_str());
+
+    sensorID = getDeviceIDFromMAC();
+    useBrokerOption();
+    setupMQTT();
+    reconnectMQTT();
+    if (fleetMode || experimentRunning) {
+        return; // Driven over MQTT, or resumed an interrupted run on connect
+    }
+
+    // What the backend sends to start a run
+    char topic[50];
+    char payload[160];
+    snprintf(topic, sizeof(topic), MQTT_CONFIG_TOPIC, sensorID.c_str());
+    snprintf(payload, sizeof(payload),
+             "{\"freq\":%lu,\"duration\":%lu,\"latencyTargetMs\":%lu,\"bulkUpload\":%s,\"resume\":%s}",
+             optionValue("freq", config.frequency), optionValue("duration", config.duration),
+             optionValue("latency", config.latencyTargetMs), simOption("bulk") ? "true" : "false",
+             simOption("resume") ? "true" : "false");
+    simMqttInject(topic, payload);
+    snprintf(topic, sizeof(topic), MQTT_COMMAND_TOPIC, sensorID.c_str());
+    simMqttInject(topic, "{\"command\":\"start_experiment\"}");
+}
+
+void loop() {
+    static bool runStarted = false;
+
+    checkSensorStatus();
+    handleBackendCleanup();
+    mqttLoop();
+    manageExperimentLoop();
+
+    if (fleetMode) {
+        delay(1);
+        return;
+    }
+    if (experimentRunning && !runStarted) {
+        runStarted = true;
+        runDeadline = millis() + config.duration * 1000UL + SIM_RUN_GRACE_MS;
+    }
+    if (runStarted && !experimentRunning) {
+        finishRun(0);
+    }
+    if (runStarted && (long)(millis() - runDeadline) > 0) {
+        printf("[native] run did not complete in time\n");
+        finishRun(1);
+    }
+
+    delay(1);
+}
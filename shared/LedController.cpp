@@ -5,65 +5,145 @@ LedController::LedController(int pin, bool activeLow) {
     _activeLow = activeLow;
     _currentState = OFF;
     _lastUpdate = 0;
+    _logicState = false;
     _onDuration = 500;
     _offDuration = 500;
+    _timer = NULL;
+    portMUX_TYPE unlocked = portMUX_INITIALIZER_UNLOCKED;
+    _mux = unlocked;
+}
+
+LedController::~LedController() {
+    if (_timer != NULL) {
+        esp_timer_stop(_timer);
+        esp_timer_delete(_timer);
+    }
 }
 
 void LedController::begin() {
     pinMode(_pin, OUTPUT);
     turnOff(); // Default to off
+
+#if !LED_CONTROLLER_POLLED
+    if (_timer == NULL) {
+        esp_timer_create_args_t args = {};
+        args.callback = &LedController::onTimer;
+        args.arg = this;
+        args.dispatch_method = ESP_TIMER_TASK;
+        args.name = "led";
+        if (esp_timer_create(&args, &_timer) != ESP_OK) {
+            _timer = NULL; // Fall back to update()
+        }
+    }
+#endif
+}
+
+void LedController::writePin(bool on) {
+    digitalWrite(_pin, on != _activeLow ? HIGH : LOW);
+    _logicState = on;
 }
 
 void LedController::turnOn() {
-    digitalWrite(_pin, _activeLow ? LOW : HIGH);
-    _logicState = true;
+    portENTER_CRITICAL(&_mux);
+    writePin(true);
+    portEXIT_CRITICAL(&_mux);
 }
 
 void LedController::turnOff() {
-    digitalWrite(_pin, _activeLow ? HIGH : LOW);
-    _logicState = false;
+    portENTER_CRITICAL(&_mux);
+    writePin(false);
+    portEXIT_CRITICAL(&_mux);
 }
 
-void LedController::set(State state) {
-    _currentState = state;
-    
+bool LedController::blinkTiming(State state, unsigned long& onTime, unsigned long& offTime) {
     switch (state) {
-        case OFF:
-            turnOff();
-            break;
-        case ON:
-            turnOn();
-            break;
         case BLINK_SLOW:
-            setBlink(1000, 1000);
-            break;
+            onTime = 1000;
+            offTime = 1000;
+            return true;
         case BLINK_FAST:
-            setBlink(200, 200);
-            break;
+            onTime = 200;
+            offTime = 200;
+            return true;
         case BLINK_PULSE:
-            setBlink(150, 2850);
-            break;
+            onTime = 150;
+            offTime = 2850;
+            return true;
         default:
-            break;
+            return false;
     }
 }
 
+void LedController::set(State state) {
+    unsigned long onTime = _onDuration;
+    unsigned long offTime = _offDuration;
+    if (state == BLINK_CUSTOM || blinkTiming(state, onTime, offTime)) {
+        startBlink(state, onTime, offTime);
+        return;
+    }
+
+    bool on = state == ON;
+    if (state == _currentState && _logicState == on) {
+        return;
+    }
+    if (_timer != NULL) {
+        esp_timer_stop(_timer);
+    }
+    // A callback already past its state check re-arms once more and then finds OFF/ON
+    portENTER_CRITICAL(&_mux);
+    _currentState = state;
+    writePin(on);
+    portEXIT_CRITICAL(&_mux);
+}
+
 void LedController::setBlink(unsigned long onTime, unsigned long offTime) {
+    startBlink(BLINK_CUSTOM, onTime, offTime);
+}
+
+void LedController::startBlink(State state, unsigned long onTime, unsigned long offTime) {
+    if (state == _currentState && onTime == _onDuration && offTime == _offDuration) {
+        return; // Already running; restarting would reset the phase
+    }
+    if (_timer != NULL) {
+        esp_timer_stop(_timer);
+    }
+    portENTER_CRITICAL(&_mux);
+    _currentState = state;
     _onDuration = onTime;
     _offDuration = offTime;
-    _currentState = BLINK_CUSTOM;
+    _lastUpdate = millis();
+    writePin(true);
+    portEXIT_CRITICAL(&_mux);
+
+    if (_timer != NULL) {
+        // Fails only if a callback re-armed in the meantime; it picks up the new durations
+        esp_timer_start_once(_timer, (uint64_t)(onTime > 0 ? onTime : 1) * 1000);
+    }
 }
 
-void LedController::update() {
+void LedController::onTimer(void* arg) {
+    LedController* led = static_cast<LedController*>(arg);
+    unsigned long next = 0;
+
+    portENTER_CRITICAL(&led->_mux);
+    if (led->_currentState != OFF && led->_currentState != ON) {
+        led->writePin(!led->_logicState);
+        next = led->_logicState ? led->_onDuration : led->_offDuration;
+        if (next == 0) {
+            next = 1;
+        }
+    }
+    portEXIT_CRITICAL(&led->_mux);
+
+    if (next > 0) {
+        esp_timer_start_once(led->_timer, (uint64_t)next * 1000);
+    }
+}
+
+void LedController::poll() {
     if (_currentState == OFF || _currentState == ON) return;
 
     unsigned long now = millis();
-    unsigned long cycleTime = _onDuration + _offDuration;
-    unsigned long currentCyclePos = (now - _lastUpdate) % cycleTime;
-
-    // Use modulo math to handle timing without resetting _lastUpdate constantly
-    // But simplistic approach:
-    
     if (_logicState) {
         // Currently ON
         if (now - _lastUpdate >= _onDuration) {
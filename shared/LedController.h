@@ -2,7 +2,23 @@
 #define LED_CONTROLLER_H
 
 #include <Arduino.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
 
+// 1 = blink from update() in loop() instead of an esp_timer
+#ifndef LED_CONTROLLER_POLLED
+#define LED_CONTROLLER_POLLED 0
+#endif
+
+/**
+ * Blink patterns run from a one-shot esp_timer that toggles the pin and
+ * re-arms itself with the next on/off duration, so they keep time while
+ * loop() is busy and update() costs nothing. If the timer cannot be created
+ * (or LED_CONTROLLER_POLLED is set) update() drives the pattern as before.
+ *
+ * set() is idempotent: asking for the state that is already running does not
+ * restart the pattern, so loop() may re-assert a state on every pass.
+ */
 class LedController {
 public:
     enum State {
@@ -15,10 +31,15 @@ public:
     };
 
     LedController(int pin, bool activeLow = true);
-    
+    ~LedController();
+
     void begin();
-    void update();
-    
+    void update() {
+        if (_timer == NULL) {
+            poll();
+        }
+    }
+
     void set(State state);
     void setBlink(unsigned long onTime, unsigned long offTime);
     void turnOn();
@@ -26,18 +47,29 @@ public:
 
     State getState() const { return _currentState; }
 
+    // On/off durations of the fixed patterns; false for OFF, ON and BLINK_CUSTOM
+    static bool blinkTiming(State state, unsigned long& onTime, unsigned long& offTime);
+
 private:
+    static void onTimer(void* arg);
+
+    void startBlink(State state, unsigned long onTime, unsigned long offTime);
+    void writePin(bool on);
+    void poll();
+
     int _pin;
     bool _activeLow;
-    State _currentState;
-    
+    volatile State _currentState;
+
     unsigned long _lastUpdate;
-    bool _ledState; // Physical state (HIGH/LOW) specific to active logic
     bool _logicState; // Logical state (true=ON, false=OFF)
-    
+
     // Blink timing
     unsigned long _onDuration;
     unsigned long _offDuration;
+
+    esp_timer_handle_t _timer; // NULL: polled from update()
+    portMUX_TYPE _mux;         // Pattern state shared with the esp_timer task
 };
 
 #endif
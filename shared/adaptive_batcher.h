@@ -0,0 +1,117 @@
+#pragma once
+/**
+ * @file adaptive_batcher.h
+ * @brief Feedback-controlled sample batching for streamed sensor data
+ *
+ * Decides when the buffered samples should be published so that the oldest
+ * sample never waits longer than a configurable end-to-end latency target,
+ * while packing as many samples per packet as that budget allows.
+ *
+ * The batch size follows an AIMD rule driven by measured publish time:
+ *  - every on-time publish of a full batch grows the batch by one sample,
+ *    up to the largest batch whose fill time plus the smoothed publish cost
+ *    still fits the latency target;
+ *  - a failed publish, or one that blocks for more than a sample interval
+ *    and twice its usual cost, halves the batch.
+ *
+ * WiFiClient::write() blocks until the TCP send buffer has taken the whole
+ * packet, so publish blocking time doubles as the send-buffer back-pressure
+ * signal; the ESP32 client does not expose free send space directly.
+ *
+ * Usage:
+ * @code
+ * static AdaptiveBatcher batcher(BINARY_MAX_SAMPLES_PER_PACKET);
+ *
+ * batcher.setSampleRate(config.frequency);
+ * if (batcher.shouldFlush(bufferedSampleCount, oldestSampleAgeMs)) {
+ *     uint32_t t0 = micros();
+ *     bool ok = publish(...);
+ *     batcher.onPublish(bufferedSampleCount, micros() - t0, ok);
+ * }
+ * @endcode
+ */
+
+#include <stdint.h>
+
+// Default end-to-end latency target (oldest sample buffered -> publish done)
+#ifndef BATCH_LATENCY_TARGET_MS
+#define BATCH_LATENCY_TARGET_MS 200
+#endif
+
+class AdaptiveBatcher {
+public:
+    explicit AdaptiveBatcher(uint16_t maxBatch)
+        : _maxBatch(maxBatch ? maxBatch : 1) {}
+
+    void setLatencyTarget(uint16_t ms) {
+        _targetMs = ms ? ms : 1;
+        clamp();
+    }
+
+    void setSampleRate(int hz) {
+        _intervalUs = hz > 0 ? 1000000UL / (unsigned long)hz : 1000000UL;
+        clamp();
+    }
+
+    uint16_t batchSize() const { return _batch; }
+    uint16_t latencyTarget() const { return _targetMs; }
+    uint32_t publishCostUs() const { return _costUs; }
+
+    /**
+     * @brief true when the buffer is full for the current batch or the oldest sample is due
+     */
+    bool shouldFlush(uint16_t buffered, unsigned long oldestAgeMs) const {
+        if (buffered == 0) {
+            return false;
+        }
+        return buffered >= _batch || oldestAgeMs + _costUs / 1000 >= _targetMs;
+    }
+
+    /**
+     * @brief Feed back the outcome of one publish
+     *
+     * @param count      samples that were in the packet
+     * @param elapsedUs  time spent inside publish()
+     * @param ok         publish() return value
+     */
+    void onPublish(uint16_t count, uint32_t elapsedUs, bool ok) {
+        bool congested = !ok || (_costUs > 0 && elapsedUs > 2 * _costUs && elapsedUs > _intervalUs);
+
+        // EWMA with alpha = 1/8
+        _costUs = _costUs ? _costUs - (_costUs >> 3) + (elapsedUs >> 3) : elapsedUs;
+
+        if (congested) {
+            _batch = _batch > 1 ? _batch / 2 : 1;
+        } else if (count >= _batch) {
+            _batch++;
+        }
+        clamp();
+    }
+
+private:
+    // Largest batch whose fill time plus publish cost fits the latency target
+    uint16_t ceiling() const {
+        uint32_t costMs = _costUs / 1000;
+        if (costMs >= _targetMs) {
+            return 1;
+        }
+        uint32_t fill = (uint32_t)(_targetMs - costMs) * 1000UL / _intervalUs + 1;
+        return fill < _maxBatch ? (uint16_t)fill : _maxBatch;
+    }
+
+    void clamp() {
+        uint16_t limit = ceiling();
+        if (_batch > limit) {
+            _batch = limit;
+        }
+        if (_batch == 0) {
+            _batch = 1;
+        }
+    }
+
+    uint16_t _maxBatch;
+    uint16_t _batch = 1;
+    uint16_t _targetMs = BATCH_LATENCY_TARGET_MS;
+    uint32_t _intervalUs = 1000000UL;
+    uint32_t _costUs = 0;
+};
@@ -0,0 +1,273 @@
+#pragma once
+/**
+ * @file async_log.h
+ * @brief Level-filtered logging through a lock-free ring, drained by a task
+ *
+ * Serial.printf() from the sampling task blocks it for as long as the UART
+ * needs to take the line (about 87 us per character at 115200 baud once the
+ * 128-byte FIFO is full), which is what turned a progress message into a
+ * missed tick. LOG_E/LOG_W/LOG_I/LOG_D instead format the line into a slot
+ * of a fixed ring and return; a low-priority task on core 1 writes the ring
+ * to Serial. The caller pays for vsnprintf() only.
+ *
+ * Levels above LOG_LEVEL (default LOG_LEVEL_INFO) compile to nothing, so
+ * their arguments are not evaluated either.
+ *
+ * Writers claim a slot with a compare-and-swap on the head counter and
+ * publish it with a release store of its sequence number, so any number of
+ * tasks can log without a lock. The drain task is the only reader. When the
+ * ring is full the line is dropped and counted; the drain task reports the
+ * count instead of stalling the writer.
+ *
+ * Lines at ASYNC_LOG_MQTT_LEVEL or more severe (off by default) are copied to
+ * a small second ring that the MQTT loop empties onto sensors/<id>/log, as
+ * PubSubClient may only be used from the task that runs mqttClient.loop().
+ *
+ * Usage:
+ * @code
+ * #include "async_log.h"
+ *
+ * asyncLog().begin();                           // setup(), after Serial.begin()
+ * LOG_W("%d consecutive samples missed\n", n);  // any task
+ *
+ * // MQTT loop, with -DASYNC_LOG_MQTT_LEVEL=LOG_LEVEL_WARN:
+ * asyncLog().drainForwarded(publishLogLine);
+ * @endcode
+ */
+
+#include <Arduino.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+#ifndef ASYNC_LOG_MQTT_LEVEL
+#define ASYNC_LOG_MQTT_LEVEL LOG_LEVEL_NONE
+#endif
+
+#define ASYNC_LOG_SLOTS 32
+#define ASYNC_LOG_LINE_SIZE 96
+#define ASYNC_LOG_FORWARD_SLOTS (ASYNC_LOG_MQTT_LEVEL ? 8 : 1)
+#define ASYNC_LOG_DRAIN_MS 20
+#define ASYNC_LOG_STACK 3072
+#define ASYNC_LOG_PRIORITY 1
+#define ASYNC_LOG_TOPIC "sensors/%s/log"
+
+/**
+ * @brief Fixed ring of formatted lines; many writers, one reader
+ */
+template <size_t Slots, size_t LineSize>
+class LogRing {
+public:
+    typedef void (*Sink)(uint8_t level, const char* line, size_t length);
+
+    LogRing() {
+        for (size_t i = 0; i < Slots; i++) {
+            _slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Format into a free slot; false (and counted) when the ring is full
+     */
+    bool vwrite(uint8_t level, const char* format, va_list args) {
+        Slot* slot = claim();
+        if (!slot) {
+            return false;
+        }
+        int len = vsnprintf(slot->text, LineSize, format, args);
+        commit(slot, level, len < 0 ? 0 : (len < (int)LineSize ? len : LineSize - 1));
+        return true;
+    }
+
+    bool write(uint8_t level, const char* text, size_t length) {
+        Slot* slot = claim();
+        if (!slot) {
+            return false;
+        }
+        length = length < LineSize - 1 ? length : LineSize - 1;
+        memcpy(slot->text, text, length);
+        slot->text[length] = '\0';
+        commit(slot, level, length);
+        return true;
+    }
+
+    /**
+     * @brief Pass every completed line to sink, oldest first; single reader only
+     */
+    size_t drain(Sink sink) {
+        size_t lines = 0;
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = _slots[tail % Slots];
+            // A writer that claimed this slot but has not committed yet ends the batch
+            if (slot.seq.load(std::memory_order_acquire) != tail + 1) {
+                break;
+            }
+            sink(slot.level, slot.text, slot.length);
+            slot.seq.store(tail + Slots, std::memory_order_release);
+            tail++;
+            lines++;
+        }
+        _tail.store(tail, std::memory_order_relaxed);
+        return lines;
+    }
+
+    uint32_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> seq;
+        uint8_t level;
+        uint16_t length;
+        char text[LineSize];
+    };
+
+    Slot* claim() {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = _slots[head % Slots];
+            // seq == head: free for this lap; anything less: the reader has not got here yet
+            int32_t diff = (int32_t)(slot.seq.load(std::memory_order_acquire) - head);
+            if (diff < 0) {
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            if (diff == 0 &&
+                _head.compare_exchange_weak(head, head + 1, std::memory_order_relaxed, std::memory_order_relaxed)) {
+                return &slot;
+            }
+            if (diff > 0) {
+                head = _head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void commit(Slot* slot, uint8_t level, size_t length) {
+        slot->level = level;
+        slot->length = (uint16_t)length;
+        uint32_t claimed = slot->seq.load(std::memory_order_relaxed);
+        slot->seq.store(claimed + 1, std::memory_order_release);
+    }
+
+    Slot _slots[Slots];
+    std::atomic<uint32_t> _head{0};
+    std::atomic<uint32_t> _tail{0};
+    std::atomic<uint32_t> _dropped{0};
+};
+
+class AsyncLog {
+public:
+    typedef LogRing<ASYNC_LOG_FORWARD_SLOTS, ASYNC_LOG_LINE_SIZE>::Sink Sink;
+
+    /**
+     * @brief Start the drain task; lines logged before this are kept (up to the ring size)
+     */
+    bool begin(Print& out = Serial, BaseType_t core = 1) {
+        if (_task) {
+            return true;
+        }
+        _out = &out;
+        return xTaskCreatePinnedToCore(taskEntry, "log_drain", ASYNC_LOG_STACK, this, ASYNC_LOG_PRIORITY, &_task,
+                                       core) == pdPASS;
+    }
+
+    __attribute__((format(printf, 3, 4))) void logf(uint8_t level, const char* format, ...) {
+        va_list args;
+        va_start(args, format);
+        _ring.vwrite(level, format, args);
+        va_end(args);
+    }
+
+    /**
+     * @brief Hand lines queued for MQTT to sink; call from the MQTT loop
+     */
+    size_t drainForwarded(Sink sink) { return _forward.drain(sink); }
+
+    uint32_t dropped() const { return _ring.dropped(); }
+
+    static char levelLetter(uint8_t level) {
+        static const char letters[] = "-EWID";
+        return level < sizeof(letters) - 1 ? letters[level] : '?';
+    }
+
+private:
+    static void taskEntry(void* arg) {
+        static_cast<AsyncLog*>(arg)->run();
+    }
+
+    void run() {
+        for (;;) {
+            drainOnce();
+            vTaskDelay(pdMS_TO_TICKS(ASYNC_LOG_DRAIN_MS));
+        }
+    }
+
+    void drainOnce() {
+        _ring.drain(printLine);
+        uint32_t dropped = _ring.dropped();
+        if (dropped != _reportedDropped) {
+            _out->printf("[log] %u line(s) dropped, ring full\n", (unsigned)(dropped - _reportedDropped));
+            _reportedDropped = dropped;
+        }
+    }
+
+    // Sinks are plain function pointers, so they reach the instance through asyncLog()
+    static void printLine(uint8_t level, const char* line, size_t length);
+
+    Print* _out = nullptr;
+    TaskHandle_t _task = nullptr;
+    uint32_t _reportedDropped = 0;
+    LogRing<ASYNC_LOG_SLOTS, ASYNC_LOG_LINE_SIZE> _ring;
+    LogRing<ASYNC_LOG_FORWARD_SLOTS, ASYNC_LOG_LINE_SIZE> _forward;
+};
+
+inline AsyncLog& asyncLog() {
+    static AsyncLog log;
+    return log;
+}
+
+inline void AsyncLog::printLine(uint8_t level, const char* line, size_t length) {
+    AsyncLog& log = asyncLog();
+    log._out->write((const uint8_t*)line, length);
+#if ASYNC_LOG_MQTT_LEVEL
+    if (level <= ASYNC_LOG_MQTT_LEVEL) {
+        log._forward.write(level, line, length);
+    }
+#else
+    (void)level;
+#endif
+}
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_E(...) asyncLog().logf(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_E(...) do { } while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_W(...) asyncLog().logf(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_W(...) do { } while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_I(...) asyncLog().logf(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_I(...) do { } while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_D(...) asyncLog().logf(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_D(...) do { } while (0)
+#endif
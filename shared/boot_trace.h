@@ -0,0 +1,190 @@
+#pragma once
+/**
+ * @file boot_trace.h
+ * @brief Timestamped boot phases, kept in RTC memory across resets
+ *
+ * Every OTA switch is a reboot, so time-to-first-sample is dominated by
+ * setup(). BootTrace records a timestamp (microseconds since boot) at the
+ * end of each startup phase. The record lives in RTC_NOINIT memory, which
+ * survives software resets, panics and watchdog resets, so the next boot
+ * can tell how far the previous one got when it never reached MQTT.
+ *
+ * mark() is safe to call from any task, so phases run concurrently (e.g. a
+ * sensor init task on core 0) appear in completion order.
+ *
+ * Usage:
+ * @code
+ * #include "boot_trace.h"
+ *
+ * RTC_NOINIT_ATTR BootTraceRecord bootTraceRecord;   // one definition per firmware
+ * BootTrace bootTrace(bootTraceRecord);
+ *
+ * bootTrace.begin();            // first thing in setup()
+ * bootTrace.mark("wifi");       // after each phase
+ *
+ * char json[BOOT_TRACE_JSON_SIZE];
+ * if (bootTrace.formatJson(json, sizeof(json)) > 0) mqttClient.publish(topic, json, true);
+ * @endcode
+ */
+
+#include <Arduino.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include <freertos/FreeRTOS.h>
+
+#define BOOT_TRACE_MAX_PHASES 16
+#define BOOT_TRACE_NAME_SIZE 16
+#define BOOT_TRACE_MAGIC 0xB0071AD0 // Changes with the record layout
+#define BOOT_TRACE_JSON_SIZE 640
+
+struct BootTracePhase {
+    char name[BOOT_TRACE_NAME_SIZE];
+    uint32_t us;
+};
+
+/**
+ * @brief RTC-resident record; define it with RTC_NOINIT_ATTR
+ */
+struct BootTraceRecord {
+    uint32_t magic;
+    uint32_t boots;      // Boots since power-on
+    uint8_t reset;       // esp_reset_reason() of this boot
+    uint8_t count;
+    uint8_t complete;    // Set by complete() once the firmware is online
+    BootTracePhase phases[BOOT_TRACE_MAX_PHASES];
+};
+
+class BootTrace {
+public:
+    explicit BootTrace(BootTraceRecord& record) : _rec(record) {}
+
+    /**
+     * @brief Start this boot's trace, keeping a summary of the previous one
+     */
+    void begin() {
+        esp_reset_reason_t reason = esp_reset_reason();
+        // RTC memory holds garbage after power-on
+        bool valid = reason != ESP_RST_POWERON && _rec.magic == BOOT_TRACE_MAGIC &&
+                     _rec.count <= BOOT_TRACE_MAX_PHASES;
+        _hasPrevious = valid && _rec.count > 0;
+        if (_hasPrevious) {
+            const BootTracePhase& last = _rec.phases[_rec.count - 1];
+            memcpy(_previousPhase, last.name, sizeof(_previousPhase));
+            _previousPhase[BOOT_TRACE_NAME_SIZE - 1] = '\0';
+            _previousUs = last.us;
+            _previousComplete = _rec.complete != 0;
+        }
+
+        _rec.boots = valid ? _rec.boots + 1 : 1;
+        _rec.magic = BOOT_TRACE_MAGIC;
+        _rec.reset = (uint8_t)reason;
+        _rec.count = 0;
+        _rec.complete = 0;
+    }
+
+    /**
+     * @brief Record the end of a phase (name is truncated to 15 characters)
+     */
+    void mark(const char* name) {
+        uint32_t now = (uint32_t)esp_timer_get_time();
+        portENTER_CRITICAL(&_lock);
+        if (_rec.count < BOOT_TRACE_MAX_PHASES) {
+            BootTracePhase& p = _rec.phases[_rec.count++];
+            snprintf(p.name, sizeof(p.name), "%s", name);
+            p.us = now;
+        }
+        portEXIT_CRITICAL(&_lock);
+    }
+
+    /**
+     * @brief Mark the boot as having reached its goal (e.g. MQTT connected)
+     */
+    void complete() { _rec.complete = 1; }
+
+    /**
+     * @brief Milliseconds since boot at the named phase, or 0 if not reached
+     */
+    uint32_t phaseMs(const char* name) const {
+        for (uint8_t i = 0; i < _rec.count; i++) {
+            if (strncmp(_rec.phases[i].name, name, BOOT_TRACE_NAME_SIZE) == 0) {
+                return _rec.phases[i].us / 1000;
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * @brief {"boots":3,"reset":3,"phases":[["wifi",412.6],...],"previous":{...}}
+     *
+     * Times are milliseconds since boot. "previous" is only present when the
+     * last boot never called complete(), and names the phase it stopped after.
+     * @return bytes written, 0 if the buffer is too small
+     */
+    size_t formatJson(char* buf, size_t size) const {
+        size_t n = 0;
+        if (!append(buf, size, n, "{\"boots\":%u,\"reset\":%u,\"phases\":[",
+                    (unsigned)_rec.boots, (unsigned)_rec.reset)) {
+            return 0;
+        }
+        for (uint8_t i = 0; i < _rec.count; i++) {
+            const BootTracePhase& p = _rec.phases[i];
+            if (!append(buf, size, n, "%s[\"%s\",%u.%u]", i ? "," : "", p.name,
+                        (unsigned)(p.us / 1000), (unsigned)(p.us % 1000 / 100))) {
+                return 0;
+            }
+        }
+        if (!append(buf, size, n, "]")) {
+            return 0;
+        }
+        if (_hasPrevious && !_previousComplete &&
+            !append(buf, size, n, ",\"previous\":{\"phase\":\"%s\",\"ms\":%u}", _previousPhase,
+                    (unsigned)(_previousUs / 1000))) {
+            return 0;
+        }
+        return append(buf, size, n, "}") ? n : 0;
+    }
+
+    /**
+     * @brief One line per phase with the time spent since the previous mark
+     */
+    void print(Print& out) const {
+        uint32_t prev = 0;
+        out.printf("Boot trace (boot %u, reset reason %u):\n", (unsigned)_rec.boots, (unsigned)_rec.reset);
+        for (uint8_t i = 0; i < _rec.count; i++) {
+            const BootTracePhase& p = _rec.phases[i];
+            out.printf("  %-12s %7.1f ms  (+%.1f)\n", p.name, p.us / 1000.0f, (p.us - prev) / 1000.0f);
+            prev = p.us;
+        }
+        if (_hasPrevious && !_previousComplete) {
+            out.printf("  previous boot stopped after '%s' at %u ms\n", _previousPhase,
+                       (unsigned)(_previousUs / 1000));
+        }
+    }
+
+private:
+    __attribute__((format(printf, 4, 5)))
+    static bool append(char* buf, size_t size, size_t& n, const char* fmt, ...) {
+        va_list args;
+        va_start(args, fmt);
+        int len = vsnprintf(buf + n, size - n, fmt, args);
+        va_end(args);
+        if (len < 0 || (size_t)len >= size - n) {
+            return false;
+        }
+        n += len;
+        return true;
+    }
+
+    BootTraceRecord& _rec;
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+    bool _hasPrevious = false;
+    bool _previousComplete = false;
+    char _previousPhase[BOOT_TRACE_NAME_SIZE] = {0};
+    uint32_t _previousUs = 0;
+};
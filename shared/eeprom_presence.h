@@ -0,0 +1,190 @@
+#pragma once
+/**
+ * @file eeprom_presence.h
+ * @brief Background presence check of the sensor's ID EEPROM
+ *
+ * The sensor firmwares used to re-read the EEPROM from loop() every few
+ * seconds, with up to EEPROM_RETRY_COUNT attempts EEPROM_RETRY_DELAY apart
+ * when it did not answer, which stalled sampling for seconds at a time.
+ *
+ * Here a low-priority task wakes every interval and only addresses the
+ * EEPROM (a single address byte; the ACK is the presence signal). Missing
+ * ACKs are retried inside the task before the sensor is declared gone. The
+ * 3-byte type code is read only when presence changes, and is compared as a
+ * fixed 3-byte code. loop() just polls changes(), which costs nothing while
+ * the sensor stays put.
+ *
+ * Wire is thread-safe in arduino-esp32 (HAL locks), so the task can share
+ * the bus with code running in loop().
+ *
+ * Usage:
+ * @code
+ * #include "eeprom_presence.h"
+ *
+ * EepromPresence sensorPresence;
+ * // In setup(), after the blocking boot-time detection succeeded:
+ * sensorPresence.begin(Wire, 0x50, "ULTTOF", 5000, 3, 1000, sensorType.c_str());
+ *
+ * // In loop():
+ * if (sensorPresence.changes() != lastChanges) {
+ *   lastChanges = sensorPresence.changes();
+ *   char code[EEPROM_PRESENCE_CODE_SIZE + 1];
+ *   if (sensorPresence.snapshot(code) != EepromPresence::PRESENT) { ... }
+ * }
+ * @endcode
+ */
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#define EEPROM_PRESENCE_CODE_SIZE 3
+#define EEPROM_PRESENCE_STACK 2048
+#define EEPROM_PRESENCE_PRIORITY 1
+
+/**
+ * @brief True if code (3 bytes, not terminated) is one of the accepted codes
+ *
+ * @param accepted 3-character codes back to back, e.g. "ULTTOF"
+ */
+inline bool eepromCodeAccepted(const char* code, const char* accepted) {
+    for (const char* p = accepted; p && strlen(p) >= EEPROM_PRESENCE_CODE_SIZE; p += EEPROM_PRESENCE_CODE_SIZE) {
+        if (memcmp(code, p, EEPROM_PRESENCE_CODE_SIZE) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+class EepromPresence {
+public:
+    enum State : uint8_t { UNKNOWN, PRESENT, MISMATCH, ABSENT };
+
+    /**
+     * @brief Start the probe task
+     *
+     * @param accepted      accepted type codes, see eepromCodeAccepted()
+     * @param intervalMs    time between probes
+     * @param retries       probes without ACK before the sensor counts as gone
+     * @param retryDelayMs  pause between those probes (spent in the task)
+     * @param bootCode      code read at boot, nullptr if none; seeds the
+     *                      state so the first probe does not re-read it
+     */
+    bool begin(TwoWire& wire, uint8_t address, const char* accepted, uint32_t intervalMs,
+               uint8_t retries, uint32_t retryDelayMs, const char* bootCode) {
+        if (_task) {
+            return true;
+        }
+        _wire = &wire;
+        _address = address;
+        _accepted = accepted;
+        _interval = pdMS_TO_TICKS(intervalMs);
+        _retries = retries > 0 ? retries : 1;
+        _retryDelay = pdMS_TO_TICKS(retryDelayMs);
+
+        memset(_code, 0, sizeof(_code));
+        if (bootCode && strlen(bootCode) == EEPROM_PRESENCE_CODE_SIZE) {
+            memcpy(_code, bootCode, EEPROM_PRESENCE_CODE_SIZE);
+            _state = eepromCodeAccepted(_code, _accepted) ? PRESENT : MISMATCH;
+            _acked = true;
+        } else {
+            _state = UNKNOWN;
+            _acked = false;
+        }
+        return xTaskCreatePinnedToCore(taskEntry, "eeprom_probe", EEPROM_PRESENCE_STACK, this,
+                                       EEPROM_PRESENCE_PRIORITY, &_task, 0) == pdPASS;
+    }
+
+    /**
+     * @brief Incremented by the task on every presence or type change
+     */
+    uint32_t changes() const { return _changes; }
+
+    /**
+     * @brief Current state, and the type code (NUL-terminated, empty if absent)
+     */
+    State snapshot(char code[EEPROM_PRESENCE_CODE_SIZE + 1]) {
+        portENTER_CRITICAL(&_lock);
+        State state = _state;
+        memcpy(code, _code, sizeof(_code));
+        portEXIT_CRITICAL(&_lock);
+        return state;
+    }
+
+    State state() const { return _state; }
+    uint32_t probes() const { return _probes; }
+
+private:
+    static void taskEntry(void* arg) {
+        static_cast<EepromPresence*>(arg)->run();
+    }
+
+    void run() {
+        TickType_t wake = xTaskGetTickCount();
+        for (;;) {
+            vTaskDelayUntil(&wake, _interval);
+
+            bool ack = probe();
+            for (uint8_t i = 1; !ack && i < _retries; i++) {
+                vTaskDelay(_retryDelay);
+                ack = probe();
+            }
+            if (ack == _acked && _state != UNKNOWN) {
+                continue;
+            }
+
+            char code[EEPROM_PRESENCE_CODE_SIZE + 1] = {0};
+            State state = ABSENT;
+            if (ack && readCode(code)) {
+                state = eepromCodeAccepted(code, _accepted) ? PRESENT : MISMATCH;
+            } else {
+                ack = false;
+            }
+            _acked = ack;
+
+            portENTER_CRITICAL(&_lock);
+            memcpy(_code, code, sizeof(_code));
+            _state = state;
+            portEXIT_CRITICAL(&_lock);
+            _changes++;
+        }
+    }
+
+    bool probe() {
+        _probes++;
+        _wire->beginTransmission(_address);
+        return _wire->endTransmission() == 0;
+    }
+
+    bool readCode(char* code) {
+        _wire->beginTransmission(_address);
+        _wire->write(0x00);
+        if (_wire->endTransmission(false) != 0) {
+            return false;
+        }
+        if (_wire->requestFrom((int)_address, EEPROM_PRESENCE_CODE_SIZE) < EEPROM_PRESENCE_CODE_SIZE) {
+            return false;
+        }
+        for (int i = 0; i < EEPROM_PRESENCE_CODE_SIZE; i++) {
+            code[i] = (char)_wire->read();
+        }
+        return true;
+    }
+
+    TwoWire* _wire = nullptr;
+    uint8_t _address = 0;
+    const char* _accepted = nullptr;
+    TickType_t _interval = 0;
+    uint8_t _retries = 1;
+    TickType_t _retryDelay = 0;
+    TaskHandle_t _task = nullptr;
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+
+    bool _acked = false;
+    volatile State _state = UNKNOWN;
+    char _code[EEPROM_PRESENCE_CODE_SIZE + 1] = {0};
+    volatile uint32_t _changes = 0;
+    volatile uint32_t _probes = 0;
+};
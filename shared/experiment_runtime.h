@@ -0,0 +1,238 @@
+#pragma once
+/**
+ * @file experiment_runtime.h
+ * @brief Experiment commands, config persistence and run resume for sensor firmwares
+ *
+ * TOF, UltraSonic and THR take the same MQTT commands (start, stop, pause,
+ * resume, disconnect), the same common config keys (duration, resume), keep
+ * their config in NVS and continue a run a reset interrupted. This class
+ * holds that logic once; a firmware supplies the sensor-specific parts as a
+ * driver, the way sampling_runtime.h does for the sampling task.
+ *
+ * The driver derives from ExperimentRuntime<Driver, StoredConfig> (CRTP),
+ * where StoredConfig is its NVS layout (see NvsRecord), and provides:
+ *   - Config& settings()                    the firmware's config; must have
+ *                                           int duration and bool resumeRuns
+ *   - void addConfigKeys(JsonDocument&)     its own config keys for the filter
+ *   - void applyConfig(JsonVariantConst)    apply those keys
+ *   - void storeConfig(StoredConfig&)       config -> NVS layout (zeroed first)
+ *   - void restoreConfig(StoredConfig&)     NVS layout -> config; may terminate strings in place
+ *   - bool running()
+ *   - bool resumable()                      resume mode on and the run can be continued
+ *   - uint32_t lastSample()                 number of the last sample taken
+ *   - uint32_t elapsedMs()                  run time so far
+ *   - uint32_t samplesPerCheckpoint()       most samples in RUN_CHECKPOINT_INTERVAL_MS
+ *   - uint32_t sampleLimit()                largest sample number a run can hold, 0 for none
+ *   - void beginRun(firstSample, elapsedMs) start a run (1, 0) or continue one
+ *   - bool stopRun()                        false: the driver reports experiment_stopped
+ *                                           itself once the run's data is out
+ *   - void pauseRun(), void continueRun()
+ *   - void publishStatus(status, message)
+ *   - void publishStatusJson(json, length)  a preformatted status record
+ *   - const char* sensorId()
+ *   - void disconnect()                     hand the device back to the OTA loader
+ * These must be public.
+ *
+ * Usage (firmware experiment_manager.cpp):
+ * @code
+ * #include "experiment_runtime.h"
+ *
+ * class ThrExperiment : public ExperimentRuntime<ThrExperiment, StoredConfig> {
+ * public:
+ *     ThrExperiment() : ExperimentRuntime(ThrTraits::typeId) {}
+ *     ...
+ * };
+ * static ThrExperiment experiment;
+ *
+ * experiment.loadPersistedState();               // setup()
+ * experiment.addFilterKeys(commandFilter);       // setupMQTT()
+ * experiment.handleMessage(kind, doc);           // MQTT callback
+ * experiment.resumeInterruptedRun();             // after MQTT connect
+ * experiment.checkpointRun();                    // loop()
+ * @endcode
+ */
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <string.h>
+#include "mqtt_command_dispatch.h"
+#include "run_persistence.h"
+
+// Filter keys added by addFilterKeys() besides the driver's: command, duration, resume
+#define EXPERIMENT_RUNTIME_KEYS 3
+
+template <class Driver, class StoredConfig>
+class ExperimentRuntime {
+public:
+    explicit ExperimentRuntime(uint8_t typeId) : _storedConfig("config", typeId), _checkpoint(typeId) {
+        _instance = this;
+    }
+
+    /**
+     * @brief Keys to keep when parsing config and command payloads
+     */
+    void addFilterKeys(JsonDocument& filter) {
+        filter["command"] = true;
+        filter["duration"] = true;
+        filter["resume"] = true;
+        derived().addConfigKeys(filter);
+    }
+
+    /**
+     * @brief Apply a parsed config message or dispatch a command
+     */
+    void handleMessage(MqttTopicKind kind, JsonVariantConst msg) {
+        if (kind == MQTT_TOPIC_CONFIG) {
+            applyConfigMessage(msg);
+            return;
+        }
+
+        static const MqttCommand<JsonVariantConst> commands[] = {
+            MQTT_COMMAND("start_experiment", cmdStartExperiment),
+            MQTT_COMMAND("stop_experiment", cmdStopExperiment),
+            MQTT_COMMAND("pause_experiment", cmdPauseExperiment),
+            MQTT_COMMAND("resume_experiment", cmdResumeExperiment),
+            MQTT_COMMAND("disconnect_device", cmdDisconnectDevice),
+        };
+        const char* command = msg["command"];
+        if (!mqttDispatch(commands, command, msg)) {
+            MQTT_LOGF("Unknown command: %s\n", command ? command : "(none)");
+        }
+    }
+
+    /**
+     * @brief Restore the config saved before the last reset and note an interrupted run
+     */
+    void loadPersistedState() {
+        StoredConfig stored;
+        if (_storedConfig.load(stored)) {
+            derived().restoreConfig(stored);
+            Serial.printf("Config restored from NVS (generation %u): dur=%ds, resume %s\n",
+                          (unsigned)_storedConfig.generation(), derived().settings().duration,
+                          derived().settings().resumeRuns ? "on" : "off");
+        }
+
+        _checkpoint.begin();
+        if (_checkpoint.interrupted()) {
+            Serial.println("Previous run was interrupted by a reset");
+        }
+    }
+
+    void saveConfig() {
+        StoredConfig stored;
+        memset(&stored, 0, sizeof(stored));
+        derived().storeConfig(stored);
+        _storedConfig.save(stored);
+    }
+
+    uint32_t configGeneration() const { return _storedConfig.generation(); }
+
+    /**
+     * @brief Track the run in NVS while resume mode is on; call from loop()
+     */
+    void checkpointRun() {
+        if (derived().running() && derived().resumable()) {
+            if (!_checkpoint.active()) {
+                _checkpoint.start();
+            }
+            _checkpoint.progress(derived().lastSample(), derived().elapsedMs());
+        } else if (_checkpoint.active()) {
+            _checkpoint.finish();
+        }
+    }
+
+    /**
+     * @brief Once MQTT is up: continue the run the last reset interrupted, after a gap marker
+     */
+    void resumeInterruptedRun() {
+        if (!_checkpoint.interrupted()) {
+            return;
+        }
+        if (!derived().resumable() || derived().running()) {
+            _checkpoint.finish();
+            return;
+        }
+
+        RunResumePoint resume;
+        _checkpoint.resume(derived().samplesPerCheckpoint(), resume);
+        uint32_t limit = derived().sampleLimit();
+        if (limit > 0 && resume.nextSample > limit) {
+            Serial.printf("Interrupted run was at sample %u, past the %u sample buffer; not resuming\n",
+                          (unsigned)resume.lastSample, (unsigned)limit);
+            _checkpoint.finish();
+            return;
+        }
+
+        derived().beginRun(resume.nextSample, resume.elapsedMs);
+
+        char json[RUN_RESUMED_JSON_SIZE];
+        int length = formatRunResumed(json, sizeof(json), derived().sensorId(), resume, configGeneration());
+        if (length > 0) {
+            derived().publishStatusJson(json, length);
+        }
+        Serial.printf("Run resumed at sample %u, %u ms; samples %u..%u may be missing\n", (unsigned)resume.nextSample,
+                      (unsigned)resume.elapsedMs, (unsigned)resume.lastSample + 1, (unsigned)resume.nextSample - 1);
+    }
+
+private:
+    Driver& derived() { return static_cast<Driver&>(*this); }
+    const Driver& derived() const { return static_cast<const Driver&>(*this); }
+    static Driver& instance() { return static_cast<Driver&>(*_instance); }
+
+    void applyConfigMessage(JsonVariantConst msg) {
+        derived().applyConfig(msg);
+
+        if (!msg["duration"].isNull()) {
+            derived().settings().duration = msg["duration"];
+            MQTT_LOGF("Duration updated to: %d\n", derived().settings().duration);
+        }
+
+        if (!msg["resume"].isNull()) {
+            derived().settings().resumeRuns = msg["resume"];
+            MQTT_LOGF("Resume after reset %s\n", derived().settings().resumeRuns ? "enabled" : "disabled");
+        }
+
+        saveConfig();
+        derived().publishStatus("config_updated", "Configuration updated successfully");
+    }
+
+    static void cmdStartExperiment(JsonVariantConst) {
+        instance().beginRun(1, 0);
+        MQTT_LOGF("Experiment started via MQTT\n");
+        instance().publishStatus("experiment_started", nullptr);
+    }
+
+    static void cmdStopExperiment(JsonVariantConst) {
+        MQTT_LOGF("Experiment stopped via MQTT\n");
+        if (instance().stopRun()) {
+            instance().publishStatus("experiment_stopped", nullptr);
+        }
+    }
+
+    static void cmdPauseExperiment(JsonVariantConst) {
+        instance().pauseRun();
+        MQTT_LOGF("Experiment paused via MQTT\n");
+        instance().publishStatus("experiment_paused", nullptr);
+    }
+
+    static void cmdResumeExperiment(JsonVariantConst) {
+        instance().continueRun();
+        MQTT_LOGF("Experiment resumed via MQTT\n");
+        instance().publishStatus("experiment_resumed", nullptr);
+    }
+
+    static void cmdDisconnectDevice(JsonVariantConst) {
+        Serial.println("Disconnect command received - cleaning firmware and booting to OTA");
+        instance().publishStatus("disconnecting", "Device disconnecting and booting to OTA");
+        delay(1000); // Give time for status message to be sent
+        instance().disconnect();
+    }
+
+    static ExperimentRuntime* _instance;
+
+    NvsRecord<StoredConfig> _storedConfig;
+    RunCheckpoint _checkpoint;
+};
+
+template <class Driver, class StoredConfig>
+ExperimentRuntime<Driver, StoredConfig>* ExperimentRuntime<Driver, StoredConfig>::_instance = nullptr;
@@ -0,0 +1,52 @@
+#pragma once
+/**
+ * @file hex_bytes.h
+ * @brief Hex string to byte decoding for OTA chunks, digests and signatures
+ *
+ * Every /ota/write chunk arrives hex encoded, so this runs once per input
+ * byte of every firmware upload. Kept header-only so the OTA firmware and
+ * the host benchmarks (TOF bench_main.cpp) decode through the same code.
+ *
+ * Usage:
+ * @code
+ * #include "hex_bytes.h"
+ *
+ * std::vector<uint8_t> bytes;
+ * if (!hexToBytes(hex, bytes)) {
+ *     // odd length or a non-hex character
+ * }
+ * @endcode
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <vector>
+
+inline bool hexToBytes(const String& hex, std::vector<uint8_t>& out) {
+    if (hex.length() % 2 != 0) {
+        return false;
+    }
+    out.clear();
+    out.reserve(hex.length() / 2);
+    auto toNib = [](char c) -> int {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f') {
+            return 10 + (c - 'a');
+        }
+        if (c >= 'A' && c <= 'F') {
+            return 10 + (c - 'A');
+        }
+        return -1;
+    };
+    for (size_t i = 0; i < hex.length(); i += 2) {
+        int n1 = toNib(hex[i]);
+        int n2 = toNib(hex[i + 1]);
+        if (n1 < 0 || n2 < 0) {
+            return false;
+        }
+        out.push_back((uint8_t)((n1 << 4) | n2));
+    }
+    return true;
+}
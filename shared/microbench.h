@@ -0,0 +1,290 @@
+#pragma once
+/**
+ * @file microbench.h
+ * @brief Google-Benchmark-style microbenchmarks for the host and the ESP32
+ *
+ * Benchmarks register themselves with MICROBENCH() and are timed over the
+ * `while (state.keepRunning())` loop only, so setup before the loop is free.
+ * The iteration count is calibrated until one batch takes at least
+ * MICROBENCH_MIN_TIME_US; each benchmark then runs MICROBENCH_REPETITIONS
+ * batches and the fastest is reported, which is the figure least disturbed
+ * by interrupts, WiFi and the host scheduler.
+ *
+ * Clocks: on the host std::chrono::steady_clock, reported in ns/op; on the
+ * ESP32 the CPU cycle counter, esp_cpu_get_ccount(), reported in cycles/op
+ * (ns derived from the CPU clock). The counter is per core and wraps every
+ * ~17 s at 240 MHz, far above any batch.
+ *
+ * A saved run can be passed back as a baseline; rows then gain a column with
+ * the change against it, and anything slower by more than
+ * MICROBENCH_REGRESSION_PCT is marked.
+ *
+ * Usage:
+ * @code
+ * #include "microbench.h"
+ *
+ * static void BM_hexToBytes(MicroBench::State& state) {
+ *     String hex = makeChunk(state.arg());      // not timed
+ *     std::vector<uint8_t> out;
+ *     while (state.keepRunning()) {
+ *         hexToBytes(hex, out);
+ *     }
+ *     state.setBytesProcessed(hex.length());    // per iteration
+ * }
+ * MICROBENCH_ARG(BM_hexToBytes, 2048);
+ *
+ * MicroBench::runAll(Serial);                   // one row per benchmark
+ * @endcode
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#ifdef ARDUINO_ARCH_ESP32
+#include <esp_cpu.h>
+#else
+#include <chrono>
+#endif
+
+#ifndef MICROBENCH_MIN_TIME_US
+#define MICROBENCH_MIN_TIME_US 200000
+#endif
+#ifndef MICROBENCH_REPETITIONS
+#define MICROBENCH_REPETITIONS 5
+#endif
+#ifndef MICROBENCH_MAX_ITERATIONS
+#define MICROBENCH_MAX_ITERATIONS 100000000UL
+#endif
+#ifndef MICROBENCH_REGRESSION_PCT
+#define MICROBENCH_REGRESSION_PCT 15
+#endif
+#define MICROBENCH_NAME_SIZE 48
+
+namespace MicroBench {
+
+#ifdef ARDUINO_ARCH_ESP32
+typedef uint32_t Ticks;
+inline Ticks now() {
+    return esp_cpu_get_ccount();
+}
+inline double ticksPerUs() {
+    return getCpuFrequencyMhz();
+}
+static const char* const kTickUnit = "cycles";
+#else
+typedef uint64_t Ticks;
+inline Ticks now() {
+    return (Ticks)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+inline double ticksPerUs() {
+    return 1000.0;
+}
+static const char* const kTickUnit = "ns";
+#endif
+
+class State {
+public:
+    State(uint32_t iterations, long arg) : _iterations(iterations), _remaining(iterations), _arg(arg) {}
+
+    // Starts the clock on the first call and stops it after the last iteration
+    inline bool keepRunning() {
+        if (_remaining == _iterations) {
+            _start = now();
+        }
+        if (_remaining == 0) {
+            _elapsed = now() - _start;
+            _done = true;
+            return false;
+        }
+        _remaining--;
+        return true;
+    }
+
+    long arg() const { return _arg; }
+    uint32_t iterations() const { return _iterations; }
+    Ticks elapsed() const { return _elapsed; }
+    bool finished() const { return _done; }
+
+    void setBytesProcessed(uint32_t bytesPerIteration) { _bytes = bytesPerIteration; }
+    uint32_t bytesProcessed() const { return _bytes; }
+    void skip(const char* reason) {
+        _skipped = reason;
+        _remaining = 0;
+    }
+    const char* skipped() const { return _skipped; }
+
+private:
+    uint32_t _iterations;
+    uint32_t _remaining;
+    long _arg;
+    Ticks _start = 0;
+    Ticks _elapsed = 0;
+    bool _done = false;
+    uint32_t _bytes = 0;
+    const char* _skipped = nullptr;
+};
+
+typedef void (*Function)(State&);
+
+struct Benchmark {
+    char name[MICROBENCH_NAME_SIZE];
+    Function fn;
+    long arg;
+};
+
+struct Result {
+    char name[MICROBENCH_NAME_SIZE];
+    double ticksPerOp;
+    uint32_t iterations;
+};
+
+inline std::vector<Benchmark>& registry() {
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+inline std::vector<Result>& baseline() {
+    static std::vector<Result> rows;
+    return rows;
+}
+
+struct Registrar {
+    Registrar(const char* name, Function fn) {
+        Benchmark b;
+        snprintf(b.name, sizeof(b.name), "%s", name);
+        b.fn = fn;
+        b.arg = 0;
+        registry().push_back(b);
+    }
+    Registrar(const char* name, Function fn, long arg) {
+        Benchmark b;
+        snprintf(b.name, sizeof(b.name), "%s/%ld", name, arg);
+        b.fn = fn;
+        b.arg = arg;
+        registry().push_back(b);
+    }
+};
+
+// Reads rows printed by runAll() (name, time, unit, iterations); other lines are ignored
+inline size_t loadBaseline(const char* text) {
+    baseline().clear();
+    while (text && *text) {
+        const char* eol = strchr(text, '\n');
+        size_t len = eol ? (size_t)(eol - text) : strlen(text);
+        char line[160];
+        snprintf(line, sizeof(line), "%.*s", (int)len, text);
+        Result row = {};
+        char unit[8];
+        if (line[0] != '#' && sscanf(line, "%47s %lf %7s %u", row.name, &row.ticksPerOp, unit, &row.iterations) == 4 &&
+            strcmp(unit, kTickUnit) == 0) {
+            baseline().push_back(row);
+        }
+        text = eol ? eol + 1 : nullptr;
+    }
+    return baseline().size();
+}
+
+inline const Result* baselineFor(const char* name) {
+    for (const Result& row : baseline()) {
+        if (strcmp(row.name, name) == 0) {
+            return &row;
+        }
+    }
+    return nullptr;
+}
+
+struct Sample {
+    double elapsed;
+    uint32_t bytesPerOp;
+    const char* skipped;
+    bool finished;
+};
+
+inline Sample measure(const Benchmark& b, uint32_t iterations) {
+    State state(iterations, b.arg);
+    b.fn(state);
+    return {(double)state.elapsed(), state.bytesProcessed(), state.skipped(), state.finished()};
+}
+
+inline void printRule(Print& out, int width) {
+    for (int i = 0; i < width; i++) {
+        out.write('-');
+    }
+    out.println();
+}
+
+// Runs every benchmark whose name contains filter (all when nullptr); returns the number of regressions
+inline int runAll(Print& out, const char* filter = nullptr) {
+    const double minTicks = MICROBENCH_MIN_TIME_US * ticksPerUs();
+    int regressions = 0;
+
+    out.printf("%-40s %12s %-6s %10s %12s", "Benchmark", "Time", "", "Iterations", "Throughput");
+    out.println(baseline().empty() ? "" : "  Baseline");
+    printRule(out, baseline().empty() ? 84 : 94);
+
+    for (const Benchmark& b : registry()) {
+        if (filter && !strstr(b.name, filter)) {
+            continue;
+        }
+        uint32_t iterations = 1;
+        Sample sample = measure(b, iterations);
+        while (!sample.skipped && sample.elapsed < minTicks && iterations < MICROBENCH_MAX_ITERATIONS) {
+            // Aim 40% past the minimum, growing at most tenfold per step
+            double scale = sample.elapsed > 0 ? minTicks * 1.4 / sample.elapsed : 10.0;
+            scale = scale < 2.0 ? 2.0 : (scale > 10.0 ? 10.0 : scale);
+            double next = iterations * scale;
+            iterations = next > MICROBENCH_MAX_ITERATIONS ? MICROBENCH_MAX_ITERATIONS : (uint32_t)next;
+            sample = measure(b, iterations);
+        }
+        if (sample.skipped) {
+            out.printf("%-40s skipped: %s\n", b.name, sample.skipped);
+            continue;
+        }
+        if (!sample.finished) {
+            out.printf("%-40s skipped: loop ended early\n", b.name);
+            continue;
+        }
+
+        double best = sample.elapsed;
+        for (int rep = 1; rep < MICROBENCH_REPETITIONS; rep++) {
+            double t = measure(b, iterations).elapsed;
+            best = t < best ? t : best;
+        }
+        double perOp = best / iterations;
+
+        char throughput[16] = "";
+        if (sample.bytesPerOp) {
+            double mbPerS = sample.bytesPerOp * ticksPerUs() / perOp;
+            snprintf(throughput, sizeof(throughput), "%.1f MB/s", mbPerS);
+        }
+        char versus[20] = "";
+        if (const Result* base = baselineFor(b.name)) {
+            double change = (perOp - base->ticksPerOp) * 100.0 / base->ticksPerOp;
+            bool regressed = change > MICROBENCH_REGRESSION_PCT;
+            regressions += regressed ? 1 : 0;
+            snprintf(versus, sizeof(versus), "  %+.1f%%%s", change, regressed ? " !" : "");
+        }
+        out.printf("%-40s %12.1f %-6s %10u %12s", b.name, perOp, kTickUnit, (unsigned)iterations, throughput);
+        out.println(versus);
+#ifdef ARDUINO_ARCH_ESP32
+        out.printf("%-40s %12.1f ns\n", "", perOp / ticksPerUs() * 1000.0);
+#endif
+    }
+    return regressions;
+}
+
+} // namespace MicroBench
+
+#define MICROBENCH_CONCAT_(a, b) a##b
+#define MICROBENCH_CONCAT(a, b) MICROBENCH_CONCAT_(a, b)
+
+// Registers void fn(MicroBench::State&)
+#define MICROBENCH(fn) static MicroBench::Registrar MICROBENCH_CONCAT(microbench_, __LINE__)(#fn, fn)
+
+// Registers fn once per argument, named "fn/arg"; read back with state.arg()
+#define MICROBENCH_ARG(fn, arg) \
+    static MicroBench::Registrar MICROBENCH_CONCAT(microbench_, __LINE__)(#fn, fn, (long)(arg))
@@ -0,0 +1,119 @@
+#pragma once
+/**
+ * @file mqtt_command_dispatch.h
+ * @brief Allocation-free MQTT topic and command dispatch for sensor firmwares
+ *
+ * Incoming topics are classified by hashing their last path segment
+ * ("config", "command") and commands are looked up in a static table keyed
+ * on a compile-time FNV-1a hash of the command name. Nothing here touches
+ * the heap, so a firmware can parse into a StaticJsonDocument on the stack
+ * and dispatch without any Arduino String copies.
+ *
+ * Usage in a firmware mqtt_handler.cpp:
+ * @code
+ * #include "mqtt_command_dispatch.h"
+ *
+ * static void cmdStart(JsonVariantConst msg) { ... }
+ * static void cmdStop(JsonVariantConst msg)  { ... }
+ *
+ * static const MqttCommand<JsonVariantConst> kCommands[] = {
+ *     MQTT_COMMAND("start_experiment", cmdStart),
+ *     MQTT_COMMAND("stop_experiment", cmdStop),
+ * };
+ *
+ * if (mqttTopicKind(topic) == MQTT_TOPIC_COMMAND) {
+ *     mqttDispatch(kCommands, doc["command"].as<const char*>(), doc.as<JsonVariantConst>());
+ * }
+ * @endcode
+ *
+ * Debug output is compiled out unless the firmware is built with
+ * -DMQTT_DEBUG=1.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef MQTT_DEBUG
+#define MQTT_DEBUG 0
+#endif
+
+#if MQTT_DEBUG
+#define MQTT_LOGF(...) Serial.printf(__VA_ARGS__)
+#else
+#define MQTT_LOGF(...) do { } while (0)
+#endif
+
+/**
+ * @brief Compile-time FNV-1a hash of a null-terminated string
+ */
+constexpr uint32_t mqttHash(const char* s, uint32_t h = 2166136261u) {
+    return *s ? mqttHash(s + 1, (h ^ (uint8_t)*s) * 16777619u) : h;
+}
+
+/**
+ * @brief Runtime FNV-1a hash (iterative, identical result to mqttHash)
+ */
+inline uint32_t mqttHashRuntime(const char* s) {
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h = (h ^ (uint8_t)*s++) * 16777619u;
+    }
+    return h;
+}
+
+enum MqttTopicKind : uint8_t {
+    MQTT_TOPIC_UNKNOWN = 0,
+    MQTT_TOPIC_CONFIG,
+    MQTT_TOPIC_COMMAND
+};
+
+/**
+ * @brief Classify a "sensors/<id>/<suffix>" topic by its last path segment
+ */
+inline MqttTopicKind mqttTopicKind(const char* topic) {
+    const char* slash = strrchr(topic, '/');
+    const char* suffix = slash ? slash + 1 : topic;
+
+    switch (mqttHashRuntime(suffix)) {
+        case mqttHash("config"):
+            return strcmp(suffix, "config") == 0 ? MQTT_TOPIC_CONFIG : MQTT_TOPIC_UNKNOWN;
+        case mqttHash("command"):
+            return strcmp(suffix, "command") == 0 ? MQTT_TOPIC_COMMAND : MQTT_TOPIC_UNKNOWN;
+        default:
+            return MQTT_TOPIC_UNKNOWN;
+    }
+}
+
+/**
+ * @brief One entry of a firmware's static command table
+ */
+template <typename Arg>
+struct MqttCommand {
+    uint32_t hash;
+    const char* name;
+    void (*handler)(Arg);
+};
+
+#define MQTT_COMMAND(name, fn) { mqttHash(name), name, fn }
+
+/**
+ * @brief Look up a command by name and invoke its handler
+ *
+ * @return true if a handler was found and called
+ */
+template <typename Arg, size_t N>
+inline bool mqttDispatch(const MqttCommand<Arg> (&table)[N], const char* name, Arg arg) {
+    if (name == nullptr) {
+        return false;
+    }
+
+    uint32_t h = mqttHashRuntime(name);
+    for (size_t i = 0; i < N; i++) {
+        if (table[i].hash == h && strcmp(table[i].name, name) == 0) {
+            table[i].handler(arg);
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,116 @@
+#pragma once
+/**
+ * @file mqtt_heartbeat.h
+ * @brief MQTT keepalive settings and compact retained heartbeat for sensor firmwares
+ *
+ * Connection liveness is left to the MQTT protocol: PubSubClient sends
+ * PINGREQ from loop() once MQTT_KEEPALIVE_SECONDS pass without traffic, so
+ * no application messages are needed to hold the session open.
+ *
+ * The optional heartbeat is a small retained JSON record on its own topic
+ * ("sensors/<id>/heartbeat") carrying uptime, RSSI and send-queue depth.
+ * Its period scales with the fleet size so a lab full of sensors produces
+ * a bounded aggregate rate, and each device is phase-shifted by a hash of
+ * its ID so heartbeats do not arrive in bursts.
+ *
+ * Usage in a firmware mqtt_handler.cpp:
+ * @code
+ * #include "mqtt_heartbeat.h"
+ *
+ * static MqttHeartbeat heartbeat;
+ *
+ * void setupMQTT() {
+ *     mqttClient.setKeepAlive(MQTT_KEEPALIVE_SECONDS);
+ *     heartbeat.begin(sensorID.c_str());
+ * }
+ *
+ * void mqttLoop() {
+ *     mqttClient.loop();
+ *     if (heartbeat.due(millis())) publishHeartbeat();
+ * }
+ * @endcode
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include "mqtt_command_dispatch.h"
+
+// Seconds of silence before the client sends PINGREQ (broker drops us at 1.5x)
+#ifndef MQTT_KEEPALIVE_SECONDS
+#define MQTT_KEEPALIVE_SECONDS 30
+#endif
+
+#ifndef MQTT_HEARTBEAT_ENABLED
+#define MQTT_HEARTBEAT_ENABLED 1
+#endif
+
+// Shortest heartbeat period for any single device
+#ifndef MQTT_HEARTBEAT_MIN_INTERVAL_MS
+#define MQTT_HEARTBEAT_MIN_INTERVAL_MS 60000UL
+#endif
+
+// Fleet-wide budget: one heartbeat per this many ms across all devices
+#ifndef MQTT_HEARTBEAT_PER_DEVICE_MS
+#define MQTT_HEARTBEAT_PER_DEVICE_MS 1000UL
+#endif
+
+// Assumed number of sensors sharing the broker until the backend says otherwise
+#ifndef MQTT_HEARTBEAT_FLEET_SIZE
+#define MQTT_HEARTBEAT_FLEET_SIZE 60
+#endif
+
+#define MQTT_HEARTBEAT_TOPIC "sensors/%s/heartbeat"
+
+/**
+ * @brief Format the compact heartbeat payload
+ *
+ * @return number of bytes written (excluding the terminator)
+ */
+inline int formatMqttHeartbeat(char* buf, size_t size, unsigned long uptimeMs, int rssi, unsigned queueDepth) {
+    int len = snprintf(buf, size, "{\"up\":%lu,\"rssi\":%d,\"q\":%u}", uptimeMs / 1000, rssi, queueDepth);
+    return (len < 0 || (size_t)len >= size) ? 0 : len;
+}
+
+/**
+ * @brief Rate limiter for the retained heartbeat
+ */
+class MqttHeartbeat {
+public:
+    void begin(const char* deviceId, uint16_t fleetSize = MQTT_HEARTBEAT_FLEET_SIZE) {
+        _phaseSeed = mqttHashRuntime(deviceId);
+        setFleetSize(fleetSize);
+    }
+
+    void setFleetSize(uint16_t fleetSize) {
+        unsigned long interval = (unsigned long)(fleetSize ? fleetSize : 1) * MQTT_HEARTBEAT_PER_DEVICE_MS;
+        _interval = interval > MQTT_HEARTBEAT_MIN_INTERVAL_MS ? interval : MQTT_HEARTBEAT_MIN_INTERVAL_MS;
+        _started = false;
+    }
+
+    unsigned long interval() const { return _interval; }
+
+    /**
+     * @brief true once per interval; the first beat is offset by the device phase
+     */
+    bool due(unsigned long now) {
+        if (!_started) {
+            _started = true;
+            _last = now - _interval + (_phaseSeed % _interval);
+            return false;
+        }
+        if (now - _last < _interval) {
+            return false;
+        }
+        _last += _interval;
+        if (now - _last >= _interval) {
+            _last = now; // Fell behind (e.g. reconnect stall); don't burst
+        }
+        return true;
+    }
+
+private:
+    uint32_t _phaseSeed = 0;
+    unsigned long _interval = MQTT_HEARTBEAT_MIN_INTERVAL_MS;
+    unsigned long _last = 0;
+    bool _started = false;
+};
@@ -0,0 +1,87 @@
+#pragma once
+/**
+ * @file mqtt_presence.h
+ * @brief Retained MQTT presence record and last-will for sensor firmwares
+ *
+ * Each sensor keeps exactly one retained message on "sensors/<id>/status":
+ * an "online" presence record published right after connect, replaced by
+ * the broker with the "offline" last-will if the TCP session drops without
+ * a DISCONNECT. A backend subscribing to "sensors/+/status" therefore learns
+ * the whole fleet (type, id, firmware version, paired user) from the
+ * retained messages alone, and is told within 1.5x the keepalive when a
+ * sensor dies.
+ *
+ * The record is the "sensor_identify" message the backend already parses
+ * (type, sensor_id, sensor_type, paired, paired_user and, on OSI,
+ * ip_address) with "fw" and "online" added.
+ *
+ * Ordinary status events (publishStatus) stay non-retained on the same
+ * topic, so they never overwrite the presence record.
+ *
+ * Usage in a firmware mqtt_handler.cpp:
+ * @code
+ * #include "mqtt_presence.h"
+ *
+ * char will[MQTT_PRESENCE_MAX_SIZE];
+ * formatMqttPresence(will, sizeof(will), sensorType.c_str(), sensorID.c_str(), nullptr, false);
+ * mqttClient.connect(clientId, nullptr, nullptr, statusTopic, MQTT_PRESENCE_QOS, true, will);
+ * @endcode
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Overridden per firmware from platformio.ini: -DFIRMWARE_VERSION=\"x.y.z\"
+#ifndef FIRMWARE_VERSION
+#define FIRMWARE_VERSION "0.0.0"
+#endif
+
+#define MQTT_PRESENCE_QOS 1
+#define MQTT_PRESENCE_MAX_SIZE 256
+
+/**
+ * @brief Copy a value into a JSON string body, dropping characters that would need escaping
+ */
+inline size_t mqttPresenceCopy(char* dst, size_t size, const char* src) {
+    size_t n = 0;
+    if (size == 0) {
+        return 0;
+    }
+    while (src && *src && n + 1 < size) {
+        char c = *src++;
+        if (c == '"' || c == '\\' || (uint8_t)c < 0x20) {
+            continue;
+        }
+        dst[n++] = c;
+    }
+    dst[n] = '\0';
+    return n;
+}
+
+/**
+ * @brief Format the compact presence record
+ *
+ * @param pairedUser  nullptr or "" when the sensor is not paired
+ * @param online      false for the last-will / graceful shutdown record
+ * @param ipAddress   nullptr to leave out "ip_address"
+ * @return number of bytes written (excluding the terminator), 0 on overflow
+ */
+inline int formatMqttPresence(char* buf, size_t size, const char* sensorType, const char* sensorId,
+                              const char* pairedUser, bool online, const char* ipAddress = nullptr) {
+    char type[24];
+    char id[24];
+    char user[48];
+    char ip[24];
+    mqttPresenceCopy(type, sizeof(type), sensorType);
+    mqttPresenceCopy(id, sizeof(id), sensorId);
+    size_t userLen = mqttPresenceCopy(user, sizeof(user), pairedUser);
+    mqttPresenceCopy(ip, sizeof(ip), ipAddress);
+
+    int len = snprintf(buf, size,
+                       "{\"type\":\"sensor_identify\",\"sensor_id\":\"%s\",\"sensor_type\":\"%s\",\"paired\":%s,"
+                       "\"paired_user\":\"%s\"%s%s%s,\"fw\":\"%s\",\"online\":%s}",
+                       id, type, userLen > 0 ? "true" : "false", user, ipAddress ? ",\"ip_address\":\"" : "", ip,
+                       ipAddress ? "\"" : "", FIRMWARE_VERSION, online ? "true" : "false");
+    return (len < 0 || (size_t)len >= size) ? 0 : len;
+}
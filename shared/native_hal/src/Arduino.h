@@ -0,0 +1,91 @@
+#pragma once
+/**
+ * @file Arduino.h
+ * @brief Linux backend of the Arduino-ESP32 core API (see native_hal.h)
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <cmath>
+
+#include "esp_attr.h"
+#include "esp_err.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "WString.h"
+#include "Print.h"
+#include "IPAddress.h"
+#include "HardwareSerial.h"
+#include "Esp.h"
+
+#define ARDUINO_ARCH_ESP32_NATIVE 1
+
+typedef bool boolean;
+typedef uint8_t byte;
+typedef uint16_t word;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define PULLUP 0x04
+#define INPUT_PULLUP 0x05
+#define PULLDOWN 0x08
+#define INPUT_PULLDOWN 0x09
+
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define PI 3.1415926535897932384626433832795
+#define DEG_TO_RAD 0.017453292519943295769236907684886
+#define RAD_TO_DEG 57.295779513082320876798154814105
+
+#define F(s) (s)
+#define PROGMEM
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+
+// arduino-esp32 takes these from <algorithm>/<cmath> rather than macros
+using std::abs;
+using std::isinf;
+using std::isnan;
+using std::max;
+using std::min;
+using ::round;
+
+// Clock
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+// GPIO
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout = 1000000L);
+
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+// Sketch entry points, called by the backend's main()
+void setup(void);
+void loop(void);
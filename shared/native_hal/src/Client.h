@@ -0,0 +1,10 @@
+#pragma once
+/**
+ * @file Client.h
+ * @brief Arduino network client base (Linux backend: no sockets)
+ */
+
+class Client {
+public:
+    virtual ~Client() {}
+};
@@ -0,0 +1,187 @@
+#include "DallasTemperature.h"
+#include "Arduino.h"
+#include "sim_devices.h"
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+#define SIM_MAX_ONEWIRE_DEVICES 8
+
+// Bus time of a reset pulse plus `bits` 1-Wire time slots
+static void oneWireTransaction(unsigned bits) {
+    std::this_thread::sleep_for(std::chrono::microseconds(960 + bits * 65));
+}
+
+SimDS18B20* DallasTemperature::byIndex(uint8_t index) {
+    SimDS18B20* devices[SIM_MAX_ONEWIRE_DEVICES];
+    size_t n = _wire ? simOneWireDevices(_wire->simPin(), devices, SIM_MAX_ONEWIRE_DEVICES) : 0;
+    return index < n ? devices[index] : nullptr;
+}
+
+SimDS18B20* DallasTemperature::find(const uint8_t* deviceAddress) {
+    SimDS18B20* devices[SIM_MAX_ONEWIRE_DEVICES];
+    size_t n = _wire ? simOneWireDevices(_wire->simPin(), devices, SIM_MAX_ONEWIRE_DEVICES) : 0;
+    for (size_t i = 0; i < n; i++) {
+        if (memcmp(devices[i]->rom(), deviceAddress, 8) == 0) {
+            return devices[i]->connected() ? devices[i] : nullptr;
+        }
+    }
+    return nullptr;
+}
+
+void DallasTemperature::begin() {
+    // Bus search: 64 ROM bits, each read twice and written once, per device
+    SimDS18B20* devices[SIM_MAX_ONEWIRE_DEVICES];
+    size_t n = _wire ? simOneWireDevices(_wire->simPin(), devices, SIM_MAX_ONEWIRE_DEVICES) : 0;
+    oneWireTransaction((unsigned)(8 + 64 * 3 * (n + 1)));
+    for (size_t i = 0; i < n; i++) {
+        if (devices[i]->resolution() > _resolution) {
+            _resolution = devices[i]->resolution();
+        }
+    }
+}
+
+uint8_t DallasTemperature::getDeviceCount() {
+    SimDS18B20* devices[SIM_MAX_ONEWIRE_DEVICES];
+    size_t n = _wire ? simOneWireDevices(_wire->simPin(), devices, SIM_MAX_ONEWIRE_DEVICES) : 0;
+    uint8_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        count += devices[i]->connected() ? 1 : 0;
+    }
+    return count;
+}
+
+bool DallasTemperature::getAddress(uint8_t* deviceAddress, uint8_t index) {
+    SimDS18B20* dev = byIndex(index);
+    if (!dev || !dev->connected()) {
+        return false;
+    }
+    memcpy(deviceAddress, dev->rom(), 8);
+    return true;
+}
+
+bool DallasTemperature::isConnected(const uint8_t* deviceAddress) {
+    oneWireTransaction(8 + 64 + 72);
+    return find(deviceAddress) != nullptr;
+}
+
+uint8_t DallasTemperature::getResolution(const uint8_t* deviceAddress) {
+    SimDS18B20* dev = find(deviceAddress);
+    oneWireTransaction(8 + 64 + 72);
+    return dev ? dev->resolution() : 0;
+}
+
+void DallasTemperature::setResolution(uint8_t newResolution) {
+    _resolution = constrain(newResolution, 9, 12);
+    SimDS18B20* dev;
+    for (uint8_t i = 0; (dev = byIndex(i)) != nullptr; i++) {
+        setResolution(dev->rom(), _resolution, true);
+    }
+}
+
+bool DallasTemperature::setResolution(const uint8_t* deviceAddress, uint8_t newResolution,
+                                      bool skipGlobalBitResolutionCalculation) {
+    newResolution = constrain(newResolution, 9, 12);
+    SimDS18B20* dev = find(deviceAddress);
+    if (!dev) {
+        return false;
+    }
+    // Read scratchpad, write config, copy to EEPROM
+    oneWireTransaction(8 + 64 + 72);
+    oneWireTransaction(8 + 64 + 8 + 24);
+    dev->setResolution(newResolution);
+    if (!skipGlobalBitResolutionCalculation) {
+        _resolution = newResolution;
+        SimDS18B20* other;
+        for (uint8_t i = 0; (other = byIndex(i)) != nullptr; i++) {
+            if (other->connected() && other->resolution() > _resolution) {
+                _resolution = other->resolution();
+            }
+        }
+    }
+    return true;
+}
+
+bool DallasTemperature::isConversionComplete() {
+    // One read slot: the bus is held low until every conversion is done
+    oneWireTransaction(1);
+    unsigned long now = millis();
+    SimDS18B20* dev;
+    for (uint8_t i = 0; (dev = byIndex(i)) != nullptr; i++) {
+        if (dev->connected() && !dev->converted(now)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint16_t DallasTemperature::millisToWaitForConversion(uint8_t bitResolution) {
+    return SimDS18B20::conversionMs(bitResolution);
+}
+
+void DallasTemperature::blockUntilConverted(unsigned long startMs) {
+    if (_checkForConversion) {
+        uint16_t timeout = millisToWaitForConversion(_resolution);
+        while (!isConversionComplete() && millis() - startMs < timeout) {
+            yield();
+        }
+    } else {
+        unsigned long wait = millisToWaitForConversion(_resolution);
+        unsigned long spent = millis() - startMs;
+        if (spent < wait) {
+            delay(wait - spent);
+        }
+    }
+}
+
+DallasTemperature::request_t DallasTemperature::requestTemperatures() {
+    request_t req = {true, millis()};
+    // Skip ROM + Convert T
+    oneWireTransaction(16);
+    SimDS18B20* dev;
+    for (uint8_t i = 0; (dev = byIndex(i)) != nullptr; i++) {
+        if (dev->connected()) {
+            dev->startConversion(req.timestamp);
+        }
+    }
+    if (_waitForConversion) {
+        blockUntilConverted(req.timestamp);
+    }
+    return req;
+}
+
+DallasTemperature::request_t DallasTemperature::requestTemperaturesByAddress(const uint8_t* deviceAddress) {
+    request_t req = {false, millis()};
+    // Match ROM + Convert T
+    oneWireTransaction(8 + 64 + 8);
+    SimDS18B20* dev = find(deviceAddress);
+    if (!dev) {
+        return req;
+    }
+    req.result = true;
+    dev->startConversion(req.timestamp);
+    if (_waitForConversion) {
+        blockUntilConverted(req.timestamp);
+    }
+    return req;
+}
+
+float DallasTemperature::getTempC(const uint8_t* deviceAddress, uint8_t retryCount) {
+    for (uint8_t attempt = 0; attempt <= retryCount; attempt++) {
+        // Match ROM + Read Scratchpad (9 bytes)
+        oneWireTransaction(8 + 64 + 8 + 72);
+        SimDS18B20* dev = find(deviceAddress);
+        if (dev) {
+            return dev->scratchpad(millis());
+        }
+    }
+    return DEVICE_DISCONNECTED_C;
+}
+
+float DallasTemperature::getTempCByIndex(uint8_t index) {
+    DeviceAddress deviceAddress;
+    if (!getAddress(deviceAddress, index)) {
+        return DEVICE_DISCONNECTED_C;
+    }
+    return getTempC(deviceAddress);
+}
@@ -0,0 +1,73 @@
+#pragma once
+/**
+ * @file DallasTemperature.h
+ * @brief DallasTemperature 3.11 API on SimDS18B20 devices (Linux backend)
+ *
+ * Conversions take the DS18B20's time for the configured resolution (94 to
+ * 750 ms). requestTemperatures() blocks for it unless setWaitForConversion
+ * (false); reading a device before its conversion finished returns the
+ * previous result (85.0 C after power-up), as the chip does. Every
+ * scratchpad read costs its 1-Wire slot time.
+ */
+
+#include <stdint.h>
+#include "OneWire.h"
+
+typedef uint8_t DeviceAddress[8];
+
+#define DEVICE_DISCONNECTED_C -127
+#define DEVICE_DISCONNECTED_F -196.6
+#define DEVICE_DISCONNECTED_RAW -7040
+
+class SimDS18B20;
+
+class DallasTemperature {
+public:
+    struct request_t {
+        bool result;
+        unsigned long timestamp;
+        operator bool() { return result; }
+    };
+
+    DallasTemperature() {}
+    explicit DallasTemperature(OneWire* wire) : _wire(wire) {}
+    void setOneWire(OneWire* wire) { _wire = wire; }
+
+    void begin();
+    uint8_t getDeviceCount();
+    bool getAddress(uint8_t* deviceAddress, uint8_t index);
+    bool isConnected(const uint8_t* deviceAddress);
+
+    uint8_t getResolution() { return _resolution; }
+    uint8_t getResolution(const uint8_t* deviceAddress);
+    void setResolution(uint8_t newResolution);
+    bool setResolution(const uint8_t* deviceAddress, uint8_t newResolution, bool skipGlobalBitResolutionCalculation = false);
+
+    void setWaitForConversion(bool flag) { _waitForConversion = flag; }
+    bool getWaitForConversion() { return _waitForConversion; }
+    void setCheckForConversion(bool flag) { _checkForConversion = flag; }
+    bool getCheckForConversion() { return _checkForConversion; }
+    bool isConversionComplete();
+    uint16_t millisToWaitForConversion(uint8_t bitResolution);
+    uint16_t millisToWaitForConversion() { return millisToWaitForConversion(_resolution); }
+
+    request_t requestTemperatures();
+    request_t requestTemperaturesByAddress(const uint8_t* deviceAddress);
+    float getTempC(const uint8_t* deviceAddress, uint8_t retryCount = 0);
+    float getTempF(const uint8_t* deviceAddress) { return toFahrenheit(getTempC(deviceAddress)); }
+    float getTempCByIndex(uint8_t index);
+    float getTempFByIndex(uint8_t index) { return toFahrenheit(getTempCByIndex(index)); }
+
+    static float toFahrenheit(float celsius) { return celsius * 1.8f + 32.0f; }
+    static float toCelsius(float fahrenheit) { return (fahrenheit - 32.0f) * 0.555555556f; }
+
+private:
+    SimDS18B20* find(const uint8_t* deviceAddress);
+    SimDS18B20* byIndex(uint8_t index);
+    void blockUntilConverted(unsigned long startMs);
+
+    OneWire* _wire = nullptr;
+    uint8_t _resolution = 9;
+    bool _waitForConversion = true;
+    bool _checkForConversion = true;
+};
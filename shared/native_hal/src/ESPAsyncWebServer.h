@@ -0,0 +1,18 @@
+#pragma once
+/**
+ * @file ESPAsyncWebServer.h
+ * @brief Declarations only (Linux backend)
+ *
+ * config_handler.h names these types; the HTTP handlers themselves are not
+ * part of the native build.
+ */
+
+#include <stdint.h>
+#include "Arduino.h"
+
+class AsyncWebServerRequest;
+
+class AsyncWebServer {
+public:
+    explicit AsyncWebServer(uint16_t port) { (void)port; }
+};
@@ -0,0 +1,26 @@
+#pragma once
+/**
+ * @file Esp.h
+ * @brief ESP object (Linux backend)
+ *
+ * restart() ends the process with SIM_EXIT_RESTART. Heap figures are fixed
+ * values of a freshly booted ESP32; they are not measured on the host.
+ */
+
+#include <stdint.h>
+
+class EspClass {
+public:
+    [[noreturn]] void restart();
+    uint32_t getHeapSize() { return 327680; }
+    uint32_t getFreeHeap() { return 245760; }
+    uint32_t getMinFreeHeap() { return 245760; }
+    uint32_t getMaxAllocHeap() { return 114688; }
+    const char* getChipModel() { return "ESP32-native"; }
+    uint8_t getChipCores() { return 2; }
+    uint32_t getCpuFreqMHz() { return 240; }
+    uint64_t getEfuseMac();
+    const char* getSdkVersion() { return "native"; }
+};
+
+extern EspClass ESP;
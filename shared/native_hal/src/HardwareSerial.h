@@ -0,0 +1,30 @@
+#pragma once
+/**
+ * @file HardwareSerial.h
+ * @brief Serial on stdout (Linux backend)
+ *
+ * Lines from different tasks are not interleaved mid-write. Nothing is ever
+ * received. After begin(baud), write() blocks like the board's UART driver
+ * once more than the 128-byte TX FIFO is pending, with or without echo.
+ */
+
+#include <stdint.h>
+#include "Print.h"
+
+class HardwareSerial : public Print {
+public:
+    void begin(unsigned long baud);
+    void end() {}
+    int available() { return 0; }
+    int read() { return -1; }
+    int peek() { return -1; }
+    void setDebugOutput(bool) {}
+    operator bool() const { return true; }
+
+    using Print::write;
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    void flush() override;
+};
+
+extern HardwareSerial Serial;
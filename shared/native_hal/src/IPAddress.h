@@ -0,0 +1,43 @@
+#pragma once
+/**
+ * @file IPAddress.h
+ * @brief IPv4 address (Linux backend)
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include "WString.h"
+
+class IPAddress {
+public:
+    IPAddress() : _addr(0) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+        : _addr((uint32_t)a | ((uint32_t)b << 8) | ((uint32_t)c << 16) | ((uint32_t)d << 24)) {}
+    IPAddress(uint32_t address) : _addr(address) {}
+
+    // Network byte order, as in arduino-esp32
+    operator uint32_t() const { return _addr; }
+    uint8_t operator[](int index) const { return (uint8_t)(_addr >> (8 * index)); }
+    bool operator==(const IPAddress& rhs) const { return _addr == rhs._addr; }
+    bool operator!=(const IPAddress& rhs) const { return _addr != rhs._addr; }
+
+    bool fromString(const char* address) {
+        unsigned a, b, c, d;
+        char tail;
+        if (!address || sscanf(address, "%u.%u.%u.%u%c", &a, &b, &c, &d, &tail) != 4 ||
+            a > 255 || b > 255 || c > 255 || d > 255) {
+            return false;
+        }
+        *this = IPAddress(a, b, c, d);
+        return true;
+    }
+
+    String toString() const {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+        return String(buf);
+    }
+
+private:
+    uint32_t _addr;
+};
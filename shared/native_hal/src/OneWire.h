@@ -0,0 +1,21 @@
+#pragma once
+/**
+ * @file OneWire.h
+ * @brief 1-Wire bus handle (Linux backend)
+ *
+ * Only names the pin; DallasTemperature talks to the SimDS18B20 devices
+ * attached to it.
+ */
+
+#include <stdint.h>
+
+class OneWire {
+public:
+    OneWire() {}
+    explicit OneWire(uint8_t pin) : _pin(pin) {}
+    void begin(uint8_t pin) { _pin = pin; }
+    uint8_t simPin() const { return _pin; }
+
+private:
+    uint8_t _pin = 0xff;
+};
@@ -0,0 +1,607 @@
+#include "PubSubClient.h"
+#include "Arduino.h"
+#include "esp_timer.h"
+#include "native_hal.h"
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+// In-process broker: one link, messages injected by the simulation
+// driver, publishes counted and handed to an optional hook.
+namespace {
+struct SimBroker {
+    std::mutex lock;
+    bool available = true;
+    uint32_t session = 1; // Bumped when the link drops
+    uint32_t fixedUs = 0;
+    uint32_t bytesPerSecond = 0;
+    std::deque<std::pair<std::string, std::string>> inbound;
+    std::function<void(const char*, const uint8_t*, unsigned int, bool)> onPublish;
+    SimMqttStats stats;
+};
+
+SimBroker& broker() {
+    static SimBroker b;
+    return b;
+}
+
+std::atomic<bool> sNetwork{false};
+
+// MQTT 3.1.1 control packet types (upper nibble of the fixed header)
+enum : uint8_t {
+    MQTTCONNECT = 1 << 4,
+    MQTTCONNACK = 2 << 4,
+    MQTTPUBLISH = 3 << 4,
+    MQTTPUBACK = 4 << 4,
+    MQTTSUBSCRIBE = 8 << 4,
+    MQTTUNSUBSCRIBE = 10 << 4,
+    MQTTPINGREQ = 12 << 4,
+    MQTTPINGRESP = 13 << 4,
+    MQTTDISCONNECT = 14 << 4,
+};
+
+void putString(std::vector<uint8_t>& out, const char* s, size_t len) {
+    out.push_back((uint8_t)(len >> 8));
+    out.push_back((uint8_t)len);
+    out.insert(out.end(), (const uint8_t*)s, (const uint8_t*)s + len);
+}
+
+void putString(std::vector<uint8_t>& out, const char* s) {
+    putString(out, s, strlen(s));
+}
+
+std::vector<uint8_t> frame(uint8_t header, const std::vector<uint8_t>& body) {
+    std::vector<uint8_t> out;
+    out.reserve(body.size() + MQTT_MAX_HEADER_SIZE);
+    out.push_back(header);
+    size_t len = body.size();
+    do {
+        uint8_t digit = len % 128;
+        len /= 128;
+        out.push_back(len ? (digit | 0x80) : digit);
+    } while (len);
+    out.insert(out.end(), body.begin(), body.end());
+    return out;
+}
+
+bool topicMatches(const std::string& filter, const char* topic) {
+    const char* f = filter.c_str();
+    const char* t = topic;
+    while (*f) {
+        if (*f == '#') {
+            return true;
+        }
+        if (*f == '+') {
+            while (*t && *t != '/') {
+                t++;
+            }
+            f++;
+            continue;
+        }
+        if (*f != *t) {
+            return false;
+        }
+        f++;
+        t++;
+    }
+    return *t == '\0';
+}
+} // namespace
+
+void simMqttInject(const char* topic, const char* payload) {
+    SimBroker& b = broker();
+    std::lock_guard<std::mutex> guard(b.lock);
+    b.inbound.emplace_back(topic, payload);
+}
+
+void simMqttOnPublish(std::function<void(const char*, const uint8_t*, unsigned int, bool)> hook) {
+    SimBroker& b = broker();
+    std::lock_guard<std::mutex> guard(b.lock);
+    b.onPublish = std::move(hook);
+}
+
+void simMqttSetLink(uint32_t fixedUs, uint32_t bytesPerSecond) {
+    SimBroker& b = broker();
+    std::lock_guard<std::mutex> guard(b.lock);
+    b.fixedUs = fixedUs;
+    b.bytesPerSecond = bytesPerSecond;
+}
+
+void simMqttSetAvailable(bool available) {
+    SimBroker& b = broker();
+    std::lock_guard<std::mutex> guard(b.lock);
+    if (b.available && !available) {
+        b.session++;
+    }
+    b.available = available;
+}
+
+void simMqttUseNetwork(bool enabled) {
+    sNetwork = enabled;
+}
+
+SimMqttStats simMqttStats() {
+    SimBroker& b = broker();
+    std::lock_guard<std::mutex> guard(b.lock);
+    return b.stats;
+}
+
+PubSubClient& PubSubClient::setServer(IPAddress ip, uint16_t port) {
+    _server = ip.toString().c_str();
+    _port = port;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setServer(const char* domain, uint16_t port) {
+    _server = domain ? domain : "";
+    _port = port;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setCallback(MQTT_CALLBACK_SIGNATURE) {
+    _callback = callback;
+    return *this;
+}
+
+bool PubSubClient::setBufferSize(uint16_t size) {
+    if (size == 0) {
+        return false;
+    }
+    _buffer.resize(size);
+    return true;
+}
+
+bool PubSubClient::connect(const char* id) {
+    return connect(id, nullptr, nullptr, nullptr, 0, false, nullptr, true);
+}
+
+bool PubSubClient::connect(const char* id, const char* user, const char* pass) {
+    return connect(id, user, pass, nullptr, 0, false, nullptr, true);
+}
+
+bool PubSubClient::connect(const char* id, const char* willTopic, uint8_t willQos, bool willRetain,
+                           const char* willMessage) {
+    return connect(id, nullptr, nullptr, willTopic, willQos, willRetain, willMessage, true);
+}
+
+bool PubSubClient::connect(const char* id, const char* user, const char* pass, const char* willTopic,
+                           uint8_t willQos, bool willRetain, const char* willMessage, bool cleanSession) {
+    if (sNetwork) {
+        return netConnect(id, user, pass, willTopic, willQos, willRetain, willMessage, cleanSession);
+    }
+    (void)id, (void)user, (void)pass, (void)willTopic, (void)willQos, (void)willRetain, (void)willMessage;
+    SimBroker& b = broker();
+    std::lock_guard<std::mutex> guard(b.lock);
+    if (!b.available || _server.empty()) {
+        _state = MQTT_CONNECT_FAILED;
+        return false;
+    }
+    if (cleanSession || _session != b.session) {
+        _subscriptions.clear();
+    }
+    _session = b.session;
+    _state = MQTT_CONNECTED;
+    b.stats.connects++;
+    return true;
+}
+
+void PubSubClient::disconnect() {
+    if (_fd >= 0) {
+        netWrite(frame(MQTTDISCONNECT, {}));
+        netClose(MQTT_DISCONNECTED);
+    }
+    _state = MQTT_DISCONNECTED;
+}
+
+bool PubSubClient::connected() {
+    if (_state != MQTT_CONNECTED) {
+        return false;
+    }
+    if (sNetwork) {
+        // A closed socket reads as 0 bytes, like WiFiClient::connected()
+        uint8_t probe;
+        ssize_t n = _fd >= 0 ? recv(_fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT) : 0;
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            netClose(MQTT_CONNECTION_LOST);
+            return false;
+        }
+        return true;
+    }
+    SimBroker& b = broker();
+    std::lock_guard<std::mutex> guard(b.lock);
+    if (!b.available || _session != b.session) {
+        _state = MQTT_CONNECTION_LOST;
+        return false;
+    }
+    return true;
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload) {
+    return publish(topic, (const uint8_t*)payload, payload ? (unsigned int)strnlen(payload, _buffer.size()) : 0, false);
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload, bool retained) {
+    return publish(topic, (const uint8_t*)payload, payload ? (unsigned int)strnlen(payload, _buffer.size()) : 0, retained);
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int plength) {
+    return publish(topic, payload, plength, false);
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int plength, bool retained) {
+    if (!connected()) {
+        return false;
+    }
+    int64_t start = esp_timer_get_time();
+    SimBroker& b = broker();
+    std::unique_lock<std::mutex> lk(b.lock);
+
+    // Same limit as PubSubClient: header + topic length field + topic + payload
+    if (_buffer.size() < MQTT_MAX_HEADER_SIZE + 2 + strnlen(topic, _buffer.size()) + plength) {
+        b.stats.rejected++;
+        return false;
+    }
+
+    if (sNetwork) {
+        lk.unlock();
+        std::vector<uint8_t> body;
+        putString(body, topic);
+        body.insert(body.end(), payload, payload + plength);
+        if (!netWrite(frame(MQTTPUBLISH | (retained ? 1 : 0), body))) {
+            lk.lock();
+            b.stats.rejected++;
+            return false;
+        }
+        lk.lock();
+        b.stats.published++;
+        b.stats.publishedBytes += plength;
+        b.stats.publishUs += (uint64_t)(esp_timer_get_time() - start);
+        return true;
+    }
+
+    uint64_t wireBytes = MQTT_MAX_HEADER_SIZE + 2 + strlen(topic) + plength;
+    uint64_t linkUs = b.fixedUs + (b.bytesPerSecond ? wireBytes * 1000000ULL / b.bytesPerSecond : 0);
+    auto hook = b.onPublish;
+    lk.unlock();
+
+    if (linkUs) {
+        std::this_thread::sleep_for(std::chrono::microseconds(linkUs));
+    }
+    if (hook) {
+        hook(topic, payload, plength, retained);
+    }
+
+    lk.lock();
+    b.stats.published++;
+    b.stats.publishedBytes += plength;
+    b.stats.publishUs += (uint64_t)(esp_timer_get_time() - start);
+    return true;
+}
+
+bool PubSubClient::subscribe(const char* topic) {
+    return subscribe(topic, 0);
+}
+
+bool PubSubClient::subscribe(const char* topic, uint8_t qos) {
+    if (qos > 1 || !topic || _buffer.size() < 9 + strnlen(topic, _buffer.size()) || !connected()) {
+        return false;
+    }
+    if (sNetwork) {
+        std::vector<uint8_t> body;
+        body.push_back((uint8_t)(_nextMsgId >> 8));
+        body.push_back((uint8_t)_nextMsgId);
+        _nextMsgId = _nextMsgId == 0xFFFF ? 1 : _nextMsgId + 1;
+        putString(body, topic);
+        body.push_back(qos);
+        return netWrite(frame(MQTTSUBSCRIBE | 2, body)); // SUBACK is consumed by loop()
+    }
+    if (!subscribed(topic)) {
+        _subscriptions.emplace_back(topic);
+    }
+    return true;
+}
+
+bool PubSubClient::unsubscribe(const char* topic) {
+    if (!connected()) {
+        return false;
+    }
+    if (sNetwork) {
+        std::vector<uint8_t> body;
+        body.push_back((uint8_t)(_nextMsgId >> 8));
+        body.push_back((uint8_t)_nextMsgId);
+        _nextMsgId = _nextMsgId == 0xFFFF ? 1 : _nextMsgId + 1;
+        putString(body, topic);
+        return netWrite(frame(MQTTUNSUBSCRIBE | 2, body));
+    }
+    for (auto it = _subscriptions.begin(); it != _subscriptions.end(); ++it) {
+        if (*it == topic) {
+            _subscriptions.erase(it);
+            break;
+        }
+    }
+    return true;
+}
+
+bool PubSubClient::subscribed(const char* topic) const {
+    for (const std::string& filter : _subscriptions) {
+        if (topicMatches(filter, topic)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PubSubClient::loop() {
+    if (!connected()) {
+        return false;
+    }
+    if (sNetwork) {
+        return netLoop();
+    }
+
+    // One inbound message per call, like one packet read per loop()
+    std::pair<std::string, std::string> message;
+    {
+        SimBroker& b = broker();
+        std::lock_guard<std::mutex> guard(b.lock);
+        if (b.inbound.empty()) {
+            return true;
+        }
+        message = std::move(b.inbound.front());
+        b.inbound.pop_front();
+    }
+
+    const std::string& topic = message.first;
+    const std::string& payload = message.second;
+    if (!subscribed(topic.c_str())) {
+        return true;
+    }
+    // Oversized packets are dropped, as PubSubClient does
+    if (topic.size() + 1 + payload.size() + MQTT_MAX_HEADER_SIZE + 2 > _buffer.size()) {
+        return true;
+    }
+
+    char* topicBuf = (char*)_buffer.data();
+    memcpy(topicBuf, topic.c_str(), topic.size() + 1);
+    uint8_t* payloadBuf = _buffer.data() + topic.size() + 1;
+    memcpy(payloadBuf, payload.data(), payload.size());
+    if (_callback) {
+        _callback(topicBuf, payloadBuf, (unsigned int)payload.size());
+        SimBroker& b = broker();
+        std::lock_guard<std::mutex> guard(b.lock);
+        b.stats.delivered++;
+    }
+    return true;
+}
+
+// ---- Network mode ----
+
+bool PubSubClient::netConnect(const char* id, const char* user, const char* pass, const char* willTopic,
+                              uint8_t willQos, bool willRetain, const char* willMessage, bool cleanSession) {
+    netClose(MQTT_DISCONNECTED);
+    _state = MQTT_CONNECT_FAILED;
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addr = nullptr;
+    char port[8];
+    snprintf(port, sizeof(port), "%u", _port);
+    if (_server.empty() || getaddrinfo(_server.c_str(), port, &hints, &addr) != 0) {
+        return false;
+    }
+    _fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+    bool ok = _fd >= 0 && ::connect(_fd, addr->ai_addr, addr->ai_addrlen) == 0;
+    freeaddrinfo(addr);
+    if (!ok) {
+        netClose(MQTT_CONNECT_FAILED);
+        return false;
+    }
+    int one = 1;
+    setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    timeval timeout = {MQTT_SOCKET_TIMEOUT, 0};
+    setsockopt(_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    std::vector<uint8_t> body;
+    putString(body, "MQTT");
+    body.push_back(4); // Protocol level 3.1.1
+    uint8_t flags = cleanSession ? 0x02 : 0x00;
+    if (willTopic) {
+        flags |= 0x04 | (uint8_t)(willQos << 3) | (willRetain ? 0x20 : 0x00);
+    }
+    if (user) {
+        flags |= 0x80;
+        if (pass) {
+            flags |= 0x40;
+        }
+    }
+    body.push_back(flags);
+    body.push_back((uint8_t)(_keepAlive >> 8));
+    body.push_back((uint8_t)_keepAlive);
+    putString(body, id ? id : "");
+    if (willTopic) {
+        putString(body, willTopic);
+        putString(body, willMessage ? willMessage : "");
+    }
+    if (user) {
+        putString(body, user);
+        if (pass) {
+            putString(body, pass);
+        }
+    }
+    if (!netWrite(frame(MQTTCONNECT, body))) {
+        netClose(MQTT_CONNECT_FAILED);
+        return false;
+    }
+
+    uint8_t header = 0;
+    std::vector<uint8_t> ack;
+    if (netRead(&header, ack, MQTT_SOCKET_TIMEOUT * 1000) <= 0 || (header & 0xF0) != MQTTCONNACK || ack.size() < 2) {
+        netClose(MQTT_CONNECTION_TIMEOUT);
+        return false;
+    }
+    if (ack[1] != 0) {
+        netClose(ack[1]); // CONNACK return code, as PubSubClient reports it
+        return false;
+    }
+
+    _state = MQTT_CONNECTED;
+    _pingOutstanding = false;
+    _lastInActivity = _lastOutActivity = millis();
+    SimBroker& b = broker();
+    std::lock_guard<std::mutex> guard(b.lock);
+    b.stats.connects++;
+    return true;
+}
+
+bool PubSubClient::netWrite(const std::vector<uint8_t>& packet) {
+    const uint8_t* data = packet.data();
+    size_t len = packet.size();
+    while (len > 0) {
+        ssize_t n = _fd >= 0 ? send(_fd, data, len, MSG_NOSIGNAL) : -1;
+        if (n <= 0) {
+            netClose(MQTT_CONNECTION_LOST);
+            return false;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    _lastOutActivity = millis();
+    return true;
+}
+
+// 1 with a whole packet, 0 if none arrived within the timeout, -1 when the connection is gone
+int PubSubClient::netRead(uint8_t* header, std::vector<uint8_t>& body, int timeoutMs) {
+    unsigned long start = millis();
+    for (;;) {
+        // Fixed header: type byte and 1..4 remaining-length bytes
+        size_t length = 0;
+        size_t used = 1;
+        bool complete = false;
+        for (int shift = 0; used < _rx.size() && used <= 4; shift += 7) {
+            uint8_t digit = _rx[used++];
+            length |= (size_t)(digit & 0x7F) << shift;
+            if (!(digit & 0x80)) {
+                complete = true;
+                break;
+            }
+        }
+        if (complete && _rx.size() >= used + length) {
+            *header = _rx[0];
+            body.assign(_rx.begin() + used, _rx.begin() + used + length);
+            _rx.erase(_rx.begin(), _rx.begin() + used + length);
+            return 1;
+        }
+
+        int waitMs = timeoutMs - (int)(millis() - start);
+        pollfd pfd = {_fd, POLLIN, 0};
+        int ready = _fd >= 0 ? poll(&pfd, 1, waitMs > 0 ? waitMs : 0) : -1;
+        if (ready < 0) {
+            return -1;
+        }
+        if (ready == 0) {
+            return 0;
+        }
+        uint8_t chunk[2048];
+        ssize_t n = recv(_fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            return -1;
+        }
+        if (n > 0) {
+            _rx.insert(_rx.end(), chunk, chunk + n);
+        }
+    }
+}
+
+bool PubSubClient::netLoop() {
+    unsigned long now = millis();
+    unsigned long keepAliveMs = _keepAlive * 1000UL;
+    if (keepAliveMs && (now - _lastInActivity > keepAliveMs || now - _lastOutActivity > keepAliveMs)) {
+        if (_pingOutstanding) {
+            netClose(MQTT_CONNECTION_TIMEOUT);
+            return false;
+        }
+        if (!netWrite(frame(MQTTPINGREQ, {}))) {
+            return false;
+        }
+        _lastInActivity = now;
+        _pingOutstanding = true;
+    }
+
+    // One packet per call
+    uint8_t header = 0;
+    std::vector<uint8_t> body;
+    int got = netRead(&header, body, 0);
+    if (got < 0) {
+        netClose(MQTT_CONNECTION_LOST);
+        return false;
+    }
+    if (got == 0) {
+        return true;
+    }
+    _lastInActivity = now;
+
+    switch (header & 0xF0) {
+    case MQTTPUBLISH: {
+        if (body.size() < 2) {
+            break;
+        }
+        uint8_t qos = (header >> 1) & 0x03;
+        size_t topicLen = ((size_t)body[0] << 8) | body[1];
+        size_t payloadAt = 2 + topicLen + (qos ? 2 : 0);
+        if (payloadAt > body.size()) {
+            break;
+        }
+        if (qos == 1) {
+            netWrite(frame(MQTTPUBACK, {body[2 + topicLen], body[3 + topicLen]}));
+        }
+        size_t payloadLen = body.size() - payloadAt;
+        // Oversized packets are dropped, as PubSubClient does
+        if (topicLen + 1 + payloadLen + MQTT_MAX_HEADER_SIZE + 2 > _buffer.size()) {
+            break;
+        }
+        char* topicBuf = (char*)_buffer.data();
+        memcpy(topicBuf, body.data() + 2, topicLen);
+        topicBuf[topicLen] = '\0';
+        uint8_t* payloadBuf = _buffer.data() + topicLen + 1;
+        memcpy(payloadBuf, body.data() + payloadAt, payloadLen);
+        if (_callback) {
+            _callback(topicBuf, payloadBuf, (unsigned int)payloadLen);
+            SimBroker& b = broker();
+            std::lock_guard<std::mutex> guard(b.lock);
+            b.stats.delivered++;
+        }
+        break;
+    }
+    case MQTTPINGREQ:
+        netWrite(frame(MQTTPINGRESP, {}));
+        break;
+    case MQTTPINGRESP:
+        _pingOutstanding = false;
+        break;
+    default:
+        break; // SUBACK, UNSUBACK, PUBACK
+    }
+    return _state == MQTT_CONNECTED;
+}
+
+void PubSubClient::netClose(int state) {
+    if (_fd >= 0) {
+        close(_fd);
+        _fd = -1;
+    }
+    _rx.clear();
+    _state = state;
+}
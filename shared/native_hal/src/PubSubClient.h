@@ -0,0 +1,111 @@
+#pragma once
+/**
+ * @file PubSubClient.h
+ * @brief PubSubClient 2.8 API on an in-process broker (Linux backend)
+ *
+ * Behaves like the library where the firmware can tell: publish() refuses
+ * packets that do not fit MQTT_MAX_PACKET_SIZE, loop() delivers at most one
+ * inbound message per call into the client buffer, and connected() drops
+ * when the broker is taken down. The broker is driven through native_hal.h.
+ *
+ * With simMqttUseNetwork(true) the same calls speak MQTT 3.1.1 over a TCP
+ * socket instead, with the library's keepalive (PINGREQ from loop()) and
+ * blocking writes.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include "Client.h"
+#include "IPAddress.h"
+
+#ifndef MQTT_MAX_PACKET_SIZE
+#define MQTT_MAX_PACKET_SIZE 256
+#endif
+#ifndef MQTT_KEEPALIVE
+#define MQTT_KEEPALIVE 15
+#endif
+#ifndef MQTT_SOCKET_TIMEOUT
+#define MQTT_SOCKET_TIMEOUT 15
+#endif
+#define MQTT_MAX_HEADER_SIZE 5
+
+#define MQTT_CONNECTION_TIMEOUT -4
+#define MQTT_CONNECTION_LOST -3
+#define MQTT_CONNECT_FAILED -2
+#define MQTT_DISCONNECTED -1
+#define MQTT_CONNECTED 0
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char*, uint8_t*, unsigned int)> callback
+
+class PubSubClient {
+public:
+    PubSubClient() : _buffer(MQTT_MAX_PACKET_SIZE) {}
+    explicit PubSubClient(Client& client) : _buffer(MQTT_MAX_PACKET_SIZE) { (void)client; }
+
+    PubSubClient& setServer(IPAddress ip, uint16_t port);
+    PubSubClient& setServer(const char* domain, uint16_t port);
+    PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE);
+    PubSubClient& setClient(Client& client) {
+        (void)client;
+        return *this;
+    }
+    PubSubClient& setKeepAlive(uint16_t keepAlive) {
+        _keepAlive = keepAlive;
+        return *this;
+    }
+    PubSubClient& setSocketTimeout(uint16_t timeout) {
+        (void)timeout;
+        return *this;
+    }
+    bool setBufferSize(uint16_t size);
+    uint16_t getBufferSize() const { return (uint16_t)_buffer.size(); }
+
+    bool connect(const char* id);
+    bool connect(const char* id, const char* user, const char* pass);
+    bool connect(const char* id, const char* willTopic, uint8_t willQos, bool willRetain, const char* willMessage);
+    bool connect(const char* id, const char* user, const char* pass, const char* willTopic, uint8_t willQos,
+                 bool willRetain, const char* willMessage, bool cleanSession = true);
+    void disconnect();
+    bool connected();
+    int state() const { return _state; }
+
+    bool publish(const char* topic, const char* payload);
+    bool publish(const char* topic, const char* payload, bool retained);
+    bool publish(const char* topic, const uint8_t* payload, unsigned int plength);
+    bool publish(const char* topic, const uint8_t* payload, unsigned int plength, bool retained);
+
+    bool subscribe(const char* topic);
+    bool subscribe(const char* topic, uint8_t qos);
+    bool unsubscribe(const char* topic);
+    bool loop();
+
+private:
+    bool subscribed(const char* topic) const;
+
+    // Network mode
+    bool netConnect(const char* id, const char* user, const char* pass, const char* willTopic, uint8_t willQos,
+                    bool willRetain, const char* willMessage, bool cleanSession);
+    bool netWrite(const std::vector<uint8_t>& packet);
+    int netRead(uint8_t* header, std::vector<uint8_t>& body, int timeoutMs);
+    bool netLoop();
+    void netClose(int state);
+
+    std::vector<uint8_t> _buffer;
+    std::vector<std::string> _subscriptions;
+    std::function<void(char*, uint8_t*, unsigned int)> _callback;
+    std::string _server;
+    uint16_t _port = 0;
+    uint16_t _keepAlive = MQTT_KEEPALIVE;
+    uint32_t _session = 0; // Broker session this client joined
+    int _state = MQTT_DISCONNECTED;
+
+    int _fd = -1;
+    std::vector<uint8_t> _rx; // Bytes received but not yet parsed
+    uint16_t _nextMsgId = 1;
+    unsigned long _lastOutActivity = 0;
+    unsigned long _lastInActivity = 0;
+    bool _pingOutstanding = false;
+};
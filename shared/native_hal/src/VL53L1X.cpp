@@ -0,0 +1,145 @@
+#include "VL53L1X.h"
+#include "Arduino.h"
+#include "sim_devices.h"
+
+// Registers the simulated sensor answers
+#define IDENTIFICATION__MODEL_ID 0x010F
+#define GPIO__TIO_HV_STATUS 0x0031
+#define RESULT__RANGE_STATUS 0x0089
+#define SYSTEM__INTERRUPT_CLEAR 0x0086
+#define SYSTEM__MODE_START 0x0087
+
+// Maximum range per distance mode in the dark (datasheet)
+static uint16_t maxRangeMm(VL53L1X::DistanceMode mode) {
+    switch (mode) {
+    case VL53L1X::Short:
+        return 1360;
+    case VL53L1X::Medium:
+        return 2900;
+    default:
+        return 3600;
+    }
+}
+
+SimVL53L1X* VL53L1X::device() {
+    return static_cast<SimVL53L1X*>(_bus->simDevice(_address));
+}
+
+bool VL53L1X::init(bool io_2v8) {
+    (void)io_2v8;
+    if (readReg16Bit(IDENTIFICATION__MODEL_ID) != 0xEACC) {
+        return false;
+    }
+    // The Pololu driver's defaults after init()
+    setDistanceMode(Long);
+    setMeasurementTimingBudget(50000);
+    return true;
+}
+
+uint16_t VL53L1X::readReg16Bit(uint16_t reg) {
+    _bus->beginTransmission(_address);
+    _bus->write((uint8_t)(reg >> 8));
+    _bus->write((uint8_t)reg);
+    last_status = _bus->endTransmission(false);
+    if (last_status != 0) {
+        return 0;
+    }
+    _bus->requestFrom(_address, (uint8_t)2);
+    uint16_t value = (uint16_t)_bus->read() << 8;
+    value |= (uint8_t)_bus->read();
+    return value;
+}
+
+bool VL53L1X::setDistanceMode(DistanceMode mode) {
+    if (mode == Unknown) {
+        return false;
+    }
+    _mode = mode;
+    return true;
+}
+
+bool VL53L1X::setMeasurementTimingBudget(uint32_t budget_us) {
+    if (budget_us < 20000 || budget_us > 1100000) {
+        return false;
+    }
+    _budgetUs = budget_us;
+    return true;
+}
+
+void VL53L1X::startContinuous(uint32_t period_ms) {
+    if (SimVL53L1X* dev = device()) {
+        dev->start(period_ms, _budgetUs, maxRangeMm(_mode));
+    }
+    _bus->beginTransmission(_address);
+    _bus->write((uint8_t)(SYSTEM__MODE_START >> 8));
+    _bus->write((uint8_t)SYSTEM__MODE_START);
+    _bus->write(0x40);
+    last_status = _bus->endTransmission();
+}
+
+void VL53L1X::stopContinuous() {
+    if (SimVL53L1X* dev = device()) {
+        dev->stop();
+    }
+    _bus->beginTransmission(_address);
+    _bus->write((uint8_t)(SYSTEM__MODE_START >> 8));
+    _bus->write((uint8_t)SYSTEM__MODE_START);
+    _bus->write(0x80);
+    last_status = _bus->endTransmission();
+}
+
+bool VL53L1X::dataReady() {
+    // Interrupt polarity is active low: bit 0 clear means a result is waiting
+    _bus->beginTransmission(_address);
+    _bus->write((uint8_t)(GPIO__TIO_HV_STATUS >> 8));
+    _bus->write((uint8_t)GPIO__TIO_HV_STATUS);
+    last_status = _bus->endTransmission(false);
+    if (last_status != 0) {
+        return false;
+    }
+    _bus->requestFrom(_address, (uint8_t)1);
+    return (_bus->read() & 0x01) == 0;
+}
+
+uint16_t VL53L1X::read(bool blocking) {
+    if (blocking) {
+        unsigned long start = millis();
+        while (!dataReady()) {
+            if (_timeoutMs > 0 && millis() - start > _timeoutMs) {
+                _didTimeout = true;
+                return 0;
+            }
+        }
+    }
+
+    // Result block (17 bytes), then clear the interrupt
+    _bus->beginTransmission(_address);
+    _bus->write((uint8_t)(RESULT__RANGE_STATUS >> 8));
+    _bus->write((uint8_t)RESULT__RANGE_STATUS);
+    last_status = _bus->endTransmission(false);
+    _bus->requestFrom(_address, (uint8_t)17);
+
+    uint16_t mm = 0;
+    SimVL53L1X* dev = device();
+    if (last_status == 0 && dev && dev->take(mm)) {
+        ranging_data.range_mm = mm;
+        ranging_data.range_status = RangeValid;
+    } else {
+        ranging_data.range_mm = 0;
+        ranging_data.range_status = SignalFail;
+    }
+
+    _bus->beginTransmission(_address);
+    _bus->write((uint8_t)(SYSTEM__INTERRUPT_CLEAR >> 8));
+    _bus->write((uint8_t)SYSTEM__INTERRUPT_CLEAR);
+    _bus->write(0x01);
+    _bus->endTransmission();
+
+    return ranging_data.range_mm;
+}
+
+bool VL53L1X::timeoutOccurred() {
+    bool tmp = _didTimeout;
+    _didTimeout = false;
+    return tmp;
+}
@@ -0,0 +1,77 @@
+#pragma once
+/**
+ * @file VL53L1X.h
+ * @brief Pololu VL53L1X driver API on a SimVL53L1X (Linux backend)
+ *
+ * The driver finds the simulated sensor attached to its bus at its address.
+ * dataReady() and read() cost the I2C time of the register accesses the
+ * real driver makes; read(true) blocks until the next ranging completes.
+ */
+
+#include <stdint.h>
+#include "Wire.h"
+
+class SimVL53L1X;
+
+class VL53L1X {
+public:
+    enum DistanceMode { Short, Medium, Long, Unknown };
+
+    enum RangeStatus : uint8_t {
+        RangeValid = 0,
+        SigmaFail = 1,
+        SignalFail = 2,
+        RangeValidMinRangeClipped = 3,
+        OutOfBoundsFail = 4,
+        HardwareFail = 5,
+        RangeValidNoWrapCheckFail = 6,
+        WrapTargetFail = 7,
+        XtalkSignalFail = 9,
+        SynchronizationInt = 10,
+        MinRangeFail = 13,
+        None = 255,
+    };
+
+    struct RangingData {
+        uint16_t range_mm;
+        RangeStatus range_status;
+        float peak_signal_count_rate_MCPS;
+        float ambient_count_rate_MCPS;
+    };
+
+    RangingData ranging_data = {0, None, 0, 0};
+    uint8_t last_status = 0;
+
+    void setBus(TwoWire* bus) { _bus = bus; }
+    TwoWire* getBus() { return _bus; }
+    void setAddress(uint8_t newAddr) { _address = newAddr; }
+    uint8_t getAddress() { return _address; }
+
+    bool init(bool io_2v8 = true);
+    uint16_t readReg16Bit(uint16_t reg);
+
+    bool setDistanceMode(DistanceMode mode);
+    DistanceMode getDistanceMode() { return _mode; }
+    bool setMeasurementTimingBudget(uint32_t budget_us);
+    uint32_t getMeasurementTimingBudget() { return _budgetUs; }
+
+    void startContinuous(uint32_t period_ms);
+    void stopContinuous();
+    uint16_t read(bool blocking = true);
+    uint16_t readRangeContinuousMillimeters(bool blocking = true) { return read(blocking); }
+    bool dataReady();
+
+    void setTimeout(uint16_t timeout) { _timeoutMs = timeout; }
+    uint16_t getTimeout() { return _timeoutMs; }
+    bool timeoutOccurred();
+
+private:
+    SimVL53L1X* device();
+
+    TwoWire* _bus = &Wire;
+    uint8_t _address = 0x29;
+    DistanceMode _mode = Unknown;
+    uint32_t _budgetUs = 50000;
+    uint16_t _timeoutMs = 0;
+    bool _didTimeout = false;
+};
@@ -0,0 +1,201 @@
+#include "WString.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+static std::string formatInteger(unsigned long long value, bool negative, unsigned char base) {
+    if (base < 2 || base > 36) {
+        base = 10;
+    }
+    char buf[72];
+    char* p = buf + sizeof(buf) - 1;
+    *p = '\0';
+    do {
+        int digit = (int)(value % base);
+        *--p = (char)(digit < 10 ? '0' + digit : 'A' + digit - 10);
+        value /= base;
+    } while (value);
+    if (negative) {
+        *--p = '-';
+    }
+    return p;
+}
+
+static std::string formatSigned(long long value, unsigned char base) {
+    // The Arduino core only prints a sign in base 10
+    if (base == 10 && value < 0) {
+        return formatInteger(0ULL - (unsigned long long)value, true, base);
+    }
+    return formatInteger((unsigned long long)value, false, base);
+}
+
+static std::string formatFloat(double value, unsigned int decimalPlaces) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", (int)decimalPlaces, value);
+    return buf;
+}
+
+String::String(unsigned char value, unsigned char base) : _s(formatInteger(value, false, base)) {}
+String::String(int value, unsigned char base) : _s(formatSigned(value, base)) {}
+String::String(unsigned int value, unsigned char base) : _s(formatInteger(value, false, base)) {}
+String::String(long value, unsigned char base) : _s(formatSigned(value, base)) {}
+String::String(unsigned long value, unsigned char base) : _s(formatInteger(value, false, base)) {}
+String::String(long long value, unsigned char base) : _s(formatSigned(value, base)) {}
+String::String(unsigned long long value, unsigned char base) : _s(formatInteger(value, false, base)) {}
+String::String(float value, unsigned int decimalPlaces) : _s(formatFloat(value, decimalPlaces)) {}
+String::String(double value, unsigned int decimalPlaces) : _s(formatFloat(value, decimalPlaces)) {}
+
+bool String::equalsIgnoreCase(const String& s) const {
+    return _s.size() == s._s.size() && strcasecmp(_s.c_str(), s._s.c_str()) == 0;
+}
+
+bool String::endsWith(const String& suffix) const {
+    return _s.size() >= suffix._s.size() &&
+           _s.compare(_s.size() - suffix._s.size(), suffix._s.size(), suffix._s) == 0;
+}
+
+void String::getBytes(unsigned char* buf, unsigned int bufsize, unsigned int index) const {
+    if (!bufsize || !buf) {
+        return;
+    }
+    if (index >= _s.size()) {
+        buf[0] = 0;
+        return;
+    }
+    size_t n = std::min<size_t>(bufsize - 1, _s.size() - index);
+    memcpy(buf, _s.data() + index, n);
+    buf[n] = 0;
+}
+
+int String::indexOf(char ch, unsigned int fromIndex) const {
+    size_t pos = _s.find(ch, fromIndex);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::indexOf(const String& str, unsigned int fromIndex) const {
+    size_t pos = _s.find(str._s, fromIndex);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(char ch) const {
+    size_t pos = _s.rfind(ch);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(const String& str) const {
+    size_t pos = _s.rfind(str._s);
+    return pos == std::string::npos ? -1 : (int)pos;
+}
+
+String String::substring(unsigned int beginIndex) const {
+    return substring(beginIndex, length());
+}
+
+String String::substring(unsigned int beginIndex, unsigned int endIndex) const {
+    if (beginIndex > endIndex) {
+        std::swap(beginIndex, endIndex);
+    }
+    if (beginIndex >= _s.size()) {
+        return String();
+    }
+    endIndex = std::min<unsigned int>(endIndex, length());
+    return String(_s.substr(beginIndex, endIndex - beginIndex).c_str());
+}
+
+void String::replace(char find, char replace) {
+    for (char& c : _s) {
+        if (c == find) {
+            c = replace;
+        }
+    }
+}
+
+void String::replace(const String& find, const String& replace) {
+    if (find._s.empty()) {
+        return;
+    }
+    size_t pos = 0;
+    while ((pos = _s.find(find._s, pos)) != std::string::npos) {
+        _s.replace(pos, find._s.size(), replace._s);
+        pos += replace._s.size();
+    }
+}
+
+void String::remove(unsigned int index) {
+    if (index < _s.size()) {
+        _s.erase(index);
+    }
+}
+
+void String::remove(unsigned int index, unsigned int count) {
+    if (index < _s.size()) {
+        _s.erase(index, count);
+    }
+}
+
+void String::toLowerCase() {
+    for (char& c : _s) {
+        c = (char)tolower((unsigned char)c);
+    }
+}
+
+void String::toUpperCase() {
+    for (char& c : _s) {
+        c = (char)toupper((unsigned char)c);
+    }
+}
+
+void String::trim() {
+    size_t begin = _s.find_first_not_of(" \t\r\n\f\v");
+    if (begin == std::string::npos) {
+        _s.clear();
+        return;
+    }
+    size_t end = _s.find_last_not_of(" \t\r\n\f\v");
+    _s = _s.substr(begin, end - begin + 1);
+}
+
+long String::toInt() const {
+    return atol(_s.c_str());
+}
+
+float String::toFloat() const {
+    return (float)atof(_s.c_str());
+}
+
+double String::toDouble() const {
+    return atof(_s.c_str());
+}
+
+StringSumHelper operator+(const String& lhs, const String& rhs) {
+    StringSumHelper sum(lhs);
+    sum.concat(rhs);
+    return sum;
+}
+
+StringSumHelper operator+(const String& lhs, const char* rhs) {
+    StringSumHelper sum(lhs);
+    sum.concat(rhs);
+    return sum;
+}
+
+StringSumHelper operator+(const char* lhs, const String& rhs) {
+    StringSumHelper sum(lhs);
+    sum.concat(rhs);
+    return sum;
+}
+
+StringSumHelper operator+(const String& lhs, char rhs) {
+    StringSumHelper sum(lhs);
+    sum.concat(rhs);
+    return sum;
+}
+
+StringSumHelper operator+(const String& lhs, int rhs) { return lhs + String(rhs); }
+StringSumHelper operator+(const String& lhs, unsigned int rhs) { return lhs + String(rhs); }
+StringSumHelper operator+(const String& lhs, long rhs) { return lhs + String(rhs); }
+StringSumHelper operator+(const String& lhs, unsigned long rhs) { return lhs + String(rhs); }
+StringSumHelper operator+(const String& lhs, float rhs) { return lhs + String(rhs); }
+StringSumHelper operator+(const String& lhs, double rhs) { return lhs + String(rhs); }
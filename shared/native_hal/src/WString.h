@@ -0,0 +1,144 @@
+#pragma once
+/**
+ * @file WString.h
+ * @brief Arduino String on top of std::string (Linux backend)
+ */
+
+#include <stddef.h>
+#include <string>
+
+class StringSumHelper;
+
+class String {
+public:
+    String(const char* cstr = "") : _s(cstr ? cstr : "") {}
+    String(const String& str) = default;
+    String(String&& str) = default;
+    explicit String(char c) : _s(1, c) {}
+    explicit String(unsigned char value, unsigned char base = 10);
+    explicit String(int value, unsigned char base = 10);
+    explicit String(unsigned int value, unsigned char base = 10);
+    explicit String(long value, unsigned char base = 10);
+    explicit String(unsigned long value, unsigned char base = 10);
+    explicit String(long long value, unsigned char base = 10);
+    explicit String(unsigned long long value, unsigned char base = 10);
+    explicit String(float value, unsigned int decimalPlaces = 2);
+    explicit String(double value, unsigned int decimalPlaces = 2);
+
+    String& operator=(const String& rhs) = default;
+    String& operator=(String&& rhs) = default;
+    String& operator=(const char* cstr) {
+        _s = cstr ? cstr : "";
+        return *this;
+    }
+
+    unsigned int length() const { return (unsigned int)_s.size(); }
+    bool isEmpty() const { return _s.empty(); }
+    const char* c_str() const { return _s.c_str(); }
+    bool reserve(unsigned int size) {
+        _s.reserve(size);
+        return true;
+    }
+
+    bool concat(const String& str) {
+        _s += str._s;
+        return true;
+    }
+    bool concat(const char* cstr) {
+        if (!cstr) {
+            return false;
+        }
+        _s += cstr;
+        return true;
+    }
+    bool concat(const char* cstr, unsigned int length) {
+        if (!cstr) {
+            return false;
+        }
+        _s.append(cstr, length);
+        return true;
+    }
+    bool concat(char c) {
+        _s += c;
+        return true;
+    }
+    bool concat(int value) { return concat(String(value)); }
+    bool concat(unsigned int value) { return concat(String(value)); }
+    bool concat(long value) { return concat(String(value)); }
+    bool concat(unsigned long value) { return concat(String(value)); }
+    bool concat(float value) { return concat(String(value)); }
+    bool concat(double value) { return concat(String(value)); }
+
+    template <typename T>
+    String& operator+=(const T& rhs) {
+        concat(rhs);
+        return *this;
+    }
+
+    bool equals(const String& s) const { return _s == s._s; }
+    bool equals(const char* cstr) const { return _s == (cstr ? cstr : ""); }
+    bool equalsIgnoreCase(const String& s) const;
+    bool operator==(const String& rhs) const { return equals(rhs); }
+    bool operator==(const char* cstr) const { return equals(cstr); }
+    bool operator!=(const String& rhs) const { return !equals(rhs); }
+    bool operator!=(const char* cstr) const { return !equals(cstr); }
+    bool operator<(const String& rhs) const { return _s < rhs._s; }
+    bool startsWith(const String& prefix) const { return _s.compare(0, prefix._s.size(), prefix._s) == 0; }
+    bool endsWith(const String& suffix) const;
+
+    char charAt(unsigned int index) const { return index < _s.size() ? _s[index] : 0; }
+    void setCharAt(unsigned int index, char c) {
+        if (index < _s.size()) {
+            _s[index] = c;
+        }
+    }
+    char operator[](unsigned int index) const { return charAt(index); }
+    char& operator[](unsigned int index) { return _s[index]; }
+    void getBytes(unsigned char* buf, unsigned int bufsize, unsigned int index = 0) const;
+    void toCharArray(char* buf, unsigned int bufsize, unsigned int index = 0) const {
+        getBytes((unsigned char*)buf, bufsize, index);
+    }
+
+    int indexOf(char ch, unsigned int fromIndex = 0) const;
+    int indexOf(const String& str, unsigned int fromIndex = 0) const;
+    int lastIndexOf(char ch) const;
+    int lastIndexOf(const String& str) const;
+    String substring(unsigned int beginIndex) const;
+    String substring(unsigned int beginIndex, unsigned int endIndex) const;
+
+    void replace(char find, char replace);
+    void replace(const String& find, const String& replace);
+    void remove(unsigned int index);
+    void remove(unsigned int index, unsigned int count);
+    void toLowerCase();
+    void toUpperCase();
+    void trim();
+
+    long toInt() const;
+    float toFloat() const;
+    double toDouble() const;
+
+private:
+    std::string _s;
+};
+
+// Result type of operator+, as in the Arduino core (ArduinoJson adapts to it too)
+class StringSumHelper : public String {
+public:
+    StringSumHelper(const String& s) : String(s) {}
+    StringSumHelper(const char* p) : String(p) {}
+};
+
+StringSumHelper operator+(const String& lhs, const String& rhs);
+StringSumHelper operator+(const String& lhs, const char* rhs);
+StringSumHelper operator+(const char* lhs, const String& rhs);
+StringSumHelper operator+(const String& lhs, char rhs);
+StringSumHelper operator+(const String& lhs, int rhs);
+StringSumHelper operator+(const String& lhs, unsigned int rhs);
+StringSumHelper operator+(const String& lhs, long rhs);
+StringSumHelper operator+(const String& lhs, unsigned long rhs);
+StringSumHelper operator+(const String& lhs, float rhs);
+StringSumHelper operator+(const String& lhs, double rhs);
+
+inline bool operator==(const char* lhs, const String& rhs) { return rhs.equals(lhs); }
+inline bool operator!=(const char* lhs, const String& rhs) { return !rhs.equals(lhs); }
@@ -0,0 +1,75 @@
+#pragma once
+/**
+ * @file WiFi.h
+ * @brief Station that is always associated (Linux backend)
+ *
+ * The MAC (and with it the sensor ID) comes from the SIM_MAC environment
+ * variable, "24:6F:28:0A:BC:DE" by default.
+ */
+
+#include <stdint.h>
+#include "Arduino.h"
+#include "Client.h"
+#include "IPAddress.h"
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6,
+} wl_status_t;
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } wifi_mode_t;
+
+class WiFiClient : public Client {};
+
+class WiFiClass {
+public:
+    wl_status_t begin(const char* ssid, const char* passphrase = nullptr, int32_t channel = 0,
+                      const uint8_t* bssid = nullptr, bool connect = true);
+    bool config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns1 = IPAddress(),
+                IPAddress dns2 = IPAddress()) {
+        (void)local, (void)gateway, (void)subnet, (void)dns1, (void)dns2;
+        return true;
+    }
+    bool disconnect(bool wifioff = false, bool eraseap = false) {
+        (void)wifioff, (void)eraseap;
+        return true;
+    }
+    bool mode(wifi_mode_t mode) {
+        (void)mode;
+        return true;
+    }
+    bool setSleep(bool enabled) {
+        (void)enabled;
+        return true;
+    }
+    bool setAutoReconnect(bool autoReconnect) {
+        (void)autoReconnect;
+        return true;
+    }
+
+    wl_status_t status() { return WL_CONNECTED; }
+    bool isConnected() { return true; }
+    int8_t RSSI() { return -55; }
+    int32_t channel() { return 6; }
+    uint8_t* BSSID() {
+        static uint8_t bssid[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+        return bssid;
+    }
+    String SSID() { return String("native"); }
+    String macAddress();
+    uint8_t* macAddress(uint8_t* mac);
+    IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+    IPAddress gatewayIP() { return IPAddress(127, 0, 0, 1); }
+    IPAddress subnetMask() { return IPAddress(255, 0, 0, 0); }
+    IPAddress dnsIP(uint8_t index = 0) {
+        (void)index;
+        return IPAddress(127, 0, 0, 1);
+    }
+};
+
+extern WiFiClass WiFi;
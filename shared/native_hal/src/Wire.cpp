@@ -0,0 +1,103 @@
+#include "Wire.h"
+#include <chrono>
+#include <thread>
+
+TwoWire Wire(0);
+TwoWire Wire1(1);
+
+bool TwoWire::begin(int sda, int scl, uint32_t frequency) {
+    (void)sda, (void)scl;
+    if (frequency) {
+        _clock = frequency;
+    }
+    return true;
+}
+
+bool TwoWire::setClock(uint32_t frequency) {
+    if (frequency == 0) {
+        return false;
+    }
+    _clock = frequency;
+    return true;
+}
+
+void TwoWire::beginTransmission(uint16_t address) {
+    // Held until the STOP, like the bus lock in arduino-esp32
+    _lock.lock();
+    if (_nonStop) {
+        // Repeated start: the lock from the previous transaction is released here
+        _nonStop = false;
+        _lock.unlock();
+    }
+    _txAddress = address;
+    _txLen = 0;
+}
+
+uint8_t TwoWire::endTransmission(bool sendStop) {
+    SimI2CDevice* device = simDevice((uint8_t)_txAddress);
+    uint8_t result = 0;
+    simTransfer(_txLen + 1);
+    if (!device || !device->present()) {
+        result = 2; // NACK on address
+    } else if (!device->write(_tx, _txLen)) {
+        result = 3; // NACK on data
+    }
+    _txLen = 0;
+    if (sendStop || result != 0) {
+        _lock.unlock();
+    } else {
+        _nonStop = true;
+    }
+    return result;
+}
+
+size_t TwoWire::requestFrom(uint16_t address, size_t size, bool sendStop) {
+    (void)sendStop;
+    if (!_nonStop) {
+        _lock.lock();
+    }
+    _nonStop = false;
+    _rxIndex = 0;
+    _rxLen = 0;
+    if (size > I2C_BUFFER_LENGTH) {
+        size = I2C_BUFFER_LENGTH;
+    }
+    SimI2CDevice* device = simDevice((uint8_t)address);
+    if (device && device->present()) {
+        _rxLen = device->read(_rx, size);
+        simTransfer(size + 1);
+    } else {
+        simTransfer(1);
+    }
+    _lock.unlock();
+    return _rxLen;
+}
+
+size_t TwoWire::write(uint8_t data) {
+    if (_txLen >= I2C_BUFFER_LENGTH) {
+        return 0;
+    }
+    _tx[_txLen++] = data;
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (!write(data[i])) {
+            return i;
+        }
+    }
+    return len;
+}
+
+void TwoWire::simAttach(uint8_t address, SimI2CDevice* device) {
+    if (address < 128) {
+        _devices[address] = device;
+    }
+}
+
+void TwoWire::simTransfer(size_t bytes) const {
+    // 9 clocks per byte (8 data + ACK) plus START and STOP
+    uint64_t us = ((uint64_t)bytes * 9 + 2) * 1000000ULL / _clock;
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
@@ -0,0 +1,88 @@
+#pragma once
+/**
+ * @file Wire.h
+ * @brief I2C master on a simulated bus (Linux backend)
+ *
+ * Transactions go to the SimI2CDevice attached at the address; with none
+ * attached the address is not acknowledged (endTransmission() returns 2).
+ * Each transfer sleeps for its bit time at the configured clock (9 bits
+ * per byte plus start/stop), so bus cost shows up in the caller's timing.
+ * As in arduino-esp32 the bus is locked per transaction, and across a
+ * repeated start (endTransmission(false) + requestFrom()).
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+#include "Print.h"
+
+#define I2C_BUFFER_LENGTH 128
+
+class SimI2CDevice {
+public:
+    virtual ~SimI2CDevice() {}
+    /** @brief ACKs its address (a device can be "unplugged") */
+    virtual bool present() const { return true; }
+    /** @brief Bytes written after the address; false NACKs the data */
+    virtual bool write(const uint8_t* data, size_t len) = 0;
+    /** @brief Fill up to len bytes; returns how many the device supplied */
+    virtual size_t read(uint8_t* data, size_t len) = 0;
+};
+
+class TwoWire : public Print {
+public:
+    explicit TwoWire(uint8_t busNum) : _num(busNum) {}
+
+    bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0);
+    bool end() { return true; }
+    bool setClock(uint32_t frequency);
+    uint32_t getClock() const { return _clock; }
+    void setTimeOut(uint16_t timeOutMillis) { (void)timeOutMillis; }
+
+    void beginTransmission(uint16_t address);
+    void beginTransmission(int address) { beginTransmission((uint16_t)address); }
+    uint8_t endTransmission(bool sendStop);
+    uint8_t endTransmission() { return endTransmission(true); }
+
+    size_t requestFrom(uint16_t address, size_t size, bool sendStop);
+    uint8_t requestFrom(int address, int size, int sendStop = 1) {
+        return (uint8_t)requestFrom((uint16_t)address, (size_t)size, sendStop != 0);
+    }
+
+    using Print::write;
+    size_t write(uint8_t data) override;
+    size_t write(const uint8_t* data, size_t len) override;
+    size_t write(int n) { return write((uint8_t)n); }
+    size_t write(unsigned int n) { return write((uint8_t)n); }
+    size_t write(long n) { return write((uint8_t)n); }
+    size_t write(unsigned long n) { return write((uint8_t)n); }
+    int available() { return (int)(_rxLen - _rxIndex); }
+    int read() { return _rxIndex < _rxLen ? _rx[_rxIndex++] : -1; }
+    int peek() { return _rxIndex < _rxLen ? _rx[_rxIndex] : -1; }
+    void flush() override {}
+
+    // ---- Simulation ----
+
+    void simAttach(uint8_t address, SimI2CDevice* device);
+    SimI2CDevice* simDevice(uint8_t address) const { return address < 128 ? _devices[address] : nullptr; }
+    /** @brief Spend the bus time of a transfer of n bytes (address byte included) */
+    void simTransfer(size_t bytes) const;
+
+private:
+    uint8_t _num;
+    uint32_t _clock = 100000;
+    std::recursive_mutex _lock;
+    bool _nonStop = false;
+
+    uint16_t _txAddress = 0;
+    uint8_t _tx[I2C_BUFFER_LENGTH];
+    size_t _txLen = 0;
+    uint8_t _rx[I2C_BUFFER_LENGTH];
+    size_t _rxLen = 0;
+    size_t _rxIndex = 0;
+
+    SimI2CDevice* _devices[128] = {nullptr};
+};
+
+extern TwoWire Wire;
+extern TwoWire Wire1;
@@ -0,0 +1,47 @@
+#pragma once
+/**
+ * @file driver/timer.h
+ * @brief Legacy timer group driver (Linux backend)
+ *
+ * Each started timer runs its registered ISR from a dedicated thread once
+ * per alarm period (alarm value x divider / 80 MHz APB clock). As on the
+ * chip, the alarm disarms itself when it fires; the ISR must call
+ * timer_group_enable_alarm_in_isr() to get the next one.
+ */
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_intr_alloc.h"
+
+typedef enum { TIMER_GROUP_0 = 0, TIMER_GROUP_1, TIMER_GROUP_MAX } timer_group_t;
+typedef enum { TIMER_0 = 0, TIMER_1, TIMER_MAX } timer_idx_t;
+typedef enum { TIMER_ALARM_DIS = 0, TIMER_ALARM_EN } timer_alarm_t;
+typedef enum { TIMER_PAUSE = 0, TIMER_START } timer_start_t;
+typedef enum { TIMER_INTR_LEVEL = 0, TIMER_INTR_MAX } timer_intr_mode_t;
+typedef enum { TIMER_COUNT_DOWN = 0, TIMER_COUNT_UP } timer_count_dir_t;
+typedef enum { TIMER_AUTORELOAD_DIS = 0, TIMER_AUTORELOAD_EN } timer_autoreload_t;
+
+typedef struct {
+    timer_alarm_t alarm_en;
+    timer_start_t counter_en;
+    timer_intr_mode_t intr_type;
+    timer_count_dir_t counter_dir;
+    timer_autoreload_t auto_reload;
+    uint32_t divider;
+} timer_config_t;
+
+typedef void* timer_isr_handle_t;
+
+esp_err_t timer_init(timer_group_t group, timer_idx_t timer, const timer_config_t* config);
+esp_err_t timer_deinit(timer_group_t group, timer_idx_t timer);
+esp_err_t timer_set_counter_value(timer_group_t group, timer_idx_t timer, uint64_t value);
+esp_err_t timer_set_alarm_value(timer_group_t group, timer_idx_t timer, uint64_t alarm);
+esp_err_t timer_set_alarm(timer_group_t group, timer_idx_t timer, timer_alarm_t alarm_en);
+esp_err_t timer_enable_intr(timer_group_t group, timer_idx_t timer);
+esp_err_t timer_disable_intr(timer_group_t group, timer_idx_t timer);
+esp_err_t timer_isr_register(timer_group_t group, timer_idx_t timer, void (*fn)(void*), void* arg,
+                             int intr_alloc_flags, timer_isr_handle_t* handle);
+esp_err_t timer_start(timer_group_t group, timer_idx_t timer);
+esp_err_t timer_pause(timer_group_t group, timer_idx_t timer);
+void timer_group_clr_intr_status_in_isr(timer_group_t group, timer_idx_t timer);
+void timer_group_enable_alarm_in_isr(timer_group_t group, timer_idx_t timer);
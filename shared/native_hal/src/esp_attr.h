@@ -0,0 +1,15 @@
+#pragma once
+/**
+ * @file esp_attr.h
+ * @brief Placement attributes (Linux backend: no effect)
+ *
+ * RTC_NOINIT data does not survive a restart here, since ESP.restart() ends
+ * the process.
+ */
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+#define RTC_FAST_ATTR
+#define RTC_SLOW_ATTR
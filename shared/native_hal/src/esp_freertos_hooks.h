@@ -0,0 +1,14 @@
+#pragma once
+/**
+ * @file esp_freertos_hooks.h
+ * @brief FreeRTOS tick hooks (Linux backend)
+ *
+ * There is no tick interrupt, so registered hooks are never called.
+ */
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+typedef void (*esp_freertos_tick_cb_t)(void);
+
+esp_err_t esp_register_freertos_tick_hook_for_cpu(esp_freertos_tick_cb_t cb, UBaseType_t cpuid);
@@ -0,0 +1,10 @@
+#pragma once
+/**
+ * @file esp_intr_alloc.h
+ * @brief Interrupt allocation flags (Linux backend: accepted and ignored)
+ */
+
+#define ESP_INTR_FLAG_LEVEL1 (1 << 1)
+#define ESP_INTR_FLAG_SHARED (1 << 8)
+#define ESP_INTR_FLAG_EDGE (1 << 9)
+#define ESP_INTR_FLAG_IRAM (1 << 10)
@@ -0,0 +1,16 @@
+#pragma once
+/**
+ * @file esp_ota_ops.h
+ * @brief OTA slot selection (Linux backend)
+ *
+ * The boot partition is only remembered, so a failsafe switch back to the
+ * bootloader can be observed before the restart ends the process.
+ */
+
+#include "esp_err.h"
+#include "esp_partition.h"
+
+const esp_partition_t* esp_ota_get_running_partition(void);
+const esp_partition_t* esp_ota_get_boot_partition(void);
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from);
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition);
@@ -0,0 +1,39 @@
+#pragma once
+/**
+ * @file esp_partition.h
+ * @brief Partition lookup (Linux backend)
+ *
+ * Mirrors partitions/custom_partitions.csv: the bootloader in ota_0 and the
+ * sensor firmware, which is what runs here, in ota_1. Erasing only logs.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef enum {
+    ESP_PARTITION_TYPE_APP = 0x00,
+    ESP_PARTITION_TYPE_DATA = 0x01,
+} esp_partition_type_t;
+
+typedef enum {
+    ESP_PARTITION_SUBTYPE_APP_FACTORY = 0x00,
+    ESP_PARTITION_SUBTYPE_APP_OTA_0 = 0x10,
+    ESP_PARTITION_SUBTYPE_APP_OTA_1 = 0x11,
+    ESP_PARTITION_SUBTYPE_DATA_OTA = 0x00,
+    ESP_PARTITION_SUBTYPE_DATA_NVS = 0x02,
+    ESP_PARTITION_SUBTYPE_ANY = 0xff,
+} esp_partition_subtype_t;
+
+typedef struct {
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    uint32_t address;
+    uint32_t size;
+    char label[17];
+    bool encrypted;
+} esp_partition_t;
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char* label);
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size);
@@ -0,0 +1,50 @@
+#pragma once
+/**
+ * @file esp_timer.h
+ * @brief Microsecond clock and one-shot esp_timer (Linux backend)
+ *
+ * Callbacks run one at a time from a single dispatch thread, as from the
+ * esp_timer task. A one-shot timer is disarmed before its callback runs, so
+ * the callback may start it again.
+ */
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef struct SimEspTimer* esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void* arg);
+
+typedef enum {
+    ESP_TIMER_TASK,
+    ESP_TIMER_ISR, // Dispatched from the same thread
+} esp_timer_dispatch_t;
+
+typedef struct {
+    esp_timer_cb_t callback;
+    void* arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char* name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+/**
+ * @brief Microseconds since the process started
+ */
+int64_t esp_timer_get_time(void);
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out);
+
+/**
+ * @brief Fire once after timeout_us; ESP_ERR_INVALID_STATE if the timer is already armed
+ */
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+
+/**
+ * @brief Disarm the timer; ESP_ERR_INVALID_STATE if it is not armed
+ */
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+
+/**
+ * @brief Free a stopped timer; ESP_ERR_INVALID_STATE if it is still armed
+ */
+esp_err_t esp_timer_delete(esp_timer_handle_t timer);
@@ -0,0 +1,607 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "driver/timer.h"
+#include "esp_timer.h"
+#include "esp_freertos_hooks.h"
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+
+static std::chrono::steady_clock::time_point deadlineAfter(TickType_t ticks) {
+    return std::chrono::steady_clock::now() + milliseconds(ticks * portTICK_PERIOD_MS);
+}
+
+// ---- Critical sections ----
+
+static uint32_t threadToken() {
+    static std::atomic<uint32_t> next{1};
+    thread_local uint32_t token = next++;
+    return token;
+}
+
+void vPortEnterCritical(portMUX_TYPE* mux) {
+    uint32_t me = threadToken();
+    if (__atomic_load_n(&mux->owner, __ATOMIC_ACQUIRE) == me) {
+        mux->count++;
+        return;
+    }
+    uint32_t expected = 0;
+    while (!__atomic_compare_exchange_n(&mux->owner, &expected, me, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        expected = 0;
+        std::this_thread::yield();
+    }
+    mux->count = 1;
+}
+
+void vPortExitCritical(portMUX_TYPE* mux) {
+    if (--mux->count == 0) {
+        __atomic_store_n(&mux->owner, 0, __ATOMIC_RELEASE);
+    }
+}
+
+// ---- Tasks ----
+
+struct SimTask {
+    std::string name;
+    UBaseType_t priority = 1;
+    BaseType_t core = 1;
+    uint32_t stackDepth = 0;
+    std::mutex lock;
+    std::condition_variable cv;
+    uint32_t notify = 0;
+};
+
+// Thrown by vTaskDelete(NULL) to unwind the task's thread
+struct SimTaskExit {};
+
+thread_local SimTask* tCurrentTask = nullptr;
+
+static void runTask(SimTask* task, TaskFunction_t fn, void* param) {
+    tCurrentTask = task;
+    try {
+        fn(param);
+        // FreeRTOS would assert here
+        fprintf(stderr, "[native] task '%s' returned without vTaskDelete()\n", task->name.c_str());
+    } catch (const SimTaskExit&) {
+    }
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stackDepth, void* param,
+                                   UBaseType_t priority, TaskHandle_t* created, BaseType_t coreID) {
+    SimTask* task = new SimTask();
+    task->name = name ? name : "";
+    task->stackDepth = stackDepth;
+    task->priority = priority;
+    task->core = coreID == tskNO_AFFINITY ? 0 : coreID;
+    if (created) {
+        *created = task;
+    }
+    std::thread(runTask, task, fn, param).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t stackDepth, void* param,
+                       UBaseType_t priority, TaskHandle_t* created) {
+    return xTaskCreatePinnedToCore(fn, name, stackDepth, param, priority, created, tskNO_AFFINITY);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    if (!tCurrentTask) {
+        // setup()/loop() run in arduino-esp32's loopTask on core 1
+        tCurrentTask = new SimTask();
+        tCurrentTask->name = "loopTask";
+    }
+    return tCurrentTask;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task == nullptr || task == tCurrentTask) {
+        throw SimTaskExit();
+    }
+    fprintf(stderr, "[native] vTaskDelete('%s') from another task is not supported\n", task->name.c_str());
+}
+
+const char* pcTaskGetName(TaskHandle_t task) {
+    return (task ? task : xTaskGetCurrentTaskHandle())->name.c_str();
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    // Threads run on host-sized stacks, so nothing is measured: report it all free
+    return (task ? task : xTaskGetCurrentTaskHandle())->stackDepth;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandleForCPU(BaseType_t cpuid) {
+    (void)cpuid;
+    return nullptr;
+}
+
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(BaseType_t cpuid) {
+    (void)cpuid;
+    return nullptr;
+}
+
+esp_err_t esp_register_freertos_tick_hook_for_cpu(esp_freertos_tick_cb_t cb, UBaseType_t cpuid) {
+    // There is no tick interrupt to hook; per-core CPU load stays unmeasured
+    (void)cb;
+    (void)cpuid;
+    return ESP_OK;
+}
+
+BaseType_t xPortGetCoreID(void) {
+    return xTaskGetCurrentTaskHandle()->core;
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(esp_timer_get_time() / (1000 * portTICK_PERIOD_MS));
+}
+
+TickType_t xTaskGetTickCountFromISR(void) {
+    return xTaskGetTickCount();
+}
+
+void vTaskDelay(TickType_t ticks) {
+    if (ticks == 0) {
+        std::this_thread::yield();
+        return;
+    }
+    std::this_thread::sleep_for(milliseconds(ticks * portTICK_PERIOD_MS));
+}
+
+BaseType_t xTaskDelayUntil(TickType_t* previousWakeTime, TickType_t increment) {
+    TickType_t wake = *previousWakeTime + increment;
+    TickType_t now = xTaskGetTickCount();
+    *previousWakeTime = wake;
+    if ((int32_t)(wake - now) <= 0) {
+        return pdFALSE;
+    }
+    vTaskDelay(wake - now);
+    return pdTRUE;
+}
+
+void vTaskDelayUntil(TickType_t* previousWakeTime, TickType_t increment) {
+    xTaskDelayUntil(previousWakeTime, increment);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    {
+        std::lock_guard<std::mutex> guard(task->lock);
+        task->notify++;
+    }
+    task->cv.notify_one();
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higherPriorityTaskWoken) {
+    xTaskNotifyGive(task);
+    if (higherPriorityTaskWoken) {
+        *higherPriorityTaskWoken = pdTRUE;
+    }
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait) {
+    SimTask* task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lk(task->lock);
+    auto notified = [task]() { return task->notify > 0; };
+    if (ticksToWait == portMAX_DELAY) {
+        task->cv.wait(lk, notified);
+    } else if (ticksToWait > 0) {
+        task->cv.wait_until(lk, deadlineAfter(ticksToWait), notified);
+    }
+    uint32_t value = task->notify;
+    if (value) {
+        task->notify = clearCountOnExit ? 0 : value - 1;
+    }
+    return value;
+}
+
+// ---- Queues ----
+
+struct SimQueue {
+    size_t length;
+    size_t itemSize;
+    std::deque<std::vector<uint8_t>> items;
+    std::mutex lock;
+    std::condition_variable changed;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    if (length == 0) {
+        return nullptr;
+    }
+    SimQueue* q = new SimQueue();
+    q->length = length;
+    q->itemSize = itemSize;
+    return q;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    delete queue;
+}
+
+static BaseType_t queueSend(QueueHandle_t q, const void* item, TickType_t ticksToWait, bool front) {
+    std::unique_lock<std::mutex> lk(q->lock);
+    auto space = [q]() { return q->items.size() < q->length; };
+    if (ticksToWait == portMAX_DELAY) {
+        q->changed.wait(lk, space);
+    } else if (!q->changed.wait_until(lk, deadlineAfter(ticksToWait), space)) {
+        return errQUEUE_FULL;
+    }
+    std::vector<uint8_t> copy((const uint8_t*)item, (const uint8_t*)item + q->itemSize);
+    if (front) {
+        q->items.push_front(std::move(copy));
+    } else {
+        q->items.push_back(std::move(copy));
+    }
+    lk.unlock();
+    q->changed.notify_all();
+    return pdPASS;
+}
+
+static BaseType_t queueReceive(QueueHandle_t q, void* item, TickType_t ticksToWait, bool remove) {
+    std::unique_lock<std::mutex> lk(q->lock);
+    auto available = [q]() { return !q->items.empty(); };
+    if (ticksToWait == portMAX_DELAY) {
+        q->changed.wait(lk, available);
+    } else if (!q->changed.wait_until(lk, deadlineAfter(ticksToWait), available)) {
+        return errQUEUE_EMPTY;
+    }
+    memcpy(item, q->items.front().data(), q->itemSize);
+    if (remove) {
+        q->items.pop_front();
+        lk.unlock();
+        q->changed.notify_all();
+    }
+    return pdPASS;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticksToWait) {
+    return queueSend(queue, item, ticksToWait, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void* item, TickType_t ticksToWait) {
+    return queueSend(queue, item, ticksToWait, true);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* higherPriorityTaskWoken) {
+    if (higherPriorityTaskWoken) {
+        *higherPriorityTaskWoken = pdFALSE;
+    }
+    return queueSend(queue, item, 0, false);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticksToWait) {
+    return queueReceive(queue, item, ticksToWait, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void* item, TickType_t ticksToWait) {
+    return queueReceive(queue, item, ticksToWait, false);
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> guard(queue->lock);
+    return (UBaseType_t)queue->items.size();
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    std::lock_guard<std::mutex> guard(queue->lock);
+    return (UBaseType_t)(queue->length - queue->items.size());
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+    {
+        std::lock_guard<std::mutex> guard(queue->lock);
+        queue->items.clear();
+    }
+    queue->changed.notify_all();
+    return pdPASS;
+}
+
+// ---- Timer groups ----
+
+#define SIM_APB_CLK_MHZ 80
+
+struct SimTimer {
+    std::mutex lock;
+    std::condition_variable changed;
+    bool threadStarted = false;
+    bool configChanged = false;
+
+    bool running = false;
+    bool alarmEnabled = false;
+    bool autoReload = false;
+    bool intrEnabled = false;
+    uint32_t divider = 2;
+    uint64_t alarm = 0;
+    int64_t counterUs = 0; // Counter value while paused
+    int64_t dueUs = 0;     // Next alarm while running
+    void (*isr)(void*) = nullptr;
+    void* arg = nullptr;
+
+    int64_t periodUs() const { return (int64_t)(alarm * divider / SIM_APB_CLK_MHZ); }
+};
+
+static SimTimer sTimers[TIMER_GROUP_MAX][TIMER_MAX];
+
+static SimTimer* timerAt(timer_group_t group, timer_idx_t timer) {
+    return (group < TIMER_GROUP_MAX && timer < TIMER_MAX) ? &sTimers[group][timer] : nullptr;
+}
+
+static void timerThread(SimTimer* t) {
+    std::unique_lock<std::mutex> lk(t->lock);
+    for (;;) {
+        if (!t->running || !t->alarmEnabled || t->periodUs() <= 0) {
+            t->changed.wait(lk, [t]() { return t->configChanged; });
+            t->configChanged = false;
+            continue;
+        }
+
+        int64_t wait = t->dueUs - esp_timer_get_time();
+        if (wait > 0 && t->changed.wait_for(lk, microseconds(wait), [t]() { return t->configChanged; })) {
+            t->configChanged = false;
+            continue;
+        }
+
+        // The alarm disarms itself; the ISR re-enables it
+        t->alarmEnabled = false;
+        int64_t now = esp_timer_get_time();
+        if (t->autoReload) {
+            // Alarms missed while the ISR was late collapse into one, as with a pending interrupt
+            do {
+                t->dueUs += t->periodUs();
+            } while (t->dueUs <= now);
+        }
+        void (*isr)(void*) = t->intrEnabled ? t->isr : nullptr;
+        void* arg = t->arg;
+        lk.unlock();
+        if (isr) {
+            isr(arg);
+        }
+        lk.lock();
+    }
+}
+
+template <typename F>
+static esp_err_t updateTimer(timer_group_t group, timer_idx_t timer, F update) {
+    SimTimer* t = timerAt(group, timer);
+    if (!t) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    {
+        std::lock_guard<std::mutex> guard(t->lock);
+        update(*t);
+        t->configChanged = true;
+    }
+    t->changed.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t timer_init(timer_group_t group, timer_idx_t timer, const timer_config_t* config) {
+    if (!config || config->divider < 2 || config->divider > 65536) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return updateTimer(group, timer, [config](SimTimer& t) {
+        t.alarmEnabled = config->alarm_en == TIMER_ALARM_EN;
+        t.autoReload = config->auto_reload == TIMER_AUTORELOAD_EN;
+        t.divider = config->divider;
+        t.counterUs = 0;
+        t.running = false;
+        if (!t.threadStarted) {
+            t.threadStarted = true;
+            std::thread(timerThread, &t).detach();
+        }
+        if (config->counter_en == TIMER_START) {
+            t.running = true;
+            t.dueUs = esp_timer_get_time() + t.periodUs();
+        }
+    });
+}
+
+esp_err_t timer_deinit(timer_group_t group, timer_idx_t timer) {
+    return updateTimer(group, timer, [](SimTimer& t) {
+        t.running = false;
+        t.isr = nullptr;
+    });
+}
+
+esp_err_t timer_set_counter_value(timer_group_t group, timer_idx_t timer, uint64_t value) {
+    return updateTimer(group, timer, [value](SimTimer& t) {
+        int64_t us = (int64_t)(value * t.divider / SIM_APB_CLK_MHZ);
+        if (t.running) {
+            t.dueUs = esp_timer_get_time() + t.periodUs() - us;
+        } else {
+            t.counterUs = us;
+        }
+    });
+}
+
+esp_err_t timer_set_alarm_value(timer_group_t group, timer_idx_t timer, uint64_t alarm) {
+    return updateTimer(group, timer, [alarm](SimTimer& t) {
+        if (t.running) {
+            // Keep the counter position, move the alarm
+            t.dueUs += (int64_t)((int64_t)alarm - (int64_t)t.alarm) * t.divider / SIM_APB_CLK_MHZ;
+        }
+        t.alarm = alarm;
+    });
+}
+
+esp_err_t timer_set_alarm(timer_group_t group, timer_idx_t timer, timer_alarm_t alarm_en) {
+    return updateTimer(group, timer, [alarm_en](SimTimer& t) { t.alarmEnabled = alarm_en == TIMER_ALARM_EN; });
+}
+
+esp_err_t timer_enable_intr(timer_group_t group, timer_idx_t timer) {
+    return updateTimer(group, timer, [](SimTimer& t) { t.intrEnabled = true; });
+}
+
+esp_err_t timer_disable_intr(timer_group_t group, timer_idx_t timer) {
+    return updateTimer(group, timer, [](SimTimer& t) { t.intrEnabled = false; });
+}
+
+esp_err_t timer_isr_register(timer_group_t group, timer_idx_t timer, void (*fn)(void*), void* arg,
+                             int intr_alloc_flags, timer_isr_handle_t* handle) {
+    (void)intr_alloc_flags;
+    if (handle) {
+        *handle = nullptr;
+    }
+    return updateTimer(group, timer, [fn, arg](SimTimer& t) {
+        t.isr = fn;
+        t.arg = arg;
+    });
+}
+
+esp_err_t timer_start(timer_group_t group, timer_idx_t timer) {
+    return updateTimer(group, timer, [](SimTimer& t) {
+        if (!t.running) {
+            t.running = true;
+            // An alarm below the counter fires immediately
+            t.dueUs = esp_timer_get_time() + std::max<int64_t>(0, t.periodUs() - t.counterUs);
+        }
+    });
+}
+
+esp_err_t timer_pause(timer_group_t group, timer_idx_t timer) {
+    return updateTimer(group, timer, [](SimTimer& t) {
+        if (t.running) {
+            t.running = false;
+            t.counterUs = std::max<int64_t>(0, t.periodUs() - (t.dueUs - esp_timer_get_time()));
+        }
+    });
+}
+
+void timer_group_clr_intr_status_in_isr(timer_group_t group, timer_idx_t timer) {
+    (void)group, (void)timer;
+}
+
+void timer_group_enable_alarm_in_isr(timer_group_t group, timer_idx_t timer) {
+    SimTimer* t = timerAt(group, timer);
+    if (t) {
+        std::lock_guard<std::mutex> guard(t->lock);
+        t->alarmEnabled = true;
+    }
+}
+
+// ---- esp_timer ----
+
+struct SimEspTimer {
+    esp_timer_cb_t callback = nullptr;
+    void* arg = nullptr;
+    bool armed = false;
+    int64_t dueUs = 0;
+};
+
+struct SimEspTimers {
+    std::mutex lock;
+    std::condition_variable changed;
+    std::vector<SimEspTimer*> timers;
+    bool taskStarted = false;
+};
+
+// Never destroyed: the dispatch thread is still waiting when a unit test returns from main()
+static SimEspTimers& sEspTimers = *new SimEspTimers();
+
+// The esp_timer task: fires the earliest armed timer, one callback at a time
+static void espTimerTask() {
+    std::unique_lock<std::mutex> lk(sEspTimers.lock);
+    for (;;) {
+        SimEspTimer* next = nullptr;
+        for (SimEspTimer* t : sEspTimers.timers) {
+            if (t->armed && (!next || t->dueUs < next->dueUs)) {
+                next = t;
+            }
+        }
+        if (!next) {
+            sEspTimers.changed.wait(lk);
+            continue;
+        }
+
+        int64_t wait = next->dueUs - esp_timer_get_time();
+        if (wait > 0) {
+            sEspTimers.changed.wait_for(lk, microseconds(wait));
+            continue;
+        }
+
+        next->armed = false;
+        esp_timer_cb_t callback = next->callback;
+        void* arg = next->arg;
+        lk.unlock();
+        callback(arg);
+        lk.lock();
+    }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out) {
+    if (!args || !args->callback || !out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    SimEspTimer* timer = new SimEspTimer();
+    timer->callback = args->callback;
+    timer->arg = args->arg;
+
+    std::lock_guard<std::mutex> guard(sEspTimers.lock);
+    sEspTimers.timers.push_back(timer);
+    if (!sEspTimers.taskStarted) {
+        sEspTimers.taskStarted = true;
+        std::thread(espTimerTask).detach();
+    }
+    *out = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    if (!timer) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    {
+        std::lock_guard<std::mutex> guard(sEspTimers.lock);
+        if (timer->armed) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        timer->armed = true;
+        timer->dueUs = esp_timer_get_time() + (int64_t)timeout_us;
+    }
+    sEspTimers.changed.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (!timer) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    {
+        std::lock_guard<std::mutex> guard(sEspTimers.lock);
+        if (!timer->armed) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        timer->armed = false;
+    }
+    sEspTimers.changed.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    if (!timer) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> guard(sEspTimers.lock);
+    if (timer->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (size_t i = 0; i < sEspTimers.timers.size(); i++) {
+        if (sEspTimers.timers[i] == timer) {
+            sEspTimers.timers.erase(sEspTimers.timers.begin() + i);
+            break;
+        }
+    }
+    delete timer;
+    return ESP_OK;
+}
@@ -0,0 +1,53 @@
+#pragma once
+/**
+ * @file freertos/FreeRTOS.h
+ * @brief FreeRTOS types and critical sections (Linux backend)
+ *
+ * One tick is one millisecond, as in arduino-esp32. Priorities and core
+ * affinity are recorded but not enforced; the host scheduler decides.
+ * portMUX_TYPE is a recursive spinlock, so critical sections still exclude
+ * each other across tasks and the timer "ISR" threads.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define errQUEUE_EMPTY ((BaseType_t)0)
+#define errQUEUE_FULL ((BaseType_t)0)
+
+#define configTICK_RATE_HZ 1000
+#define configMAX_PRIORITIES 25
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define pdMS_TO_TICKS(xTimeInMs) ((TickType_t)(((uint64_t)(xTimeInMs) * configTICK_RATE_HZ) / 1000U))
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+typedef struct {
+    volatile uint32_t owner; // 0 when free
+    uint32_t count;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0, 0}
+
+void vPortEnterCritical(portMUX_TYPE* mux);
+void vPortExitCritical(portMUX_TYPE* mux);
+
+#define portENTER_CRITICAL(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) vPortExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux) vPortExitCritical(mux)
+#define taskENTER_CRITICAL(mux) vPortEnterCritical(mux)
+#define taskEXIT_CRITICAL(mux) vPortExitCritical(mux)
+
+#define portYIELD_FROM_ISR(...) ((void)0)
+
+BaseType_t xPortGetCoreID(void);
@@ -0,0 +1,37 @@
+#pragma once
+/**
+ * @file freertos/task.h
+ * @brief Tasks and direct-to-task notifications (Linux backend)
+ *
+ * Tasks are detached threads. vTaskDelete(NULL) ends the calling task;
+ * deleting another task is not supported and only logs. Stacks are host
+ * thread stacks: uxTaskGetStackHighWaterMark() reports the requested depth,
+ * and there are no idle tasks, so the per-CPU handles are NULL.
+ */
+
+#include "FreeRTOS.h"
+
+typedef struct SimTask* TaskHandle_t;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stackDepth, void* param,
+                                   UBaseType_t priority, TaskHandle_t* created, BaseType_t coreID);
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t stackDepth, void* param,
+                       UBaseType_t priority, TaskHandle_t* created);
+void vTaskDelete(TaskHandle_t task);
+
+void vTaskDelay(TickType_t ticks);
+void vTaskDelayUntil(TickType_t* previousWakeTime, TickType_t increment);
+BaseType_t xTaskDelayUntil(TickType_t* previousWakeTime, TickType_t increment);
+TickType_t xTaskGetTickCount(void);
+TickType_t xTaskGetTickCountFromISR(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+const char* pcTaskGetName(TaskHandle_t task);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+TaskHandle_t xTaskGetCurrentTaskHandleForCPU(BaseType_t cpuid);
+TaskHandle_t xTaskGetIdleTaskHandleForCPU(BaseType_t cpuid);
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higherPriorityTaskWoken);
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait);
+
+#define taskYIELD() vTaskDelay(0)
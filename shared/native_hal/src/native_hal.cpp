@@ -0,0 +1,489 @@
+#include "Arduino.h"
+#include "WiFi.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "native_hal.h"
+#include <stdarg.h>
+#include <unistd.h>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+// ---- Clock ----
+
+// SIM_CLOCK_EPOCH_US (CLOCK_MONOTONIC microseconds) lets several processes share one time base
+static std::chrono::steady_clock::time_point bootTime() {
+    const char* epoch = getenv("SIM_CLOCK_EPOCH_US");
+    if (epoch && *epoch) {
+        return std::chrono::steady_clock::time_point(std::chrono::microseconds(strtoll(epoch, nullptr, 10)));
+    }
+    return std::chrono::steady_clock::now();
+}
+
+static const std::chrono::steady_clock::time_point kBoot = bootTime();
+
+int64_t esp_timer_get_time(void) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - kBoot).count();
+}
+
+unsigned long millis() {
+    return (unsigned long)(uint32_t)(esp_timer_get_time() / 1000);
+}
+
+unsigned long micros() {
+    return (unsigned long)(uint32_t)esp_timer_get_time();
+}
+
+void delay(uint32_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(uint32_t us) {
+    // Busy-waits like the core; sleeping would overshoot short delays
+    int64_t end = esp_timer_get_time() + us;
+    while (esp_timer_get_time() < end) {
+    }
+}
+
+void yield() {
+    std::this_thread::yield();
+}
+
+// ---- GPIO ----
+
+#define SIM_GPIO_COUNT 40
+
+struct SimPin {
+    uint8_t mode = 0;
+    int level = LOW;
+    int analog = 0;
+    uint32_t writes = 0;
+    std::function<int()> input;
+    std::function<void(int)> onWrite;
+    std::function<unsigned long(uint8_t, unsigned long)> pulse;
+};
+
+static SimPin sPins[SIM_GPIO_COUNT];
+static std::mutex sGpioLock;
+
+static SimPin* pinAt(uint8_t pin) {
+    return pin < SIM_GPIO_COUNT ? &sPins[pin] : nullptr;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    std::lock_guard<std::mutex> guard(sGpioLock);
+    if (SimPin* p = pinAt(pin)) {
+        p->mode = mode;
+        if (mode == INPUT_PULLUP) {
+            p->level = HIGH; // Idle level of an unconnected pull-up
+        }
+    }
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+    std::function<void(int)> hook;
+    {
+        std::lock_guard<std::mutex> guard(sGpioLock);
+        SimPin* p = pinAt(pin);
+        if (!p) {
+            return;
+        }
+        p->level = val ? HIGH : LOW;
+        p->writes++;
+        hook = p->onWrite;
+    }
+    if (hook) {
+        hook(val ? HIGH : LOW);
+    }
+}
+
+int digitalRead(uint8_t pin) {
+    std::function<int()> source;
+    int level;
+    {
+        std::lock_guard<std::mutex> guard(sGpioLock);
+        SimPin* p = pinAt(pin);
+        if (!p) {
+            return LOW;
+        }
+        source = p->input;
+        level = p->level;
+    }
+    // Output pins read back what was written, as on the ESP32
+    return source ? (source() ? HIGH : LOW) : level;
+}
+
+int analogRead(uint8_t pin) {
+    std::lock_guard<std::mutex> guard(sGpioLock);
+    SimPin* p = pinAt(pin);
+    return p ? p->analog : 0;
+}
+
+void analogWrite(uint8_t pin, int value) {
+    std::lock_guard<std::mutex> guard(sGpioLock);
+    if (SimPin* p = pinAt(pin)) {
+        p->analog = value;
+        p->writes++;
+    }
+}
+
+unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout) {
+    std::function<unsigned long(uint8_t, unsigned long)> source;
+    {
+        std::lock_guard<std::mutex> guard(sGpioLock);
+        if (SimPin* p = pinAt(pin)) {
+            source = p->pulse;
+        }
+    }
+    if (source) {
+        return source(state, timeout);
+    }
+    delayMicroseconds(timeout);
+    return 0;
+}
+
+void simGpioSetInput(uint8_t pin, std::function<int()> source) {
+    std::lock_guard<std::mutex> guard(sGpioLock);
+    if (SimPin* p = pinAt(pin)) {
+        p->input = std::move(source);
+    }
+}
+
+void simGpioSetLevel(uint8_t pin, int level) {
+    simGpioSetInput(pin, [level]() { return level; });
+}
+
+void simGpioOnWrite(uint8_t pin, std::function<void(int level)> hook) {
+    std::lock_guard<std::mutex> guard(sGpioLock);
+    if (SimPin* p = pinAt(pin)) {
+        p->onWrite = std::move(hook);
+    }
+}
+
+void simGpioSetPulse(uint8_t pin, std::function<unsigned long(uint8_t state, unsigned long timeoutUs)> source) {
+    std::lock_guard<std::mutex> guard(sGpioLock);
+    if (SimPin* p = pinAt(pin)) {
+        p->pulse = std::move(source);
+    }
+}
+
+int simGpioOutput(uint8_t pin) {
+    std::lock_guard<std::mutex> guard(sGpioLock);
+    SimPin* p = pinAt(pin);
+    return p ? p->level : LOW;
+}
+
+uint32_t simGpioWrites(uint8_t pin) {
+    std::lock_guard<std::mutex> guard(sGpioLock);
+    SimPin* p = pinAt(pin);
+    return p ? p->writes : 0;
+}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max) {
+    if (in_max == in_min) {
+        return out_min;
+    }
+    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+static uint32_t sRandom = 0x2545F491;
+
+void randomSeed(unsigned long seed) {
+    if (seed) {
+        sRandom = (uint32_t)seed;
+    }
+}
+
+long random(long howbig) {
+    if (howbig <= 0) {
+        return 0;
+    }
+    sRandom ^= sRandom << 13;
+    sRandom ^= sRandom >> 17;
+    sRandom ^= sRandom << 5;
+    return (long)(sRandom % (uint32_t)howbig);
+}
+
+long random(long howsmall, long howbig) {
+    return howsmall >= howbig ? howsmall : howsmall + random(howbig - howsmall);
+}
+
+// ---- Print / Serial ----
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (size--) {
+        n += write(*buffer++);
+    }
+    return n;
+}
+
+size_t Print::printf(const char* format, ...) {
+    char small[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(small, sizeof(small), format, args);
+    va_end(args);
+    if (len < 0) {
+        return 0;
+    }
+    if ((size_t)len < sizeof(small)) {
+        return write((const uint8_t*)small, len);
+    }
+    char* buf = new char[len + 1];
+    va_start(args, format);
+    vsnprintf(buf, len + 1, format, args);
+    va_end(args);
+    size_t n = write((const uint8_t*)buf, len);
+    delete[] buf;
+    return n;
+}
+
+size_t Print::print(long n, int base) {
+    return print(String(n, (unsigned char)base));
+}
+
+size_t Print::print(unsigned long n, int base) {
+    return print(String(n, (unsigned char)base));
+}
+
+size_t Print::print(long long n, int base) {
+    return print(String(n, (unsigned char)base));
+}
+
+size_t Print::print(unsigned long long n, int base) {
+    return print(String(n, (unsigned char)base));
+}
+
+size_t Print::print(double n, int digits) {
+    return print(String(n, (unsigned int)digits));
+}
+
+HardwareSerial Serial;
+static std::mutex sSerialLock;
+static bool sSerialEcho = true;
+
+// UART timing: arduino-esp32 installs the driver without a TX ring buffer, so
+// write() returns once the last byte is in the 128-byte hardware FIFO, which
+// empties at baud / 10 bytes per second
+static const size_t kUartFifoSize = 128;
+static int64_t sUartByteUs = 0;        // 0 until begin(): no cost
+static int64_t sUartIdleAtUs = 0;      // When the FIFO will have drained
+
+void HardwareSerial::begin(unsigned long baud) {
+    std::lock_guard<std::mutex> guard(sSerialLock);
+    sUartByteUs = baud ? (int64_t)(10000000ULL / baud) : 0;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+    std::lock_guard<std::mutex> guard(sSerialLock);
+    if (sUartByteUs) {
+        int64_t now = esp_timer_get_time();
+        int64_t start = sUartIdleAtUs > now ? sUartIdleAtUs : now;
+        sUartIdleAtUs = start + (int64_t)size * sUartByteUs;
+        // Block until what is left to send fits the FIFO
+        int64_t fifoUs = (int64_t)kUartFifoSize * sUartByteUs;
+        if (sUartIdleAtUs - now > fifoUs) {
+            std::this_thread::sleep_for(std::chrono::microseconds(sUartIdleAtUs - now - fifoUs));
+        }
+    }
+    if (!sSerialEcho) {
+        return size;
+    }
+    return fwrite(buffer, 1, size, stdout);
+}
+
+void HardwareSerial::flush() {
+    std::lock_guard<std::mutex> guard(sSerialLock);
+    fflush(stdout);
+}
+
+void simSerialEcho(bool enabled) {
+    sSerialEcho = enabled;
+}
+
+// ---- Process ----
+
+static int sArgc = 0;
+static char** sArgv = nullptr;
+
+const char* simOption(const char* name) {
+    size_t len = strlen(name);
+    for (int i = 1; i < sArgc; i++) {
+        const char* arg = sArgv[i];
+        if (strncmp(arg, "--", 2) != 0 || strncmp(arg + 2, name, len) != 0) {
+            continue;
+        }
+        if (arg[2 + len] == '\0') {
+            return "";
+        }
+        if (arg[2 + len] == '=') {
+            return arg + 3 + len;
+        }
+    }
+    return nullptr;
+}
+
+// Unit tests (pio test -e native) bring their own main()
+#ifndef PIO_UNIT_TESTING
+int main(int argc, char** argv) {
+    sArgc = argc;
+    sArgv = argv;
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    setup();
+    for (;;) {
+        loop();
+    }
+}
+#endif
+
+// ---- ESP / system ----
+
+EspClass ESP;
+
+void simExit(int status) {
+    fflush(stdout);
+    fflush(stderr);
+    _exit(status);
+}
+
+void EspClass::restart() {
+    esp_restart();
+}
+
+void esp_restart(void) {
+    printf("[native] ESP.restart() requested, exiting with %d\n", SIM_EXIT_RESTART);
+    simExit(SIM_EXIT_RESTART);
+}
+
+esp_reset_reason_t esp_reset_reason(void) {
+    return ESP_RST_POWERON;
+}
+
+uint32_t esp_get_free_heap_size(void) {
+    return ESP.getFreeHeap();
+}
+
+const char* esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_NVS_NOT_INITIALIZED: return "ESP_ERR_NVS_NOT_INITIALIZED";
+        case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+        case ESP_ERR_NVS_TYPE_MISMATCH: return "ESP_ERR_NVS_TYPE_MISMATCH";
+        case ESP_ERR_NVS_READ_ONLY: return "ESP_ERR_NVS_READ_ONLY";
+        case ESP_ERR_NVS_INVALID_HANDLE: return "ESP_ERR_NVS_INVALID_HANDLE";
+        case ESP_ERR_NVS_INVALID_NAME: return "ESP_ERR_NVS_INVALID_NAME";
+        case ESP_ERR_NVS_INVALID_LENGTH: return "ESP_ERR_NVS_INVALID_LENGTH";
+        case ESP_ERR_NVS_NO_FREE_PAGES: return "ESP_ERR_NVS_NO_FREE_PAGES";
+        case ESP_ERR_NVS_NEW_VERSION_FOUND: return "ESP_ERR_NVS_NEW_VERSION_FOUND";
+        default: return "UNKNOWN ERROR";
+    }
+}
+
+// ---- WiFi ----
+
+WiFiClass WiFi;
+
+static void simMac(uint8_t* mac) {
+    static const uint8_t kDefault[6] = {0x24, 0x6F, 0x28, 0x0A, 0xBC, 0xDE};
+    memcpy(mac, kDefault, 6);
+    const char* env = getenv("SIM_MAC");
+    unsigned v[6];
+    if (env && sscanf(env, "%x:%x:%x:%x:%x:%x", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5]) == 6) {
+        for (int i = 0; i < 6; i++) {
+            mac[i] = (uint8_t)v[i];
+        }
+    }
+}
+
+wl_status_t WiFiClass::begin(const char* ssid, const char* passphrase, int32_t channel, const uint8_t* bssid,
+                             bool connect) {
+    (void)ssid, (void)passphrase, (void)channel, (void)bssid, (void)connect;
+    return WL_CONNECTED;
+}
+
+uint8_t* WiFiClass::macAddress(uint8_t* mac) {
+    simMac(mac);
+    return mac;
+}
+
+String WiFiClass::macAddress() {
+    uint8_t mac[6];
+    simMac(mac);
+    char buf[18];
+    snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    return String(buf);
+}
+
+uint64_t EspClass::getEfuseMac() {
+    uint8_t mac[6];
+    simMac(mac);
+    uint64_t v = 0;
+    for (int i = 5; i >= 0; i--) {
+        v = (v << 8) | mac[i];
+    }
+    return v;
+}
+
+// ---- Partitions ----
+
+static const esp_partition_t kPartitions[] = {
+    {ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, 0x10000, 0x180000, "ota_0", false},
+    {ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, 0x190000, 0x180000, "ota_1", false},
+};
+static const esp_partition_t* sBootPartition = &kPartitions[1];
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char* label) {
+    for (const esp_partition_t& p : kPartitions) {
+        if (p.type == type && (subtype == ESP_PARTITION_SUBTYPE_ANY || p.subtype == subtype) &&
+            (!label || strcmp(label, p.label) == 0)) {
+            return &p;
+        }
+    }
+    return nullptr;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size) {
+    if (!partition || offset + size > partition->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    printf("[native] erase %s 0x%zx+0x%zx\n", partition->label, offset, size);
+    return ESP_OK;
+}
+
+const esp_partition_t* esp_ota_get_running_partition(void) {
+    return &kPartitions[1];
+}
+
+const esp_partition_t* esp_ota_get_boot_partition(void) {
+    return sBootPartition;
+}
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from) {
+    if (!start_from) {
+        start_from = esp_ota_get_running_partition();
+    }
+    return start_from == &kPartitions[0] ? &kPartitions[1] : &kPartitions[0];
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition) {
+    if (!partition || partition->type != ESP_PARTITION_TYPE_APP) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sBootPartition = partition;
+    printf("[native] boot partition set to %s\n", partition->label);
+    return ESP_OK;
+}
@@ -0,0 +1,144 @@
+#pragma once
+/**
+ * @file native_hal.h
+ * @brief Control surface of the Linux backend (simulation only)
+ *
+ * The sensor firmwares are written against the Arduino-ESP32 API: clock
+ * (millis, micros, delay), GPIO, Wire, the timer group driver, FreeRTOS and
+ * PubSubClient. That API is the hardware abstraction layer. On the board it
+ * is backed by arduino-esp32 and the usual libraries; in [env:native] the
+ * headers of this library back it on Linux instead:
+ *
+ *  - clock      steady_clock since process start, or since SIM_CLOCK_EPOCH_US
+ *               (CLOCK_MONOTONIC us) so that processes share a time base
+ *  - GPIO       per-pin levels; inputs can be driven by simulated devices
+ *  - I2C        TwoWire routes transactions to SimI2CDevice objects and
+ *               spends the bus time a real transfer would take
+ *  - timer      each timer group runs its ISR from a thread at the alarm rate;
+ *               one-shot esp_timers fire from one shared dispatch thread
+ *  - FreeRTOS   tasks are threads; notifications and queues keep their
+ *               blocking semantics
+ *  - MQTT       PubSubClient talks to an in-process broker; publishes can be
+ *               given a link cost so they block like a TCP write. In network
+ *               mode it speaks MQTT 3.1.1 over TCP to a real broker instead
+ *
+ * main() calls setup() and then loop() forever, as arduino-esp32's loopTask
+ * does. Firmware sources compile unchanged. Only the simulation entry point
+ * (src/sim_main.cpp of each firmware) includes this header, to wire up the
+ * simulated devices (sim_devices.h) and drive the run.
+ *
+ * Usage:
+ * @code
+ * #include "native_hal.h"
+ *
+ * simGpioSetLevel(LIMIT_PIN, HIGH);
+ * simMqttSetLink(400, 250000);                  // 400 us + 250 kB/s per publish
+ * simMqttOnPublish([](const char* topic, const uint8_t*, unsigned int len, bool) { ... });
+ * simMqttInject("sensors/ABCDE/command", "{\"command\":\"start_experiment\"}");
+ * ...
+ * simExit(0);
+ * @endcode
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+
+// ---- Process ----
+
+#define SIM_EXIT_RESTART 3 // Exit status when the firmware calls ESP.restart()
+
+/**
+ * @brief Flush output and end the process without running static destructors
+ *
+ * Firmware tasks never return, so a normal exit would tear down globals
+ * under running threads.
+ */
+[[noreturn]] void simExit(int status);
+
+/**
+ * @brief Value of a --name=value command line option
+ * @return "" for a bare --name, nullptr if the option was not given
+ */
+const char* simOption(const char* name);
+
+/**
+ * @brief Echo Serial output to stdout (default on)
+ */
+void simSerialEcho(bool enabled);
+
+// ---- GPIO ----
+
+/**
+ * @brief Drive an input pin from a function of time; digitalRead() calls it
+ */
+void simGpioSetInput(uint8_t pin, std::function<int()> source);
+
+/**
+ * @brief Hold an input pin at a fixed level
+ */
+void simGpioSetLevel(uint8_t pin, int level);
+
+/**
+ * @brief Called on every digitalWrite() to the pin
+ */
+void simGpioOnWrite(uint8_t pin, std::function<void(int level)> hook);
+
+/**
+ * @brief Answer pulseIn() on the pin
+ *
+ * The source returns the pulse width in microseconds (0 for no pulse) and is
+ * expected to block for as long as the measurement would take on hardware.
+ */
+void simGpioSetPulse(uint8_t pin, std::function<unsigned long(uint8_t state, unsigned long timeoutUs)> source);
+
+/**
+ * @brief Last level written to the pin, and how many writes it has seen
+ */
+int simGpioOutput(uint8_t pin);
+uint32_t simGpioWrites(uint8_t pin);
+
+// ---- MQTT ----
+
+struct SimMqttStats {
+    uint32_t connects = 0;
+    uint32_t published = 0;      // Accepted by the broker
+    uint64_t publishedBytes = 0; // Payload bytes
+    uint32_t rejected = 0;       // Larger than the client buffer, or link down
+    uint32_t delivered = 0;      // Injected messages handed to a callback
+    uint64_t publishUs = 0;      // Time spent inside publish()
+};
+
+/**
+ * @brief Queue a message for the client; delivered by PubSubClient::loop()
+ */
+void simMqttInject(const char* topic, const char* payload);
+
+/**
+ * @brief Observe every accepted publish (called from the publishing task)
+ */
+void simMqttOnPublish(std::function<void(const char* topic, const uint8_t* payload, unsigned int length, bool retained)> hook);
+
+/**
+ * @brief Cost of one publish: fixed latency plus payload at the given rate
+ *
+ * publish() sleeps for that long before returning, like WiFiClient::write()
+ * blocking on the TCP send buffer. 0/0 (default) makes publishes free.
+ */
+void simMqttSetLink(uint32_t fixedUs, uint32_t bytesPerSecond);
+
+/**
+ * @brief Take the broker up or down; connected() follows it
+ */
+void simMqttSetAvailable(bool available);
+
+/**
+ * @brief Connect to the server given to setServer() over TCP (MQTT 3.1.1)
+ *
+ * For running many firmware processes against one broker (tools/fleet_sim).
+ * Injection, link cost and availability apply to the in-process broker only;
+ * the stats count publishes either way.
+ */
+void simMqttUseNetwork(bool enabled);
+
+SimMqttStats simMqttStats();
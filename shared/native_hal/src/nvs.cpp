@@ -0,0 +1,248 @@
+#include "nvs.h"
+#include "nvs_flash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define NVS_KEY_NAME_MAX_SIZE 16
+
+namespace {
+enum NvsType : uint8_t { NVS_U8, NVS_I8, NVS_U16, NVS_I16, NVS_U32, NVS_I32, NVS_U64, NVS_I64, NVS_STR, NVS_BLOB };
+
+struct NvsEntry {
+    NvsType type;
+    std::vector<uint8_t> data;
+};
+
+typedef std::map<std::string, NvsEntry> NvsNamespace;
+
+struct NvsHandle {
+    std::string ns;
+    bool writable;
+    bool open;
+};
+
+std::mutex sLock;
+bool sLoaded = false;
+std::map<std::string, NvsNamespace> sStore;
+std::vector<NvsHandle> sHandles;
+
+// File format, one entry per line: <namespace> <key> <type> <hex bytes>
+void load() {
+    if (sLoaded) {
+        return;
+    }
+    sLoaded = true;
+    const char* path = getenv("SIM_NVS_FILE");
+    FILE* f = path ? fopen(path, "r") : nullptr;
+    if (!f) {
+        return;
+    }
+    char ns[NVS_KEY_NAME_MAX_SIZE + 1];
+    char key[NVS_KEY_NAME_MAX_SIZE + 1];
+    unsigned type;
+    static char hex[2 * 4096 + 2];
+    while (fscanf(f, "%16s %16s %u %8193s", ns, key, &type, hex) == 4) {
+        NvsEntry entry;
+        entry.type = (NvsType)type;
+        for (size_t i = 0; hex[i] && hex[i + 1] && hex[0] != '-'; i += 2) {
+            unsigned byte;
+            sscanf(hex + i, "%2x", &byte);
+            entry.data.push_back((uint8_t)byte);
+        }
+        sStore[ns][key] = entry;
+    }
+    fclose(f);
+}
+
+void save() {
+    const char* path = getenv("SIM_NVS_FILE");
+    FILE* f = path ? fopen(path, "w") : nullptr;
+    if (!f) {
+        return;
+    }
+    for (const auto& ns : sStore) {
+        for (const auto& kv : ns.second) {
+            fprintf(f, "%s %s %u ", ns.first.c_str(), kv.first.c_str(), (unsigned)kv.second.type);
+            if (kv.second.data.empty()) {
+                fputc('-', f);
+            }
+            for (uint8_t b : kv.second.data) {
+                fprintf(f, "%02x", b);
+            }
+            fputc('\n', f);
+        }
+    }
+    fclose(f);
+}
+
+NvsHandle* handleAt(nvs_handle_t handle) {
+    return (handle > 0 && handle <= sHandles.size() && sHandles[handle - 1].open) ? &sHandles[handle - 1] : nullptr;
+}
+
+esp_err_t setValue(nvs_handle_t handle, const char* key, NvsType type, const void* value, size_t length) {
+    std::lock_guard<std::mutex> guard(sLock);
+    NvsHandle* h = handleAt(handle);
+    if (!h) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (!h->writable) {
+        return ESP_ERR_NVS_READ_ONLY;
+    }
+    if (!key || strlen(key) >= NVS_KEY_NAME_MAX_SIZE) {
+        return ESP_ERR_NVS_INVALID_NAME;
+    }
+    NvsEntry& entry = sStore[h->ns][key];
+    entry.type = type;
+    entry.data.assign((const uint8_t*)value, (const uint8_t*)value + length);
+    return ESP_OK;
+}
+
+esp_err_t getValue(nvs_handle_t handle, const char* key, NvsType type, void* out, size_t* length) {
+    std::lock_guard<std::mutex> guard(sLock);
+    NvsHandle* h = handleAt(handle);
+    if (!h) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    auto ns = sStore.find(h->ns);
+    if (ns == sStore.end()) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    auto it = ns->second.find(key);
+    if (it == ns->second.end()) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (it->second.type != type) {
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+    size_t size = it->second.data.size();
+    if (!out) {
+        *length = size;
+        return ESP_OK;
+    }
+    if (*length < size) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out, it->second.data.data(), size);
+    *length = size;
+    return ESP_OK;
+}
+
+template <typename T>
+esp_err_t getScalar(nvs_handle_t handle, const char* key, NvsType type, T* out) {
+    size_t length = sizeof(T);
+    return getValue(handle, key, type, out, &length);
+}
+} // namespace
+
+esp_err_t nvs_flash_init(void) {
+    std::lock_guard<std::mutex> guard(sLock);
+    load();
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    std::lock_guard<std::mutex> guard(sLock);
+    sLoaded = true;
+    sStore.clear();
+    save();
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_deinit(void) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char* name, nvs_open_mode_t open_mode, nvs_handle_t* out_handle) {
+    std::lock_guard<std::mutex> guard(sLock);
+    // arduino-esp32 initializes NVS before setup()
+    load();
+    if (!name || strlen(name) >= NVS_KEY_NAME_MAX_SIZE) {
+        return ESP_ERR_NVS_INVALID_NAME;
+    }
+    if (open_mode == NVS_READONLY && sStore.find(name) == sStore.end()) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    sHandles.push_back({name, open_mode == NVS_READWRITE, true});
+    *out_handle = (nvs_handle_t)sHandles.size();
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    std::lock_guard<std::mutex> guard(sLock);
+    if (NvsHandle* h = handleAt(handle)) {
+        h->open = false;
+    }
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    std::lock_guard<std::mutex> guard(sLock);
+    if (!handleAt(handle)) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    save();
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key) {
+    std::lock_guard<std::mutex> guard(sLock);
+    NvsHandle* h = handleAt(handle);
+    if (!h) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (!h->writable) {
+        return ESP_ERR_NVS_READ_ONLY;
+    }
+    return sStore[h->ns].erase(key) ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle) {
+    std::lock_guard<std::mutex> guard(sLock);
+    NvsHandle* h = handleAt(handle);
+    if (!h) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (!h->writable) {
+        return ESP_ERR_NVS_READ_ONLY;
+    }
+    sStore[h->ns].clear();
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_i8(nvs_handle_t h, const char* key, int8_t v) { return setValue(h, key, NVS_I8, &v, sizeof(v)); }
+esp_err_t nvs_set_u8(nvs_handle_t h, const char* key, uint8_t v) { return setValue(h, key, NVS_U8, &v, sizeof(v)); }
+esp_err_t nvs_set_i16(nvs_handle_t h, const char* key, int16_t v) { return setValue(h, key, NVS_I16, &v, sizeof(v)); }
+esp_err_t nvs_set_u16(nvs_handle_t h, const char* key, uint16_t v) { return setValue(h, key, NVS_U16, &v, sizeof(v)); }
+esp_err_t nvs_set_i32(nvs_handle_t h, const char* key, int32_t v) { return setValue(h, key, NVS_I32, &v, sizeof(v)); }
+esp_err_t nvs_set_u32(nvs_handle_t h, const char* key, uint32_t v) { return setValue(h, key, NVS_U32, &v, sizeof(v)); }
+esp_err_t nvs_set_i64(nvs_handle_t h, const char* key, int64_t v) { return setValue(h, key, NVS_I64, &v, sizeof(v)); }
+esp_err_t nvs_set_u64(nvs_handle_t h, const char* key, uint64_t v) { return setValue(h, key, NVS_U64, &v, sizeof(v)); }
+
+esp_err_t nvs_set_str(nvs_handle_t h, const char* key, const char* value) {
+    return setValue(h, key, NVS_STR, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t h, const char* key, const void* value, size_t length) {
+    return setValue(h, key, NVS_BLOB, value, length);
+}
+
+esp_err_t nvs_get_i8(nvs_handle_t h, const char* key, int8_t* out) { return getScalar(h, key, NVS_I8, out); }
+esp_err_t nvs_get_u8(nvs_handle_t h, const char* key, uint8_t* out) { return getScalar(h, key, NVS_U8, out); }
+esp_err_t nvs_get_i16(nvs_handle_t h, const char* key, int16_t* out) { return getScalar(h, key, NVS_I16, out); }
+esp_err_t nvs_get_u16(nvs_handle_t h, const char* key, uint16_t* out) { return getScalar(h, key, NVS_U16, out); }
+esp_err_t nvs_get_i32(nvs_handle_t h, const char* key, int32_t* out) { return getScalar(h, key, NVS_I32, out); }
+esp_err_t nvs_get_u32(nvs_handle_t h, const char* key, uint32_t* out) { return getScalar(h, key, NVS_U32, out); }
+esp_err_t nvs_get_i64(nvs_handle_t h, const char* key, int64_t* out) { return getScalar(h, key, NVS_I64, out); }
+esp_err_t nvs_get_u64(nvs_handle_t h, const char* key, uint64_t* out) { return getScalar(h, key, NVS_U64, out); }
+
+esp_err_t nvs_get_str(nvs_handle_t h, const char* key, char* out_value, size_t* length) {
+    return getValue(h, key, NVS_STR, out_value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t h, const char* key, void* out_value, size_t* length) {
+    return getValue(h, key, NVS_BLOB, out_value, length);
+}
@@ -0,0 +1,48 @@
+#pragma once
+/**
+ * @file nvs.h
+ * @brief ESP-IDF non-volatile storage (Linux backend)
+ *
+ * Namespaces live in memory. With SIM_NVS_FILE set in the environment they
+ * are loaded from that file at first use and written back on every
+ * nvs_commit(), so a simulated restart (a new process) finds its settings.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef uint32_t nvs_handle_t;
+typedef nvs_handle_t nvs_handle;
+
+typedef enum { NVS_READONLY, NVS_READWRITE } nvs_open_mode_t;
+typedef nvs_open_mode_t nvs_open_mode;
+
+esp_err_t nvs_open(const char* name, nvs_open_mode_t open_mode, nvs_handle_t* out_handle);
+void nvs_close(nvs_handle_t handle);
+esp_err_t nvs_commit(nvs_handle_t handle);
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key);
+esp_err_t nvs_erase_all(nvs_handle_t handle);
+
+esp_err_t nvs_set_i8(nvs_handle_t handle, const char* key, int8_t value);
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char* key, uint8_t value);
+esp_err_t nvs_set_i16(nvs_handle_t handle, const char* key, int16_t value);
+esp_err_t nvs_set_u16(nvs_handle_t handle, const char* key, uint16_t value);
+esp_err_t nvs_set_i32(nvs_handle_t handle, const char* key, int32_t value);
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char* key, uint32_t value);
+esp_err_t nvs_set_i64(nvs_handle_t handle, const char* key, int64_t value);
+esp_err_t nvs_set_u64(nvs_handle_t handle, const char* key, uint64_t value);
+esp_err_t nvs_set_str(nvs_handle_t handle, const char* key, const char* value);
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value, size_t length);
+
+esp_err_t nvs_get_i8(nvs_handle_t handle, const char* key, int8_t* out_value);
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char* key, uint8_t* out_value);
+esp_err_t nvs_get_i16(nvs_handle_t handle, const char* key, int16_t* out_value);
+esp_err_t nvs_get_u16(nvs_handle_t handle, const char* key, uint16_t* out_value);
+esp_err_t nvs_get_i32(nvs_handle_t handle, const char* key, int32_t* out_value);
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char* key, uint32_t* out_value);
+esp_err_t nvs_get_i64(nvs_handle_t handle, const char* key, int64_t* out_value);
+esp_err_t nvs_get_u64(nvs_handle_t handle, const char* key, uint64_t* out_value);
+/** @brief out_value nullptr: *length receives the size including the terminator */
+esp_err_t nvs_get_str(nvs_handle_t handle, const char* key, char* out_value, size_t* length);
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out_value, size_t* length);
@@ -0,0 +1,12 @@
+#pragma once
+/**
+ * @file nvs_flash.h
+ * @brief NVS partition init/erase (Linux backend, see nvs.h)
+ */
+
+#include "esp_err.h"
+#include "nvs.h"
+
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_erase(void);
+esp_err_t nvs_flash_deinit(void);
@@ -0,0 +1,288 @@
+#include "sim_devices.h"
+#include "Arduino.h"
+#include "native_hal.h"
+#include <math.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+static void sleepUs(int64_t us) {
+    if (us > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(us));
+    }
+}
+
+// ---- SimSignal ----
+
+float SimSignal::at(int64_t us) const {
+    thread_local uint32_t state = 0x9E3779B9u;
+    float value = offset;
+    if (periodMs > 0) {
+        value += amplitude * sinf(2.0f * (float)PI * ((float)us / 1000.0f) / periodMs);
+    }
+    if (noise > 0) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        value += noise * ((float)(state & 0xFFFF) / 65535.0f - 0.5f);
+    }
+    return value;
+}
+
+// ---- SimEeprom24C02 ----
+
+SimEeprom24C02::SimEeprom24C02(const char* code) {
+    memset(_mem, 0xFF, sizeof(_mem));
+    if (code) {
+        memcpy(_mem, code, strnlen(code, sizeof(_mem)));
+    }
+}
+
+bool SimEeprom24C02::write(const uint8_t* data, size_t len) {
+    std::lock_guard<std::mutex> guard(_lock);
+    if (len == 0) {
+        return true;
+    }
+    // First byte sets the word address, the rest is a page write
+    _pointer = data[0];
+    for (size_t i = 1; i < len; i++) {
+        _mem[_pointer++] = data[i];
+    }
+    return true;
+}
+
+size_t SimEeprom24C02::read(uint8_t* data, size_t len) {
+    std::lock_guard<std::mutex> guard(_lock);
+    for (size_t i = 0; i < len; i++) {
+        data[i] = _mem[_pointer++];
+    }
+    return len;
+}
+
+// ---- SimVL53L1X ----
+
+void SimVL53L1X::attach(TwoWire& bus, uint8_t address) {
+    _attachedUs = esp_timer_get_time();
+    bus.simAttach(address, this);
+}
+
+bool SimVL53L1X::write(const uint8_t* data, size_t len) {
+    std::lock_guard<std::mutex> guard(_lock);
+    if (len >= 2) {
+        _register = (uint16_t)((data[0] << 8) | data[1]);
+    }
+    return true;
+}
+
+size_t SimVL53L1X::read(uint8_t* data, size_t len) {
+    std::lock_guard<std::mutex> guard(_lock);
+    memset(data, 0, len);
+    if (_register == 0x010F && len >= 2) {
+        // Model ID
+        data[0] = 0xEA;
+        data[1] = 0xCC;
+    } else if (_register == 0x0031 && len >= 1) {
+        // GPIO__TIO_HV_STATUS, active low
+        data[0] = latest(esp_timer_get_time()) > _consumed ? 0x00 : 0x01;
+    }
+    return len;
+}
+
+void SimVL53L1X::start(uint32_t periodMs, uint32_t budgetUs, uint16_t maxRangeMm) {
+    std::lock_guard<std::mutex> guard(_lock);
+    _running = true;
+    _startUs = esp_timer_get_time();
+    _budgetUs = budgetUs;
+    _periodUs = std::max<int64_t>((int64_t)periodMs * 1000, budgetUs);
+    _maxRangeMm = maxRangeMm;
+    _consumed = -1;
+}
+
+void SimVL53L1X::stop() {
+    std::lock_guard<std::mutex> guard(_lock);
+    _running = false;
+}
+
+int64_t SimVL53L1X::latest(int64_t now) const {
+    // Result k completes at start + budget + k * period
+    if (!_running || _periodUs <= 0 || now < _startUs + _budgetUs) {
+        return -1;
+    }
+    return (now - _startUs - _budgetUs) / _periodUs;
+}
+
+bool SimVL53L1X::ready() {
+    std::lock_guard<std::mutex> guard(_lock);
+    return latest(esp_timer_get_time()) > _consumed;
+}
+
+bool SimVL53L1X::take(uint16_t& mm) {
+    std::lock_guard<std::mutex> guard(_lock);
+    int64_t index = latest(esp_timer_get_time());
+    if (index < 0) {
+        return false;
+    }
+    _consumed = index;
+    _results++;
+    int64_t measuredAt = _startUs + _budgetUs + index * _periodUs;
+    float distance = _signal.at(measuredAt - _attachedUs);
+    if (distance <= 0 || distance > _maxRangeMm) {
+        return false;
+    }
+    mm = (uint16_t)lroundf(distance);
+    return true;
+}
+
+// ---- SimHCSR04 ----
+
+#define HCSR04_MAX_RANGE_MM 4000
+#define HCSR04_ECHO_DELAY_US 450
+
+void SimHCSR04::attach() {
+    _attachedUs = esp_timer_get_time();
+    simGpioOnWrite(_trig, [this](int level) {
+        if (level == HIGH) {
+            _triggered = true;
+        }
+    });
+    simGpioSetPulse(_echo, [this](uint8_t state, unsigned long timeoutUs) {
+        return state == HIGH ? echo(timeoutUs) : 0UL;
+    });
+}
+
+unsigned long SimHCSR04::echo(unsigned long timeoutUs) {
+    if (!_triggered.exchange(false)) {
+        sleepUs(timeoutUs);
+        return 0;
+    }
+    _pings++;
+    float distance = _signal.at(esp_timer_get_time() - _attachedUs);
+    if (distance <= 0 || distance > HCSR04_MAX_RANGE_MM) {
+        // No echo: pulseIn() waits out its timeout
+        sleepUs(timeoutUs);
+        return 0;
+    }
+    unsigned long width = (unsigned long)lroundf(2.0f * distance / 0.343f);
+    if (HCSR04_ECHO_DELAY_US + width > timeoutUs) {
+        sleepUs(timeoutUs);
+        return 0;
+    }
+    sleepUs(HCSR04_ECHO_DELAY_US + width);
+    return width;
+}
+
+// ---- SimDS18B20 ----
+
+static std::mutex sOneWireLock;
+static std::vector<SimDS18B20*> sOneWireDevices;
+
+static uint8_t crc8(const uint8_t* data, size_t len) {
+    uint8_t crc = 0;
+    while (len--) {
+        uint8_t in = *data++;
+        for (int i = 0; i < 8; i++) {
+            uint8_t mix = (crc ^ in) & 0x01;
+            crc >>= 1;
+            if (mix) {
+                crc ^= 0x8C;
+            }
+            in >>= 1;
+        }
+    }
+    return crc;
+}
+
+SimDS18B20::SimDS18B20(uint8_t pin, SimSignal tempC, uint8_t serial) : _pin(pin), _signal(tempC) {
+    const uint8_t rom[7] = {0x28, serial, 0x00, 0x00, 0x5A, 0x1D, 0x00};
+    memcpy(_rom, rom, sizeof(rom));
+    _rom[7] = crc8(_rom, 7);
+}
+
+void SimDS18B20::attach() {
+    _attachedUs = esp_timer_get_time();
+    std::lock_guard<std::mutex> guard(sOneWireLock);
+    sOneWireDevices.push_back(this);
+}
+
+size_t simOneWireDevices(uint8_t pin, SimDS18B20** out, size_t max) {
+    std::lock_guard<std::mutex> guard(sOneWireLock);
+    size_t n = 0;
+    for (SimDS18B20* dev : sOneWireDevices) {
+        if (dev->pin() == pin && n < max) {
+            out[n++] = dev;
+        }
+    }
+    return n;
+}
+
+void SimDS18B20::setResolution(uint8_t bits) {
+    std::lock_guard<std::mutex> guard(_lock);
+    _resolution = constrain(bits, 9, 12);
+}
+
+uint16_t SimDS18B20::conversionMs(uint8_t bits) {
+    switch (bits) {
+    case 9:
+        return 94;
+    case 10:
+        return 188;
+    case 11:
+        return 375;
+    default:
+        return 750;
+    }
+}
+
+void SimDS18B20::startConversion(unsigned long nowMs) {
+    std::lock_guard<std::mutex> guard(_lock);
+    _converting = true;
+    _conversionStart = nowMs;
+    _conversionBits = _resolution;
+}
+
+void SimDS18B20::finish(unsigned long nowMs) {
+    if (_converting && nowMs - _conversionStart >= conversionMs(_conversionBits)) {
+        // The low bits of the register are undefined below 12 bits; the driver sees them as 0
+        float step = 0.0625f * (float)(1 << (12 - _conversionBits));
+        float value = _signal.at(esp_timer_get_time() - _attachedUs);
+        _value = floorf(value / step) * step;
+        _converting = false;
+    }
+}
+
+bool SimDS18B20::converted(unsigned long nowMs) {
+    std::lock_guard<std::mutex> guard(_lock);
+    finish(nowMs);
+    return !_converting;
+}
+
+float SimDS18B20::scratchpad(unsigned long nowMs) {
+    std::lock_guard<std::mutex> guard(_lock);
+    finish(nowMs);
+    return _value;
+}
+
+// ---- SimLDR ----
+
+void SimLDR::attach() {
+    simGpioSetInput(_pin, [this]() { return level(); });
+}
+
+void SimLDR::release() {
+    _releasedUs = esp_timer_get_time();
+    _swinging = true;
+}
+
+int SimLDR::level() const {
+    if (!_swinging) {
+        return LOW;
+    }
+    // Crossings at T/4 + k * T/2, the beam cut for cutMs around each
+    float t = (float)(esp_timer_get_time() - _releasedUs) / 1000.0f;
+    float sinceFirst = t - _periodMs / 4.0f + _cutMs / 2.0f;
+    if (sinceFirst < 0) {
+        return LOW;
+    }
+    return fmodf(sinceFirst, _periodMs / 2.0f) < _cutMs ? HIGH : LOW;
+}
@@ -0,0 +1,186 @@
+#pragma once
+/**
+ * @file sim_devices.h
+ * @brief Simulated sensor hardware for the native build
+ *
+ * Each device reproduces the timing the firmware sees on the real part:
+ *  - SimEeprom24C02  sensor ID EEPROM, 256 bytes on I2C, can be unplugged
+ *  - SimVL53L1X      continuous ranging; a result every max(period, budget)
+ *  - SimHCSR04       echo width 2 * d / 0.343 us after a 10 us trigger;
+ *                    no echo past 4 m, so pulseIn() runs into its timeout
+ *  - SimDS18B20      1-Wire thermometer, conversion time per resolution
+ *  - SimLDR          light gate under a pendulum: HIGH while the bob cuts
+ *                    the beam, twice per swing period
+ *
+ * Measured quantities follow a SimSignal (offset + sine + uniform noise)
+ * over time since the device was attached.
+ *
+ * Usage:
+ * @code
+ * #include "sim_devices.h"
+ *
+ * static SimEeprom24C02 eeprom("TOF");
+ * static SimVL53L1X tof(SimSignal{300, 120, 2000, 4});   // 300 +- 120 mm, 2 s period
+ * eeprom.attach(Wire);
+ * tof.attach(Wire1);
+ * @endcode
+ */
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include "Wire.h"
+
+/**
+ * @brief offset + amplitude * sin(2 pi t / period) + uniform noise in +-noise/2
+ */
+struct SimSignal {
+    float offset = 0;
+    float amplitude = 0;
+    float periodMs = 0; // 0 keeps the value at offset
+    float noise = 0;    // Peak to peak
+
+    float at(int64_t us) const;
+};
+
+class SimEeprom24C02 : public SimI2CDevice {
+public:
+    /**
+     * @param code type code stored at address 0 (e.g. "TOF"); nullptr leaves it blank (0xFF)
+     */
+    explicit SimEeprom24C02(const char* code);
+
+    void attach(TwoWire& bus, uint8_t address = 0x50) { bus.simAttach(address, this); }
+    void setPresent(bool present) { _present = present; }
+
+    bool present() const override { return _present; }
+    bool write(const uint8_t* data, size_t len) override;
+    size_t read(uint8_t* data, size_t len) override;
+
+private:
+    std::atomic<bool> _present{true};
+    std::mutex _lock;
+    uint8_t _mem[256];
+    uint8_t _pointer = 0;
+};
+
+class SimVL53L1X : public SimI2CDevice {
+public:
+    explicit SimVL53L1X(SimSignal distanceMm) : _signal(distanceMm) {}
+
+    void attach(TwoWire& bus, uint8_t address = 0x29);
+    void setPresent(bool present) { _present = present; }
+
+    bool present() const override { return _present; }
+    bool write(const uint8_t* data, size_t len) override;
+    size_t read(uint8_t* data, size_t len) override;
+
+    // Driver side (VL53L1X.h)
+    void start(uint32_t periodMs, uint32_t budgetUs, uint16_t maxRangeMm);
+    void stop();
+    bool ready();
+    /** @brief Consume the latest result; false if the target was out of range */
+    bool take(uint16_t& mm);
+    uint32_t results() const { return _results; }
+
+private:
+    int64_t latest(int64_t now) const;
+
+    SimSignal _signal;
+    std::atomic<bool> _present{true};
+    std::mutex _lock;
+    uint16_t _register = 0;
+    int64_t _attachedUs = 0;
+    bool _running = false;
+    int64_t _startUs = 0;
+    int64_t _periodUs = 0;
+    int64_t _budgetUs = 0;
+    uint16_t _maxRangeMm = 0;
+    int64_t _consumed = -1; // Index of the last result read
+    std::atomic<uint32_t> _results{0};
+};
+
+class SimHCSR04 {
+public:
+    SimHCSR04(uint8_t trigPin, uint8_t echoPin, SimSignal distanceMm)
+        : _trig(trigPin), _echo(echoPin), _signal(distanceMm) {}
+
+    void attach();
+    uint32_t pings() const { return _pings; }
+
+private:
+    unsigned long echo(unsigned long timeoutUs);
+
+    uint8_t _trig;
+    uint8_t _echo;
+    SimSignal _signal;
+    int64_t _attachedUs = 0;
+    std::atomic<bool> _triggered{false};
+    std::atomic<uint32_t> _pings{0};
+};
+
+class SimDS18B20 {
+public:
+    /**
+     * @param serial distinguishes the ROM codes of several sensors on one bus
+     */
+    SimDS18B20(uint8_t pin, SimSignal tempC, uint8_t serial = 1);
+
+    void attach();
+    void setConnected(bool connected) { _connected = connected; }
+
+    // Driver side (DallasTemperature.h)
+    uint8_t pin() const { return _pin; }
+    const uint8_t* rom() const { return _rom; }
+    bool connected() const { return _connected; }
+    uint8_t resolution() const { return _resolution; }
+    void setResolution(uint8_t bits);
+    static uint16_t conversionMs(uint8_t bits);
+    void startConversion(unsigned long nowMs);
+    bool converted(unsigned long nowMs);
+    /** @brief Scratchpad temperature: the last finished conversion, quantized to the resolution */
+    float scratchpad(unsigned long nowMs);
+
+private:
+    void finish(unsigned long nowMs);
+
+    uint8_t _pin;
+    SimSignal _signal;
+    uint8_t _rom[8];
+    std::atomic<bool> _connected{true};
+    std::mutex _lock;
+    uint8_t _resolution = 12;
+    int64_t _attachedUs = 0;
+    bool _converting = false;
+    unsigned long _conversionStart = 0;
+    uint8_t _conversionBits = 12;
+    float _value = 85.0f; // Power-on reset value
+};
+
+/**
+ * @brief All DS18B20s attached to a pin, in attach order
+ */
+size_t simOneWireDevices(uint8_t pin, SimDS18B20** out, size_t max);
+
+class SimLDR {
+public:
+    /**
+     * @param periodMs swing period; the bob crosses the beam every periodMs / 2
+     * @param cutMs    time the beam stays cut per crossing
+     */
+    SimLDR(uint8_t pin, float periodMs, float cutMs) : _pin(pin), _periodMs(periodMs), _cutMs(cutMs) {}
+
+    void attach();
+    /** @brief Release the pendulum now; the first crossing follows a quarter period later */
+    void release();
+    void stop() { _swinging = false; }
+
+private:
+    int level() const;
+
+    uint8_t _pin;
+    float _periodMs;
+    float _cutMs;
+    std::atomic<bool> _swinging{false};
+    std::atomic<int64_t> _releasedUs{0};
+};
@@ -18,10 +18,30 @@
  *   // No credentials found - boot back to OTA
  * }
  * @endcode
+ *
+ * Fast reconnect: after every connect the BSSID and channel are cached in
+ * the same namespace (key WIFI_LINK_NVS_KEY). The next boot, usually the hop
+ * between ota_0 and ota_1, associates directly with that access point on
+ * that channel, skipping the scan. The address still comes from DHCP: a
+ * cached lease reused as a static IP could have expired across a reset or
+ * a long run and been handed to another host. If the directed connect does
+ * not complete within WIFI_FAST_CONNECT_TIMEOUT_MS the caller falls back to
+ * a full connect, which refreshes the cache. Sensor firmwares get both steps
+ * from connectSensorWiFi() in sensor_runtime.h.
+ * @code
+ * if (!connectWiFiFast(ssid, password)) {
+ *   WiFi.begin(ssid, password); // full connect: scan and DHCP, then wait for it
+ *   saveWiFiLinkToNVS();
+ * }
+ * @endcode
  */
 
 #include <nvs_flash.h>
 #include <nvs.h>
+#include <WiFi.h>
+
+#define WIFI_FAST_CONNECT_TIMEOUT_MS 3000
+#define WIFI_LINK_NVS_KEY "link"
 
 /**
  * @brief Load WiFi credentials from NVS storage
@@ -36,7 +56,7 @@
  * @return true if credentials were successfully loaded
  * @return false if credentials not found or invalid
  */
-bool loadWiFiCredentialsFromNVS(char* ssidBuf, size_t ssidSize, char* passBuf, size_t passSize) {
+inline bool loadWiFiCredentialsFromNVS(char* ssidBuf, size_t ssidSize, char* passBuf, size_t passSize) {
   // Initialize NVS if not already done
   esp_err_t err = nvs_flash_init();
   if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -81,3 +101,91 @@ bool loadWiFiCredentialsFromNVS(char* ssidBuf, size_t ssidSize, char* passBuf, s
   
   return true;
 }
+
+/**
+ * @brief Last association, cached for a fast reconnect
+ */
+struct WiFiLinkCache {
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint8_t reserved;
+};
+
+/**
+ * @brief Load the cached link from NVS
+ * @return false if none is stored
+ */
+inline bool loadWiFiLinkFromNVS(WiFiLinkCache& link) {
+  nvs_handle_t handle;
+  if (nvs_open("wifi", NVS_READONLY, &handle) != ESP_OK) {
+    return false;
+  }
+  size_t len = sizeof(link);
+  esp_err_t err = nvs_get_blob(handle, WIFI_LINK_NVS_KEY, &link, &len);
+  nvs_close(handle);
+  // A blob of another size is an older layout (it also held the lease): ignore it
+  return err == ESP_OK && len == sizeof(link) && link.channel != 0;
+}
+
+/**
+ * @brief Cache the current connection's BSSID and channel
+ *
+ * Call after a full connect. The NVS write is skipped when nothing
+ * changed, so repeated boots on the same network do not wear the flash.
+ */
+inline bool saveWiFiLinkToNVS() {
+  if (WiFi.status() != WL_CONNECTED || !WiFi.BSSID()) {
+    return false;
+  }
+
+  WiFiLinkCache link;
+  memset(&link, 0, sizeof(link));
+  memcpy(link.bssid, WiFi.BSSID(), sizeof(link.bssid));
+  link.channel = (uint8_t)WiFi.channel();
+
+  WiFiLinkCache stored;
+  if (loadWiFiLinkFromNVS(stored) && memcmp(&stored, &link, sizeof(link)) == 0) {
+    return true;
+  }
+
+  nvs_handle_t handle;
+  if (nvs_open("wifi", NVS_READWRITE, &handle) != ESP_OK) {
+    return false;
+  }
+  esp_err_t err = nvs_set_blob(handle, WIFI_LINK_NVS_KEY, &link, sizeof(link));
+  if (err == ESP_OK) {
+    err = nvs_commit(handle);
+  }
+  nvs_close(handle);
+  return err == ESP_OK;
+}
+
+/**
+ * @brief Directed connect with the cached BSSID and channel, address from DHCP
+ *
+ * @return true when connected; false leaves WiFi disconnected
+ */
+inline bool connectWiFiFast(const char* ssid, const char* password,
+                            uint32_t timeoutMs = WIFI_FAST_CONNECT_TIMEOUT_MS) {
+  WiFiLinkCache link;
+  if (!loadWiFiLinkFromNVS(link)) {
+    return false;
+  }
+
+  unsigned long start = millis();
+  WiFi.begin(ssid, password, link.channel, link.bssid);
+  while (WiFi.status() != WL_CONNECTED && millis() - start < timeoutMs) {
+    delay(20);
+  }
+
+  if (WiFi.status() == WL_CONNECTED) {
+    Serial.printf("⚡ Fast reconnect (ch %u, IP %s) in %lu ms\n", link.channel,
+                  WiFi.localIP().toString().c_str(), millis() - start);
+    return true;
+  }
+
+  // Access point moved or changed channel: the caller scans again
+  Serial.println("Fast reconnect failed, falling back to a full connect");
+  WiFi.disconnect();
+  return false;
+}
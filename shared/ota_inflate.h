@@ -0,0 +1,308 @@
+#pragma once
+/**
+ * @file ota_inflate.h
+ * @brief Streaming gzip decoder for OTA firmware images
+ *
+ * Experiment firmwares compress to well under their raw size, so pushing
+ * `firmware.bin.gz` instead of `firmware.bin` cuts the bytes sent over WiFi
+ * for every re-flash. The decoder sits between the upload handler and the
+ * flash writer: it takes the received bytes in whatever pieces they arrive
+ * and hands decompressed data to a sink callback.
+ *
+ * The format is detected from the first byte: 0x1F starts a gzip stream, any
+ * other byte (an ESP32 image starts with 0xE9) is passed through untouched, so
+ * raw uploads keep working on the same endpoint.
+ *
+ * Inflation uses the tinfl decoder in the ESP32 ROM with a 32 KB circular
+ * window (the deflate maximum), so memory use does not depend on the image
+ * size: about 43 KB of heap, allocated on the first gzip byte and freed by
+ * finish() / release(). The gzip trailer (CRC-32 and length of the
+ * decompressed data) is checked before finish() reports success.
+ *
+ * Usage in an upload handler:
+ * @code
+ * #include "ota_inflate.h"
+ *
+ * static OtaInflater inflater;
+ * static bool writeImage(const uint8_t* data, size_t len, void*) {
+ *     return Update.write((uint8_t*)data, len) == len;
+ * }
+ *
+ * inflater.begin(writeImage, nullptr);      // first chunk
+ * inflater.write(data, len);                // every chunk
+ * if (inflater.finish()) Update.end(true);  // last chunk
+ * @endcode
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "esp32/rom/crc.h"
+#include "esp32/rom/miniz.h"
+
+#define OTA_GZIP_ID1 0x1F
+#define OTA_GZIP_ID2 0x8B
+#define OTA_GZIP_DEFLATE 8
+
+class OtaInflater {
+public:
+    /**
+     * @brief Receives decompressed image bytes; return false to abort the stream
+     */
+    typedef bool (*Sink)(const uint8_t* data, size_t len, void* ctx);
+
+    ~OtaInflater() { release(); }
+
+    /**
+     * @brief Start a new image; frees any state left from the previous one
+     */
+    void begin(Sink sink, void* ctx) {
+        release();
+        _sink = sink;
+        _ctx = ctx;
+        _state = DETECT;
+        _compressed = false;
+        _error = nullptr;
+        _in = 0;
+        _out = 0;
+        _crc = 0;
+    }
+
+    /**
+     * @brief Feed received bytes, in order
+     * @return false on a format error or when the sink fails; see error()
+     */
+    bool write(const uint8_t* data, size_t len) {
+        if (_error) {
+            return false;
+        }
+        _in += len;
+
+        while (len > 0) {
+            switch (_state) {
+            case DETECT:
+                _compressed = data[0] == OTA_GZIP_ID1;
+                if (!_compressed) {
+                    _state = RAW;
+                } else if (!allocate()) {
+                    return fail("no_memory");
+                } else {
+                    _state = HEADER;
+                    _pos = 0;
+                }
+                break;
+
+            case RAW:
+                return emit(data, len);
+
+            case BODY: {
+                size_t used = 0;
+                if (!inflate(data, len, used)) {
+                    return false;
+                }
+                data += used;
+                len -= used;
+                break;
+            }
+
+            case DONE:
+                return fail("trailing_data");
+
+            default:
+                // Gzip header and trailer fields, a few bytes each
+                if (!field(*data)) {
+                    return false;
+                }
+                data++;
+                len--;
+                break;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Call after the last byte; true if a complete, intact image was written
+     */
+    bool finish() {
+        if (!_error && _state != RAW && _state != DONE) {
+            fail("truncated");
+        }
+        release();
+        return _error == nullptr;
+    }
+
+    /**
+     * @brief Free the inflate window (also done by finish() and begin())
+     */
+    void release() {
+        free(_inflator);
+        free(_window);
+        _inflator = nullptr;
+        _window = nullptr;
+    }
+
+    bool compressed() const { return _compressed; }
+    size_t inputBytes() const { return _in; }
+    size_t outputBytes() const { return _out; }
+    const char* error() const { return _error; }
+
+private:
+    enum State { DETECT, RAW, HEADER, EXTRA_LEN, EXTRA, NAME, COMMENT, HCRC, BODY, TRAILER, DONE };
+
+    // Gzip header flag bits (RFC 1952)
+    enum { FHCRC = 0x02, FEXTRA = 0x04, FNAME = 0x08, FCOMMENT = 0x10 };
+
+    bool allocate() {
+        _inflator = (tinfl_decompressor*)malloc(sizeof(tinfl_decompressor));
+        _window = (uint8_t*)malloc(TINFL_LZ_DICT_SIZE);
+        return _inflator && _window;
+    }
+
+    bool fail(const char* error) {
+        _error = error;
+        release();
+        return false;
+    }
+
+    bool emit(const uint8_t* data, size_t len) {
+        if (_compressed) {
+            _crc = crc32_le(_crc, data, len);
+        }
+        _out += len;
+        return _sink(data, len, _ctx) || fail("write_failed");
+    }
+
+    // Optional header fields are handled in RFC order, clearing each flag once seen
+    void nextField() {
+        _pos = 0;
+        if (_flags & FEXTRA) {
+            _flags &= ~FEXTRA;
+            _state = EXTRA_LEN;
+        } else if (_flags & FNAME) {
+            _flags &= ~FNAME;
+            _state = NAME;
+        } else if (_flags & FCOMMENT) {
+            _flags &= ~FCOMMENT;
+            _state = COMMENT;
+        } else if (_flags & FHCRC) {
+            _flags &= ~FHCRC;
+            _state = HCRC;
+        } else {
+            tinfl_init(_inflator);
+            _windowPos = 0;
+            _state = BODY;
+        }
+    }
+
+    bool field(uint8_t b) {
+        switch (_state) {
+        case HEADER:
+            _buf[_pos++] = b;
+            if (_pos == 10) {
+                if (_buf[0] != OTA_GZIP_ID1 || _buf[1] != OTA_GZIP_ID2 || _buf[2] != OTA_GZIP_DEFLATE) {
+                    return fail("bad_header");
+                }
+                _flags = _buf[3];
+                nextField();
+            }
+            break;
+        case EXTRA_LEN:
+            _buf[_pos++] = b;
+            if (_pos == 2) {
+                _skip = _buf[0] | (_buf[1] << 8);
+                _state = EXTRA;
+                if (_skip == 0) {
+                    nextField();
+                }
+            }
+            break;
+        case EXTRA:
+            if (--_skip == 0) {
+                nextField();
+            }
+            break;
+        case NAME:
+        case COMMENT:
+            if (b == 0) {
+                nextField();
+            }
+            break;
+        case HCRC:
+            if (++_pos == 2) {
+                nextField();
+            }
+            break;
+        case TRAILER:
+            _buf[_pos++] = b;
+            if (_pos == 8) {
+                if (readLe32(_buf) != _crc) {
+                    return fail("crc_mismatch");
+                }
+                if (readLe32(_buf + 4) != (uint32_t)_out) {
+                    return fail("size_mismatch");
+                }
+                _state = DONE;
+                release();
+            }
+            break;
+        default:
+            return fail("bad_state");
+        }
+        return true;
+    }
+
+    // The window is a ring: tinfl derives its size from (next - start) + outSize
+    bool inflate(const uint8_t* data, size_t len, size_t& used) {
+        for (;;) {
+            size_t inBytes = len - used;
+            size_t outBytes = TINFL_LZ_DICT_SIZE - _windowPos;
+            tinfl_status status = tinfl_decompress(_inflator, data + used, &inBytes, _window,
+                                                   _window + _windowPos, &outBytes,
+                                                   TINFL_FLAG_HAS_MORE_INPUT);
+            used += inBytes;
+            if (outBytes > 0 && !emit(_window + _windowPos, outBytes)) {
+                return false;
+            }
+            _windowPos = (_windowPos + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+
+            if (status < TINFL_STATUS_DONE) {
+                return fail("bad_deflate");
+            }
+            if (status == TINFL_STATUS_DONE) {
+                _state = TRAILER;
+                _pos = 0;
+                return true;
+            }
+            if (status == TINFL_STATUS_NEEDS_MORE_INPUT && used == len) {
+                return true;
+            }
+            if (inBytes == 0 && outBytes == 0 && status != TINFL_STATUS_HAS_MORE_OUTPUT) {
+                return fail("bad_deflate");
+            }
+        }
+    }
+
+    static uint32_t readLe32(const uint8_t* p) {
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    Sink _sink = nullptr;
+    void* _ctx = nullptr;
+    State _state = DETECT;
+    bool _compressed = false;
+    const char* _error = nullptr;
+
+    tinfl_decompressor* _inflator = nullptr;
+    uint8_t* _window = nullptr;
+    size_t _windowPos = 0;
+
+    uint8_t _buf[10];
+    uint8_t _pos = 0;
+    uint8_t _flags = 0;
+    uint16_t _skip = 0;
+
+    size_t _in = 0;
+    size_t _out = 0;
+    uint32_t _crc = 0;
+};
@@ -0,0 +1,146 @@
+#pragma once
+/**
+ * @file ota_verify.h
+ * @brief Streaming SHA-256 and optional Ed25519 check of OTA images
+ *
+ * The image is hashed as it is written, chunk by chunk, so checking it costs
+ * no second pass over flash. The expected digest (SHA-256 of firmware.bin)
+ * is supplied when the upload starts and compared before the boot partition
+ * is switched; without one the upload behaves as before.
+ *
+ * Signed images: build with
+ *   -DOTA_SIGNING_PUBLIC_KEY=\"<64 hex chars>\"
+ * and every upload must carry an Ed25519 signature of the 32-byte digest
+ * (128 hex chars). Verification uses libsodium from the ESP-IDF that ships
+ * with arduino-esp32.
+ *
+ * hashMicros() accumulates the time spent hashing, so the per-chunk cost can
+ * be read back from a real transfer.
+ *
+ * Usage:
+ * @code
+ * #include "ota_verify.h"
+ *
+ * static OtaImageVerifier verifier;
+ * verifier.begin(sha256Hex, signatureHex);   // nullptr when not supplied
+ * verifier.update(data, len);                // for every image chunk written
+ * if (verifier.finish()) Update.end(true);   // else verifier.error()
+ * @endcode
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <mbedtls/sha256.h>
+#include "esp_timer.h"
+#ifdef OTA_SIGNING_PUBLIC_KEY
+#include "sodium.h"
+#endif
+
+#define OTA_SHA256_SIZE 32
+#define OTA_SIGNATURE_SIZE 64
+
+/**
+ * @brief Decode exactly size bytes of hex (either case)
+ */
+inline bool otaParseHex(const char* hex, uint8_t* out, size_t size) {
+    if (!hex || strlen(hex) != size * 2) {
+        return false;
+    }
+    for (size_t i = 0; i < size * 2; i++) {
+        char c = hex[i];
+        int nib = (c >= '0' && c <= '9') ? c - '0'
+                : (c >= 'a' && c <= 'f') ? c - 'a' + 10
+                : (c >= 'A' && c <= 'F') ? c - 'A' + 10
+                : -1;
+        if (nib < 0) {
+            return false;
+        }
+        out[i / 2] = (i % 2) ? (out[i / 2] | nib) : (uint8_t)(nib << 4);
+    }
+    return true;
+}
+
+class OtaImageVerifier {
+public:
+    OtaImageVerifier() { mbedtls_sha256_init(&_ctx); }
+    ~OtaImageVerifier() { mbedtls_sha256_free(&_ctx); }
+
+    /**
+     * @brief Start hashing a new image
+     *
+     * @param sha256Hex     expected digest, nullptr or "" to only compute it
+     * @param signatureHex  Ed25519 signature of the digest; required when
+     *                      built with OTA_SIGNING_PUBLIC_KEY, ignored otherwise
+     * @return false (and error() set) if a value is malformed or missing
+     */
+    bool begin(const char* sha256Hex, const char* signatureHex) {
+        mbedtls_sha256_starts(&_ctx, 0);
+        _error = nullptr;
+        _hashUs = 0;
+        _expect = sha256Hex && *sha256Hex;
+        if (_expect && !otaParseHex(sha256Hex, _expected, OTA_SHA256_SIZE)) {
+            _error = "bad_sha256";
+            return false;
+        }
+#ifdef OTA_SIGNING_PUBLIC_KEY
+        if (!_expect || !signatureHex || !*signatureHex) {
+            _error = "signature_required";
+            return false;
+        }
+        if (!otaParseHex(signatureHex, _signature, OTA_SIGNATURE_SIZE)) {
+            _error = "bad_signature";
+            return false;
+        }
+#else
+        (void)signatureHex;
+#endif
+        return true;
+    }
+
+    void update(const uint8_t* data, size_t len) {
+        int64_t t0 = esp_timer_get_time();
+        mbedtls_sha256_update(&_ctx, data, len);
+        _hashUs += (uint32_t)(esp_timer_get_time() - t0);
+    }
+
+    /**
+     * @brief Call after the last chunk, before switching the boot partition
+     * @return true if the digest (and signature, if required) match
+     */
+    bool finish() {
+        mbedtls_sha256_finish(&_ctx, _digest);
+        if (_error) {
+            return false;
+        }
+        if (_expect && memcmp(_digest, _expected, OTA_SHA256_SIZE) != 0) {
+            _error = "sha256_mismatch";
+            return false;
+        }
+#ifdef OTA_SIGNING_PUBLIC_KEY
+        uint8_t key[crypto_sign_PUBLICKEYBYTES];
+        if (sodium_init() < 0 || !otaParseHex(OTA_SIGNING_PUBLIC_KEY, key, sizeof(key)) ||
+            crypto_sign_verify_detached(_signature, _digest, OTA_SHA256_SIZE, key) != 0) {
+            _error = "bad_signature";
+            return false;
+        }
+#endif
+        return true;
+    }
+
+    bool expectsDigest() const { return _expect; }
+    const uint8_t* digest() const { return _digest; }
+    uint32_t hashMicros() const { return _hashUs; }
+    const char* error() const { return _error; }
+
+private:
+    mbedtls_sha256_context _ctx;
+    uint8_t _expected[OTA_SHA256_SIZE];
+    uint8_t _digest[OTA_SHA256_SIZE];
+#ifdef OTA_SIGNING_PUBLIC_KEY
+    uint8_t _signature[OTA_SIGNATURE_SIZE];
+#endif
+    bool _expect = false;
+    const char* _error = nullptr;
+    uint32_t _hashUs = 0;
+};
@@ -0,0 +1,275 @@
+#pragma once
+/**
+ * @file run_persistence.h
+ * @brief Experiment configuration and run progress kept in NVS across resets
+ *
+ * The experiment configuration used to live only in RAM: after a brownout or
+ * watchdog reset the sensor came back unconfigured and the backend had to
+ * re-send the config and restart the run. NvsRecord<T> keeps a plain struct
+ * as one NVS blob, tagged with the sensor type and layout size so another
+ * firmware (or an older layout) never loads it, and with a generation
+ * counter that increases on every write. Unchanged records are not
+ * rewritten.
+ *
+ * RunCheckpoint keeps the number and timestamp of the last sample of the
+ * current run, written at most every RUN_CHECKPOINT_INTERVAL_MS. The samples
+ * themselves were already streamed to the backend; what a reset loses is
+ * where the run stood. When resume mode is on and the previous boot died
+ * mid-run, the firmware continues the run after the next MQTT connect. The
+ * samples sent after the last checkpoint are unknown, so numbering skips
+ * every number that could have been used since (the firmware gives that
+ * bound from its sample rate, assuming loop() ran at least once per
+ * interval), and a gap marker on the status topic names the range that
+ * may be missing. Timestamps continue from the end of that window; the
+ * time spent rebooting is not counted against the run's duration.
+ *
+ * Each NVS write can stall both cores for a flash erase, so checkpoints are
+ * only written while resume mode is on.
+ *
+ * Usage (firmware experiment_manager.cpp):
+ * @code
+ * #include "run_persistence.h"
+ *
+ * static NvsRecord<StoredConfig> storedConfig("config", SensorTraits::typeId);
+ * static RunCheckpoint runCheckpoint(SensorTraits::typeId);
+ *
+ * storedConfig.load(stored);                        // setup()
+ * runCheckpoint.begin();                            // setup(): notes an interrupted run
+ * storedConfig.save(stored);                        // after a config change
+ *
+ * runCheckpoint.start();                            // run start
+ * runCheckpoint.progress(sampleCount, elapsedMs);   // loop(); writes every 5 s
+ * runCheckpoint.finish();                           // run end
+ *
+ * RunResumePoint resume;                            // after MQTT connect
+ * if (runCheckpoint.resume(samplesPerInterval, resume)) {
+ *     char json[RUN_RESUMED_JSON_SIZE];
+ *     formatRunResumed(json, sizeof(json), sensorID.c_str(), resume, storedConfig.generation());
+ * }
+ * @endcode
+ */
+
+#include <Arduino.h>
+#include <nvs.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_system.h"
+
+#define RUN_NVS_NAMESPACE "experiment"
+#define RUN_CHECKPOINT_INTERVAL_MS 5000
+#define RUN_RESUMED_JSON_SIZE 256
+
+/**
+ * @brief One struct stored as an NVS blob with a generation counter
+ *
+ * T must be trivially copyable and free of padding (4-byte fields, char
+ * arrays last), since unchanged records are detected with memcmp.
+ */
+template <class T>
+class NvsRecord {
+public:
+    NvsRecord(const char* key, uint8_t tag) : _key(key), _tag(tag) {}
+
+    /**
+     * @brief Read the record; false when none was saved with this tag and layout
+     */
+    bool load(T& value) {
+        nvs_handle_t handle;
+        if (nvs_open(RUN_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+            return false;
+        }
+        Blob blob;
+        size_t length = sizeof(blob);
+        esp_err_t err = nvs_get_blob(handle, _key, &blob, &length);
+        nvs_close(handle);
+        if (err != ESP_OK || length != sizeof(blob) || blob.tag != _tag || blob.size != sizeof(T)) {
+            return false;
+        }
+        _generation = blob.generation;
+        _stored = blob.value;
+        _valid = true;
+        value = blob.value;
+        return true;
+    }
+
+    /**
+     * @brief Write the record with the next generation; a no-op when it is unchanged
+     */
+    bool save(const T& value) {
+        if (_valid && memcmp(&_stored, &value, sizeof(T)) == 0) {
+            return true;
+        }
+        Blob blob;
+        memset(&blob, 0, sizeof(blob));
+        blob.generation = _generation + 1;
+        blob.size = sizeof(T);
+        blob.tag = _tag;
+        blob.value = value;
+
+        nvs_handle_t handle;
+        esp_err_t err = nvs_open(RUN_NVS_NAMESPACE, NVS_READWRITE, &handle);
+        if (err == ESP_OK) {
+            err = nvs_set_blob(handle, _key, &blob, sizeof(blob));
+            if (err == ESP_OK) {
+                err = nvs_commit(handle);
+            }
+            nvs_close(handle);
+        }
+        if (err != ESP_OK) {
+            Serial.printf("❌ Failed to save %s to NVS: %s\n", _key, esp_err_to_name(err));
+            return false;
+        }
+        _generation = blob.generation;
+        _stored = value;
+        _valid = true;
+        return true;
+    }
+
+    // Writes of this record so far; 0 when it was never saved
+    uint32_t generation() const { return _generation; }
+
+private:
+    struct Blob {
+        uint32_t generation;
+        uint16_t size;
+        uint8_t tag;
+        uint8_t reserved;
+        T value;
+    };
+
+    const char* _key;
+    uint8_t _tag;
+    uint32_t _generation = 0;
+    bool _valid = false;
+    T _stored;
+};
+
+// Progress of the current run as kept in NVS
+struct RunProgress {
+    uint32_t active;     // 1 from run start until it ends
+    uint32_t lastSample; // Number of the last sample taken
+    uint32_t elapsedMs;  // Run time at lastSample
+    uint32_t resumes;    // Times the run was continued after a reset
+};
+
+// Where an interrupted run continues
+struct RunResumePoint {
+    uint32_t lastSample;    // Last sample number known to be sent
+    uint32_t lastElapsedMs; // Run time at lastSample
+    uint32_t nextSample;    // First sample number after the reset
+    uint32_t elapsedMs;     // Run time the resumed run starts at
+    uint32_t resumes;
+};
+
+class RunCheckpoint {
+public:
+    explicit RunCheckpoint(uint8_t tag) : _record("run", tag) {}
+
+    /**
+     * @brief Load the last checkpoint; interrupted() tells whether the previous boot died mid-run
+     */
+    void begin() {
+        RunProgress saved;
+        if (_record.load(saved) && saved.active) {
+            _interrupted = saved;
+            _hasInterrupted = true;
+        }
+    }
+
+    /**
+     * @brief A new run; any interrupted run is given up
+     */
+    void start() {
+        _hasInterrupted = false;
+        _progress.active = 1;
+        _progress.lastSample = 0;
+        _progress.elapsedMs = 0;
+        _progress.resumes = 0;
+        write();
+    }
+
+    void progress(uint32_t lastSample, uint32_t elapsedMs) {
+        if (!_progress.active) {
+            return;
+        }
+        _progress.lastSample = lastSample;
+        _progress.elapsedMs = elapsedMs;
+        if (millis() - _lastWriteMs >= RUN_CHECKPOINT_INTERVAL_MS) {
+            write();
+        }
+    }
+
+    /**
+     * @brief The run ended (completed, stopped or paused); also gives up an interrupted run
+     */
+    void finish() {
+        if (!_progress.active && !_hasInterrupted) {
+            return;
+        }
+        _hasInterrupted = false;
+        _progress.active = 0;
+        write();
+    }
+
+    bool active() const { return _progress.active != 0; }
+    bool interrupted() const { return _hasInterrupted; }
+
+    /**
+     * @brief Continue the interrupted run; false if there is none
+     *
+     * @param samplesPerInterval  most samples the run can take in RUN_CHECKPOINT_INTERVAL_MS
+     */
+    bool resume(uint32_t samplesPerInterval, RunResumePoint& out) {
+        if (!_hasInterrupted) {
+            return false;
+        }
+        _hasInterrupted = false;
+        out.lastSample = _interrupted.lastSample;
+        out.lastElapsedMs = _interrupted.elapsedMs;
+        out.nextSample = _interrupted.lastSample + samplesPerInterval + 1;
+        out.elapsedMs = _interrupted.elapsedMs + RUN_CHECKPOINT_INTERVAL_MS;
+        out.resumes = _interrupted.resumes + 1;
+
+        // The skipped numbers count as used, should this boot die before the next write
+        _progress.active = 1;
+        _progress.lastSample = out.nextSample - 1;
+        _progress.elapsedMs = out.elapsedMs;
+        _progress.resumes = out.resumes;
+        write();
+        return true;
+    }
+
+private:
+    void write() {
+        _lastWriteMs = millis();
+        _record.save(_progress);
+    }
+
+    NvsRecord<RunProgress> _record;
+    RunProgress _progress = {0, 0, 0, 0};
+    RunProgress _interrupted = {0, 0, 0, 0};
+    bool _hasInterrupted = false;
+    unsigned long _lastWriteMs = 0;
+};
+
+/**
+ * @brief Gap marker published on the status topic when an interrupted run continues
+ *
+ * {"status":"run_resumed","sensor_id":"A1B2C","gap":{"after_sample":120,"next_sample":371,
+ *  "after_ms":60012,"resume_ms":65012},"resumes":1,"config_gen":4,"reset":9}
+ *
+ * Samples after_sample+1 .. next_sample-1 may be missing; "reset" is esp_reset_reason().
+ * @return bytes written, 0 if the buffer is too small
+ */
+inline int formatRunResumed(char* buf, size_t size, const char* sensorId, const RunResumePoint& resume,
+                            uint32_t configGeneration) {
+    int len = snprintf(buf, size,
+                       "{\"status\":\"run_resumed\",\"sensor_id\":\"%s\",\"gap\":{\"after_sample\":%u,"
+                       "\"next_sample\":%u,\"after_ms\":%u,\"resume_ms\":%u},\"resumes\":%u,\"config_gen\":%u,"
+                       "\"reset\":%u}",
+                       sensorId, (unsigned)resume.lastSample, (unsigned)resume.nextSample,
+                       (unsigned)resume.lastElapsedMs, (unsigned)resume.elapsedMs, (unsigned)resume.resumes,
+                       (unsigned)configGeneration, (unsigned)esp_reset_reason());
+    return (len < 0 || (size_t)len >= size) ? 0 : len;
+}
@@ -0,0 +1,271 @@
+#pragma once
+/**
+ * @file runtime_metrics.h
+ * @brief Runtime counters and gauges for /metrics and the MQTT metrics topic
+ *
+ * Counters are monotonic since boot, as Prometheus expects, and are bumped
+ * with relaxed atomic adds from the sampling task, loop() and the web
+ * server, so no hot path takes a lock. Gauges (heap, stack high-water
+ * marks, RSSI, CPU load) are read only while a report is written.
+ *
+ * CPU load is sampled from the FreeRTOS tick interrupt on each core: every
+ * tick (1 ms) the hook checks whether that core's idle task is the one
+ * running. Over RUNTIME_METRICS_LOAD_WINDOW ticks this gives the busy share
+ * of the last second for a few instructions per tick, without the run-time
+ * stats option the Arduino core is built without. The hook runs from the
+ * tick ISR, so the firmware defines it in IRAM (see below).
+ *
+ * Usage:
+ * @code
+ * #include "runtime_metrics.h"
+ *
+ * RuntimeMetrics metrics;
+ * static void IRAM_ATTR metricsTick() { metrics.onTick(xPortGetCoreID()); }
+ *
+ * metrics.begin(metricsTick);                  // setup()
+ * metrics.watchTask(sensorTaskHandle);          // stack high-water mark
+ * metrics.counter(METRIC_SENSOR_READS).add();   // hot paths
+ *
+ * metrics.writePrometheus(response, "TOF", sensorID.c_str(), WiFi.RSSI());
+ * metrics.writeJson(buffer, WiFi.RSSI());       // any Print
+ * @endcode
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <esp_attr.h>
+#include <esp_freertos_hooks.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#define RUNTIME_METRICS_TOPIC "sensors/%s/metrics"
+
+// Ticks per CPU load figure (1 s at the default 1 kHz tick)
+#ifndef RUNTIME_METRICS_LOAD_WINDOW
+#define RUNTIME_METRICS_LOAD_WINDOW 1000
+#endif
+
+// Period of the MQTT metrics message; 0 disables it
+#ifndef RUNTIME_METRICS_INTERVAL_MS
+#define RUNTIME_METRICS_INTERVAL_MS 60000UL
+#endif
+
+#define RUNTIME_METRICS_MAX_TASKS 4
+#define RUNTIME_METRICS_CORES 2
+#define RUNTIME_METRICS_JSON_SIZE 512
+
+// Prometheus name, compact JSON key, help text
+#define RUNTIME_METRICS_COUNTERS(X)                                                              \
+    X(METRIC_SENSOR_READS, "sensor_reads_total", "reads", "Sensor measurements read")            \
+    X(METRIC_SENSOR_I2C_ERRORS, "sensor_i2c_errors_total", "i2c_err", "I2C transfers not ACKed") \
+    X(METRIC_SENSOR_TIMEOUTS, "sensor_timeouts_total", "timeouts", "Sensor reads that timed out") \
+    X(METRIC_SENSOR_OUT_OF_RANGE, "sensor_out_of_range_total", "oor", "Readings outside the valid range") \
+    X(METRIC_SAMPLES, "samples_total", "samples", "Samples stored")                              \
+    X(METRIC_SAMPLES_MISSED, "samples_missed_total", "missed", "Timer ticks never serviced")    \
+    X(METRIC_MQTT_PUBLISHES, "mqtt_publishes_total", "pub", "MQTT publishes accepted")         \
+    X(METRIC_MQTT_PUBLISH_FAILURES, "mqtt_publish_failures_total", "pub_fail", "MQTT publishes refused") \
+    X(METRIC_MQTT_PUBLISH_BYTES, "mqtt_publish_bytes_total", "pub_bytes", "MQTT payload bytes published") \
+    X(METRIC_MQTT_CONNECTS, "mqtt_connects_total", "conn", "MQTT sessions established")
+
+enum RuntimeMetricId {
+#define RUNTIME_METRICS_ENUM(id, name, key, help) id,
+    RUNTIME_METRICS_COUNTERS(RUNTIME_METRICS_ENUM)
+#undef RUNTIME_METRICS_ENUM
+    METRIC_COUNT
+};
+
+/**
+ * @brief Lock-free monotonic counter
+ */
+class MetricCounter {
+public:
+    void add(uint32_t n = 1) { _value.fetch_add(n, std::memory_order_relaxed); }
+    uint32_t value() const { return _value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint32_t> _value{0};
+};
+
+class RuntimeMetrics {
+public:
+    typedef void (*TickHook)(void);
+
+    /**
+     * @brief Start CPU load sampling; call once from setup()
+     */
+    void begin(TickHook hook) {
+        for (int core = 0; core < RUNTIME_METRICS_CORES; core++) {
+            _cpu[core].idleTask = xTaskGetIdleTaskHandleForCPU(core);
+            esp_register_freertos_tick_hook_for_cpu(hook, core);
+        }
+        _started = true;
+    }
+
+    /**
+     * @brief Report the stack high-water mark of a task, labelled with its FreeRTOS name
+     */
+    bool watchTask(TaskHandle_t task) {
+        if (!task || _taskCount >= RUNTIME_METRICS_MAX_TASKS) {
+            return false;
+        }
+        _tasks[_taskCount++] = task;
+        return true;
+    }
+
+    MetricCounter& counter(RuntimeMetricId id) { return _counters[id]; }
+
+    /**
+     * @brief Per-tick CPU sample; call from an IRAM tick hook on each core
+     */
+    inline __attribute__((always_inline)) void onTick(BaseType_t core) {
+        CpuWindow& cpu = _cpu[core & 1];
+        bool idle = xTaskGetCurrentTaskHandleForCPU(core) == cpu.idleTask;
+        cpu.ticks++;
+        cpu.windowTicks++;
+        if (idle) {
+            cpu.idleTicks++;
+            cpu.windowIdle++;
+        }
+        if (cpu.windowTicks >= RUNTIME_METRICS_LOAD_WINDOW) {
+            cpu.loadPermille = 1000 - cpu.windowIdle * 1000 / cpu.windowTicks;
+            cpu.windowTicks = 0;
+            cpu.windowIdle = 0;
+        }
+    }
+
+    /**
+     * @brief Busy share of the last load window, 0-1000; -1 before the first window
+     */
+    int cpuLoadPermille(int core) const {
+        return (_started && _cpu[core].ticks >= RUNTIME_METRICS_LOAD_WINDOW) ? (int)_cpu[core].loadPermille : -1;
+    }
+
+    /**
+     * @brief Prometheus text exposition format (version 0.0.4)
+     */
+    void writePrometheus(Print& out, const char* sensorType, const char* sensorId, int rssi) const {
+        char labels[64];
+        snprintf(labels, sizeof(labels), "sensor_type=\"%s\",sensor_id=\"%s\"", sensorType, sensorId);
+
+#define RUNTIME_METRICS_PROM(id, name, key, help)                                                   \
+    out.printf("# HELP labexpert_%s %s\n# TYPE labexpert_%s counter\nlabexpert_%s{%s} %u\n", name, help, name, \
+               name, labels, (unsigned)_counters[id].value());
+        RUNTIME_METRICS_COUNTERS(RUNTIME_METRICS_PROM)
+#undef RUNTIME_METRICS_PROM
+
+        uint32_t freeHeap = ESP.getFreeHeap();
+        uint32_t maxBlock = ESP.getMaxAllocHeap();
+        gauge(out, "uptime_seconds", "Time since boot", labels, millis() / 1000);
+        gauge(out, "heap_free_bytes", "Free heap", labels, freeHeap);
+        gauge(out, "heap_min_free_bytes", "Lowest free heap since boot", labels, ESP.getMinFreeHeap());
+        gauge(out, "heap_largest_block_bytes", "Largest allocatable heap block", labels, maxBlock);
+        gauge(out, "heap_fragmentation_percent", "100 - largest block / free heap", labels,
+              fragmentationPercent(freeHeap, maxBlock));
+        gauge(out, "wifi_rssi_dbm", "WiFi signal strength", labels, rssi);
+
+        out.printf("# HELP labexpert_task_stack_free_bytes Stack never used since the task started\n"
+                   "# TYPE labexpert_task_stack_free_bytes gauge\n");
+        for (int i = 0; i < _taskCount; i++) {
+            out.printf("labexpert_task_stack_free_bytes{%s,task=\"%s\"} %u\n", labels, pcTaskGetName(_tasks[i]),
+                       (unsigned)uxTaskGetStackHighWaterMark(_tasks[i]));
+        }
+
+        out.printf("# HELP labexpert_cpu_idle_ticks_total Ticks that found the idle task running\n"
+                   "# TYPE labexpert_cpu_idle_ticks_total counter\n");
+        for (int core = 0; core < RUNTIME_METRICS_CORES; core++) {
+            out.printf("labexpert_cpu_idle_ticks_total{%s,core=\"%d\"} %u\n", labels, core,
+                       (unsigned)_cpu[core].idleTicks);
+        }
+        out.printf("# HELP labexpert_cpu_ticks_total Ticks sampled\n# TYPE labexpert_cpu_ticks_total counter\n");
+        for (int core = 0; core < RUNTIME_METRICS_CORES; core++) {
+            out.printf("labexpert_cpu_ticks_total{%s,core=\"%d\"} %u\n", labels, core, (unsigned)_cpu[core].ticks);
+        }
+    }
+
+    /**
+     * @brief Compact JSON for the MQTT topic and /metrics?format=json
+     *
+     * {"up":s,"heap":[free,min,largest],"frag":%,"rssi":dBm,"cpu":[permille,...],
+     *  "stack":{"task":bytes,...},"reads":n,...}
+     */
+    void writeJson(Print& out, int rssi) const {
+        uint32_t freeHeap = ESP.getFreeHeap();
+        uint32_t maxBlock = ESP.getMaxAllocHeap();
+        out.printf("{\"up\":%lu,\"heap\":[%u,%u,%u],\"frag\":%d,\"rssi\":%d,\"cpu\":[%d,%d],\"stack\":{",
+                   (unsigned long)(millis() / 1000), (unsigned)freeHeap, (unsigned)ESP.getMinFreeHeap(),
+                   (unsigned)maxBlock, fragmentationPercent(freeHeap, maxBlock), rssi, cpuLoadPermille(0),
+                   cpuLoadPermille(1));
+        for (int i = 0; i < _taskCount; i++) {
+            out.printf("%s\"%s\":%u", i ? "," : "", pcTaskGetName(_tasks[i]),
+                       (unsigned)uxTaskGetStackHighWaterMark(_tasks[i]));
+        }
+        out.print("}");
+#define RUNTIME_METRICS_JSON(id, name, key, help) out.printf(",\"%s\":%u", key, (unsigned)_counters[id].value());
+        RUNTIME_METRICS_COUNTERS(RUNTIME_METRICS_JSON)
+#undef RUNTIME_METRICS_JSON
+        out.print("}");
+    }
+
+private:
+    struct CpuWindow {
+        TaskHandle_t idleTask = nullptr;
+        volatile uint32_t ticks = 0;
+        volatile uint32_t idleTicks = 0;
+        uint32_t windowTicks = 0;
+        uint32_t windowIdle = 0;
+        volatile uint32_t loadPermille = 0;
+    };
+
+    static int fragmentationPercent(uint32_t freeHeap, uint32_t maxBlock) {
+        return freeHeap ? 100 - (int)((uint64_t)maxBlock * 100 / freeHeap) : 0;
+    }
+
+    static void gauge(Print& out, const char* name, const char* help, const char* labels, long value) {
+        out.printf("# HELP labexpert_%s %s\n# TYPE labexpert_%s gauge\nlabexpert_%s{%s} %ld\n", name, help, name, name,
+                   labels, value);
+    }
+
+    MetricCounter _counters[METRIC_COUNT];
+    CpuWindow _cpu[RUNTIME_METRICS_CORES];
+    TaskHandle_t _tasks[RUNTIME_METRICS_MAX_TASKS] = {};
+    int _taskCount = 0;
+    bool _started = false;
+};
+
+/**
+ * @brief Print into a fixed buffer (for an MQTT payload); output past the end is dropped
+ */
+class MetricsBuffer : public Print {
+public:
+    MetricsBuffer(char* buf, size_t size) : _buf(buf), _size(size) {
+        if (size) {
+            buf[0] = '\0';
+        }
+    }
+    size_t write(uint8_t c) override {
+        if (_len + 1 >= _size) {
+            _overflow = true;
+            return 0;
+        }
+        _buf[_len++] = (char)c;
+        _buf[_len] = '\0';
+        return 1;
+    }
+    size_t write(const uint8_t* data, size_t size) override {
+        size_t n = 0;
+        while (n < size && write(data[n])) {
+            n++;
+        }
+        return n;
+    }
+    size_t length() const { return _len; }
+    bool overflowed() const { return _overflow; }
+
+private:
+    char* _buf;
+    size_t _size;
+    size_t _len = 0;
+    bool _overflow = false;
+};
@@ -0,0 +1,158 @@
+#pragma once
+/**
+ * @file sample_timing.h
+ * @brief Per-run histograms of sampling jitter and ISR-to-read latency
+ *
+ * The sampling task records every timer tick it services: the micros()
+ * taken in the timer ISR and the micros() when the sensor read starts.
+ * Two fixed histograms are kept:
+ *   - interval jitter: |tick-to-tick interval - nominal interval|
+ *   - latency: ISR to the start of the read (task wake-up and scheduling)
+ * Bucket i counts values below SAMPLE_TIMING_BUCKET_US(i) (8, 16, 32 ...
+ * 8192 us); the last bucket also takes everything above. A tick the task
+ * never serviced shows up as an interval of about twice the nominal one
+ * and is counted in missed, so the histograms back up a claimed sample
+ * rate without trusting the sample count alone.
+ *
+ * record() runs on the sampling core and snapshot() from the web server or
+ * loop(), so both take a short critical section.
+ *
+ * Usage:
+ * @code
+ * #include "sample_timing.h"
+ *
+ * SampleTiming sampleTiming;
+ * sampleTiming.reset(1000000UL / config.frequency);  // run start
+ * sampleTiming.restartInterval();                     // after a pause
+ *
+ * // Sampling task, per serviced tick (isrMicros captured in the ISR):
+ * uint32_t missed = sampleTiming.record(isrMicros, micros());
+ *
+ * SampleTimingPacket packet = sampleTiming.snapshot();   // /status, MQTT
+ * @endcode
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+
+#define SAMPLE_TIMING_VERSION 1
+#define SAMPLE_TIMING_BUCKETS 12
+#define SAMPLE_TIMING_BUCKET_US(i) (8UL << (i))
+
+// Binary diagnostics message (little-endian, 128 bytes), published once per run
+#pragma pack(push, 1)
+typedef struct {
+    uint8_t version;                                  // SAMPLE_TIMING_VERSION
+    uint8_t bucket_count;                             // SAMPLE_TIMING_BUCKETS
+    uint16_t reserved;
+    uint32_t nominal_interval_us;                     // 1e6 / frequency at run start
+    uint32_t ticks;                                   // Ticks serviced by the sampling task
+    uint32_t missed;                                  // Ticks never serviced
+    uint32_t interval_min_us;
+    uint32_t interval_max_us;
+    uint32_t latency_max_us;
+    uint32_t interval_jitter[SAMPLE_TIMING_BUCKETS];
+    uint32_t latency[SAMPLE_TIMING_BUCKETS];
+    uint32_t run_ms;                                  // Run start to snapshot
+} SampleTimingPacket;
+#pragma pack(pop)
+static_assert(sizeof(SampleTimingPacket) == 128, "SampleTimingPacket layout changed");
+
+class SampleTiming {
+public:
+    SampleTiming() {
+        _stats.version = SAMPLE_TIMING_VERSION;
+        _stats.bucket_count = SAMPLE_TIMING_BUCKETS;
+    }
+
+    /**
+     * @brief Clear everything for a new run
+     */
+    void reset(uint32_t nominalIntervalUs) {
+        portENTER_CRITICAL(&_lock);
+        memset(&_stats, 0, sizeof(_stats));
+        _stats.version = SAMPLE_TIMING_VERSION;
+        _stats.bucket_count = SAMPLE_TIMING_BUCKETS;
+        _stats.nominal_interval_us = nominalIntervalUs;
+        _stats.interval_min_us = UINT32_MAX;
+        _lastTickUs = 0;
+        _haveTick = false;
+        _startMs = millis();
+        portEXIT_CRITICAL(&_lock);
+    }
+
+    /**
+     * @brief Do not measure an interval across a pause
+     */
+    void restartInterval() {
+        portENTER_CRITICAL(&_lock);
+        _haveTick = false;
+        portEXIT_CRITICAL(&_lock);
+    }
+
+    /**
+     * @brief Record one serviced tick
+     *
+     * @param tickUs micros() captured in the timer ISR
+     * @param readUs micros() just before the sensor read
+     * @return Ticks missed since the previous serviced one
+     */
+    uint32_t record(uint32_t tickUs, uint32_t readUs) {
+        uint32_t missed = 0;
+        uint32_t latency = readUs - tickUs;
+        portENTER_CRITICAL(&_lock);
+        uint32_t nominal = _stats.nominal_interval_us;
+        if (_haveTick && nominal > 0) {
+            uint32_t interval = tickUs - _lastTickUs;
+            if (interval > nominal + nominal / 2) {
+                missed = (interval + nominal / 2) / nominal - 1;
+                _stats.missed += missed;
+            }
+            uint32_t jitter = interval > nominal ? interval - nominal : nominal - interval;
+            _stats.interval_jitter[bucketFor(jitter)]++;
+            _stats.interval_min_us = interval < _stats.interval_min_us ? interval : _stats.interval_min_us;
+            _stats.interval_max_us = interval > _stats.interval_max_us ? interval : _stats.interval_max_us;
+        }
+        _stats.latency[bucketFor(latency)]++;
+        _stats.latency_max_us = latency > _stats.latency_max_us ? latency : _stats.latency_max_us;
+        _stats.ticks++;
+        _lastTickUs = tickUs;
+        _haveTick = true;
+        portEXIT_CRITICAL(&_lock);
+        return missed;
+    }
+
+    uint32_t missed() const { return _stats.missed; }
+
+    /**
+     * @brief Consistent copy of the counters, in wire format
+     */
+    SampleTimingPacket snapshot() {
+        portENTER_CRITICAL(&_lock);
+        SampleTimingPacket copy = _stats;
+        unsigned long startMs = _startMs;
+        portEXIT_CRITICAL(&_lock);
+        if (copy.interval_min_us == UINT32_MAX) {
+            copy.interval_min_us = 0;
+        }
+        copy.run_ms = startMs ? (uint32_t)(millis() - startMs) : 0;
+        return copy;
+    }
+
+    static uint8_t bucketFor(uint32_t us) {
+        uint8_t bucket = 0;
+        while (bucket < SAMPLE_TIMING_BUCKETS - 1 && us >= SAMPLE_TIMING_BUCKET_US(bucket)) {
+            bucket++;
+        }
+        return bucket;
+    }
+
+private:
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+    SampleTimingPacket _stats = {};
+    uint32_t _lastTickUs = 0;
+    bool _haveTick = false;
+    unsigned long _startMs = 0;
+};
@@ -0,0 +1,376 @@
+#pragma once
+/**
+ * @file sampling_runtime.h
+ * @brief Timer-driven sampling task and sample streaming for sensor firmwares
+ *
+ * The TOF and UltraSonic firmwares sample the same way: hardware timer 0 of
+ * group 0 fires at the configured rate, its ISR stamps the tick and wakes a
+ * task on core 0, and the task reads the sensor, stores the sample and
+ * appends it to the packet being streamed. loop() publishes the packet when
+ * the AdaptiveBatcher says so. This class holds that machinery once; a
+ * firmware supplies only the sensor-specific parts as a driver.
+ *
+ * Streaming is double-buffered: the task appends to one packet while loop()
+ * publishes the other, and the two swap under a spinlock. A packet that fills
+ * up is handed to loop() as it is; only loop() talks to PubSubClient. If
+ * both packets are full (loop() stalled for a whole packet) further samples
+ * are still stored but not streamed, and are counted in streamDropped().
+ *
+ * The driver derives from SamplingRuntime<Driver, Sample, BufferSamples>
+ * (CRTP) and provides:
+ *   - static bool running()         run in progress; called from the ISR, so
+ *                                   keep it an inline read of a flag
+ *   - uint16_t read()               one reading, SAMPLE_READ_ERROR on failure
+ *   - bool store(ms, value, out)    keep a reading (ms from the ISR); false
+ *                                   when full, otherwise fills the Sample
+ *   - bool streaming()              stream samples (false in bulk mode)
+ *   - bool publish(samples, count)  send one packet
+ * and may hide onTicksMissed(n) and onSampleStored(n). These must be public.
+ * Calls are resolved at compile time, so the per-sample path has no virtual
+ * calls.
+ *
+ * Usage:
+ * @code
+ * #include "sampling_runtime.h"
+ *
+ * class TofSampler : public SamplingRuntime<TofSampler, BinarySample, BINARY_MAX_SAMPLES_PER_PACKET> {
+ * public:
+ *     static bool running() { return experimentRunning; }
+ *     uint16_t read() { return readTOFDistanceMM(); }
+ *     bool store(unsigned long ms, uint16_t value, BinarySample& out);
+ *     bool streaming() const { return !config.bulkUpload; }
+ *     bool publish(const BinarySample* samples, uint16_t count);
+ * };
+ * static TofSampler sampler;
+ *
+ * sampler.begin(config.frequency);                              // setup()
+ * sampler.startRun(config.frequency);                           // run start
+ * sampler.pollFlush(config.frequency, config.latencyTargetMs);  // loop()
+ * sampler.finishRun();                                          // loop(), once running() is false
+ * @endcode
+ */
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <driver/timer.h>
+#include <esp_attr.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "adaptive_batcher.h"
+#include "async_log.h"
+#include "sample_timing.h"
+
+#define SAMPLE_READ_ERROR 65535
+#define SAMPLING_TASK_STACK 4096
+#define SAMPLING_TASK_CORE 0
+#define SAMPLING_TIMER_DIVIDER 80 // 1 MHz timer ticks from the 80 MHz APB clock
+
+template <class Driver, class Sample, uint16_t BufferSamples>
+class SamplingRuntime {
+public:
+    SamplingRuntime() : _batcher(BufferSamples) {}
+
+    /**
+     * @brief Start the sampling task and the timer; ticks are ignored while !running()
+     */
+    bool begin(int frequencyHz) {
+        if (_timerStarted) {
+            return true;
+        }
+        _instance = this;
+        xTaskCreatePinnedToCore(taskEntry, "SensorTask", SAMPLING_TASK_STACK, this, configMAX_PRIORITIES - 1,
+                                &_task, SAMPLING_TASK_CORE);
+        if (_task == NULL) {
+            Serial.println("ERROR: Failed to create sensor task");
+            return false;
+        }
+
+        timer_config_t timerConfig = {
+            .alarm_en = TIMER_ALARM_EN,
+            .counter_en = TIMER_PAUSE,
+            .intr_type = TIMER_INTR_LEVEL,
+            .counter_dir = TIMER_COUNT_UP,
+            .auto_reload = TIMER_AUTORELOAD_EN,
+            .divider = SAMPLING_TIMER_DIVIDER};
+        timer_init(TIMER_GROUP_0, TIMER_0, &timerConfig);
+        timer_set_alarm_value(TIMER_GROUP_0, TIMER_0, 1000000 / frequencyHz);
+        timer_enable_intr(TIMER_GROUP_0, TIMER_0);
+        timer_isr_register(TIMER_GROUP_0, TIMER_0, timerISR, NULL, ESP_INTR_FLAG_IRAM, NULL);
+        timer_start(TIMER_GROUP_0, TIMER_0);
+
+        _timerStarted = true;
+        Serial.printf("Timer initialized for %dHz\n", frequencyHz);
+        return true;
+    }
+
+    void setFrequency(int frequencyHz) {
+        if (!_timerStarted) {
+            return;
+        }
+        timer_pause(TIMER_GROUP_0, TIMER_0);
+        timer_set_alarm_value(TIMER_GROUP_0, TIMER_0, 1000000 / frequencyHz);
+        timer_start(TIMER_GROUP_0, TIMER_0);
+        Serial.printf("Timer frequency updated to %dHz\n", frequencyHz);
+    }
+
+    /**
+     * @brief Clear the per-run counters and timing histograms at the start of a run
+     */
+    void startRun(int frequencyHz) {
+        timing.reset(1000000UL / frequencyHz);
+        _stored = 0;
+        _missedSamples = 0;
+        _consecutiveMisses = 0;
+        portENTER_CRITICAL(&_lock);
+        _count[0] = 0;
+        _count[1] = 0;
+        _handedOff = false;
+        _streamDropped = 0;
+        portEXIT_CRITICAL(&_lock);
+    }
+
+    /**
+     * @brief Publish the streamed samples once the batcher's latency budget is used up (loop() only)
+     */
+    void pollFlush(int frequencyHz, uint16_t latencyTargetMs) {
+        _batcher.setSampleRate(frequencyHz);
+        _batcher.setLatencyTarget(latencyTargetMs);
+        publishHandedOff();
+
+        portENTER_CRITICAL(&_lock);
+        uint16_t count = _count[_filling];
+        unsigned long oldestMs = _oldestMs[_filling];
+        portEXIT_CRITICAL(&_lock);
+        if (count > 0 && _batcher.shouldFlush(count, millis() - oldestMs)) {
+            flush();
+        }
+    }
+
+    /**
+     * @brief Publish everything buffered so far (loop() only)
+     */
+    void flush() {
+        publishHandedOff();
+        portENTER_CRITICAL(&_lock);
+        if (!_handedOff && _count[_filling] > 0) {
+            _handedOff = true;
+            _filling ^= 1;
+        }
+        portEXIT_CRITICAL(&_lock);
+        publishHandedOff();
+    }
+
+    /**
+     * @brief End of a run: wait for a sample the task may still be taking, then flush
+     *
+     * Call from loop() once running() returns false; without the wait the
+     * last sample of a run could be stored after the final flush and never sent.
+     */
+    void finishRun() {
+        for (;;) {
+            portENTER_CRITICAL(&_lock);
+            bool sampling = _sampling;
+            portEXIT_CRITICAL(&_lock);
+            if (!sampling) {
+                break;
+            }
+            vTaskDelay(1);
+        }
+        flush();
+    }
+
+    /**
+     * @brief Publish total samples in full packets; fill(index, sample) supplies each one
+     *
+     * Reuses the streaming buffers, so call it only from loop() while no run is streaming.
+     */
+    template <class Fill>
+    int publishAll(int total, Fill fill) {
+        Sample* packet = _packets[0];
+        int sent = 0;
+        while (sent < total) {
+            uint16_t count = 0;
+            while (count < BufferSamples && sent + count < total) {
+                fill(sent + count, packet[count]);
+                count++;
+            }
+            if (!derived().publish(packet, count)) {
+                break;
+            }
+            sent += count;
+            yield();
+        }
+        return sent;
+    }
+
+    uint16_t buffered() const { return _count[0] + _count[1]; }
+    uint32_t streamDropped() const { return _streamDropped; }
+    uint16_t batchSize() const { return _batcher.batchSize(); }
+    TaskHandle_t task() const { return _task; }
+
+    // Tick interval and ISR-to-read histograms of the current run
+    SampleTiming timing;
+
+protected:
+    // Optional driver hooks
+    void onTicksMissed(uint32_t ticks) { (void)ticks; }
+    void onSampleStored(int sampleNumber) { (void)sampleNumber; }
+
+private:
+    Driver& derived() { return static_cast<Driver&>(*this); }
+
+    static void IRAM_ATTR timerISR(void* arg) {
+        (void)arg;
+        BaseType_t higherPriorityTaskWoken = pdFALSE;
+        SamplingRuntime* self = _instance;
+
+        if (Driver::running()) {
+            // Stamp the tick before anything else; the read happens later in the task
+            self->_tickMs = millis();
+            self->_tickUs = micros();
+            self->_tickPending = true;
+            if (self->_task != NULL) {
+                vTaskNotifyGiveFromISR(self->_task, &higherPriorityTaskWoken);
+            }
+        }
+
+        timer_group_clr_intr_status_in_isr(TIMER_GROUP_0, TIMER_0);
+        timer_group_enable_alarm_in_isr(TIMER_GROUP_0, TIMER_0);
+
+        if (higherPriorityTaskWoken) {
+            portYIELD_FROM_ISR();
+        }
+    }
+
+    static void taskEntry(void* arg) {
+        static_cast<SamplingRuntime*>(arg)->run();
+    }
+
+    void run() {
+        LOG_I("Sensor task started on Core %d\n", (int)xPortGetCoreID());
+        for (;;) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1));
+            // finishRun() waits on _sampling, so it is set in the same step as the running() check
+            portENTER_CRITICAL(&_lock);
+            _sampling = _tickPending && Driver::running();
+            portEXIT_CRITICAL(&_lock);
+            if (_sampling) {
+                _tickPending = false;
+                sampleTick(_tickMs, _tickUs);
+                portENTER_CRITICAL(&_lock);
+                _sampling = false;
+                portEXIT_CRITICAL(&_lock);
+            }
+            vTaskDelay(0);
+        }
+    }
+
+    // Sampling task: append to the packet being filled; a full one goes to loop() if it is free
+    void append(unsigned long tickMs, const Sample& sample) {
+        portENTER_CRITICAL(&_lock);
+        uint8_t p = _filling;
+        if (_count[p] == BufferSamples && !_handedOff) {
+            // Filled while loop() was still publishing the other one
+            _handedOff = true;
+            _filling = p ^= 1;
+        }
+        if (_count[p] < BufferSamples) {
+            if (_count[p] == 0) {
+                _oldestMs[p] = tickMs;
+            }
+            _packets[p][_count[p]++] = sample;
+            if (_count[p] == BufferSamples && !_handedOff) {
+                _handedOff = true;
+                _filling = p ^ 1;
+            }
+        } else {
+            _streamDropped++;
+        }
+        portEXIT_CRITICAL(&_lock);
+    }
+
+    // loop(): publish the packet the task handed off, then give it back empty
+    void publishHandedOff() {
+        portENTER_CRITICAL(&_lock);
+        bool handedOff = _handedOff;
+        uint8_t p = _filling ^ 1; // Fixed while handed off: the task swaps only when it is not
+        portEXIT_CRITICAL(&_lock);
+        if (!handedOff) {
+            return;
+        }
+
+        uint16_t count = _count[p];
+        uint32_t publishStart = micros();
+        bool ok = derived().publish(_packets[p], count);
+        _batcher.onPublish(count, micros() - publishStart, ok);
+
+        portENTER_CRITICAL(&_lock);
+        _count[p] = 0;
+        _handedOff = false;
+        portEXIT_CRITICAL(&_lock);
+    }
+
+    void sampleTick(unsigned long tickMs, uint32_t tickUs) {
+        uint32_t missedTicks = timing.record(tickUs, micros());
+        if (missedTicks > 0) {
+            derived().onTicksMissed(missedTicks);
+            _missedSamples += missedTicks;
+            _consecutiveMisses += missedTicks;
+            if (_consecutiveMisses > 3) {
+                LOG_W("WARNING: %d consecutive samples missed\n", _consecutiveMisses);
+            }
+        } else {
+            _consecutiveMisses = 0;
+        }
+
+        uint16_t value = derived().read();
+        if (value == SAMPLE_READ_ERROR) {
+            LOG_W("Sensor read error (65535), skipping sample\n");
+            _missedSamples++;
+            return;
+        }
+
+        Sample sample;
+        if (!derived().store(tickMs, value, sample)) {
+            return;
+        }
+        _stored++;
+        if (derived().streaming()) {
+            append(tickMs, sample);
+        }
+        derived().onSampleStored(_stored);
+
+        if (_stored <= 5) {
+            LOG_D("Sample %d: %u @ %lums\n", _stored, value, tickMs);
+        }
+        if (_stored % 50 == 0) {
+            LOG_I("Collected %d samples, %d missed\n", _stored, _missedSamples);
+        }
+    }
+
+    static SamplingRuntime* _instance;
+
+    TaskHandle_t _task = NULL;
+    bool _timerStarted = false;
+    volatile bool _tickPending = false;
+    volatile unsigned long _tickMs = 0;
+    volatile uint32_t _tickUs = 0;
+
+    int _stored = 0;
+    int _missedSamples = 0;
+    int _consecutiveMisses = 0;
+
+    // Streaming packets; _lock guards the counts, _filling and _handedOff
+    portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+    Sample _packets[2][BufferSamples];
+    volatile uint16_t _count[2] = {0, 0};
+    unsigned long _oldestMs[2] = {0, 0};
+    uint8_t _filling = 0;              // Packet the task appends to
+    bool _handedOff = false;           // The other packet waits for loop() to publish it
+    volatile bool _sampling = false;   // Task is between the running() check and the store
+    volatile uint32_t _streamDropped = 0;
+    AdaptiveBatcher _batcher;
+};
+
+template <class Driver, class Sample, uint16_t BufferSamples>
+SamplingRuntime<Driver, Sample, BufferSamples>* SamplingRuntime<Driver, Sample, BufferSamples>::_instance = nullptr;
@@ -0,0 +1,254 @@
+#pragma once
+/**
+ * @file sensor_runtime.h
+ * @brief Device identity, WiFi and MQTT session setup, and the hand-back to the OTA loader
+ *
+ * Shared by all four sensor firmwares, which used to carry diverging copies.
+ *
+ * readSensorTypeFromEeprom() reads the 3-byte type code from the ID EEPROM
+ * at boot, with retries; each firmware wraps it in detectSensorFromEEPROM()
+ * to drive its own sensor LED. connectSensorWiFi() first tries the directed
+ * connect to the cached access point (see nvs_wifi_credentials.h), then a
+ * full scan and DHCP, and refreshes that cache when the full connect works.
+ *
+ * Every sensor firmware runs from ota_1 and is installed by the OTA loader in
+ * ota_0. When the sensor is missing or the backend releases the device, the
+ * firmware makes ota_0 the boot partition again and restarts into it; when it
+ * gives up because the sensor is gone it also erases itself from ota_1 so the
+ * loader installs the right firmware for whatever is plugged in next.
+ *
+ * connectMqttSession() makes one connect attempt and returns; mqttLoop()
+ * paces the retries, so a broker outage never stalls loop() and the packet
+ * flushes it drives.
+ *
+ * Usage:
+ * @code
+ * #include "sensor_runtime.h"
+ *
+ * sensorID = sensorIdFromMac();             // "A1B2C" from ..:0A:1B:2C
+ *
+ * bool online = connectSensorWiFi(ssid, password);
+ * bool found = readSensorTypeFromEeprom(Wire, 0x50, "ULTTOF", 3, 1000, sensorType);
+ *
+ * // mqttLoop(), at most every 5 s while disconnected:
+ * if (connectMqttSession(mqttClient, clientId.c_str(), sensorType.c_str(), sensorID.c_str())) {
+ *     publishSensorIdentification();          // replaces the retained last-will
+ * }
+ *
+ * if (!detectSensorFromEEPROM()) {
+ *     failsafeToOtaLoader("EEPROM failure");  // does not return
+ * }
+ *
+ * // cleanFirmwareAndBootOTA(), after MQTT/WiFi teardown:
+ * restartIntoOtaLoader(false);
+ * ESP.restart();                            // ota_0 missing: restart anyway
+ * @endcode
+ */
+
+#include <Arduino.h>
+#include <PubSubClient.h>
+#include <WiFi.h>
+#include <Wire.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <string.h>
+#include "eeprom_presence.h"
+#include "mqtt_presence.h"
+#include "nvs_wifi_credentials.h"
+
+#define SENSOR_ID_LENGTH 5
+#define SENSOR_WIFI_CONNECT_TIMEOUT_MS 15000 // Full connect: scan, association and DHCP
+
+#ifndef MQTT_STATUS_TOPIC
+#define MQTT_STATUS_TOPIC "sensors/%s/status"
+#endif
+#ifndef MQTT_CONFIG_TOPIC
+#define MQTT_CONFIG_TOPIC "sensors/%s/config"
+#endif
+#ifndef MQTT_COMMAND_TOPIC
+#define MQTT_COMMAND_TOPIC "sensors/%s/command"
+#endif
+
+/**
+ * @brief Last SENSOR_ID_LENGTH hex digits of the WiFi MAC address
+ */
+inline String sensorIdFromMac() {
+    String mac = WiFi.macAddress();
+    mac.replace(":", "");
+    if (mac.length() >= SENSOR_ID_LENGTH) {
+        return mac.substring(mac.length() - SENSOR_ID_LENGTH);
+    }
+    return mac;
+}
+
+/**
+ * @brief Read the sensor type code from the ID EEPROM, retrying while it does not answer
+ *
+ * @param accepted  codes this firmware runs with, see eepromCodeAccepted();
+ *                  nullptr accepts any non-empty code
+ * @param type      the code read, also when it is not accepted; "UNKNOWN"
+ *                  when the EEPROM never answered
+ * @return true when a code was read and accepted
+ */
+inline bool readSensorTypeFromEeprom(TwoWire& wire, uint8_t address, const char* accepted, int retries,
+                                     unsigned long retryDelayMs, String& type) {
+    for (int retry = 0; retry < retries; retry++) {
+        wire.beginTransmission(address);
+        uint8_t error = wire.endTransmission();
+        if (error != 0) {
+            Serial.printf("✘ EEPROM sensor not found, I2C error: %u\n", (unsigned)error);
+        } else {
+            wire.beginTransmission(address);
+            wire.write(0x00);
+            if (wire.endTransmission(false) != 0) {
+                Serial.println("✘ Failed to set EEPROM address");
+            } else if (wire.requestFrom((int)address, EEPROM_PRESENCE_CODE_SIZE) == 0 ||
+                       wire.available() < EEPROM_PRESENCE_CODE_SIZE) {
+                Serial.println("✘ Not enough data from EEPROM");
+            } else {
+                char code[EEPROM_PRESENCE_CODE_SIZE + 1];
+                for (int i = 0; i < EEPROM_PRESENCE_CODE_SIZE; i++) {
+                    code[i] = (char)wire.read();
+                }
+                code[EEPROM_PRESENCE_CODE_SIZE] = '\0';
+                Serial.printf("EEPROM data: %s\n", code);
+
+                type = code;
+                bool ok = accepted ? eepromCodeAccepted(code, accepted) : code[0] != '\0';
+                if (ok) {
+                    Serial.printf("Sensor Type: %s\n", code);
+                } else {
+                    Serial.printf("⚠️ Sensor type %s is not compatible with this firmware\n", code);
+                }
+                return ok;
+            }
+        }
+        if (retry < retries - 1) {
+            Serial.printf("Retrying EEPROM detection (%d/%d)...\n", retry + 1, retries);
+            delay(retryDelayMs);
+        }
+    }
+
+    Serial.println("❌ EEPROM detection failed after all retries");
+    type = "UNKNOWN";
+    return false;
+}
+
+/**
+ * @brief Join WiFi: directed connect to the cached access point, else a full connect
+ *
+ * Call after WiFi.mode(WIFI_STA). A full connect that succeeds is cached for
+ * the next boot's directed connect.
+ * @return true when connected
+ */
+inline bool connectSensorWiFi(const char* ssid, const char* password,
+                              uint32_t timeoutMs = SENSOR_WIFI_CONNECT_TIMEOUT_MS) {
+    if (connectWiFiFast(ssid, password)) {
+        return true;
+    }
+
+    Serial.println("🌐 Connecting to WiFi using DHCP...");
+    WiFi.begin(ssid, password);
+    // Poll finely so the connect is noticed as soon as it happens
+    unsigned long start = millis();
+    while (WiFi.status() != WL_CONNECTED && millis() - start < timeoutMs) {
+        delay(50);
+    }
+
+    if (WiFi.status() != WL_CONNECTED) {
+        Serial.println("❌ DHCP connection failed");
+        return false;
+    }
+    Serial.printf("✅ DHCP connection successful. IP: %s\n", WiFi.localIP().toString().c_str());
+    saveWiFiLinkToNVS();
+    return true;
+}
+
+/**
+ * @brief One MQTT connect attempt with the offline presence as last-will
+ *
+ * On success subscribes to the config and command topics at QoS 1 (the
+ * backend publishes them at QoS 1). Does not wait or retry.
+ */
+inline bool connectMqttSession(PubSubClient& client, const char* clientId, const char* sensorType,
+                               const char* sensorId) {
+    // Last-will: broker marks us offline (retained) if the session drops
+    char statusTopic[50];
+    snprintf(statusTopic, sizeof(statusTopic), MQTT_STATUS_TOPIC, sensorId);
+    char offlinePresence[MQTT_PRESENCE_MAX_SIZE];
+    formatMqttPresence(offlinePresence, sizeof(offlinePresence), sensorType, sensorId, nullptr, false);
+
+    if (!client.connect(clientId, nullptr, nullptr, statusTopic, MQTT_PRESENCE_QOS, true, offlinePresence)) {
+        return false;
+    }
+
+    char configTopic[50];
+    snprintf(configTopic, sizeof(configTopic), MQTT_CONFIG_TOPIC, sensorId);
+    client.subscribe(configTopic, 1);
+
+    char commandTopic[50];
+    snprintf(commandTopic, sizeof(commandTopic), MQTT_COMMAND_TOPIC, sensorId);
+    client.subscribe(commandTopic, 1);
+
+    Serial.printf("Subscribed to: %s and %s\n", configTopic, commandTopic);
+    return true;
+}
+
+/**
+ * @brief Select ota_0 as the boot partition and restart into it
+ *
+ * With eraseRunningApp the running partition is erased first when it is
+ * ota_1. Returns only when ota_0 is missing or cannot be selected.
+ */
+inline void restartIntoOtaLoader(bool eraseRunningApp) {
+    const esp_partition_t* ota_0 = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
+    if (ota_0 == NULL) {
+        Serial.println("❌ ota_0 partition not found!");
+        return;
+    }
+
+    esp_err_t err = esp_ota_set_boot_partition(ota_0);
+    if (err != ESP_OK) {
+        Serial.printf("❌ Failed to set boot partition: %s\n", esp_err_to_name(err));
+        return;
+    }
+    Serial.println("✅ Boot partition set to ota_0 (ESP_32_OTA)");
+
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    if (eraseRunningApp && running && strcmp(running->label, "ota_1") == 0) {
+        Serial.println("🗑️ Erasing ota_1 partition...");
+        err = esp_partition_erase_range(running, 0, running->size);
+        if (err == ESP_OK) {
+            Serial.println("✅ ota_1 partition erased successfully");
+        } else {
+            Serial.printf("❌ Failed to erase ota_1 partition: %s\n", esp_err_to_name(err));
+        }
+    }
+
+    Serial.println("🔄 Restarting to ESP_32_OTA bootloader...");
+    delay(2000);
+    ESP.restart();
+}
+
+/**
+ * @brief Give the device back to the OTA loader because the sensor is unusable; does not return
+ *
+ * On ota_1 this erases the firmware and boots ota_0. On ota_0 the loader is
+ * already running and handles the missing sensor itself, so it only restarts.
+ */
+inline void failsafeToOtaLoader(const char* reason) {
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    Serial.printf("Current running partition: %s\n", running ? running->label : "?");
+
+    if (running && strcmp(running->label, "ota_1") == 0) {
+        Serial.printf("Running on ota_1 with %s - switching to ota_0...\n", reason);
+        restartIntoOtaLoader(true);
+    } else {
+        Serial.printf("Running on ota_0 - %s handled by OTA bootloader\n", reason);
+    }
+
+    // Partition switch failed: restart anyway
+    Serial.println("⚠️ Failsafe mechanism completed - restarting...");
+    delay(1000);
+    ESP.restart();
+}
@@ -0,0 +1,208 @@
+#pragma once
+/**
+ * @file sensor_traits.h
+ * @brief Compile-time sample formats of the sensor firmwares and the binary packet layout
+ *
+ * Each sensor has a traits struct that fixes, as constants, what the backend
+ * needs to decode its samples: the 8-byte wire record, the sensor_type byte
+ * of the packet header, the valid value range and the size of one count.
+ * A firmware selects its traits once, so BinaryPacket<Traits>::write() fills
+ * the header and copies the samples without looking at sensorType at run
+ * time, and the range checks on the read path are constant clamps.
+ *
+ * The backend decodes every binary_data packet as a 12-byte header followed
+ * by fixed 8-byte records. The static_asserts below hold each layout to
+ * that, so a field change that would break the decoder fails the build.
+ *
+ * The header has no Arduino dependencies; tools/fleet_sim decodes packets
+ * with the same structs.
+ *
+ * Usage (firmware mqtt_handler.h / .cpp):
+ * @code
+ * #include "sensor_traits.h"
+ *
+ * typedef TofTraits SensorTraits;
+ * typedef SensorTraits::Sample BinarySample;
+ *
+ * size_t size = BinaryPacket<SensorTraits>::write(buffer, samples, count, packetId, total, start);
+ * uint16_t mm = SensorTraits::clamp(raw + offset);
+ * @endcode
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define BINARY_PROTOCOL_VERSION 1
+#define BINARY_HEADER_SIZE 12 // version(1) + sensor_type(1) + packet_id(2) + sample_count(2) + total_samples(2) + start_timestamp(4)
+#define BINARY_SAMPLE_SIZE 8
+
+// sensor_type byte of a binary packet
+enum SensorTypeId : uint8_t {
+    SENSOR_TYPE_OTHER = 0,
+    SENSOR_TYPE_TOF = 1,
+    SENSOR_TYPE_ULTRASONIC = 2,
+    SENSOR_TYPE_THR = 3,
+    SENSOR_TYPE_OSI = 4,
+    SENSOR_TYPE_BH1750 = 5,
+};
+
+#pragma pack(push, 1)
+struct BinaryPacketHeader {
+    uint8_t version;          // BINARY_PROTOCOL_VERSION
+    uint8_t sensor_type;      // SensorTypeId
+    uint16_t packet_id;       // Low 16 bits of millis() at publish
+    uint16_t sample_count;    // Samples in this packet
+    uint16_t total_samples;   // Samples in the run so far
+    uint32_t start_timestamp; // millis() at run start
+    // Followed by sample_count * BINARY_SAMPLE_SIZE bytes of sample data
+};
+
+// TOF and ULT: distance in mm
+struct DistanceSample {
+    uint32_t timestamp;     // ms since run start
+    uint16_t distance;      // mm
+    uint16_t sample_number; // 1-based
+};
+
+// THR: DS18B20 temperature in 1/100 degC
+struct TemperatureSample {
+    uint32_t timestamp;
+    int16_t centi_celsius;
+    uint16_t sample_number;
+};
+
+// OSI: one pass of the pendulum through the light gate
+struct OscillationSample {
+    uint32_t timestamp;          // ms since run start at which the beam was restored
+    uint16_t blocked_ms;         // time the beam was interrupted
+    uint16_t oscillation_number; // 1-based
+};
+
+// BH1750: raw illuminance count (lux = count / 1.2 in H-resolution mode)
+struct LightSample {
+    uint32_t timestamp;
+    uint16_t raw;
+    uint16_t sample_number;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(BinaryPacketHeader) == BINARY_HEADER_SIZE, "binary_data header layout changed");
+static_assert(offsetof(BinaryPacketHeader, start_timestamp) == 8, "binary_data header layout changed");
+
+/**
+ * @brief Clamp v into [lo, hi]; a single expression so it stays constexpr in C++11
+ */
+template <class T>
+constexpr T clampTo(int32_t v, T lo, T hi) {
+    return v < (int32_t)lo ? lo : (v > (int32_t)hi ? hi : (T)v);
+}
+
+struct TofTraits {
+    typedef DistanceSample Sample;
+    static constexpr uint8_t typeId = SENSOR_TYPE_TOF;
+    static constexpr uint16_t minValue = 10;   // mm after calibration
+    static constexpr uint16_t maxValue = 8500; // mm, VL53L1X long mode with margin
+    static constexpr float unitsPerCount = 1.0f; // mm
+
+    static constexpr uint16_t clamp(int32_t mm) { return clampTo<uint16_t>(mm, minValue, maxValue); }
+
+    static void encode(Sample& out, uint32_t timestamp, uint16_t mm, uint16_t number) {
+        out.timestamp = timestamp;
+        out.distance = mm;
+        out.sample_number = number;
+    }
+};
+
+struct UltrasonicTraits {
+    typedef DistanceSample Sample;
+    static constexpr uint8_t typeId = SENSOR_TYPE_ULTRASONIC;
+    static constexpr uint16_t minValue = 20;   // mm, HC-SR04 blind zone
+    static constexpr uint16_t maxValue = 4000; // mm, reliable HC-SR04 range
+    static constexpr float unitsPerCount = 1.0f; // mm
+
+    static constexpr uint16_t clamp(int32_t mm) { return clampTo<uint16_t>(mm, minValue, maxValue); }
+
+    static void encode(Sample& out, uint32_t timestamp, uint16_t mm, uint16_t number) {
+        out.timestamp = timestamp;
+        out.distance = mm;
+        out.sample_number = number;
+    }
+};
+
+struct ThrTraits {
+    typedef TemperatureSample Sample;
+    static constexpr uint8_t typeId = SENSOR_TYPE_THR;
+    static constexpr int16_t minValue = -5500; // DS18B20 datasheet range, 1/100 degC
+    static constexpr int16_t maxValue = 12500;
+    static constexpr float unitsPerCount = 0.01f; // degC
+
+    static constexpr bool inRange(float celsius) {
+        return celsius >= minValue * unitsPerCount && celsius <= maxValue * unitsPerCount;
+    }
+
+    static void encode(Sample& out, uint32_t timestamp, float celsius, uint16_t number) {
+        out.timestamp = timestamp;
+        out.centi_celsius = clampTo<int16_t>((int32_t)(celsius * 100.0f + (celsius < 0 ? -0.5f : 0.5f)), minValue,
+                                             maxValue);
+        out.sample_number = number;
+    }
+};
+
+struct OsiTraits {
+    typedef OscillationSample Sample;
+    static constexpr uint8_t typeId = SENSOR_TYPE_OSI;
+    static constexpr uint16_t minValue = 0;
+    static constexpr uint16_t maxValue = 65535; // ms; longer interruptions saturate
+    static constexpr float unitsPerCount = 1.0f; // ms
+
+    static void encode(Sample& out, uint32_t timestamp, uint32_t blockedMs, uint16_t number) {
+        out.timestamp = timestamp;
+        out.blocked_ms = blockedMs > maxValue ? maxValue : (uint16_t)blockedMs;
+        out.oscillation_number = number;
+    }
+};
+
+struct Bh1750Traits {
+    typedef LightSample Sample;
+    static constexpr uint8_t typeId = SENSOR_TYPE_BH1750;
+    static constexpr uint16_t minValue = 0;
+    static constexpr uint16_t maxValue = 65535;
+    static constexpr float unitsPerCount = 1.0f / 1.2f; // lux, H-resolution mode
+
+    static void encode(Sample& out, uint32_t timestamp, uint16_t raw, uint16_t number) {
+        out.timestamp = timestamp;
+        out.raw = raw;
+        out.sample_number = number;
+    }
+};
+
+/**
+ * @brief Binary packet writer specialised for one sensor's traits
+ */
+template <class Traits>
+struct BinaryPacket {
+    typedef typename Traits::Sample Sample;
+
+    static_assert(sizeof(Sample) == BINARY_SAMPLE_SIZE, "sample record must stay BINARY_SAMPLE_SIZE bytes");
+    static_assert(offsetof(Sample, timestamp) == 0, "sample timestamp must lead the record");
+
+    static constexpr size_t size(uint16_t count) { return BINARY_HEADER_SIZE + (size_t)count * sizeof(Sample); }
+
+    /**
+     * @brief Write header and samples to out, which must hold size(count) bytes; returns the size
+     */
+    static size_t write(uint8_t* out, const Sample* samples, uint16_t count, uint16_t packetId, uint16_t totalSamples,
+                        uint32_t startTimestamp) {
+        BinaryPacketHeader header;
+        header.version = BINARY_PROTOCOL_VERSION;
+        header.sensor_type = Traits::typeId;
+        header.packet_id = packetId;
+        header.sample_count = count;
+        header.total_samples = totalSamples;
+        header.start_timestamp = startTimestamp;
+        memcpy(out, &header, sizeof(header));
+        memcpy(out + BINARY_HEADER_SIZE, samples, (size_t)count * sizeof(Sample));
+        return size(count);
+    }
+};
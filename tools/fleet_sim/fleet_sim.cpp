@@ -0,0 +1,1282 @@
+/**
+ * @file fleet_sim.cpp
+ * @brief Many virtual sensors against one local MQTT broker
+ *
+ * Starts N copies of each firmware's host build (`pio run -e native`), each
+ * with its own MAC and therefore its own sensor ID, and points them at an
+ * MQTT 3.1.1 broker stand-in running in this process. The devices run the
+ * real mqtt_handler/experiment_manager code: TOF and ULT stream binary
+ * sample packets, THR publishes one JSON reading per conversion, OSI one
+ * JSON event per oscillation.
+ *
+ * A consumer inside the broker plays the backend. It subscribes to
+ * sensors/#, keeps a bounded queue (--queue, like a broker's per-client
+ * queue) and can be slowed down. It reports aggregate throughput,
+ * per-device latency percentiles and drops:
+ *  - latency of a binary sample is its age when consumed: the devices share
+ *    this process's clock (SIM_CLOCK_EPOCH_US), so start_timestamp + sample
+ *    timestamp is comparable. JSON readings are stamped when the broker
+ *    receives them.
+ *  - drops are sample/reading numbers that never arrived (the device could
+ *    not publish), and messages the broker discarded on a full queue.
+ *
+ * Scenarios are timed scripts, one step per line, times in ms after the
+ * whole fleet is online:
+ *   <ms> config  <all|tof,thr,osi,ult> <json>   publish to sensors/<id>/config
+ *   <ms> command <all|tof,thr,osi,ult> <json>   publish to sensors/<id>/command
+ *   <ms> broker_restart <down ms>               drop every connection, refuse for a while
+ *   <ms> consumer_delay <us>                    consumer processing time per message
+ *   <ms> end
+ * "{fleet_size}" in a JSON argument is replaced by the number of devices.
+ * Built in: simultaneous-start, broker-restart, slow-consumer.
+ *
+ * Build (Linux, no dependencies):
+ *   g++ -O2 -std=c++17 -pthread -o fleet_sim fleet_sim.cpp
+ *
+ * Usage (from the repository root, after `pio run -e native` in each firmware):
+ *   ./fleet_sim [--tof N] [--thr N] [--osi N] [--ult N] [--scenario NAME | --script FILE]
+ *               [--repo DIR] [--port PORT] [--queue MESSAGES] [--csv FILE] [--logs DIR]
+ */
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../../shared/sensor_traits.h" // binary_data header and sample layout, as sent by TOF/ULT
+
+namespace {
+
+const int kExitRestart = 3;           // SIM_EXIT_RESTART: the firmware called ESP.restart()
+const int kOnlineTimeoutMs = 60000;   // Whole fleet must announce itself within this
+const size_t kMaxPacket = 1 << 20;
+
+int64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t gEpochUs = 0; // Devices' millis() count from here (SIM_CLOCK_EPOCH_US)
+
+double msSince(int64_t us) {
+    return (nowUs() - us) / 1000.0;
+}
+
+// ---- MQTT framing ----
+
+enum : uint8_t {
+    CONNECT = 1 << 4,
+    CONNACK = 2 << 4,
+    PUBLISH = 3 << 4,
+    PUBACK = 4 << 4,
+    SUBSCRIBE = 8 << 4,
+    SUBACK = 9 << 4,
+    UNSUBSCRIBE = 10 << 4,
+    UNSUBACK = 11 << 4,
+    PINGREQ = 12 << 4,
+    PINGRESP = 13 << 4,
+    DISCONNECT = 14 << 4,
+};
+
+std::string frame(uint8_t header, const std::string& body) {
+    std::string out(1, (char)header);
+    size_t len = body.size();
+    do {
+        uint8_t digit = len % 128;
+        len /= 128;
+        out += (char)(len ? (digit | 0x80) : digit);
+    } while (len);
+    return out + body;
+}
+
+std::string mqttString(const std::string& s) {
+    std::string out;
+    out += (char)(s.size() >> 8);
+    out += (char)(s.size() & 0xFF);
+    return out + s;
+}
+
+bool readString(const std::string& body, size_t& at, std::string& out) {
+    if (at + 2 > body.size()) {
+        return false;
+    }
+    size_t len = ((size_t)(uint8_t)body[at] << 8) | (uint8_t)body[at + 1];
+    if (at + 2 + len > body.size()) {
+        return false;
+    }
+    out = body.substr(at + 2, len);
+    at += 2 + len;
+    return true;
+}
+
+bool topicMatches(const std::string& filter, const std::string& topic) {
+    size_t f = 0;
+    size_t t = 0;
+    while (f < filter.size()) {
+        if (filter[f] == '#') {
+            return true;
+        }
+        if (filter[f] == '+') {
+            while (t < topic.size() && topic[t] != '/') {
+                t++;
+            }
+            f++;
+            continue;
+        }
+        if (t >= topic.size() || filter[f] != topic[t]) {
+            return false;
+        }
+        f++;
+        t++;
+    }
+    return t == topic.size();
+}
+
+// ---- Minimal JSON field access (flat objects from the firmwares) ----
+
+const char* jsonField(const std::string& json, const char* key) {
+    std::string needle = std::string("\"") + key + "\":";
+    size_t at = json.find(needle);
+    return at == std::string::npos ? nullptr : json.c_str() + at + needle.size();
+}
+
+bool jsonNumber(const std::string& json, const char* key, double& out) {
+    const char* v = jsonField(json, key);
+    if (!v) {
+        return false;
+    }
+    char* end;
+    out = strtod(v, &end);
+    return end != v;
+}
+
+std::string jsonString(const std::string& json, const char* key) {
+    const char* v = jsonField(json, key);
+    if (!v || *v != '"') {
+        return "";
+    }
+    const char* end = strchr(v + 1, '"');
+    return end ? std::string(v + 1, end) : "";
+}
+
+// ---- Consumer (the backend) ----
+
+struct Message {
+    std::string topic;
+    std::string payload;
+    bool retain = false;
+    int64_t arrivedUs = 0;
+};
+
+struct DeviceStats {
+    std::string type;
+    bool online = false;
+    uint32_t runs = 0;
+    uint32_t completed = 0;
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+    uint64_t samples = 0;
+    uint64_t lost = 0;        // Closed runs
+    int64_t expected = 0;     // Current run: highest sample/reading number announced
+    uint64_t seen = 0;        // Current run: samples/readings received
+    std::vector<float> latencyMs;
+
+    uint64_t lostNow() const {
+        return lost + (expected > (int64_t)seen ? (uint64_t)(expected - (int64_t)seen) : 0);
+    }
+    void closeRun() {
+        lost = lostNow();
+        expected = 0;
+        seen = 0;
+    }
+};
+
+class Consumer {
+public:
+    explicit Consumer(size_t limit) : _limit(limit) {}
+
+    void start() { _thread = std::thread([this] { run(); }); }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _stopping = true;
+        }
+        _ready.notify_all();
+        _thread.join();
+    }
+
+    /** @brief Called by the broker thread; false when the queue is full */
+    bool offer(const Message& m) {
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            if (_queue.size() >= _limit) {
+                return false;
+            }
+            _queue.push_back(m);
+        }
+        _ready.notify_one();
+        return true;
+    }
+
+    void setDelayUs(int us) { _delayUs = us; }
+
+    void expectDevice(const std::string& id, const std::string& type) {
+        std::lock_guard<std::mutex> guard(_statsLock);
+        _devices[id].type = type;
+    }
+
+    size_t onlineCount() {
+        std::lock_guard<std::mutex> guard(_statsLock);
+        size_t n = 0;
+        for (auto& d : _devices) {
+            n += d.second.online ? 1 : 0;
+        }
+        return n;
+    }
+
+    std::map<std::string, DeviceStats> snapshot() {
+        std::lock_guard<std::mutex> guard(_statsLock);
+        return _devices;
+    }
+
+    uint64_t messages() const { return _messages; }
+    uint64_t bytes() const { return _bytes; }
+    uint64_t samples() const { return _samples; }
+    size_t peakQueue() const { return _peakQueue; }
+
+private:
+    void run() {
+        for (;;) {
+            Message m;
+            {
+                std::unique_lock<std::mutex> lk(_lock);
+                _ready.wait(lk, [this] { return _stopping || !_queue.empty(); });
+                if (_stopping) {
+                    return;
+                }
+                _peakQueue = std::max(_peakQueue.load(), _queue.size());
+                m = std::move(_queue.front());
+                _queue.pop_front();
+            }
+            int delayUs = _delayUs;
+            if (delayUs > 0) {
+                std::this_thread::sleep_for(std::chrono::microseconds(delayUs));
+            }
+            process(m);
+        }
+    }
+
+    void process(const Message& m) {
+        // sensors/<id>/<kind>
+        if (m.topic.compare(0, 8, "sensors/") != 0) {
+            return;
+        }
+        size_t slash = m.topic.find('/', 8);
+        if (slash == std::string::npos) {
+            return;
+        }
+        std::string id = m.topic.substr(8, slash - 8);
+        std::string kind = m.topic.substr(slash + 1);
+        double consumedMs = msSince(gEpochUs);
+
+        std::lock_guard<std::mutex> guard(_statsLock);
+        DeviceStats& d = _devices[id];
+        d.messages++;
+        d.bytes += m.payload.size();
+        _messages++;
+        _bytes += m.payload.size();
+
+        if (kind == "status") {
+            if (jsonString(m.payload, "type") == "sensor_identify") {
+                d.online = m.payload.find("\"online\":true") != std::string::npos;
+                if (d.type.empty()) {
+                    d.type = jsonString(m.payload, "sensor_type");
+                }
+            } else {
+                std::string status = jsonString(m.payload, "status");
+                if (status == "experiment_started") {
+                    d.closeRun();
+                    d.runs++;
+                } else if (status == "experiment_completed") {
+                    d.completed++;
+                }
+            }
+        } else if (kind == "binary_data" && m.payload.size() >= sizeof(BinaryPacketHeader)) {
+            BinaryPacketHeader h;
+            memcpy(&h, m.payload.data(), sizeof(h));
+            size_t count = std::min<size_t>(h.sample_count, (m.payload.size() - sizeof(h)) / sizeof(DistanceSample));
+            for (size_t i = 0; i < count; i++) {
+                DistanceSample s;
+                memcpy(&s, m.payload.data() + sizeof(h) + i * sizeof(s), sizeof(s));
+                d.latencyMs.push_back((float)(consumedMs - (double)(h.start_timestamp + s.timestamp)));
+            }
+            d.expected = std::max<int64_t>(d.expected, h.total_samples);
+            d.seen += count;
+            d.samples += count;
+            _samples += count;
+        } else if (kind == "data") {
+            double number = 0;
+            if (jsonNumber(m.payload, "cnt", number) || jsonNumber(m.payload, "count", number)) {
+                d.expected = std::max<int64_t>(d.expected, (int64_t)number);
+            }
+            d.latencyMs.push_back((float)((nowUs() - m.arrivedUs) / 1000.0));
+            d.seen++;
+            d.samples++;
+            _samples++;
+        }
+    }
+
+    size_t _limit;
+    std::atomic<int> _delayUs{0};
+    std::mutex _lock;
+    std::condition_variable _ready;
+    std::deque<Message> _queue;
+    bool _stopping = false;
+    std::atomic<size_t> _peakQueue{0};
+    std::thread _thread;
+
+    std::mutex _statsLock;
+    std::map<std::string, DeviceStats> _devices;
+    std::atomic<uint64_t> _messages{0};
+    std::atomic<uint64_t> _bytes{0};
+    std::atomic<uint64_t> _samples{0};
+};
+
+// ---- Broker ----
+
+struct Session {
+    int fd = -1;
+    std::string rx;
+    std::deque<std::string> tx;
+    size_t txOffset = 0; // Bytes of tx.front() already written
+    std::string clientId;
+    std::vector<std::string> filters;
+    bool connected = false;
+    bool hasWill = false;
+    Message will;
+};
+
+/**
+ * One poll() thread: accepts clients, parses their packets and routes
+ * publishes to matching sessions and to the consumer. QoS 1 publishes are
+ * acknowledged; subscriptions are granted QoS 0. Retained messages and
+ * last-wills behave as in mosquitto without persistence.
+ */
+class Broker {
+public:
+    Broker(uint16_t port, size_t queueLimit, Consumer& consumer)
+        : _port(port), _queueLimit(queueLimit), _consumer(consumer) {}
+
+    bool start() {
+        if (pipe2(_wake, O_CLOEXEC | O_NONBLOCK) != 0 || !listenSocket(true)) {
+            return false;
+        }
+        _thread = std::thread([this] { run(); });
+        return true;
+    }
+
+    void stop() {
+        _stopping = true;
+        wake();
+        _thread.join();
+    }
+
+    /** @brief Publish as the backend would (any thread) */
+    void publish(const std::string& topic, const std::string& payload) {
+        Message m;
+        m.topic = topic;
+        m.payload = payload;
+        {
+            std::lock_guard<std::mutex> guard(_inboxLock);
+            _inbox.push_back(m);
+        }
+        wake();
+    }
+
+    /** @brief Drop every client and refuse connections for downMs (any thread) */
+    void restart(int downMs) {
+        _restartMs = downMs;
+        wake();
+    }
+
+    void expectClients(size_t n) { _expected = n; }
+
+    uint64_t received() const { return _received; }
+    uint64_t queueDrops() const { return _queueDrops; }
+    uint64_t connects() const { return _connects; }
+    uint32_t restarts() const { return _restarts; }
+    /** @brief ms from the last restart's end until every expected client was back, -1 if not yet */
+    double reconnectMs() const { return _reconnectMs; }
+
+private:
+    // Sockets are close-on-exec so device processes do not keep them open
+    bool listenSocket(bool report) {
+        _listen = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        int one = 1;
+        setsockopt(_listen, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(_port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (_listen < 0 || bind(_listen, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(_listen, 1024) != 0) {
+            if (report) {
+                perror("broker listen");
+            }
+            if (_listen >= 0) {
+                close(_listen);
+            }
+            _listen = -1;
+            return false;
+        }
+        return true;
+    }
+
+    void wake() {
+        char c = 0;
+        if (write(_wake[1], &c, 1) < 0) {
+            // Pipe full: the broker is awake anyway
+        }
+    }
+
+    void run() {
+        while (!_stopping) {
+            std::vector<pollfd> fds;
+            fds.push_back({_wake[0], POLLIN, 0});
+            if (_listen >= 0) {
+                fds.push_back({_listen, POLLIN, 0});
+            }
+            size_t first = fds.size();
+            for (Session& s : _sessions) {
+                fds.push_back({s.fd, (short)(POLLIN | (s.tx.empty() ? 0 : POLLOUT)), 0});
+            }
+            poll(fds.data(), fds.size(), 20);
+
+            if (fds[0].revents & POLLIN) {
+                char drain[256];
+                while (read(_wake[0], drain, sizeof(drain)) > 0) {
+                }
+            }
+            int downMs = _restartMs.exchange(0);
+            if (downMs > 0) {
+                goDown(downMs);
+                continue;
+            }
+            if (_listen < 0 && _downUntilUs && nowUs() >= _downUntilUs && listenSocket(false)) {
+                _downUntilUs = 0;
+                _upAtUs = nowUs();
+                _backSinceUp.clear();
+            }
+            drainInbox();
+
+            if (_listen >= 0 && first > 1 && (fds[1].revents & POLLIN)) {
+                acceptClients();
+            }
+            // Sessions appended by accept() were not polled yet
+            for (size_t i = 0; i + first < fds.size() && i < _sessions.size(); i++) {
+                Session& s = _sessions[i];
+                short ev = fds[i + first].revents;
+                if ((ev & (POLLIN | POLLHUP | POLLERR)) && !readFrom(s)) {
+                    drop(s, true);
+                    continue;
+                }
+                if ((ev & POLLOUT) && !flush(s)) {
+                    drop(s, true);
+                }
+            }
+            _sessions.erase(std::remove_if(_sessions.begin(), _sessions.end(), [](const Session& s) { return s.fd < 0; }),
+                            _sessions.end());
+        }
+        for (Session& s : _sessions) {
+            drop(s, false);
+        }
+    }
+
+    void goDown(int downMs) {
+        for (Session& s : _sessions) {
+            drop(s, false); // The broker died: nobody is left to send the wills
+        }
+        _sessions.clear();
+        _retained.clear();
+        if (_listen >= 0) {
+            close(_listen);
+            _listen = -1;
+        }
+        _downUntilUs = nowUs() + downMs * 1000LL;
+        _upAtUs = 0;
+        _reconnectMs = -1;
+        _restarts++;
+    }
+
+    void drainInbox() {
+        std::deque<Message> inbox;
+        {
+            std::lock_guard<std::mutex> guard(_inboxLock);
+            inbox.swap(_inbox);
+        }
+        for (Message& m : inbox) {
+            if (_listen >= 0) {
+                m.arrivedUs = nowUs();
+                route(m);
+            }
+        }
+    }
+
+    void acceptClients() {
+        for (;;) {
+            int fd = accept4(_listen, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+            if (fd < 0) {
+                return;
+            }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            Session s;
+            s.fd = fd;
+            _sessions.push_back(std::move(s));
+        }
+    }
+
+    bool readFrom(Session& s) {
+        char buf[16384];
+        for (;;) {
+            ssize_t n = recv(s.fd, buf, sizeof(buf), 0);
+            if (n == 0) {
+                return false;
+            }
+            if (n < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    return false;
+                }
+                break;
+            }
+            s.rx.append(buf, (size_t)n);
+        }
+        for (;;) {
+            size_t length = 0;
+            size_t used = 1;
+            bool complete = false;
+            for (int shift = 0; used < s.rx.size() && used <= 4; shift += 7) {
+                uint8_t digit = (uint8_t)s.rx[used++];
+                length |= (size_t)(digit & 0x7F) << shift;
+                if (!(digit & 0x80)) {
+                    complete = true;
+                    break;
+                }
+            }
+            if (!complete || length > kMaxPacket) {
+                return s.rx.size() < 5 + kMaxPacket;
+            }
+            if (s.rx.size() < used + length) {
+                return true;
+            }
+            uint8_t header = (uint8_t)s.rx[0];
+            std::string body = s.rx.substr(used, length);
+            s.rx.erase(0, used + length);
+            if (!handle(s, header, body)) {
+                return false;
+            }
+        }
+    }
+
+    bool handle(Session& s, uint8_t header, const std::string& body) {
+        uint8_t type = header & 0xF0;
+        if (!s.connected && type != CONNECT) {
+            return false;
+        }
+        switch (type) {
+        case CONNECT:
+            return handleConnect(s, body);
+        case PUBLISH: {
+            size_t at = 0;
+            Message m;
+            if (!readString(body, at, m.topic)) {
+                return false;
+            }
+            uint8_t qos = (header >> 1) & 0x03;
+            if (qos > 0) {
+                if (at + 2 > body.size()) {
+                    return false;
+                }
+                send(s, frame(PUBACK, body.substr(at, 2)));
+                at += 2;
+            }
+            m.payload = body.substr(at);
+            m.retain = header & 0x01;
+            m.arrivedUs = nowUs();
+            _received++;
+            route(m);
+            return true;
+        }
+        case SUBSCRIBE: {
+            if (body.size() < 2) {
+                return false;
+            }
+            std::string ack = body.substr(0, 2);
+            size_t at = 2;
+            std::vector<std::string> added;
+            std::string filter;
+            while (at < body.size() && readString(body, at, filter) && at < body.size()) {
+                at++; // Requested QoS
+                s.filters.push_back(filter);
+                added.push_back(filter);
+                ack += (char)0x00;
+            }
+            send(s, frame(SUBACK, ack));
+            for (const auto& r : _retained) {
+                for (const std::string& f : added) {
+                    if (topicMatches(f, r.first)) {
+                        send(s, frame(PUBLISH | 0x01, mqttString(r.first) + r.second));
+                        break;
+                    }
+                }
+            }
+            return true;
+        }
+        case UNSUBSCRIBE: {
+            if (body.size() < 2) {
+                return false;
+            }
+            size_t at = 2;
+            std::string filter;
+            while (readString(body, at, filter)) {
+                s.filters.erase(std::remove(s.filters.begin(), s.filters.end(), filter), s.filters.end());
+            }
+            send(s, frame(UNSUBACK, body.substr(0, 2)));
+            return true;
+        }
+        case PINGREQ:
+            send(s, frame(PINGRESP, ""));
+            return true;
+        case DISCONNECT:
+            s.hasWill = false;
+            return false;
+        default:
+            return true; // PUBACK and friends for QoS 0 deliveries do not occur
+        }
+    }
+
+    bool handleConnect(Session& s, const std::string& body) {
+        size_t at = 0;
+        std::string protocol;
+        if (!readString(body, at, protocol) || at + 4 > body.size()) {
+            return false;
+        }
+        uint8_t flags = (uint8_t)body[at + 1];
+        at += 4; // Level, flags, keepalive
+        if (!readString(body, at, s.clientId)) {
+            return false;
+        }
+        if (flags & 0x04) {
+            s.hasWill = true;
+            s.will.retain = flags & 0x20;
+            if (!readString(body, at, s.will.topic) || !readString(body, at, s.will.payload)) {
+                return false;
+            }
+        }
+        // A second connection with the same client ID takes the session over
+        for (Session& other : _sessions) {
+            if (&other != &s && other.fd >= 0 && other.connected && other.clientId == s.clientId) {
+                drop(other, false);
+            }
+        }
+        s.connected = true;
+        _connects++;
+        send(s, frame(CONNACK, std::string("\x00\x00", 2)));
+        if (_upAtUs) {
+            _backSinceUp.insert(s.clientId);
+            if (_expected && _backSinceUp.size() >= _expected && _reconnectMs < 0) {
+                _reconnectMs = msSince(_upAtUs);
+            }
+        }
+        return true;
+    }
+
+    void route(const Message& m) {
+        if (m.retain) {
+            if (m.payload.empty()) {
+                _retained.erase(m.topic);
+            } else {
+                _retained[m.topic] = m.payload;
+            }
+        }
+        std::string packet;
+        for (Session& s : _sessions) {
+            if (s.fd < 0 || !s.connected) {
+                continue;
+            }
+            for (const std::string& f : s.filters) {
+                if (topicMatches(f, m.topic)) {
+                    if (s.tx.size() >= _queueLimit) {
+                        _queueDrops++;
+                    } else {
+                        if (packet.empty()) {
+                            packet = frame(PUBLISH, mqttString(m.topic) + m.payload);
+                        }
+                        send(s, packet);
+                    }
+                    break;
+                }
+            }
+        }
+        if (m.topic.compare(0, 8, "sensors/") == 0 && !_consumer.offer(m)) {
+            _queueDrops++;
+        }
+    }
+
+    void send(Session& s, const std::string& packet) {
+        s.tx.push_back(packet);
+        if (s.tx.size() == 1 && !flush(s)) {
+            drop(s, true);
+        }
+    }
+
+    bool flush(Session& s) {
+        while (!s.tx.empty() && s.fd >= 0) {
+            const std::string& front = s.tx.front();
+            ssize_t n = ::send(s.fd, front.data() + s.txOffset, front.size() - s.txOffset, MSG_NOSIGNAL);
+            if (n < 0) {
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            s.txOffset += (size_t)n;
+            if (s.txOffset == front.size()) {
+                s.tx.pop_front();
+                s.txOffset = 0;
+            }
+        }
+        return true;
+    }
+
+    void drop(Session& s, bool sendWill) {
+        if (s.fd < 0) {
+            return;
+        }
+        close(s.fd);
+        s.fd = -1;
+        s.tx.clear();
+        if (sendWill && s.connected && s.hasWill) {
+            s.will.arrivedUs = nowUs();
+            route(s.will);
+        }
+        s.connected = false;
+    }
+
+    uint16_t _port;
+    size_t _queueLimit;
+    Consumer& _consumer;
+    int _listen = -1;
+    int _wake[2] = {-1, -1};
+    std::thread _thread;
+    std::atomic<bool> _stopping{false};
+    std::atomic<int> _restartMs{0};
+
+    std::deque<Session> _sessions;
+    std::map<std::string, std::string> _retained;
+    std::mutex _inboxLock;
+    std::deque<Message> _inbox;
+
+    int64_t _downUntilUs = 0;
+    int64_t _upAtUs = 0;
+    std::set<std::string> _backSinceUp;
+    size_t _expected = 0;
+
+    std::atomic<uint64_t> _received{0};
+    std::atomic<uint64_t> _queueDrops{0};
+    std::atomic<uint64_t> _connects{0};
+    std::atomic<uint32_t> _restarts{0};
+    std::atomic<double> _reconnectMs{-1};
+};
+
+// ---- Devices ----
+
+struct FirmwareKind {
+    const char* type;  // As in the presence record and scenario targets
+    const char* dir;   // Firmware project under the repository root
+};
+
+const FirmwareKind kKinds[] = {
+    {"TOF", "TOF_Firmware_bin_Generator"},
+    {"THR", "THR_Firmware_bin_Generator"},
+    {"OSI", "OSI_Firmware_bin_Generator"},
+    {"ULT", "UltraSonic_Firmware_bin_Generator"},
+};
+
+struct Device {
+    size_t kind;
+    std::string id;
+    std::string mac;
+    pid_t pid = -1;
+    uint32_t restarts = 0;
+    int exitStatus = -1; // Set once it exited for good
+};
+
+struct Options {
+    size_t counts[4] = {10, 10, 10, 0};
+    std::string scenario = "simultaneous-start";
+    std::string script;
+    std::string repo = ".";
+    std::string bins[4];
+    uint16_t port = 1883;
+    size_t queue = 1000;
+    std::string csv;
+    std::string logs;
+};
+
+/** MAC 24:6F:28:1k:HH:LL, so getDeviceIDFromMAC() (last 5 hex digits) gives "kHHLL" */
+void assignIdentity(Device& d, size_t index) {
+    char mac[18];
+    snprintf(mac, sizeof(mac), "24:6F:28:1%X:%02X:%02X", (unsigned)d.kind, (unsigned)(index >> 8) & 0xFF,
+             (unsigned)index & 0xFF);
+    d.mac = mac;
+    char id[8];
+    snprintf(id, sizeof(id), "%X%02X%02X", (unsigned)d.kind, (unsigned)(index >> 8) & 0xFF, (unsigned)index & 0xFF);
+    d.id = id;
+}
+
+bool spawn(Device& d, const Options& opt) {
+    const std::string& program = opt.bins[d.kind];
+    char broker[32];
+    snprintf(broker, sizeof(broker), "--broker=127.0.0.1:%u", opt.port);
+    char epoch[24];
+    snprintf(epoch, sizeof(epoch), "%lld", (long long)gEpochUs);
+    std::string log = opt.logs.empty() ? "/dev/null" : opt.logs + "/" + kKinds[d.kind].type + "_" + d.id + ".log";
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        setenv("SIM_MAC", d.mac.c_str(), 1);
+        setenv("SIM_CLOCK_EPOCH_US", epoch, 1);
+        int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+        if (opt.logs.empty()) {
+            execl(program.c_str(), program.c_str(), broker, "--quiet", (char*)nullptr);
+        } else {
+            execl(program.c_str(), program.c_str(), broker, (char*)nullptr);
+        }
+        _exit(127);
+    }
+    d.pid = pid;
+    return true;
+}
+
+/** @brief Restart devices that rebooted (ESP.restart()), note the ones that died */
+void reap(std::vector<Device>& devices, const Options& opt) {
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        for (Device& d : devices) {
+            if (d.pid != pid) {
+                continue;
+            }
+            d.pid = -1;
+            if (WIFEXITED(status) && WEXITSTATUS(status) == kExitRestart) {
+                d.restarts++;
+                spawn(d, opt);
+            } else {
+                d.exitStatus = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            }
+        }
+    }
+}
+
+// ---- Scenarios ----
+
+struct Step {
+    int atMs = 0;
+    std::string action;
+    std::string target;
+    std::string arg;
+};
+
+const char* kRunSteps =
+    "0     config  tof,ult {\"freq\":50,\"duration\":10,\"fleet_size\":{fleet_size}}\n"
+    "0     config  thr     {\"resolution\":9,\"duration\":10,\"fleet_size\":{fleet_size}}\n"
+    "0     config  osi     {\"fleet_size\":{fleet_size}}\n"
+    "1000  command tof,ult,thr {\"command\":\"start_experiment\"}\n"
+    "1000  command osi     {\"command\":\"start_experiment\",\"max_count\":5}\n";
+
+std::string builtinScenario(const std::string& name) {
+    if (name == "simultaneous-start") {
+        return std::string(kRunSteps) + "15000 end\n";
+    }
+    if (name == "broker-restart") {
+        return std::string(kRunSteps) + "5000  broker_restart 3000\n20000 end\n";
+    }
+    if (name == "slow-consumer") {
+        return "0     consumer_delay 5000\n" + std::string(kRunSteps) + "15000 end\n";
+    }
+    return "";
+}
+
+bool parseScript(const std::string& text, std::vector<Step>& steps) {
+    std::istringstream in(text);
+    std::string line;
+    int lineNo = 0;
+    while (std::getline(in, line)) {
+        lineNo++;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos && line.find('{') > hash) {
+            line.erase(hash);
+        }
+        std::istringstream words(line);
+        Step step;
+        if (!(words >> step.atMs)) {
+            continue; // Blank or comment
+        }
+        words >> step.action;
+        if (step.action == "config" || step.action == "command") {
+            words >> step.target;
+            std::getline(words >> std::ws, step.arg);
+        } else {
+            words >> step.arg;
+        }
+        if (step.action.empty() || ((step.action == "config" || step.action == "command") && step.arg.empty())) {
+            fprintf(stderr, "script line %d: %s\n", lineNo, line.c_str());
+            return false;
+        }
+        steps.push_back(step);
+    }
+    std::stable_sort(steps.begin(), steps.end(), [](const Step& a, const Step& b) { return a.atMs < b.atMs; });
+    return !steps.empty();
+}
+
+bool targets(const std::string& target, const char* type) {
+    if (target == "all") {
+        return true;
+    }
+    std::string lower(type);
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    std::istringstream list(target);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        if (item == lower) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void runStep(const Step& step, std::vector<Device>& devices, Broker& broker, Consumer& consumer) {
+    if (step.action == "config" || step.action == "command") {
+        std::string payload = step.arg;
+        size_t at = payload.find("{fleet_size}");
+        if (at != std::string::npos) {
+            payload.replace(at, 12, std::to_string(devices.size()));
+        }
+        for (const Device& d : devices) {
+            if (targets(step.target, kKinds[d.kind].type)) {
+                broker.publish("sensors/" + d.id + "/" + step.action, payload);
+            }
+        }
+    } else if (step.action == "broker_restart") {
+        broker.restart(atoi(step.arg.c_str()));
+    } else if (step.action == "consumer_delay") {
+        consumer.setDelayUs(atoi(step.arg.c_str()));
+    } else if (step.action != "end") {
+        fprintf(stderr, "unknown step '%s' ignored\n", step.action.c_str());
+    }
+}
+
+// ---- Report ----
+
+struct Percentiles {
+    double p50 = 0, p95 = 0, p99 = 0, max = 0;
+};
+
+Percentiles percentiles(std::vector<float> v) {
+    Percentiles p;
+    if (v.empty()) {
+        return p;
+    }
+    std::sort(v.begin(), v.end());
+    auto at = [&](double q) { return (double)v[std::min(v.size() - 1, (size_t)(q * v.size()))]; };
+    p.p50 = at(0.50);
+    p.p95 = at(0.95);
+    p.p99 = at(0.99);
+    p.max = v.back();
+    return p;
+}
+
+void report(const std::vector<Device>& devices, Consumer& consumer, Broker& broker, double seconds,
+            const Options& opt) {
+    auto stats = consumer.snapshot();
+    printf("\nThroughput over %.1f s\n", seconds);
+    printf("  messages  %llu (%.0f/s), %.1f kB/s\n", (unsigned long long)consumer.messages(),
+           consumer.messages() / seconds, consumer.bytes() / 1024.0 / seconds);
+    printf("  samples   %llu (%.0f/s)\n", (unsigned long long)consumer.samples(), consumer.samples() / seconds);
+    printf("  broker    %llu publishes in, %llu connects, %llu dropped on full queues, consumer queue peak %zu/%zu\n",
+           (unsigned long long)broker.received(), (unsigned long long)broker.connects(),
+           (unsigned long long)broker.queueDrops(), consumer.peakQueue(), opt.queue);
+    if (broker.restarts()) {
+        if (broker.reconnectMs() >= 0) {
+            printf("  restart   all %zu devices reconnected %.0f ms after the broker came back\n", devices.size(),
+                   broker.reconnectMs());
+        } else {
+            printf("  restart   not every device reconnected\n");
+        }
+    }
+
+    struct Row {
+        const Device* device;
+        const DeviceStats* stats;
+        Percentiles latency;
+    };
+    std::vector<Row> rows;
+    std::vector<float> all;
+    uint64_t lost = 0;
+    size_t lossy = 0;
+    size_t neverStarted = 0;
+    for (const Device& d : devices) {
+        const DeviceStats& s = stats[d.id];
+        rows.push_back({&d, &s, percentiles(s.latencyMs)});
+        all.insert(all.end(), s.latencyMs.begin(), s.latencyMs.end());
+        lost += s.lostNow();
+        lossy += s.lostNow() ? 1 : 0;
+        neverStarted += s.runs ? 0 : 1;
+    }
+
+    Percentiles fleet = percentiles(all);
+    printf("\nLatency (ms)        p50      p95      p99      max\n");
+    printf("  all samples  %8.1f %8.1f %8.1f %8.1f\n", fleet.p50, fleet.p95, fleet.p99, fleet.max);
+    for (size_t k = 0; k < 4; k++) {
+        std::vector<float> kind;
+        for (const Row& r : rows) {
+            if (r.device->kind == k) {
+                kind.insert(kind.end(), r.stats->latencyMs.begin(), r.stats->latencyMs.end());
+            }
+        }
+        if (!kind.empty()) {
+            Percentiles p = percentiles(kind);
+            printf("  %-12s %8.1f %8.1f %8.1f %8.1f\n", kKinds[k].type, p.p50, p.p95, p.p99, p.max);
+        }
+    }
+
+    printf("\nDrops: %llu samples/readings never arrived, from %zu of %zu devices\n", (unsigned long long)lost, lossy,
+           devices.size());
+    if (neverStarted) {
+        printf("       no experiment_started status consumed from %zu devices\n", neverStarted);
+    }
+    size_t died = 0;
+    uint32_t restarts = 0;
+    for (const Device& d : devices) {
+        died += d.exitStatus >= 0 ? 1 : 0;
+        restarts += d.restarts;
+    }
+    if (died || restarts) {
+        printf("Devices: %zu exited, %u reboots\n", died, restarts);
+    }
+
+    std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) { return a.latency.p99 > b.latency.p99; });
+    printf("\nWorst devices by p99\n  %-6s %-4s %7s %8s %6s %8s %8s %8s\n", "id", "type", "msgs", "samples", "lost",
+           "p50", "p99", "max");
+    for (size_t i = 0; i < rows.size() && i < 10; i++) {
+        const Row& r = rows[i];
+        printf("  %-6s %-4s %7llu %8llu %6llu %8.1f %8.1f %8.1f\n", r.device->id.c_str(), kKinds[r.device->kind].type,
+               (unsigned long long)r.stats->messages, (unsigned long long)r.stats->samples,
+               (unsigned long long)r.stats->lostNow(), r.latency.p50, r.latency.p99, r.latency.max);
+    }
+
+    if (!opt.csv.empty()) {
+        FILE* f = fopen(opt.csv.c_str(), "w");
+        if (!f) {
+            perror(opt.csv.c_str());
+            return;
+        }
+        fprintf(f, "id,type,runs,completed,messages,bytes,samples,lost,p50_ms,p95_ms,p99_ms,max_ms,reboots\n");
+        for (const Row& r : rows) {
+            fprintf(f, "%s,%s,%u,%u,%llu,%llu,%llu,%llu,%.2f,%.2f,%.2f,%.2f,%u\n", r.device->id.c_str(),
+                    kKinds[r.device->kind].type, r.stats->runs, r.stats->completed,
+                    (unsigned long long)r.stats->messages, (unsigned long long)r.stats->bytes,
+                    (unsigned long long)r.stats->samples, (unsigned long long)r.stats->lostNow(), r.latency.p50,
+                    r.latency.p95, r.latency.p99, r.latency.max, r.device->restarts);
+        }
+        fclose(f);
+        printf("\nPer-device results written to %s\n", opt.csv.c_str());
+    }
+}
+
+bool parseArgs(int argc, char** argv, Options& opt) {
+    const char* kindFlags[4] = {"--tof", "--thr", "--osi", "--ult"};
+    const char* binFlags[4] = {"--tof-bin", "--thr-bin", "--osi-bin", "--ult-bin"};
+    for (int i = 1; i < argc; i++) {
+        bool known = false;
+        for (size_t k = 0; k < 4 && !known && i + 1 < argc; k++) {
+            if (strcmp(argv[i], kindFlags[k]) == 0) {
+                opt.counts[k] = strtoul(argv[++i], nullptr, 10);
+                known = true;
+            } else if (strcmp(argv[i], binFlags[k]) == 0) {
+                opt.bins[k] = argv[++i];
+                known = true;
+            }
+        }
+        if (known) {
+            continue;
+        }
+        if (strcmp(argv[i], "--scenario") == 0 && i + 1 < argc) {
+            opt.scenario = argv[++i];
+        } else if (strcmp(argv[i], "--script") == 0 && i + 1 < argc) {
+            opt.script = argv[++i];
+        } else if (strcmp(argv[i], "--repo") == 0 && i + 1 < argc) {
+            opt.repo = argv[++i];
+        } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            opt.port = (uint16_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--queue") == 0 && i + 1 < argc) {
+            opt.queue = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            opt.csv = argv[++i];
+        } else if (strcmp(argv[i], "--logs") == 0 && i + 1 < argc) {
+            opt.logs = argv[++i];
+        } else {
+            return false;
+        }
+    }
+    // IDs carry a 16-bit index
+    for (size_t k = 0; k < 4; k++) {
+        if (opt.counts[k] > 0xFFFF) {
+            return false;
+        }
+        if (opt.bins[k].empty()) {
+            opt.bins[k] = opt.repo + "/" + kKinds[k].dir + "/.pio/build/native/program";
+        }
+    }
+    return opt.queue > 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) {
+        fprintf(stderr, "usage: %s [--tof N] [--thr N] [--osi N] [--ult N] [--scenario NAME | --script FILE]\n"
+                        "          [--repo DIR] [--port PORT] [--queue MESSAGES] [--csv FILE] [--logs DIR]\n"
+                        "          [--tof-bin PATH] [--thr-bin PATH] [--osi-bin PATH] [--ult-bin PATH]\n"
+                        "scenarios: simultaneous-start, broker-restart, slow-consumer\n", argv[0]);
+        return 2;
+    }
+
+    std::string script = opt.script.empty() ? builtinScenario(opt.scenario) : "";
+    if (!opt.script.empty()) {
+        std::ifstream in(opt.script);
+        std::stringstream text;
+        text << in.rdbuf();
+        script = text.str();
+    }
+    std::vector<Step> steps;
+    if (!parseScript(script, steps)) {
+        fprintf(stderr, "no scenario steps (unknown scenario '%s' or empty script)\n", opt.scenario.c_str());
+        return 2;
+    }
+
+    std::vector<Device> devices;
+    for (size_t k = 0; k < 4; k++) {
+        if (opt.counts[k] && access(opt.bins[k].c_str(), X_OK) != 0) {
+            fprintf(stderr, "%s not found; run `pio run -e native` in %s or pass --%s-bin\n", opt.bins[k].c_str(),
+                    kKinds[k].dir, k == 3 ? "ult" : k == 2 ? "osi" : k == 1 ? "thr" : "tof");
+            return 1;
+        }
+        for (size_t i = 0; i < opt.counts[k]; i++) {
+            Device d;
+            d.kind = k;
+            assignIdentity(d, i);
+            devices.push_back(d);
+        }
+    }
+    if (devices.empty()) {
+        fprintf(stderr, "no devices\n");
+        return 2;
+    }
+    if (!opt.logs.empty()) {
+        mkdir(opt.logs.c_str(), 0755);
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    gEpochUs = nowUs();
+    Consumer consumer(opt.queue);
+    for (const Device& d : devices) {
+        consumer.expectDevice(d.id, kKinds[d.kind].type);
+    }
+    Broker broker(opt.port, opt.queue, consumer);
+    broker.expectClients(devices.size());
+    consumer.start();
+    if (!broker.start()) {
+        consumer.stop();
+        return 1;
+    }
+
+    printf("Fleet: %zu TOF, %zu THR, %zu OSI, %zu ULT on 127.0.0.1:%u, scenario %s\n", opt.counts[0], opt.counts[1],
+           opt.counts[2], opt.counts[3], opt.port, opt.script.empty() ? opt.scenario.c_str() : opt.script.c_str());
+    for (Device& d : devices) {
+        spawn(d, opt);
+    }
+
+    // t = 0 once every device has published its online presence record
+    int64_t spawnedUs = nowUs();
+    while (consumer.onlineCount() < devices.size() && msSince(spawnedUs) < kOnlineTimeoutMs) {
+        reap(devices, opt);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    printf("Online: %zu/%zu devices after %.0f ms\n", consumer.onlineCount(), devices.size(), msSince(spawnedUs));
+
+    int64_t t0 = nowUs();
+    size_t next = 0;
+    bool ended = false;
+    while (!ended) {
+        while (next < steps.size() && msSince(t0) >= steps[next].atMs) {
+            const Step& step = steps[next++];
+            printf("[%6.0f ms] %s %s %s\n", msSince(t0), step.action.c_str(), step.target.c_str(), step.arg.c_str());
+            runStep(step, devices, broker, consumer);
+            ended = ended || step.action == "end";
+        }
+        ended = ended || next >= steps.size();
+        reap(devices, opt);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    double seconds = msSince(t0) / 1000.0;
+
+    for (Device& d : devices) {
+        if (d.pid > 0) {
+            kill(d.pid, SIGTERM);
+        }
+    }
+    for (Device& d : devices) {
+        if (d.pid > 0) {
+            waitpid(d.pid, nullptr, 0);
+        }
+    }
+    broker.stop();
+    consumer.stop();
+
+    report(devices, consumer, broker, seconds, opt);
+    return 0;
+}